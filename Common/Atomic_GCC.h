@@ -51,6 +51,11 @@ inline void AtomicAnd(volatile u32& target, u32 value) {
 	__sync_and_and_fetch(&target, value);
 }
 
+// Returns true if target was expected, and is now desired.  Full barrier.
+inline bool AtomicCompareExchange(volatile u32& target, u32 expected, u32 desired) {
+	return __sync_bool_compare_and_swap(&target, expected, desired);
+}
+
 inline void AtomicDecrement(volatile u32& target) {
 	__sync_add_and_fetch(&target, -1);
 }
@@ -65,9 +70,13 @@ inline u32 AtomicLoad(volatile u32& src) {
 inline u32 AtomicLoadAcquire(volatile u32& src) {
 	//keep the compiler from caching any memory references
 	u32 result = src; // 32-bit reads are always atomic.
-	//__sync_synchronize(); // TODO: May not be necessary.
+#if defined(__i386__) || defined(__x86_64__)
 	// Compiler instruction only. x86 loads always have acquire semantics.
 	__asm__ __volatile__ ( "":::"memory" );
+#else
+	// ARM and friends may move later accesses ahead of this load.
+	__sync_synchronize();
+#endif
 	return result;
 }
 
@@ -83,8 +92,12 @@ inline void AtomicStoreRelease(volatile u32& dest, u32 value) {
 	atomic_set(&dest, value);
 #elif defined(__SYMBIAN32__)
     g_atomic_int_set(&dest, value);
+#elif defined(__i386__) || defined(__x86_64__)
+	__sync_lock_test_and_set(&dest, value); // Acquire only, but x86 stores are never reordered with earlier accesses.
 #else
-	__sync_lock_test_and_set(&dest, value); // TODO: Wrong! This function is has acquire semantics.
+	// __sync_lock_test_and_set() only has acquire semantics, so fence earlier accesses first.
+	__sync_synchronize();
+	dest = value;
 #endif
 }
 
@@ -51,6 +51,11 @@ inline void AtomicAnd(volatile u32& target, u32 value) {
 	_InterlockedAnd((volatile LONG*)&target, (LONG)value);
 }
 
+// Returns true if target was expected, and is now desired.  Full barrier.
+inline bool AtomicCompareExchange(volatile u32& target, u32 expected, u32 desired) {
+	return (u32)InterlockedCompareExchange((volatile LONG*)&target, (LONG)desired, (LONG)expected) == expected;
+}
+
 inline void AtomicIncrement(volatile u32& target) {
 	InterlockedIncrement((volatile LONG*)&target);
 }
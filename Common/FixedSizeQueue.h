@@ -18,7 +18,10 @@
 #ifndef _FIXED_SIZE_QUEUE_H_
 #define _FIXED_SIZE_QUEUE_H_
 
+#include <algorithm>
 #include <cstring>
+#include <vector>
+#include "Atomics.h"
 #include "ChunkFile.h"
 #include "MemoryUtil.h"
 
@@ -170,6 +173,129 @@ private:
 };
 
 
+// A queue for exactly one thread pushing and one other thread popping, without locks.
+// Each side only moves its own position, so neither can ever block the other.
+// N must be a power of 2, and T must be safe to memcpy.
+template <class T, int N>
+class LockFreeRingQueue {
+public:
+	LockFreeRingQueue() : readPos_(0), writePos_(0), underruns_(0), overruns_(0) {
+		storage_ = new T[N];
+	}
+
+	~LockFreeRingQueue() {
+		delete [] storage_;
+	}
+
+	// Producer side.  Pushes all of src, or nothing (and counts an overrun) if it won't fit.
+	bool push(const T *src, size_t count) {
+		if (room() < count) {
+			overruns_++;
+			return false;
+		}
+		pushUnchecked(src, count);
+		return true;
+	}
+
+	// Producer side.
+	size_t room() {
+		return N - (writePos_ - Common::AtomicLoadAcquire(readPos_));
+	}
+
+	// Consumer side.  Returns how many were popped, and counts an underrun if that's less
+	// than count.
+	size_t pop(T *dest, size_t count) {
+		u32 read = readPos_;
+		size_t avail = Common::AtomicLoadAcquire(writePos_) - read;
+		if (avail < count) {
+			underruns_++;
+			count = avail;
+		}
+
+		u32 pos = read & (N - 1);
+		size_t first = std::min(count, (size_t)(N - pos));
+		memcpy(dest, storage_ + pos, first * sizeof(T));
+		memcpy(dest + first, storage_, (count - first) * sizeof(T));
+		Common::AtomicStoreRelease(readPos_, read + (u32)count);
+		return count;
+	}
+
+	// Either side, though it may be stale by the time it's used.
+	size_t size() {
+		return Common::AtomicLoad(writePos_) - Common::AtomicLoad(readPos_);
+	}
+
+	size_t capacity() const {
+		return N;
+	}
+
+	u32 underruns() const {
+		return underruns_;
+	}
+
+	u32 overruns() const {
+		return overruns_;
+	}
+
+	// Producer side.  Same format as FixedSizeQueue.  Only the consumer may drop samples,
+	// so loading adds the saved ones after anything still queued, as far as they fit.
+	void DoState(PointerWrap &p) {
+		int size = N;
+		p.Do(size);
+		if (size != N)
+		{
+			ERROR_LOG(HLE, "Savestate failure: Incompatible queue size.");
+			return;
+		}
+
+		u32 read = Common::AtomicLoadAcquire(readPos_);
+		int head = read & (N - 1);
+		int tail = writePos_ & (N - 1);
+		int count = writePos_ - read;
+		if (p.mode == p.MODE_READ) {
+			std::vector<T> saved(N);
+			p.DoArray<T>(&saved[0], N);
+			p.Do(head);
+			p.Do(tail);
+			p.Do(count);
+
+			int first = std::min(count, N - head);
+			if ((size_t)count <= room()) {
+				pushUnchecked(&saved[head], first);
+				pushUnchecked(&saved[0], count - first);
+			}
+		} else {
+			p.DoArray<T>(storage_, N);
+			p.Do(head);
+			p.Do(tail);
+			p.Do(count);
+		}
+		p.DoMarker("FixedSizeQueue");
+	}
+
+private:
+	void pushUnchecked(const T *src, size_t count) {
+		u32 write = writePos_;
+		u32 pos = write & (N - 1);
+		size_t first = std::min(count, (size_t)(N - pos));
+		memcpy(storage_ + pos, src, first * sizeof(T));
+		memcpy(storage_, src + first, (count - first) * sizeof(T));
+		Common::AtomicStoreRelease(writePos_, write + (u32)count);
+	}
+
+	T *storage_;
+	// These only ever increase (and wrap), so write - read is the count even when full.
+	volatile u32 readPos_;
+	volatile u32 writePos_;
+	// Each only touched by one side.
+	u32 underruns_;
+	u32 overruns_;
+
+	LockFreeRingQueue(const LockFreeRingQueue &other);
+	void operator =(const LockFreeRingQueue &other);
+};
+
+
 // I'm not sure this is 100% safe but it might be "Good Enough" :)
 // TODO: Use this, maybe make it safer first by using proper atomics
 // instead of volatile
@@ -32,6 +32,14 @@
 #endif
 #endif
 
+#if defined(_M_X64) && defined(__linux__)
+// Everything around the 4GB base that isn't a view is kept reserved (PROT_NONE), so that
+// any stray access through the base pointer is guaranteed to fault.
+static const size_t GUARD_PADDING = 0x10000;
+static const size_t GUARD_SIZE = 0x100000000ULL + 2 * GUARD_PADDING;
+static bool guardReserved = false;
+#endif
+
 #ifdef ANDROID
 
 // Hopefully this ABI will never change...
@@ -194,10 +202,38 @@ void MemArena::ReleaseView(void* view, size_t size)
 #elif defined(__SYMBIAN32__)
 	memmap->Decommit(((int)view - (int)memmap->Base()) & 0x3FFFFFFF, size);
 #else
+#if defined(_M_X64) && defined(__linux__)
+	// Put the guard back rather than leaving a hole someone else could mmap into.
+	if (IsInGuardRegion(view))
+	{
+		mmap(view, size, PROT_NONE, MAP_ANON | MAP_PRIVATE | MAP_NORESERVE | MAP_FIXED, -1, 0);
+		return;
+	}
+#endif
 	munmap(view, size);
 #endif
 }
 
+bool MemArena::HasGuardRegion()
+{
+#if defined(_M_X64) && defined(__linux__)
+	return guardReserved;
+#else
+	return false;
+#endif
+}
+
+bool MemArena::IsInGuardRegion(const void *ptr)
+{
+#if defined(_M_X64) && defined(__linux__)
+	const u8 *guardStart = reinterpret_cast<const u8 *>(0x2300000000ULL) - GUARD_PADDING;
+	const u8 *p = (const u8 *)ptr;
+	return guardReserved && p >= guardStart && p < guardStart + GUARD_SIZE;
+#else
+	return false;
+#endif
+}
+
 #ifndef __SYMBIAN32__
 u8* MemArena::Find4GBBase()
 {
@@ -210,7 +246,21 @@ u8* MemArena::Find4GBBase()
 #else
 	// Very precarious - mmap cannot return an error when trying to map already used pages.
 	// This makes the Windows approach above unusable on Linux, so we will simply pray...
-	return reinterpret_cast<u8*>(0x2300000000ULL);
+	u8 *base = reinterpret_cast<u8*>(0x2300000000ULL);
+#ifdef __linux__
+	// Reserve the whole window (without MAP_FIXED, so we can tell if it's taken.)
+	// The views are later mapped over it with MAP_FIXED.
+	if (!guardReserved)
+	{
+		void *guard = mmap(base - GUARD_PADDING, GUARD_SIZE, PROT_NONE, MAP_ANON | MAP_PRIVATE | MAP_NORESERVE, -1, 0);
+		guardReserved = guard == base - GUARD_PADDING;
+		if (!guardReserved && guard != MAP_FAILED)
+			munmap(guard, GUARD_SIZE);
+		if (!guardReserved)
+			WARN_LOG(MEMMAP, "Unable to reserve guard region around %p", base);
+	}
+#endif
+	return base;
 #endif
 
 #else // 32 bit
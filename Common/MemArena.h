@@ -40,6 +40,11 @@ public:
 	void *CreateView(s64 offset, size_t size, void *base = 0);
 	void ReleaseView(void *view, size_t size);
 
+	// Whether addresses around the 4GB base which aren't mapped by a view are reserved to always fault.
+	// Only implemented on Linux x64.
+	static bool HasGuardRegion();
+	static bool IsInGuardRegion(const void *ptr);
+
 #ifdef __SYMBIAN32__
 	RChunk* memmap;
 #else
@@ -30,6 +30,9 @@ bool DisassembleMov(const unsigned char *codePtr, InstructionInfo &info, int acc
 	info.signExtend = false;
 	info.hasImmediate = false;
 	info.isMemoryWrite = false;
+	info.scaledReg = -1;
+	info.otherReg = -1;
+	info.displacement = 0;
 
 	int addressSize = 8;
 	u8 modRMbyte = 0;
@@ -132,7 +135,7 @@ bool DisassembleMov(const unsigned char *codePtr, InstructionInfo &info, int acc
 
 	if (displacementSize == 1)
 		info.displacement = (s32)(s8)*codePtr;
-	else
+	else if (displacementSize == 4)
 		info.displacement = *((s32 *)codePtr);
 	codePtr += displacementSize;
 
@@ -176,6 +179,10 @@ bool DisassembleMov(const unsigned char *codePtr, InstructionInfo &info, int acc
 		case MOVE_REG_TO_MEM: //move reg to memory
 			break;
 
+		case MOVE_8BIT_REG_TO_MEM: //move 8-bit reg to memory
+			info.operandSize = 1;
+			break;
+
 		default:
 			PanicAlert("Unhandled disasm case in write handler!\n\nPlease implement or avoid.");
 			return false;
@@ -655,6 +655,7 @@ public:
 	// These only support u32 parameters, but that's enough for a lot of uses.
 	// These will destroy the 1 or 2 first "parameter regs".
 	void ABI_CallFunctionC(void *func, u32 param1);
+	void ABI_CallFunctionP(void *func, void *param1);
 	void ABI_CallFunctionCC(void *func, u32 param1, u32 param2);
 	void ABI_CallFunctionCCC(void *func, u32 param1, u32 param2, u32 param3);
 	void ABI_CallFunctionCCP(void *func, u32 param1, u32 param2, void *param3);
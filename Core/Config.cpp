@@ -59,6 +59,7 @@ void Config::Load(const char *iniFileName)
 	general->Get("ShowDebuggerOnLoad", &bShowDebuggerOnLoad, false);
 	general->Get("Language", &languageIni, "en_US");
 	general->Get("NumWorkerThreads", &iNumWorkerThreads, cpu_info.num_cores);
+	general->Get("CSOCacheBlocks", &iCSOCacheBlocks, 2048);
 	general->Get("EnableCheats", &bEnableCheats, false);
 	general->Get("MaxRecent", &iMaxRecent, 12);
 
@@ -102,6 +103,7 @@ void Config::Load(const char *iniFileName)
 	graphics->Get("SSAA", &SSAntiAliasing, 0);
 	graphics->Get("VBO", &bUseVBO, false);
 	graphics->Get("FrameSkip", &iFrameSkip, 0);
+	graphics->Get("AutoFrameSkip", &bAutoFrameSkip, false);
 	graphics->Get("FrameRate", &iFpsLimit, 0);
 	graphics->Get("ForceMaxEmulatedFPS", &iForceMaxEmulatedFPS, 0);
 #ifdef USING_GLES2
@@ -131,6 +133,7 @@ void Config::Load(const char *iniFileName)
 	sound->Get("EnableAtrac3plus", &bEnableAtrac3plus, true);
 	sound->Get("BGMVolume", &iBGMVolume, 4);
 	sound->Get("SEVolume", &iSEVolume, 4);
+	sound->Get("ParallelSasVoices", &bParallelSasVoices, false);
 	
 	IniFile::Section *control = iniFile.GetOrCreateSection("Control");
 	control->Get("ShowStick", &bShowAnalogStick, false);
@@ -170,6 +173,7 @@ void Config::Load(const char *iniFileName)
 	debugConfig->Get("DisasmWindowH", &iDisasmWindowH, -1);
 	debugConfig->Get("ConsoleWindowX", &iConsoleWindowX, -1);
 	debugConfig->Get("ConsoleWindowY", &iConsoleWindowY, -1);
+	debugConfig->Get("ProfileSyscalls", &bProfileSyscalls, false);
 
 	KeyMap::LoadFromIni(iniFile);
 
@@ -208,6 +212,7 @@ void Config::Save()
 #endif
 		general->Set("Language", languageIni);
 		general->Set("NumWorkerThreads", iNumWorkerThreads);
+		general->Set("CSOCacheBlocks", iCSOCacheBlocks);
 		general->Set("MaxRecent", iMaxRecent);
 		general->Set("EnableCheats", bEnableCheats);
 
@@ -226,6 +231,7 @@ void Config::Save()
 		graphics->Set("SSAA", SSAntiAliasing);
 		graphics->Set("VBO", bUseVBO);
 		graphics->Set("FrameSkip", iFrameSkip);
+		graphics->Set("AutoFrameSkip", bAutoFrameSkip);
 		graphics->Set("FrameRate", iFpsLimit);
 		graphics->Set("ForceMaxEmulatedFPS", iForceMaxEmulatedFPS);
 		graphics->Set("AnisotropyLevel", iAnisotropyLevel);
@@ -251,6 +257,7 @@ void Config::Save()
 		sound->Set("EnableAtrac3plus", bEnableAtrac3plus);
 		sound->Set("BGMVolume", iBGMVolume);
 		sound->Set("SEVolume", iSEVolume);
+		sound->Set("ParallelSasVoices", bParallelSasVoices);
 
 		IniFile::Section *control = iniFile.GetOrCreateSection("Control");
 		control->Set("ShowStick", bShowAnalogStick);
@@ -284,6 +291,7 @@ void Config::Save()
 		debugConfig->Set("DisasmWindowH", iDisasmWindowH);
 		debugConfig->Set("ConsoleWindowX", iConsoleWindowX);
 		debugConfig->Set("ConsoleWindowY", iConsoleWindowY);
+		debugConfig->Set("ProfileSyscalls", bProfileSyscalls);
 
 		KeyMap::SaveToIni(iniFile);
 
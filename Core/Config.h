@@ -49,6 +49,8 @@ public:
 	// General
 	bool bNewUI;  // "Hidden" setting, does not get saved to ini file.
 	int iNumWorkerThreads;
+	// Decompressed CSO blocks to keep, 2 KB each.  0 turns off caching and read-ahead.
+	int iCSOCacheBlocks;
 
 	// Core
 	bool bIgnoreBadMemAccess;
@@ -72,6 +74,8 @@ public:
 	bool bStretchToDisplay;
 	int iVSyncInterval;
 	int iFrameSkip;
+	// Only skip when behind and it will help.  iFrameSkip is then the most in a row.
+	bool bAutoFrameSkip;
 
 	int iWindowX;
 	int iWindowY;
@@ -98,6 +102,7 @@ public:
 	bool bEnableAtrac3plus;
 	int iSEVolume;
 	int iBGMVolume;
+	bool bParallelSasVoices;
 
 	// UI
 	bool bShowTouchControls;
@@ -141,6 +146,8 @@ public:
 	int iDisasmWindowH;
 	int iConsoleWindowX;
 	int iConsoleWindowY;
+	// Times every syscall, shown in the debug stats.
+	bool bProfileSyscalls;
 
 	std::string currentDirectory;
 	std::string externalDirectory; 
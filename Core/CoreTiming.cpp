@@ -17,7 +17,10 @@
 
 
 #include <vector>
+#include <algorithm>
+#include <unordered_map>
 #include <cstdio>
+#include <cstring>
 
 #include "MsgHandler.h"
 #include "StdMutex.h"
@@ -59,12 +62,66 @@ struct BaseEvent
 
 typedef LinkedListItem<BaseEvent> Event;
 
-Event *first;
+// Events are kept in slots, and a binary min-heap of slot indices orders them.
+struct QueuedEvent
+{
+	BaseEvent ev;
+	// Breaks ties in time, so that events fire in the order they were scheduled.
+	u64 order;
+	int heapIndex;
+	// Other events with the same type and userdata, for UnscheduleEvent().
+	int keyPrev;
+	int keyNext;
+};
+
+struct EventKey
+{
+	int type;
+	u64 userdata;
+
+	bool operator ==(const EventKey &other) const
+	{
+		return type == other.type && userdata == other.userdata;
+	}
+};
+
+struct EventKeyHash
+{
+	size_t operator ()(const EventKey &key) const
+	{
+		return (size_t)((key.userdata * 0x9E3779B97F4A7C15ULL) >> 16) ^ (size_t)key.type;
+	}
+};
+
+std::vector<QueuedEvent> eventSlots;
+std::vector<int> freeEventSlots;
+std::vector<int> eventHeap;
+// The first slot of each chain of events with the same type and userdata.
+std::unordered_map<EventKey, int, EventKeyHash> eventsByKey;
+// How many events of each type are scheduled, for IsScheduled() and RemoveEvent().
+std::vector<int> eventTypeCounts;
+u64 nextEventOrder;
+
+// Other threads push events into a fixed ring without locking, and only the CPU thread
+// pops them (in MoveEvents.)  Each cell's sequence says whose turn it is:
+// == pos when free to write, == pos + 1 once written, == pos + TS_RING_SIZE once read.
+const u32 TS_RING_SIZE = 256;
+struct TsRingCell
+{
+	volatile u32 sequence;
+	BaseEvent ev;
+};
+TsRingCell tsRing[TS_RING_SIZE];
+volatile u32 tsRingWritePos;
+u32 tsRingReadPos;
+
+// When the ring is full, events go here instead, under externalEventSection.
 Event *tsFirst;
 Event *tsLast;
+// Set while tsFirst has events, so later events also go to the list and stay in order.
+volatile u32 hasTsOverflow = 0;
 
-// event pools
-Event *eventPool = 0;
+// event pool
 Event *eventTsPool = 0;
 int allocatedTsEvents = 0;
 // Optimization to skip MoveEvents when possible.
@@ -76,6 +133,8 @@ int slicelength;
 
 s64 globalTimer;
 s64 idledCycles;
+// Not saved in states, just for stats.
+s64 spinIdledCycles;
 
 static std::recursive_mutex externalEventSection;
 
@@ -94,16 +153,6 @@ int GetClockFrequencyMHz()
 }
 
 
-Event* GetNewEvent()
-{
-	if(!eventPool)
-		return new Event;
-
-	Event* ev = eventPool;
-	eventPool = ev->next;
-	return ev;
-}
-
 Event* GetNewTsEvent()
 {
 	allocatedTsEvents++;
@@ -116,12 +165,6 @@ Event* GetNewTsEvent()
 	return ev;
 }
 
-void FreeEvent(Event* ev)
-{
-	ev->next = eventPool;
-	eventPool = ev;
-}
-
 void FreeTsEvent(Event* ev)
 {
 	ev->next = eventTsPool;
@@ -151,7 +194,7 @@ void RestoreRegisterEvent(int event_type, const char *name, TimedCallback callba
 
 void UnregisterAllEvents()
 {
-	if (first)
+	if (!eventHeap.empty())
 		PanicAlert("Cannot unregister events with events pending");
 	event_types.clear();
 }
@@ -162,7 +205,14 @@ void Init()
 	slicelength = INITIAL_SLICE_LENGTH;
 	globalTimer = 0;
 	idledCycles = 0;
+	spinIdledCycles = 0;
+	nextEventOrder = 0;
 	hasTsEvents = 0;
+
+	for (u32 i = 0; i < TS_RING_SIZE; ++i)
+		tsRing[i].sequence = i;
+	tsRingWritePos = 0;
+	tsRingReadPos = 0;
 }
 
 void Shutdown()
@@ -171,13 +221,6 @@ void Shutdown()
 	ClearPendingEvents();
 	UnregisterAllEvents();
 
-	while(eventPool)
-	{
-		Event *ev = eventPool;
-		eventPool = ev->next;
-		delete ev;
-	}
-
 	std::lock_guard<std::recursive_mutex> lk(externalEventSection);
 	while(eventTsPool)
 	{
@@ -197,22 +240,73 @@ u64 GetIdleTicks()
 	return (u64)idledCycles;
 }
 
+u64 GetSpinIdleTicks()
+{
+	return (u64)spinIdledCycles;
+}
+
+
+static bool PushTsRing(s64 time, int event_type, u64 userdata)
+{
+	u32 pos = Common::AtomicLoad(tsRingWritePos);
+	TsRingCell *cell;
+	while (true)
+	{
+		cell = &tsRing[pos & (TS_RING_SIZE - 1)];
+		s32 diff = (s32)(Common::AtomicLoadAcquire(cell->sequence) - pos);
+		if (diff == 0)
+		{
+			if (Common::AtomicCompareExchange(tsRingWritePos, pos, pos + 1))
+				break;
+		}
+		else if (diff < 0)
+		{
+			// Still holds an event from last time around, so we're full.
+			return false;
+		}
+		pos = Common::AtomicLoad(tsRingWritePos);
+	}
+
+	cell->ev.time = time;
+	cell->ev.type = event_type;
+	cell->ev.userdata = userdata;
+	Common::AtomicStoreRelease(cell->sequence, pos + 1);
+	return true;
+}
+
+// CPU thread only.
+static bool PopTsRing(BaseEvent &ev)
+{
+	TsRingCell *cell = &tsRing[tsRingReadPos & (TS_RING_SIZE - 1)];
+	if (Common::AtomicLoadAcquire(cell->sequence) != tsRingReadPos + 1)
+		return false;
+
+	ev = cell->ev;
+	Common::AtomicStoreRelease(cell->sequence, tsRingReadPos + TS_RING_SIZE);
+	tsRingReadPos++;
+	return true;
+}
 
 // This is to be called when outside threads, such as the graphics thread, wants to
 // schedule things to be executed on the main thread.
 void ScheduleEvent_Threadsafe(s64 cyclesIntoFuture, int event_type, u64 userdata)
 {
-	std::lock_guard<std::recursive_mutex> lk(externalEventSection);
-	Event *ne = GetNewTsEvent();
-	ne->time = globalTimer + cyclesIntoFuture;
-	ne->type = event_type;
-	ne->next = 0;
-	ne->userdata = userdata;
-	if(!tsFirst)
-		tsFirst = ne;
-	if(tsLast)
-		tsLast->next = ne;
-	tsLast = ne;
+	s64 time = globalTimer + cyclesIntoFuture;
+	if (Common::AtomicLoadAcquire(hasTsOverflow) || !PushTsRing(time, event_type, userdata))
+	{
+		std::lock_guard<std::recursive_mutex> lk(externalEventSection);
+		Event *ne = GetNewTsEvent();
+		ne->time = time;
+		ne->type = event_type;
+		ne->next = 0;
+		ne->userdata = userdata;
+		if(!tsFirst)
+			tsFirst = ne;
+		if(tsLast)
+			tsLast->next = ne;
+		tsLast = ne;
+		Common::AtomicStoreRelease(hasTsOverflow, 1);
+	}
 
 	Common::AtomicStoreRelease(hasTsEvents, 1);
 }
@@ -232,30 +326,135 @@ void ScheduleEvent_Threadsafe_Immediate(int event_type, u64 userdata)
 
 void ClearPendingEvents()
 {
-	while (first)
+	eventSlots.clear();
+	freeEventSlots.clear();
+	eventHeap.clear();
+	eventsByKey.clear();
+	eventTypeCounts.clear();
+}
+
+static inline bool EventBefore(int a, int b)
+{
+	const QueuedEvent &ea = eventSlots[a];
+	const QueuedEvent &eb = eventSlots[b];
+	if (ea.ev.time != eb.ev.time)
+		return ea.ev.time < eb.ev.time;
+	return ea.order < eb.order;
+}
+
+static inline void SetHeapSlot(int pos, int slot)
+{
+	eventHeap[pos] = slot;
+	eventSlots[slot].heapIndex = pos;
+}
+
+static void SiftUp(int pos)
+{
+	int slot = eventHeap[pos];
+	while (pos > 0)
 	{
-		Event *e = first->next;
-		FreeEvent(first);
-		first = e;
+		int parent = (pos - 1) / 2;
+		if (!EventBefore(slot, eventHeap[parent]))
+			break;
+		SetHeapSlot(pos, eventHeap[parent]);
+		pos = parent;
 	}
+	SetHeapSlot(pos, slot);
 }
 
-void AddEventToQueue(Event* ne)
+static void SiftDown(int pos)
 {
-	Event* prev = NULL;
-	Event** pNext = &first;
-	for(;;)
+	const int size = (int)eventHeap.size();
+	int slot = eventHeap[pos];
+	for (;;)
 	{
-		Event*& next = *pNext;
-		if(!next || ne->time < next->time)
-		{
-			ne->next = next;
-			next = ne;
+		int child = pos * 2 + 1;
+		if (child >= size)
 			break;
-		}
-		prev = next;
-		pNext = &prev->next;
+		if (child + 1 < size && EventBefore(eventHeap[child + 1], eventHeap[child]))
+			child++;
+		if (!EventBefore(eventHeap[child], slot))
+			break;
+		SetHeapSlot(pos, eventHeap[child]);
+		pos = child;
+	}
+	SetHeapSlot(pos, slot);
+}
+
+static inline int FirstEvent()
+{
+	return eventHeap.empty() ? -1 : eventHeap[0];
+}
+
+void AddEventToQueue(const BaseEvent &ev)
+{
+	int slot;
+	if (freeEventSlots.empty())
+	{
+		slot = (int)eventSlots.size();
+		eventSlots.push_back(QueuedEvent());
+	}
+	else
+	{
+		slot = freeEventSlots.back();
+		freeEventSlots.pop_back();
+	}
+
+	QueuedEvent &qe = eventSlots[slot];
+	qe.ev = ev;
+	qe.order = nextEventOrder++;
+	qe.keyPrev = -1;
+
+	EventKey key = {ev.type, ev.userdata};
+	std::pair<std::unordered_map<EventKey, int, EventKeyHash>::iterator, bool> inserted = eventsByKey.insert(std::make_pair(key, slot));
+	if (inserted.second)
+		qe.keyNext = -1;
+	else
+	{
+		qe.keyNext = inserted.first->second;
+		eventSlots[qe.keyNext].keyPrev = slot;
+		inserted.first->second = slot;
 	}
+
+	if (ev.type >= (int)eventTypeCounts.size())
+		eventTypeCounts.resize(ev.type + 1, 0);
+	eventTypeCounts[ev.type]++;
+
+	eventHeap.push_back(slot);
+	SiftUp((int)eventHeap.size() - 1);
+}
+
+static void RemoveQueuedEvent(int slot)
+{
+	QueuedEvent &qe = eventSlots[slot];
+
+	if (qe.keyNext != -1)
+		eventSlots[qe.keyNext].keyPrev = qe.keyPrev;
+	if (qe.keyPrev != -1)
+		eventSlots[qe.keyPrev].keyNext = qe.keyNext;
+	else
+	{
+		EventKey key = {qe.ev.type, qe.ev.userdata};
+		if (qe.keyNext != -1)
+			eventsByKey[key] = qe.keyNext;
+		else
+			eventsByKey.erase(key);
+	}
+	eventTypeCounts[qe.ev.type]--;
+
+	int pos = qe.heapIndex;
+	int last = eventHeap.back();
+	eventHeap.pop_back();
+	if (last != slot)
+	{
+		SetHeapSlot(pos, last);
+		if (pos > 0 && EventBefore(last, eventHeap[(pos - 1) / 2]))
+			SiftUp(pos);
+		else
+			SiftDown(pos);
+	}
+
+	freeEventSlots.push_back(slot);
 }
 
 // This must be run ONLY from within the cpu thread
@@ -263,10 +462,12 @@ void AddEventToQueue(Event* ne)
 // than Advance 
 void ScheduleEvent(s64 cyclesIntoFuture, int event_type, u64 userdata)
 {
-	Event *ne = GetNewEvent();
-	ne->userdata = userdata;
-	ne->type = event_type;
-	ne->time = GetTicks() + cyclesIntoFuture;
+	BaseEvent ne;
+	// The padding is saved in states too.
+	memset(&ne, 0, sizeof(ne));
+	ne.userdata = userdata;
+	ne.type = event_type;
+	ne.time = GetTicks() + cyclesIntoFuture;
 	AddEventToQueue(ne);
 }
 
@@ -274,42 +475,26 @@ void ScheduleEvent(s64 cyclesIntoFuture, int event_type, u64 userdata)
 s64 UnscheduleEvent(int event_type, u64 userdata)
 {
 	s64 result = 0;
-	if (!first)
+	EventKey key = {event_type, userdata};
+	std::unordered_map<EventKey, int, EventKeyHash>::iterator it = eventsByKey.find(key);
+	if (it == eventsByKey.end())
 		return result;
-	while(first)
-	{
-		if (first->type == event_type && first->userdata == userdata)
-		{
-			result = first->time - globalTimer;
 
-			Event *next = first->next;
-			FreeEvent(first);
-			first = next;
-		}
-		else
-		{
-			break;
-		}
-	}
-	if (!first)
-		return result;
-	Event *prev = first;
-	Event *ptr = prev->next;
-	while (ptr)
+	// If there are several, the result is from the last one to fire.
+	int latest = -1;
+	for (int slot = it->second; slot != -1; slot = eventSlots[slot].keyNext)
 	{
-		if (ptr->type == event_type && ptr->userdata == userdata)
-		{
-			result = ptr->time - globalTimer;
+		if (latest == -1 || EventBefore(latest, slot))
+			latest = slot;
+	}
+	result = eventSlots[latest].ev.time - globalTimer;
 
-			prev->next = ptr->next;
-			FreeEvent(ptr);
-			ptr = prev->next;
-		}
-		else
-		{
-			prev = ptr;
-			ptr = ptr->next;
-		}
+	int slot = it->second;
+	while (slot != -1)
+	{
+		int next = eventSlots[slot].keyNext;
+		RemoveQueuedEvent(slot);
+		slot = next;
 	}
 
 	return result;
@@ -318,6 +503,16 @@ s64 UnscheduleEvent(int event_type, u64 userdata)
 s64 UnscheduleThreadsafeEvent(int event_type, u64 userdata)
 {
 	s64 result = 0;
+	// Anything in the ring is older than the list, so it can go to the queue right away.
+	BaseEvent ev;
+	while (PopTsRing(ev))
+	{
+		if (ev.type == event_type && ev.userdata == userdata)
+			result = ev.time - globalTimer;
+		else
+			AddEventToQueue(ev);
+	}
+
 	std::lock_guard<std::recursive_mutex> lk(externalEventSection);
 	if (!tsFirst)
 		return result;
@@ -369,56 +564,34 @@ void RegisterAdvanceCallback(void (*callback)(int cyclesExecuted))
 
 bool IsScheduled(int event_type) 
 {
-	if (!first)
-		return false;
-	Event *e = first;
-	while (e) {
-		if (e->type == event_type)
-			return true;
-		e = e->next;
-	}
-	return false;
+	return event_type < (int)eventTypeCounts.size() && eventTypeCounts[event_type] > 0;
 }
 
 void RemoveEvent(int event_type)
 {
-	if (!first)
-		return;
-	while(first)
-	{
-		if (first->type == event_type)
-		{
-			Event *next = first->next;
-			FreeEvent(first);
-			first = next;
-		}
-		else
-		{
-			break;
-		}
-	}
-	if (!first)
+	if (!IsScheduled(event_type))
 		return;
-	Event *prev = first;
-	Event *ptr = prev->next;
-	while (ptr)
+
+	// Removing shuffles the heap, so find them all first.
+	std::vector<int> slots;
+	for (size_t i = 0; i < eventHeap.size(); ++i)
 	{
-		if (ptr->type == event_type)
-		{
-			prev->next = ptr->next;
-			FreeEvent(ptr);
-			ptr = prev->next;
-		}
-		else
-		{
-			prev = ptr;
-			ptr = ptr->next;
-		}
+		if (eventSlots[eventHeap[i]].ev.type == event_type)
+			slots.push_back(eventHeap[i]);
 	}
+	for (size_t i = 0; i < slots.size(); ++i)
+		RemoveQueuedEvent(slots[i]);
 }
 
 void RemoveThreadsafeEvent(int event_type)
 {
+	BaseEvent ev;
+	while (PopTsRing(ev))
+	{
+		if (ev.type != event_type)
+			AddEventToQueue(ev);
+	}
+
 	std::lock_guard<std::recursive_mutex> lk(externalEventSection);
 	if (!tsFirst)
 	{
@@ -468,16 +641,16 @@ void RemoveAllEvents(int event_type)
 //This raise only the events required while the fifo is processing data
 void ProcessFifoWaitEvents()
 {
-	while (first)
+	int slot;
+	while ((slot = FirstEvent()) != -1)
 	{
-		if (first->time <= globalTimer)
+		if (eventSlots[slot].ev.time <= globalTimer)
 		{
 //			LOG(CPU, "[Scheduler] %s		 (%lld, %lld) ", 
 //				first->name ? first->name : "?", (u64)globalTimer, (u64)first->time);
-			Event* evt = first;
-			first = first->next;
-			event_types[evt->type].callback(evt->userdata, (int)(globalTimer - evt->time));
-			FreeEvent(evt);
+			BaseEvent evt = eventSlots[slot].ev;
+			RemoveQueuedEvent(slot);
+			event_types[evt.type].callback(evt.userdata, (int)(globalTimer - evt.time));
 		}
 		else
 		{
@@ -490,25 +663,24 @@ void MoveEvents()
 {
 	Common::AtomicStoreRelease(hasTsEvents, 0);
 
+	// Move events from async queue into main queue
+	BaseEvent ev;
+	while (PopTsRing(ev))
+		AddEventToQueue(ev);
+
+	if (!Common::AtomicLoadAcquire(hasTsOverflow))
+		return;
+
 	std::lock_guard<std::recursive_mutex> lk(externalEventSection);
-		// Move events from async queue into main queue
 	while (tsFirst)
 	{
 		Event *next = tsFirst->next;
-		AddEventToQueue(tsFirst);
+		AddEventToQueue(*tsFirst);
+		FreeTsEvent(tsFirst);
 		tsFirst = next;
 	}
 	tsLast = NULL;
-
-	// Move free events to threadsafe pool
-	while(allocatedTsEvents > 0 && eventPool)
-	{
-		Event *ev = eventPool;
-		eventPool = ev->next;
-		ev->next = eventTsPool;
-		eventTsPool = ev;
-		allocatedTsEvents--;
-	}
+	Common::AtomicStoreRelease(hasTsOverflow, 0);
 }
 
 void AdvanceQuick()
@@ -519,14 +691,15 @@ void AdvanceQuick()
 
 	ProcessFifoWaitEvents();
 
-	if (!first)
+	int slot = FirstEvent();
+	if (slot == -1)
 	{
 		// WARN_LOG(CPU, "WARNING - no events in queue. Setting currentMIPS->downcount to 10000");
 		currentMIPS->downcount += 10000;
 	}
 	else
 	{
-		slicelength = (int)(first->time - globalTimer);
+		slicelength = (int)(eventSlots[slot].ev.time - globalTimer);
 		if (slicelength > MAX_SLICE_LENGTH)
 			slicelength = MAX_SLICE_LENGTH;
 		currentMIPS->downcount = slicelength;
@@ -543,13 +716,25 @@ void Advance()
 	AdvanceQuick();
 }
 
+static bool EventSlotBefore(int a, int b)
+{
+	return EventBefore(a, b);
+}
+
+// Slot indices in the order the events will fire.
+static std::vector<int> GetSortedEventSlots()
+{
+	std::vector<int> slots = eventHeap;
+	std::sort(slots.begin(), slots.end(), EventSlotBefore);
+	return slots;
+}
+
 void LogPendingEvents()
 {
-	Event *ptr = first;
-	while (ptr)
+	std::vector<int> slots = GetSortedEventSlots();
+	for (size_t i = 0; i < slots.size(); ++i)
 	{
-		//INFO_LOG(CPU, "PENDING: Now: %lld Pending: %lld Type: %d", globalTimer, ptr->time, ptr->type);
-		ptr = ptr->next;
+		//INFO_LOG(CPU, "PENDING: Now: %lld Pending: %lld Type: %d", globalTimer, eventSlots[slots[i]].ev.time, eventSlots[slots[i]].ev.type);
 	}
 }
 
@@ -559,10 +744,11 @@ void Idle(int maxIdle)
 	if (maxIdle != 0 && cyclesDown > maxIdle)
 		cyclesDown = maxIdle;
 
-	if (first && cyclesDown > 0)
+	int slot = FirstEvent();
+	if (slot != -1 && cyclesDown > 0)
 	{
 		int cyclesExecuted = slicelength - currentMIPS->downcount;
-		int cyclesNextEvent = (int) (first->time - globalTimer);
+		int cyclesNextEvent = (int) (eventSlots[slot].ev.time - globalTimer);
 
 		if (cyclesNextEvent < cyclesExecuted + cyclesDown)
 		{
@@ -581,13 +767,21 @@ void Idle(int maxIdle)
 		currentMIPS->downcount = -1;
 }
 
+void IdleSpinLoop()
+{
+	s64 before = idledCycles;
+	Idle();
+	spinIdledCycles += idledCycles - before;
+}
+
 std::string GetScheduledEventsSummary()
 {
-	Event *ptr = first;
+	std::vector<int> slots = GetSortedEventSlots();
 	std::string text = "Scheduled events\n";
 	text.reserve(1000);
-	while (ptr)
+	for (size_t i = 0; i < slots.size(); ++i)
 	{
+		const BaseEvent *ptr = &eventSlots[slots[i]].ev;
 		unsigned int t = ptr->type;
 		if (t >= event_types.size())
 			PanicAlert("Invalid event type"); // %i", t);
@@ -597,7 +791,6 @@ std::string GetScheduledEventsSummary()
 		char temp[512];
 		sprintf(temp, "%s : %i %08x%08x\n", name, (int)ptr->time, (u32)(ptr->userdata >> 32), (u32)(ptr->userdata));
 		text += temp;
-		ptr = ptr->next;
 	}
 	return text;
 }
@@ -607,6 +800,37 @@ void Event_DoState(PointerWrap &p, BaseEvent *ev)
 	p.Do(*ev);
 }
 
+// Same layout as PointerWrap::DoLinkedList(), which was used before the heap.
+void EventQueue_DoState(PointerWrap &p)
+{
+	if (p.mode == PointerWrap::MODE_READ)
+	{
+		ClearPendingEvents();
+		for (;;)
+		{
+			u8 shouldExist = 0;
+			p.Do(shouldExist);
+			if (shouldExist != 1)
+				break;
+			BaseEvent ev;
+			Event_DoState(p, &ev);
+			AddEventToQueue(ev);
+		}
+	}
+	else
+	{
+		std::vector<int> slots = GetSortedEventSlots();
+		for (size_t i = 0; i < slots.size(); ++i)
+		{
+			u8 shouldExist = 1;
+			p.Do(shouldExist);
+			Event_DoState(p, &eventSlots[slots[i]].ev);
+		}
+		u8 shouldExist = 0;
+		p.Do(shouldExist);
+	}
+}
+
 void DoState(PointerWrap &p)
 {
 	std::lock_guard<std::recursive_mutex> lk(externalEventSection);
@@ -616,8 +840,51 @@ void DoState(PointerWrap &p)
 	// These (should) be filled in later by the modules.
 	event_types.resize(n, EventType(AntiCrashCallback, "INVALID EVENT"));
 
-	p.DoLinkedList<BaseEvent, GetNewEvent, FreeEvent, Event_DoState>(first, (Event **) NULL);
+	EventQueue_DoState(p);
+	// Events still in the ring count as arriving after the state, so loading drops them
+	// like it drops anything pending in the list.
+	if (p.mode == PointerWrap::MODE_READ)
+	{
+		BaseEvent ev;
+		while (PopTsRing(ev))
+			continue;
+	}
+	else
+	{
+		// Saving keeps them, though.  New ones go to the list (and wait on the lock) until
+		// MoveEvents, so the state can't change between measuring and writing.
+		Common::AtomicStoreRelease(hasTsOverflow, 1);
+		// They're older than anything in the list, so they go in front.
+		Event *ringFirst = NULL;
+		Event *ringLast = NULL;
+		BaseEvent ev;
+		while (PopTsRing(ev))
+		{
+			Event *ne = GetNewTsEvent();
+			ne->time = ev.time;
+			ne->type = ev.type;
+			ne->userdata = ev.userdata;
+			ne->next = NULL;
+			if (ringLast)
+				ringLast->next = ne;
+			else
+				ringFirst = ne;
+			ringLast = ne;
+		}
+		if (ringFirst)
+		{
+			ringLast->next = tsFirst;
+			if (!tsLast)
+				tsLast = ringLast;
+			tsFirst = ringFirst;
+		}
+	}
 	p.DoLinkedList<BaseEvent, GetNewTsEvent, FreeTsEvent, Event_DoState>(tsFirst, &tsLast);
+	if (p.mode == PointerWrap::MODE_READ)
+	{
+		Common::AtomicStoreRelease(hasTsOverflow, tsFirst != NULL ? 1 : 0);
+		Common::AtomicStoreRelease(hasTsEvents, tsFirst != NULL ? 1 : 0);
+	}
 
 	p.Do(CPU_HZ);
 	p.Do(slicelength);
@@ -79,6 +79,8 @@ namespace CoreTiming
 
 	u64 GetTicks();
 	u64 GetIdleTicks();
+	// Part of the idle ticks, skipped because the CPU was spinning on a flag.
+	u64 GetSpinIdleTicks();
 
 	// Returns the event_type identifier.
 	int RegisterEvent(const char *name, TimedCallback callback);
@@ -105,6 +107,8 @@ namespace CoreTiming
 
 	// Pretend that the main CPU has executed enough cycles to reach the next event.
 	void Idle(int maxIdle = 0);
+	// Same, for a loop which can't exit before the next event.  Counted separately.
+	void IdleSpinLoop();
 
 	// Clear all pending events. This should ONLY be done on exit or state load.
 	void ClearPendingEvents();
@@ -17,8 +17,15 @@
 
 
 #include "BlockDevices.h"
+#include <algorithm>
 #include <cstdio>
 #include <cstring>
+#if !defined(_WIN32) && !defined(__SYMBIAN32__)
+#include <sys/mman.h>
+#endif
+
+#include "Common/Thread.h"
+#include "Core/Config.h"
 
 extern "C"
 {
@@ -27,6 +34,17 @@ extern "C"
 
 };
 
+bool BlockDevice::ReadBlocks(u32 minBlock, int count, u8 *outPtr)
+{
+	bool ok = true;
+	for (int i = 0; i < count; ++i)
+	{
+		if (!ReadBlock(minBlock + i, outPtr + i * GetBlockSize()))
+			ok = false;
+	}
+	return ok;
+}
+
 BlockDevice *constructBlockDevice(const char *filename) {
 	// Check for CISO
 	FILE *f = fopen(filename, "rb");
@@ -36,7 +54,7 @@ BlockDevice *constructBlockDevice(const char *filename) {
 	auto size = fread(buffer, 1, 4, f); //size_t
 	fseek(f, 0, SEEK_SET);
 	if (!memcmp(buffer, "CISO", 4) && size == 4)
-		return new CISOFileBlockDevice(f);
+		return new CISOFileBlockDevice(f, g_Config.iCSOCacheBlocks);
 	else if (!memcmp(buffer, "\x00PBP", 4) && size == 4)
 		return new NPDRMDemoBlockDevice(f);
 	else
@@ -44,20 +62,39 @@ BlockDevice *constructBlockDevice(const char *filename) {
 }
 
 FileBlockDevice::FileBlockDevice(FILE *file)
-	: f(file)
+	: f(file), mapped(NULL)
 {
 	fseek(f,0,SEEK_END);
 	filesize = ftell(f);
 	fseek(f,0,SEEK_SET);
+
+#if !defined(_WIN32) && !defined(__SYMBIAN32__)
+	// A big image may not fit in a 32-bit address space, so this can fail.
+	if (filesize > 0)
+	{
+		void *ptr = mmap(0, filesize, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+		if (ptr != MAP_FAILED)
+			mapped = (const u8 *)ptr;
+		else
+			WARN_LOG(LOADER, "Could not map the ISO, reading it with stdio instead");
+	}
+#endif
 }
 
 FileBlockDevice::~FileBlockDevice()
 {
+#if !defined(_WIN32) && !defined(__SYMBIAN32__)
+	if (mapped)
+		munmap((void *)mapped, filesize);
+#endif
 	fclose(f);
 }
 
 bool FileBlockDevice::ReadBlock(int blockNumber, u8 *outPtr) 
 {
+	if (mapped)
+		return ReadBlocks(blockNumber, 1, outPtr);
+
 	fseek(f, blockNumber * GetBlockSize(), SEEK_SET);
 	if(fread(outPtr, 1, 2048, f) != 2048)
 		DEBUG_LOG(LOADER, "Could not read 2048 bytes from block");
@@ -65,6 +102,29 @@ bool FileBlockDevice::ReadBlock(int blockNumber, u8 *outPtr)
 	return true;
 }
 
+bool FileBlockDevice::ReadBlocks(u32 minBlock, int count, u8 *outPtr)
+{
+	if (mapped)
+	{
+		size_t pos = (size_t)minBlock * GetBlockSize();
+		size_t size = (size_t)count * GetBlockSize();
+		size_t valid = pos < filesize ? std::min(size, filesize - pos) : 0;
+		memcpy(outPtr, mapped + pos, valid);
+		if (valid < size)
+		{
+			DEBUG_LOG(LOADER, "Could not read %d blocks", count);
+			memset(outPtr + valid, 0, size - valid);
+		}
+		return true;
+	}
+
+	fseek(f, minBlock * GetBlockSize(), SEEK_SET);
+	if (fread(outPtr, GetBlockSize(), count, f) != (size_t)count)
+		DEBUG_LOG(LOADER, "Could not read %d blocks", count);
+
+	return true;
+}
+
 // .CSO format
 
 // compressed ISO(9660) header format
@@ -93,8 +153,34 @@ typedef struct ciso_header
 
 // TODO: Need much better error handling.
 
-CISOFileBlockDevice::CISOFileBlockDevice(FILE *file)
-	: f(file)
+static z_stream *NewInflater()
+{
+	z_stream *z = new z_stream;
+	memset(z, 0, sizeof(z_stream));
+	z->zalloc = Z_NULL;
+	z->zfree = Z_NULL;
+	z->opaque = Z_NULL;
+	if (inflateInit2(z, -15) != Z_OK)
+	{
+		ERROR_LOG(LOADER, "deflateInit ERROR : %s\n", (z->msg) ? z->msg : "???");
+		delete z;
+		return NULL;
+	}
+	return z;
+}
+
+static void DeleteInflater(z_stream *z)
+{
+	if (z)
+	{
+		inflateEnd(z);
+		delete z;
+	}
+}
+
+CISOFileBlockDevice::CISOFileBlockDevice(FILE *file, int cacheBlocks)
+	: f(file), lastReadEnd(0xFFFFFFFF), cacheBlocks(std::max(cacheBlocks, 0)), cacheHits(0), readAheadThread(NULL),
+	  readAheadStop(false), readAheadNext(0), readAheadEnd(0), readAheadBusyStart(0), readAheadBusyEnd(0), readAheadDone(0)
 {
 	// CISO format is EXTREMELY crappy and incomplete. All tools make broken CISO.
 
@@ -131,77 +217,304 @@ CISOFileBlockDevice::CISOFileBlockDevice(FILE *file)
 	index = new u32[indexSize];
 	if(fread(index, sizeof(u32), indexSize, f) != indexSize)
 		memset(index, 0, indexSize * sizeof(u32));
+
+	inflater.z = NewInflater();
+	// Read-ahead mustn't push out what it's read ahead before it's used.
+	readAheadBlocks = std::min((int)READ_AHEAD_BLOCKS, this->cacheBlocks / 2);
 }
 
 CISOFileBlockDevice::~CISOFileBlockDevice()
 {
+	if (readAheadThread)
+	{
+		{
+			std::lock_guard<std::mutex> guard(cacheLock);
+			readAheadStop = true;
+			cacheCond.notify_all();
+		}
+		readAheadThread->join();
+		delete readAheadThread;
+	}
+	DeleteInflater(inflater.z);
 	fclose(f);
 	delete [] index;
 }
 
-bool CISOFileBlockDevice::ReadBlock(int blockNumber, u8 *outPtr) 
+bool CISOFileBlockDevice::ReadBlock(int blockNumber, u8 *outPtr)
+{
+	return ReadBlocks(blockNumber, 1, outPtr);
+}
+
+static bool InflateBlock(z_stream *z, u8 *in, u32 inSize, u8 *outPtr, u32 blockNumber)
 {
-	if ((u32)blockNumber >= numBlocks)
+	if (!z || inflateReset(z) != Z_OK)
+		return false;
+	z->avail_in = inSize;
+	z->next_out = outPtr;
+	z->avail_out = 2048;
+	z->next_in = in;
+
+	int status = inflate(z, Z_FULL_FLUSH);
+	if (status != Z_STREAM_END)
+	{
+		ERROR_LOG(LOADER, "block %d:inflate : %s[%d]\n", blockNumber, (z->msg) ? z->msg : "error", status);
+		return false;
+	}
+	int cmp_size = 2048 - z->avail_out;
+	if (cmp_size != 2048)
 	{
-		memset(outPtr, 0, 2048);
+		ERROR_LOG(LOADER, "block %d : block size error %d != %d\n", blockNumber, cmp_size, 2048);
 		return false;
 	}
+	return true;
+}
+
+bool CISOFileBlockDevice::DecompressBlocks(Inflater &inflater, u32 minBlock, int count, u8 *outPtr)
+{
+	// Plain blocks are 2048 bytes plus alignment, and compressed ones should be smaller.
+	// Anything much bigger is a broken index.
+	const u32 maxBlockData = 2048 * 2 + (1 << indexShift);
+
+	bool ok = true;
+	while (count > 0)
+	{
+		// Blocks are stored in order, so a run of them is one read.
+		int n = std::min(count, (int)MAX_READ_RUN);
+		u32 readPos = (index[minBlock] & 0x7FFFFFFF) << indexShift;
+		u32 readEnd = (index[minBlock + n] & 0x7FFFFFFF) << indexShift;
+		if (readEnd < readPos || readEnd - readPos > n * maxBlockData)
+		{
+			n = 1;
+			readEnd = (index[minBlock + 1] & 0x7FFFFFFF) << indexShift;
+			if (readEnd < readPos || readEnd - readPos > maxBlockData)
+				readEnd = readPos + maxBlockData;
+		}
 
-	u32 idx = index[blockNumber];
-	u32 idx2 = index[blockNumber+1];
-	u8 inbuffer[4096]; //too big
-	z_stream z;
+		if (inflater.readBuffer.size() < readEnd - readPos)
+			inflater.readBuffer.resize(readEnd - readPos);
+		u8 *inbuffer = &inflater.readBuffer[0];
+		u32 readSize;
+		{
+			std::lock_guard<std::mutex> guard(fileLock);
+			fseek(f, readPos, SEEK_SET);
+			readSize = (u32)fread(inbuffer, 1, readEnd - readPos, f);
+		}
 
-	int plain = idx & 0x80000000;
+		for (int i = 0; i < n; ++i)
+		{
+			u32 blockNumber = minBlock + i;
+			u32 idx = index[blockNumber];
+			u32 idx2 = index[blockNumber + 1];
+			int plain = idx & 0x80000000;
+			u32 pos = ((idx & 0x7FFFFFFF) << indexShift) - readPos;
+			u32 end = ((idx2 & 0x7FFFFFFF) << indexShift) - readPos;
+			// Only a single block can have a broken index here, so clamp it to what was read.
+			pos = std::min(pos, readSize);
+			end = std::max(pos, std::min(end, readSize));
+
+			u8 *out = outPtr + i * 2048;
+			memset(out, 0, 2048);
+			if (plain)
+				memcpy(out, inbuffer + pos, std::min(end - pos, (u32)2048));
+			else if (!InflateBlock(inflater.z, inbuffer + pos, end - pos, out, blockNumber))
+				ok = false;
+		}
 
-	idx = (idx & 0x7FFFFFFF) << indexShift;
-	idx2 = (idx2 & 0x7FFFFFFF) << indexShift;
+		minBlock += n;
+		outPtr += n * 2048;
+		count -= n;
+	}
+	return ok;
+}
 
-	u32 compressedReadPos = idx;
-	u32 compressedReadSize = idx2 - idx;
+bool CISOFileBlockDevice::CacheLookup(u32 blockNumber, u8 *outPtr)
+{
+	std::map<u32, CachedBlock>::iterator it = cacheMap.find(blockNumber);
+	if (it == cacheMap.end())
+		return false;
+	cacheLRU.splice(cacheLRU.begin(), cacheLRU, it->second.lru);
+	memcpy(outPtr, &cacheData[it->second.slot * 2048], 2048);
+	return true;
+}
 
-	fseek(f, compressedReadPos, SEEK_SET);
-	u32 readSize = (u32)fread(inbuffer, 1, compressedReadSize, f);
+void CISOFileBlockDevice::CacheInsert(u32 blockNumber, const u8 *data)
+{
+	if (cacheBlocks == 0 || cacheMap.find(blockNumber) != cacheMap.end())
+		return;
 
-	if (plain)
+	CachedBlock cached;
+	if ((int)cacheMap.size() < cacheBlocks)
 	{
-		memset(outPtr, 0, 2048);
-		memcpy(outPtr, inbuffer, readSize);
+		cached.slot = (int)cacheMap.size();
+		cacheData.resize((cached.slot + 1) * 2048);
+		cacheLRU.push_front(blockNumber);
 	}
 	else
 	{
-		memset(outPtr, 0, 2048);
-		z.zalloc = Z_NULL;
-		z.zfree = Z_NULL;
-		z.opaque = Z_NULL;
-		if(inflateInit2(&z, -15) != Z_OK)
-		{
-			ERROR_LOG(LOADER, "deflateInit ERROR : %s\n", (z.msg) ? z.msg : "???");
+		// Reuse the least recently used one.
+		std::map<u32, CachedBlock>::iterator oldest = cacheMap.find(cacheLRU.back());
+		cached.slot = oldest->second.slot;
+		cacheMap.erase(oldest);
+		cacheLRU.back() = blockNumber;
+		cacheLRU.splice(cacheLRU.begin(), cacheLRU, --cacheLRU.end());
+	}
+	cached.lru = cacheLRU.begin();
+	cacheMap[blockNumber] = cached;
+	memcpy(&cacheData[cached.slot * 2048], data, 2048);
+}
+
+bool CISOFileBlockDevice::IsCachedOrBusy(u32 blockNumber)
+{
+	if (blockNumber >= readAheadBusyStart && blockNumber < readAheadBusyEnd)
+		return true;
+	return cacheMap.find(blockNumber) != cacheMap.end();
+}
+
+bool CISOFileBlockDevice::ReadBlocks(u32 minBlock, int count, u8 *outPtr)
+{
+	if (count <= 0)
+		return true;
+	bool ok = true;
+	if (minBlock >= numBlocks || count > (int)(numBlocks - minBlock))
+	{
+		int valid = minBlock >= numBlocks ? 0 : (int)(numBlocks - minBlock);
+		memset(outPtr + valid * 2048, 0, (count - valid) * 2048);
+		count = valid;
+		ok = false;
+		if (count == 0)
 			return false;
+	}
+
+	if (cacheBlocks == 0)
+		return DecompressBlocks(inflater, minBlock, count, outPtr) && ok;
+
+	u32 endBlock = minBlock + count;
+	// Start on what comes next while we work on these.  A seek drops whatever was planned,
+	// and read-ahead starts over from the new position once reads are sequential again.
+	if (minBlock == lastReadEnd)
+		RequestReadAhead(endBlock);
+	else if (readAheadThread)
+	{
+		std::lock_guard<std::mutex> guard(cacheLock);
+		readAheadNext = endBlock;
+		readAheadEnd = endBlock;
+	}
+	lastReadEnd = endBlock;
+
+	u32 block = minBlock;
+	while (block < endBlock)
+	{
+		u32 runEnd;
+		{
+			std::unique_lock<std::mutex> guard(cacheLock);
+			while (block < endBlock)
+			{
+				if (CacheLookup(block, outPtr + (block - minBlock) * 2048))
+				{
+					++block;
+					++cacheHits;
+				}
+				else if (block >= readAheadBusyStart && block < readAheadBusyEnd)
+					cacheCond.wait(guard);
+				else
+					break;
+			}
+			if (block >= endBlock)
+				break;
+			runEnd = block + 1;
+			while (runEnd < endBlock && runEnd - block < MAX_READ_RUN && !IsCachedOrBusy(runEnd))
+				++runEnd;
+		}
+
+		u8 *out = outPtr + (block - minBlock) * 2048;
+		if (DecompressBlocks(inflater, block, runEnd - block, out))
+		{
+			std::lock_guard<std::mutex> guard(cacheLock);
+			for (u32 b = block; b < runEnd; ++b)
+				CacheInsert(b, out + (b - block) * 2048);
+		}
+		else
+			ok = false;
+		block = runEnd;
+	}
+	return ok;
+}
+
+void CISOFileBlockDevice::RequestReadAhead(u32 minBlock)
+{
+	if (readAheadBlocks <= 0 || minBlock >= numBlocks)
+		return;
+
+	std::lock_guard<std::mutex> guard(cacheLock);
+	// Anything before minBlock is either done, or being read right now.
+	readAheadNext = std::max(readAheadNext, minBlock);
+	readAheadEnd = std::min(minBlock + readAheadBlocks, numBlocks);
+	if (!readAheadThread)
+		readAheadThread = new std::thread(&CISOFileBlockDevice::RunReadAheadThread, this);
+	cacheCond.notify_all();
+}
+
+u32 CISOFileBlockDevice::ReadAheadDone()
+{
+	std::lock_guard<std::mutex> guard(cacheLock);
+	return readAheadDone;
+}
+
+void CISOFileBlockDevice::RunReadAheadThread(CISOFileBlockDevice *self)
+{
+	self->ReadAheadThreadFunc();
+}
+
+void CISOFileBlockDevice::ReadAheadThreadFunc()
+{
+	Common::SetCurrentThreadName("CISOReadAhead");
+
+	Inflater readAheadInflater;
+	readAheadInflater.z = NewInflater();
+	std::vector<u8> decoded;
+
+	std::unique_lock<std::mutex> guard(cacheLock);
+	while (!readAheadStop)
+	{
+		if (readAheadNext >= readAheadEnd)
+		{
+			cacheCond.wait(guard);
+			continue;
 		}
-		z.avail_in = readSize;
-		z.next_out = outPtr;
-		z.avail_out = blockSize;
-		z.next_in = inbuffer;
-
-		int status = inflate(&z, Z_FULL_FLUSH);
-		if(status != Z_STREAM_END)
-			//if (status != Z_OK)
+		if (IsCachedOrBusy(readAheadNext))
 		{
-			ERROR_LOG(LOADER, "block %d:inflate : %s[%d]\n", blockNumber, (z.msg) ? z.msg : "error", status);
-			inflateEnd(&z);
-			return 1;
+			++readAheadNext;
+			continue;
 		}
-		int cmp_size = blockSize - z.avail_out;
-		if (cmp_size != (int)blockSize)
+
+		// A few at a time, so the emulator thread doesn't wait long if it catches up.
+		u32 start = readAheadNext;
+		u32 end = start + 1;
+		while (end < readAheadEnd && end - start < READ_AHEAD_BATCH && !IsCachedOrBusy(end))
+			++end;
+		readAheadBusyStart = start;
+		readAheadBusyEnd = end;
+		readAheadNext = end;
+		guard.unlock();
+
+		decoded.resize((end - start) * 2048);
+		bool ok = DecompressBlocks(readAheadInflater, start, end - start, &decoded[0]);
+
+		guard.lock();
+		// If something failed, the emulator thread will try again and log it.
+		if (ok)
 		{
-			ERROR_LOG(LOADER, "block %d : block size error %d != %d\n", blockNumber, cmp_size, blockSize);
-			inflateEnd(&z);
-			return false;
+			for (u32 b = start; b < end; ++b)
+				CacheInsert(b, &decoded[(b - start) * 2048]);
+			readAheadDone += end - start;
 		}
-		inflateEnd(&z);
+		readAheadBusyStart = 0;
+		readAheadBusyEnd = 0;
+		cacheCond.notify_all();
 	}
-	return true;
+	guard.unlock();
+
+	DeleteInflater(readAheadInflater.z);
 }
 
 
@@ -23,47 +23,120 @@
 // The ISOFileSystemReader reads from a BlockDevice, so it automatically works
 // with CISO images.
 
+#include <list>
+#include <map>
+#include <vector>
+
 #include "../../Globals.h"
+#include "Common/StdConditionVariable.h"
+#include "Common/StdMutex.h"
+#include "Common/StdThread.h"
 #include "Core/ELF/PBPReader.h"
 
+struct z_stream_s;
+
 class BlockDevice
 {
 public:
 	virtual ~BlockDevice() {}
 	virtual bool ReadBlock(int blockNumber, u8 *outPtr) = 0;
+	// count blocks in a row.  By default, just one at a time.
+	virtual bool ReadBlocks(u32 minBlock, int count, u8 *outPtr);
 	int GetBlockSize() const { return 2048;}  // forced, it cannot be changed by subclasses
 	virtual u32 GetNumBlocks() = 0;
 };
 
 
+// Keeps the most recently used blocks decompressed, and once reads are sequential,
+// decompresses the next ones ahead of time on a thread.
 class CISOFileBlockDevice : public BlockDevice
 {
 public:
-	CISOFileBlockDevice(FILE *file);
+	enum {
+		READ_AHEAD_BLOCKS = 64,
+		// Blocks read from the file at once.
+		MAX_READ_RUN = 64,
+		READ_AHEAD_BATCH = 8,
+	};
+
+	// cacheBlocks is how many decompressed blocks to keep.  0 means no cache, and no read-ahead.
+	CISOFileBlockDevice(FILE *file, int cacheBlocks = 0);
 	~CISOFileBlockDevice();
 	bool ReadBlock(int blockNumber, u8 *outPtr);
+	bool ReadBlocks(u32 minBlock, int count, u8 *outPtr);
 	u32 GetNumBlocks() { return numBlocks;}
 
+	u32 CacheHits() const { return cacheHits; }
+	// Blocks the read-ahead thread has decompressed so far.
+	u32 ReadAheadDone();
+
 private:
+	// Each thread has its own.
+	struct Inflater {
+		z_stream_s *z;
+		std::vector<u8> readBuffer;
+	};
+	struct CachedBlock {
+		std::list<u32>::iterator lru;
+		int slot;
+	};
+
+	bool DecompressBlocks(Inflater &inflater, u32 minBlock, int count, u8 *outPtr);
+	// These need cacheLock.
+	bool CacheLookup(u32 blockNumber, u8 *outPtr);
+	void CacheInsert(u32 blockNumber, const u8 *data);
+	bool IsCachedOrBusy(u32 blockNumber);
+
+	void RequestReadAhead(u32 minBlock);
+	static void RunReadAheadThread(CISOFileBlockDevice *self);
+	void ReadAheadThreadFunc();
+
 	FILE *f;
 	u32 *index;
 	int indexShift;
 	u32 blockSize;
 	u32 numBlocks;
+
+	// Only the file position is shared between threads.
+	std::mutex fileLock;
+	Inflater inflater;
+	u32 lastReadEnd;
+
+	std::mutex cacheLock;
+	std::condition_variable cacheCond;
+	int cacheBlocks;
+	// Most recently used first.
+	std::list<u32> cacheLRU;
+	std::map<u32, CachedBlock> cacheMap;
+	std::vector<u8> cacheData;
+	u32 cacheHits;
+
+	std::thread *readAheadThread;
+	bool readAheadStop;
+	int readAheadBlocks;
+	// Still to do, and what the thread is decompressing right now.
+	u32 readAheadNext;
+	u32 readAheadEnd;
+	u32 readAheadBusyStart;
+	u32 readAheadBusyEnd;
+	u32 readAheadDone;
 };
 
 
+// Maps the whole file where it can, so reads are just a memcpy.  Otherwise, stdio.
 class FileBlockDevice : public BlockDevice
 {
 public:
 	FileBlockDevice(FILE *file);
 	~FileBlockDevice();
 	bool ReadBlock(int blockNumber, u8 *outPtr);
+	bool ReadBlocks(u32 minBlock, int count, u8 *outPtr);
 	u32 GetNumBlocks() {return (u32)(filesize / GetBlockSize());}
 
 private:
 	FILE *f;
 	size_t filesize;
+	const u8 *mapped;
 };
 
 
@@ -429,10 +429,10 @@ size_t ISOFileSystem::ReadFile(u32 handle, u8 *pointer, s64 size)
 		if (e.file != 0 && e.file->isBlockSectorMode)
 		{
 			// Whole sectors! Shortcut to this simple code.
-			for (int i = 0; i < size; i++)
+			if (size > 0)
 			{
-				blockDevice->ReadBlock(e.seekPos, pointer + i * 2048);
-				e.seekPos++;
+				blockDevice->ReadBlocks(e.seekPos, (int)size, pointer);
+				e.seekPos += (unsigned int)size;
 			}
 			return (size_t)size;
 		}
@@ -470,6 +470,18 @@ size_t ISOFileSystem::ReadFile(u32 handle, u8 *pointer, s64 size)
 
 		while (remain > 0)
 		{
+			// Whole sectors in the middle go straight to the output.
+			if (posInSector == 0 && remain >= 2048)
+			{
+				int sectors = (int)(remain / 2048);
+				blockDevice->ReadBlocks(secNum, sectors, pointer);
+				totalRead += sectors * 2048;
+				pointer += sectors * 2048;
+				remain -= sectors * 2048;
+				secNum += sectors;
+				continue;
+			}
+
 			blockDevice->ReadBlock(secNum, theSector);
 			size_t bytesToCopy = 2048 - posInSector;
 			if ((s64)bytesToCopy > remain)
@@ -20,12 +20,24 @@
 #include <map>
 #include <vector>
 #include <string>
+#include <algorithm>
+#include <cstdio>
+#if defined(_M_IX86) || defined(_M_X64)
+#ifdef _WIN32
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#elif !defined(_WIN32) && !defined(__APPLE__) && !defined(__SYMBIAN32__)
+#include <time.h>
+#endif
 #include "../MemMap.h"
 #include "../Config.h"
 #include "Core/CoreTiming.h"
 #include "Core/Reporting.h"
 
 #include "HLETables.h"
+#include "ReplaceTables.h"
 #include "../System.h"
 #include "sceDisplay.h"
 #include "sceIo.h"
@@ -57,6 +69,24 @@ enum
 typedef std::vector<Syscall> SyscallVector;
 typedef std::map<std::string, SyscallVector> SyscallVectorByModule;
 
+struct HLEProfileEntry
+{
+	u64 ticks;
+	u64 maxTicks;
+	u32 calls;
+};
+
+// All functions of all modules, in order.  A syscall's index is its module's
+// first index plus its index in the module's table.
+static std::vector<const HLEFunction *> syscallFuncs;
+static std::vector<int> syscallModules;
+static std::vector<int> moduleFirstSyscall;
+// Indexed like syscallFuncs.  The frame counters are folded into the totals on reset.
+static std::vector<HLEProfileEntry> profileFrame;
+static std::vector<HLEProfileEntry> profileTotal;
+static u64 profileStartTicks;
+static double profileStartTime;
+
 static std::vector<HLEModule> moduleDB;
 static SyscallVectorByModule unresolvedSyscalls;
 static SyscallVectorByModule exportedCalls;
@@ -79,9 +109,40 @@ void hleDelayResultFinish(u64 userdata, int cycleslate)
 		WARN_LOG(HLE, "Someone else woke up HLE-blocked thread?");
 }
 
+static inline u64 hleProfilerNow()
+{
+#if defined(_M_IX86) || defined(_M_X64)
+	return __rdtsc();
+#elif defined(_WIN32) || defined(__APPLE__) || defined(__SYMBIAN32__)
+	time_update();
+	return (u64)(time_now_d() * 1000000000.0);
+#else
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static double hleProfilerTicksToMs(u64 ticks)
+{
+	// rdtsc has no fixed rate, so measure it against the wall clock since init.
+	time_update();
+	double elapsed = time_now_d() - profileStartTime;
+	u64 elapsedTicks = hleProfilerNow() - profileStartTicks;
+	if (elapsed <= 0.0 || elapsedTicks == 0)
+		return 0.0;
+	return (double)ticks * elapsed * 1000.0 / (double)elapsedTicks;
+}
+
 void HLEInit()
 {
 	RegisterAllModules();
+	profileFrame.assign(syscallFuncs.size(), HLEProfileEntry());
+	profileTotal.assign(syscallFuncs.size(), HLEProfileEntry());
+	time_update();
+	profileStartTime = time_now_d();
+	profileStartTicks = hleProfilerNow();
+	Replacement_Init();
 	delayedResultEvent = CoreTiming::RegisterEvent("HLEDelayedResult", hleDelayResultFinish);
 }
 
@@ -98,13 +159,25 @@ void HLEShutdown()
 {
 	hleAfterSyscall = HLE_AFTER_NOTHING;
 	moduleDB.clear();
+	syscallFuncs.clear();
+	syscallModules.clear();
+	moduleFirstSyscall.clear();
+	profileFrame.clear();
+	profileTotal.clear();
 	unresolvedSyscalls.clear();
 	exportedCalls.clear();
+	Replacement_Shutdown();
 }
 
 void RegisterModule(const char *name, int numFunctions, const HLEFunction *funcTable)
 {
 	HLEModule module = {name, numFunctions, funcTable};
+	moduleFirstSyscall.push_back((int)syscallFuncs.size());
+	for (int i = 0; i < numFunctions; i++)
+	{
+		syscallFuncs.push_back(&funcTable[i]);
+		syscallModules.push_back((int)moduleDB.size());
+	}
 	moduleDB.push_back(module);
 }
 
@@ -210,6 +283,8 @@ u32 GetSyscallOp(const char *moduleName, u32 nib)
 
 void WriteSyscall(const char *moduleName, u32 nib, u32 address)
 {
+	// Whatever gets written, the stub may have been run before.
+	currentMIPS->InvalidateICache(address, 8);
 	if (nib == 0)
 	{
 		Memory::Write_U32(MIPS_MAKE_JR_RA(), address); //patched out?
@@ -277,6 +352,7 @@ void ResolveSyscall(const char *moduleName, u32 nib, u32 address)
 				// Note that this should be J not JAL, as otherwise control will return to the stub..
 				Memory::Write_U32(MIPS_MAKE_J(address), sysc->symAddr);
 				Memory::Write_U32(MIPS_MAKE_NOP(), sysc->symAddr + 4);
+				currentMIPS->InvalidateICache(sysc->symAddr, 8);
 			}
 		}
 	}
@@ -389,7 +465,7 @@ void hleEatMicro(int usec)
 	hleEatCycles((int) usToCycles(usec));
 }
 
-inline void hleFinishSyscall(int modulenum, int funcnum)
+inline void hleFinishSyscall(const HLEFunction &info)
 {
 	if ((hleAfterSyscall & HLE_AFTER_CURRENT_CALLBACKS) != 0)
 		__KernelForceCallbacks();
@@ -407,7 +483,7 @@ inline void hleFinishSyscall(int modulenum, int funcnum)
 
 	if ((hleAfterSyscall & HLE_AFTER_DEBUG_BREAK) != 0)
 	{
-		if (!hleExecuteDebugBreak(moduleDB[modulenum].funcTable[funcnum]))
+		if (!hleExecuteDebugBreak(info))
 		{
 			// We'll do it next syscall.
 			hleAfterSyscall = HLE_AFTER_DEBUG_BREAK;
@@ -420,84 +496,176 @@ inline void hleFinishSyscall(int modulenum, int funcnum)
 	hleAfterSyscallReschedReason = 0;
 }
 
-inline void updateSyscallStats(int modulenum, int funcnum, double total)
+int GetSyscallIndex(u32 op)
 {
-	const char *name = moduleDB[modulenum].funcTable[funcnum].name;
-	// Ignore this one, especially for msInSyscalls (although that ignores CoreTiming events.)
-	if (0 == strcmp(name, "_sceKernelIdle"))
-		return;
-
-	if (total > kernelStats.slowestSyscallTime)
+	u32 callno = (op >> 6) & 0xFFFFF; //20 bits
+	int funcnum = callno & 0xFFF;
+	int modulenum = (callno & 0xFF000) >> 12;
+	if (funcnum == 0xfff || op == 0xffff || modulenum >= (int)moduleDB.size() || funcnum >= moduleDB[modulenum].numFunctions)
 	{
-		kernelStats.slowestSyscallTime = total;
-		kernelStats.slowestSyscallName = name;
+		ERROR_LOG(HLE, "Unknown syscall: Module: %s", modulenum >= (int)moduleDB.size() ? "(unknown)" : moduleDB[modulenum].name);
+		return -1;
 	}
-	kernelStats.msInSyscalls += total;
-
-	KernelStatsSyscall statCall(modulenum, funcnum);
-	auto summedStat = kernelStats.summedMsInSyscalls.find(statCall);
-	if (summedStat == kernelStats.summedMsInSyscalls.end())
+	int index = moduleFirstSyscall[modulenum] + funcnum;
+	if (!syscallFuncs[index]->func)
 	{
-		kernelStats.summedMsInSyscalls[statCall] = total;
-		if (total > kernelStats.summedSlowestSyscallTime)
-		{
-			kernelStats.summedSlowestSyscallTime = total;
-			kernelStats.summedSlowestSyscallName = name;
-		}
+		ERROR_LOG_REPORT(HLE, "Unimplemented HLE function %s", syscallFuncs[index]->name);
+		return -1;
 	}
+	return index;
+}
+
+void *GetQuickSyscallFunc(int index)
+{
+	if (index < 0)
+		return NULL;
+	const HLEFunction *info = syscallFuncs[index];
+	if ((info->flags & HLE_CLEAN) == 0 || (info->flags & HLE_NOT_DISPATCH_SUSPENDED) != 0)
+		return NULL;
+	return (void *)info->func;
+}
+
+inline void CallSyscallWithProfile(int index, bool checkDispatch)
+{
+	const HLEFunction *info = syscallFuncs[index];
+	// Read the flag once, in case it's enabled in the middle of this func.
+	const bool profile = g_Config.bProfileSyscalls;
+	u64 start = profile ? hleProfilerNow() : 0;
+
+	if (checkDispatch && !__KernelIsDispatchEnabled())
+		RETURN(SCE_KERNEL_ERROR_CAN_NOT_WAIT);
 	else
+		info->func();
+
+	if (hleAfterSyscall != HLE_AFTER_NOTHING)
+		hleFinishSyscall(*info);
+
+	if (profile)
 	{
-		double newTotal = kernelStats.summedMsInSyscalls[statCall] += total;
-		if (newTotal > kernelStats.summedSlowestSyscallTime)
-		{
-			kernelStats.summedSlowestSyscallTime = newTotal;
-			kernelStats.summedSlowestSyscallName = name;
-		}
+		u64 ticks = hleProfilerNow() - start;
+		HLEProfileEntry &entry = profileFrame[index];
+		entry.ticks += ticks;
+		entry.maxTicks = std::max(entry.maxTicks, ticks);
+		entry.calls++;
 	}
 }
 
+void CallSyscallWithFlags(int index)
+{
+	CallSyscallWithProfile(index, (syscallFuncs[index]->flags & HLE_NOT_DISPATCH_SUSPENDED) != 0);
+}
+
+void CallSyscallWithoutFlags(int index)
+{
+	CallSyscallWithProfile(index, false);
+}
+
 void CallSyscall(u32 op)
 {
-	double start = 0.0;  // need to initialize to fix the race condition where g_Config.bShowDebugStats is enabled in the middle of this func.
-	if (g_Config.bShowDebugStats)
-	{
-		time_update();
-		start = time_now_d();
-	}
-	u32 callno = (op >> 6) & 0xFFFFF; //20 bits
-	int funcnum = callno & 0xFFF;
-	int modulenum = (callno & 0xFF000) >> 12;
-	if (funcnum == 0xfff || op == 0xffff)
+	int index = GetSyscallIndex(op);
+	if (index >= 0)
+		CallSyscallWithFlags(index);
+}
+
+static bool hleProfilerIgnored(int index)
+{
+	// This is where threads wait, so it'd always be on top.
+	return strcmp(syscallFuncs[index]->name, "_sceKernelIdle") == 0;
+}
+
+static bool hleProfilerResultSlower(const HLEProfilerResult &a, const HLEProfilerResult &b)
+{
+	return a.ms > b.ms;
+}
+
+static void hleProfilerSort(std::vector<HLEProfilerResult> &results, size_t count)
+{
+	std::sort(results.begin(), results.end(), hleProfilerResultSlower);
+	if (results.size() > count)
+		results.resize(count);
+}
+
+std::vector<HLEProfilerResult> hleProfilerTopFunctions(size_t count)
+{
+	std::vector<HLEProfilerResult> results;
+	for (size_t i = 0; i < profileFrame.size(); i++)
 	{
-		_dbg_assert_msg_(HLE,0,"Unknown syscall");
-		ERROR_LOG(HLE,"Unknown syscall: Module: %s", modulenum > (int) moduleDB.size() ? "(unknown)" : moduleDB[modulenum].name); 
-		return;
+		const HLEProfileEntry &entry = profileFrame[i];
+		if (entry.calls == 0 || hleProfilerIgnored((int)i))
+			continue;
+		HLEProfilerResult result = {syscallFuncs[i]->name, hleProfilerTicksToMs(entry.ticks), hleProfilerTicksToMs(entry.maxTicks), entry.calls};
+		results.push_back(result);
 	}
-	HLEFunc func = moduleDB[modulenum].funcTable[funcnum].func;
-	if (func)
+	hleProfilerSort(results, count);
+	return results;
+}
+
+std::vector<HLEProfilerResult> hleProfilerTopModules(size_t count)
+{
+	std::vector<HLEProfilerResult> results;
+	for (size_t m = 0; m < moduleDB.size(); m++)
 	{
-		// TODO: Move to jit/interp.
-		u32 flags = moduleDB[modulenum].funcTable[funcnum].flags;
-		if (flags & HLE_NOT_DISPATCH_SUSPENDED)
+		HLEProfileEntry sum = {0};
+		const int first = moduleFirstSyscall[m];
+		for (int i = first; i < first + moduleDB[m].numFunctions; i++)
 		{
-			if (!__KernelIsDispatchEnabled())
-				RETURN(SCE_KERNEL_ERROR_CAN_NOT_WAIT);
-			else
-				func();
+			if (hleProfilerIgnored(i))
+				continue;
+			sum.ticks += profileFrame[i].ticks;
+			sum.maxTicks = std::max(sum.maxTicks, profileFrame[i].maxTicks);
+			sum.calls += profileFrame[i].calls;
 		}
-		else
-			func();
+		if (sum.calls == 0)
+			continue;
+		HLEProfilerResult result = {moduleDB[m].name, hleProfilerTicksToMs(sum.ticks), hleProfilerTicksToMs(sum.maxTicks), sum.calls};
+		results.push_back(result);
+	}
+	hleProfilerSort(results, count);
+	return results;
+}
 
-		if (hleAfterSyscall != HLE_AFTER_NOTHING)
-			hleFinishSyscall(modulenum, funcnum);
+double hleProfilerFrameMs()
+{
+	u64 ticks = 0;
+	for (size_t i = 0; i < profileFrame.size(); i++)
+	{
+		if (!hleProfilerIgnored((int)i))
+			ticks += profileFrame[i].ticks;
 	}
-	else
+	return hleProfilerTicksToMs(ticks);
+}
+
+void hleProfilerResetFrame()
+{
+	for (size_t i = 0; i < profileFrame.size(); i++)
 	{
-		ERROR_LOG_REPORT(HLE, "Unimplemented HLE function %s", moduleDB[modulenum].funcTable[funcnum].name);
+		HLEProfileEntry &total = profileTotal[i];
+		total.ticks += profileFrame[i].ticks;
+		total.maxTicks = std::max(total.maxTicks, profileFrame[i].maxTicks);
+		total.calls += profileFrame[i].calls;
 	}
-	if (g_Config.bShowDebugStats)
+	profileFrame.assign(profileFrame.size(), HLEProfileEntry());
+}
+
+bool hleProfilerWriteCSV(const char *filename)
+{
+	FILE *file = fopen(filename, "w");
+	if (!file)
 	{
-		time_update();
-		updateSyscallStats(modulenum, funcnum, time_now_d() - start);
+		ERROR_LOG(HLE, "Unable to write syscall profile to %s", filename);
+		return false;
 	}
+
+	hleProfilerResetFrame();
+	fprintf(file, "module,function,calls,total_ms,max_ms,avg_us\n");
+	for (size_t i = 0; i < profileTotal.size(); i++)
+	{
+		const HLEProfileEntry &entry = profileTotal[i];
+		if (entry.calls == 0)
+			continue;
+		double ms = hleProfilerTicksToMs(entry.ticks);
+		fprintf(file, "%s,%s,%u,%f,%f,%f\n", moduleDB[syscallModules[i]].name, syscallFuncs[i]->name, entry.calls, ms, hleProfilerTicksToMs(entry.maxTicks), ms * 1000.0 / entry.calls);
+	}
+	fclose(file);
+	return true;
 }
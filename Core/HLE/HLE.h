@@ -17,6 +17,8 @@
 
 #pragma once
 
+#include <vector>
+
 #include "../Globals.h"
 #include "../MIPS/MIPS.h"
 
@@ -31,6 +33,9 @@ enum {
 	HLE_NOT_IN_INTERRUPT = 1 << 8,
 	// Don't allow the call if dispatch or interrupts are disabled.
 	HLE_NOT_DISPATCH_SUSPENDED = 1 << 9,
+	// Never reschedules, runs callbacks, or uses the other hleAfterSyscall actions.
+	// The jit calls these directly.
+	HLE_CLEAN = 1 << 10,
 };
 
 struct HLEFunction
@@ -115,5 +120,30 @@ u32 GetNibByName(const char *module, const char *function);
 u32 GetSyscallOp(const char *module, u32 nib);
 void WriteSyscall(const char *module, u32 nib, u32 address);
 void CallSyscall(u32 op);
+// Resolves the op once, so the jit can skip the lookup in CallSyscall.
+// -1 if the op is invalid or the function is unimplemented.
+int GetSyscallIndex(u32 op);
+// The func itself if it can be called without any of CallSyscall's checks, or NULL.
+// Only the CallSyscall variants update the profiler, so use those while it's enabled.
+void *GetQuickSyscallFunc(int index);
+void CallSyscallWithFlags(int index);
+void CallSyscallWithoutFlags(int index);
+
+// Times every syscall while g_Config.bProfileSyscalls is set.
+struct HLEProfilerResult
+{
+	const char *name;
+	double ms;
+	double maxMs;
+	u32 calls;
+};
+
+// The slowest functions or modules this frame, by total time.
+std::vector<HLEProfilerResult> hleProfilerTopFunctions(size_t count);
+std::vector<HLEProfilerResult> hleProfilerTopModules(size_t count);
+double hleProfilerFrameMs();
+void hleProfilerResetFrame();
+// Totals since boot, one line per function.
+bool hleProfilerWriteCSV(const char *filename);
 void ResolveSyscall(const char *moduleName, u32 nib, u32 address);
 
@@ -87,8 +87,8 @@ const HLEFunction FakeSysCalls[] = {
 
 const HLEFunction UtilsForUser[] = 
 {
-	{0x91E4F6A7, WrapU_V<sceKernelLibcClock>, "sceKernelLibcClock"},
-	{0x27CC57F0, WrapU_U<sceKernelLibcTime>, "sceKernelLibcTime"},
+	{0x91E4F6A7, WrapU_V<sceKernelLibcClock>, "sceKernelLibcClock", HLE_CLEAN},
+	{0x27CC57F0, WrapU_U<sceKernelLibcTime>, "sceKernelLibcTime", HLE_CLEAN},
 	{0x71EC4271, WrapU_UU<sceKernelLibcGettimeofday>, "sceKernelLibcGettimeofday"},
 	{0xBFA98062, WrapI_UI<sceKernelDcacheInvalidateRange>, "sceKernelDcacheInvalidateRange"},
 	{0xC8186A58, 0, "sceKernelUtilsMd5Digest"},
@@ -0,0 +1,238 @@
+// Copyright (c) 2013- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#pragma once
+
+#include <map>
+#include <vector>
+
+#include "ChunkFile.h"
+#include "sceKernel.h"
+#include "sceKernelThread.h"
+
+// The threads waiting on a kernel object, in the order they should be woken.
+// FIFO queues wake in the order threads started waiting.  Priority queues wake the best
+// current priority first, and FIFO among equal priorities.
+//
+// T is whatever the object remembers about each waiting thread.  A plain SceUID works,
+// otherwise there must be a WaitQueueThreadID(const T &) overload to find the thread.
+// Priorities says where thread priorities come from, which tests can replace.
+
+inline SceUID WaitQueueThreadID(SceUID threadID)
+{
+	return threadID;
+}
+
+struct KernelThreadPriorities
+{
+	static u32 Get(SceUID threadID)
+	{
+		return __KernelGetThreadPrio(threadID);
+	}
+
+	// Changes whenever any thread's priority does.
+	static u32 Generation()
+	{
+		return __KernelThreadPriorityGeneration();
+	}
+};
+
+template <typename T, typename Priorities = KernelThreadPriorities>
+class KernelWaitQueue
+{
+	// Priority in the high bits, so that FIFO queues are ordered just by when they waited.
+	typedef u64 Key;
+	typedef std::map<Key, T> WaitMap;
+
+public:
+	class iterator
+	{
+	public:
+		iterator() {}
+		explicit iterator(typename WaitMap::iterator it) : it_(it) {}
+
+		T &operator *() const { return it_->second; }
+		T *operator ->() const { return &it_->second; }
+		iterator &operator ++() { ++it_; return *this; }
+		bool operator ==(const iterator &other) const { return it_ == other.it_; }
+		bool operator !=(const iterator &other) const { return it_ != other.it_; }
+
+	private:
+		typename WaitMap::iterator it_;
+		friend class KernelWaitQueue<T, Priorities>;
+	};
+
+	KernelWaitQueue() : usePriority_(false), nextOrder_(0), priorityGeneration_(0) {}
+
+	void SetUsePriority(bool usePriority)
+	{
+		usePriority_ = usePriority;
+		Resort(true);
+	}
+
+	bool empty() const
+	{
+		return waiting_.empty();
+	}
+
+	size_t size() const
+	{
+		return waiting_.size();
+	}
+
+	bool contains(SceUID threadID) const
+	{
+		return keys_.find(threadID) != keys_.end();
+	}
+
+	T *find(SceUID threadID)
+	{
+		typename std::map<SceUID, Key>::iterator it = keys_.find(threadID);
+		if (it == keys_.end())
+			return NULL;
+		return &waiting_[it->second];
+	}
+
+	// Adds to the end of its priority, unless it's already waiting.
+	void push(const T &info)
+	{
+		SceUID threadID = WaitQueueThreadID(info);
+		if (contains(threadID))
+			return;
+
+		Resort();
+		Key key = MakeKey(threadID, nextOrder_++);
+		// Most waits land at the end, so this is usually constant time.
+		waiting_.insert(waiting_.end(), std::make_pair(key, info));
+		keys_[threadID] = key;
+	}
+
+	bool remove(SceUID threadID)
+	{
+		typename std::map<SceUID, Key>::iterator it = keys_.find(threadID);
+		if (it == keys_.end())
+			return false;
+		waiting_.erase(it->second);
+		keys_.erase(it);
+		Compact();
+		return true;
+	}
+
+	T &front()
+	{
+		Resort();
+		return waiting_.begin()->second;
+	}
+
+	void pop_front()
+	{
+		Resort();
+		keys_.erase(WaitQueueThreadID(waiting_.begin()->second));
+		waiting_.erase(waiting_.begin());
+		Compact();
+	}
+
+	iterator begin()
+	{
+		Resort();
+		return iterator(waiting_.begin());
+	}
+
+	iterator end()
+	{
+		return iterator(waiting_.end());
+	}
+
+	iterator erase(iterator it)
+	{
+		keys_.erase(WaitQueueThreadID(it.it_->second));
+		waiting_.erase(it.it_++);
+		// Don't Compact() here, it's probably mid loop.
+		return it;
+	}
+
+	void clear()
+	{
+		waiting_.clear();
+		keys_.clear();
+		nextOrder_ = 0;
+	}
+
+	// Same format as a std::vector<T> in wake order, which is what these used to be.
+	void DoState(PointerWrap &p, T &defaultVal)
+	{
+		std::vector<T> list;
+		if (p.mode != p.MODE_READ)
+		{
+			for (iterator it = begin(); it != end(); ++it)
+				list.push_back(*it);
+		}
+		p.Do(list, defaultVal);
+
+		if (p.mode == p.MODE_READ)
+		{
+			clear();
+			// Threads may not be loaded yet, so keep the saved order until the next access.
+			bool usePriority = usePriority_;
+			usePriority_ = false;
+			for (size_t i = 0; i < list.size(); ++i)
+				push(list[i]);
+			usePriority_ = usePriority;
+			priorityGeneration_ = Priorities::Generation() - 1;
+		}
+	}
+
+private:
+	void Compact()
+	{
+		// Keeps the order from wrapping.
+		if (waiting_.empty())
+			nextOrder_ = 0;
+	}
+
+	Key MakeKey(SceUID threadID, u32 order) const
+	{
+		u32 priority = usePriority_ ? Priorities::Get(threadID) : 0;
+		return ((Key)priority << 32) | order;
+	}
+
+	// Thread priorities may have changed since they started waiting.  Stable, so equal
+	// priorities still wake in the order they waited.
+	void Resort(bool force = false)
+	{
+		u32 generation = Priorities::Generation();
+		if (!force && (!usePriority_ || priorityGeneration_ == generation))
+			return;
+		priorityGeneration_ = generation;
+
+		WaitMap old;
+		old.swap(waiting_);
+		for (typename WaitMap::iterator it = old.begin(); it != old.end(); ++it)
+		{
+			SceUID threadID = WaitQueueThreadID(it->second);
+			Key key = MakeKey(threadID, (u32)it->first);
+			waiting_.insert(waiting_.end(), std::make_pair(key, it->second));
+			keys_[threadID] = key;
+		}
+	}
+
+	WaitMap waiting_;
+	std::map<SceUID, Key> keys_;
+	bool usePriority_;
+	u32 nextOrder_;
+	u32 priorityGeneration_;
+};
@@ -0,0 +1,394 @@
+// Copyright (c) 2013- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <map>
+#include <cstring>
+
+#include "Core/HLE/HLE.h"
+#include "Core/HLE/ReplaceTables.h"
+#include "Core/HLE/sceKernel.h"
+#include "Core/Debugger/SymbolMap.h"
+#include "Core/MemMap.h"
+#include "Core/MIPS/MIPS.h"
+#include "Core/MIPS/MIPSAnalyst.h"
+#include "GPU/GPUInterface.h"
+#include "GPU/GPUState.h"
+
+#if defined(_M_IX86) || defined(_M_X64)
+#include <xmmintrin.h>
+#endif
+
+static std::map<u32, int> replacedFunctions;
+
+static bool IsValidRange(u32 addr, u32 size)
+{
+	if (size == 0)
+		return true;
+	if (!Memory::IsValidAddress(addr) || !Memory::IsValidAddress(addr + size - 1))
+		return false;
+	// Must also be contiguous on the host side.
+	return Memory::GetPointer(addr) + size - 1 == Memory::GetPointer(addr + size - 1);
+}
+
+static bool IsVRAM(u32 addr)
+{
+	addr &= ~0x40000000;
+	return addr >= PSP_GetVidMemBase() && addr < PSP_GetVidMemEnd();
+}
+
+static u64 ReadDoubleParamBits(int n)
+{
+	// Doubles are passed in a register pair, low word first.
+	return (u64)PARAM(n) | ((u64)PARAM(n + 1) << 32);
+}
+
+static double ReadDoubleParam(int n)
+{
+	u64 bits = ReadDoubleParamBits(n);
+	double d;
+	memcpy(&d, &bits, sizeof(d));
+	return d;
+}
+
+static void ReturnDouble(double d)
+{
+	u64 bits;
+	memcpy(&bits, &d, sizeof(bits));
+	currentMIPS->r[MIPS_REG_V0] = (u32)bits;
+	currentMIPS->r[MIPS_REG_V1] = (u32)(bits >> 32);
+}
+
+static int Replace_memcpy()
+{
+	u32 destPtr = PARAM(0);
+	u32 srcPtr = PARAM(1);
+	u32 bytes = PARAM(2);
+
+	// Some games copy forward over an overlapping range on purpose, so keep that working.
+	bool overlapForward = destPtr > srcPtr && destPtr < srcPtr + bytes;
+	if (!overlapForward && IsValidRange(destPtr, bytes) && IsValidRange(srcPtr, bytes))
+		memmove(Memory::GetPointer(destPtr), Memory::GetPointer(srcPtr), bytes);
+	else
+	{
+		for (u32 i = 0; i < bytes; ++i)
+			Memory::Write_U8(Memory::Read_U8(srcPtr + i), destPtr + i);
+	}
+
+	if (bytes != 0 && (IsVRAM(destPtr) || IsVRAM(srcPtr)))
+		gpu->UpdateMemory(destPtr, srcPtr, bytes);
+	RETURN(destPtr);
+	return 10 + bytes / 4;
+}
+
+static int Replace_memmove()
+{
+	u32 destPtr = PARAM(0);
+	u32 srcPtr = PARAM(1);
+	u32 bytes = PARAM(2);
+
+	if (IsValidRange(destPtr, bytes) && IsValidRange(srcPtr, bytes))
+		memmove(Memory::GetPointer(destPtr), Memory::GetPointer(srcPtr), bytes);
+	else if (destPtr > srcPtr)
+	{
+		for (u32 i = bytes; i > 0; --i)
+			Memory::Write_U8(Memory::Read_U8(srcPtr + i - 1), destPtr + i - 1);
+	}
+	else
+	{
+		for (u32 i = 0; i < bytes; ++i)
+			Memory::Write_U8(Memory::Read_U8(srcPtr + i), destPtr + i);
+	}
+
+	if (bytes != 0 && (IsVRAM(destPtr) || IsVRAM(srcPtr)))
+		gpu->UpdateMemory(destPtr, srcPtr, bytes);
+	RETURN(destPtr);
+	return 10 + bytes / 4;
+}
+
+static int Replace_memset()
+{
+	u32 destPtr = PARAM(0);
+	u8 value = (u8)PARAM(1);
+	u32 bytes = PARAM(2);
+
+	if (IsValidRange(destPtr, bytes))
+		memset(Memory::GetPointer(destPtr), value, bytes);
+	else
+	{
+		for (u32 i = 0; i < bytes; ++i)
+			Memory::Write_U8(value, destPtr + i);
+	}
+
+	if (bytes != 0 && IsVRAM(destPtr))
+		gpu->InvalidateCache(destPtr, bytes, GPU_INVALIDATE_HINT);
+	RETURN(destPtr);
+	return 10 + bytes / 4;
+}
+
+static int Replace_strlen()
+{
+	u32 srcPtr = PARAM(0);
+	u32 len = 0;
+	while (Memory::IsValidAddress(srcPtr + len) && Memory::Read_U8(srcPtr + len) != 0)
+		++len;
+	RETURN(len);
+	return 10 + len;
+}
+
+static int Replace_strcmp()
+{
+	u32 aPtr = PARAM(0);
+	u32 bPtr = PARAM(1);
+	u32 i = 0;
+	int result = 0;
+	while (Memory::IsValidAddress(aPtr + i) && Memory::IsValidAddress(bPtr + i))
+	{
+		u8 a = Memory::Read_U8(aPtr + i);
+		u8 b = Memory::Read_U8(bPtr + i);
+		result = (int)a - (int)b;
+		if (result != 0 || a == 0)
+			break;
+		++i;
+	}
+	RETURN(result);
+	return 10 + i * 2;
+}
+
+// libgcc's soft float always rounds to nearest and keeps denormals.  The host may not:
+// -ffast-math turns on flush to zero at startup, and the jit may leave another rounding mode.
+class SoftFloatScope
+{
+public:
+	SoftFloatScope()
+	{
+#if defined(_M_IX86) || defined(_M_X64)
+		savedState_ = _mm_getcsr();
+		// Round to nearest, no FTZ or DAZ, all exceptions masked.
+		_mm_setcsr(0x1F80);
+#elif defined(ARM) && defined(__VFP_FP__) && !defined(__SOFTFP__)
+		asm volatile ("vmrs %0, fpscr" : "=r"(savedState_));
+		// Round to nearest, and clear flush to zero and default NaN.
+		u32 fpscr = savedState_ & ~((3 << 22) | (1 << 24) | (1 << 25));
+		asm volatile ("vmsr fpscr, %0" : : "r"(fpscr));
+#endif
+	}
+	~SoftFloatScope()
+	{
+#if defined(_M_IX86) || defined(_M_X64)
+		_mm_setcsr(savedState_);
+#elif defined(ARM) && defined(__VFP_FP__) && !defined(__SOFTFP__)
+		asm volatile ("vmsr fpscr, %0" : : "r"(savedState_));
+#endif
+	}
+
+private:
+	u32 savedState_;
+};
+
+// The FPU only handles singles, so these are the doubles from libgcc.
+// volatile keeps the math inside the scope, the compiler doesn't know it depends on it.
+static int Replace_adddf3()
+{
+	SoftFloatScope scope;
+	volatile double a = ReadDoubleParam(0), b = ReadDoubleParam(2);
+	volatile double result = a + b;
+	ReturnDouble(result);
+	return 30;
+}
+
+static int Replace_subdf3()
+{
+	SoftFloatScope scope;
+	volatile double a = ReadDoubleParam(0), b = ReadDoubleParam(2);
+	volatile double result = a - b;
+	ReturnDouble(result);
+	return 30;
+}
+
+static int Replace_muldf3()
+{
+	SoftFloatScope scope;
+	volatile double a = ReadDoubleParam(0), b = ReadDoubleParam(2);
+	volatile double result = a * b;
+	ReturnDouble(result);
+	return 40;
+}
+
+static int Replace_divdf3()
+{
+	SoftFloatScope scope;
+	volatile double a = ReadDoubleParam(0), b = ReadDoubleParam(2);
+	volatile double result = a / b;
+	ReturnDouble(result);
+	return 80;
+}
+
+static int Replace_floatsidf()
+{
+	ReturnDouble((double)(s32)PARAM(0));
+	return 20;
+}
+
+static int Replace_fixdfsi()
+{
+	// Saturate like libgcc rather than hitting host undefined behavior.
+	// Classify using the bits, fast math may assume NaN and infinity never happen.
+	u64 bits = ReadDoubleParamBits(0);
+	int exponent = (int)((bits >> 52) & 0x7FF);
+	bool negative = (bits >> 63) != 0;
+	if (exponent == 0x7FF && (bits & 0x000FFFFFFFFFFFFFULL) != 0)
+		RETURN(0);
+	else if (exponent >= 1023 + 31)
+		RETURN(negative ? 0x80000000 : 0x7FFFFFFF);
+	else
+		RETURN((u32)(s32)ReadDoubleParam(0));
+	return 20;
+}
+
+static const ReplacementTableEntry entries[] =
+{
+	{"memcpy", &Replace_memcpy},
+	{"memmove", &Replace_memmove},
+	{"memset", &Replace_memset},
+	{"strlen", &Replace_strlen},
+	{"strcmp", &Replace_strcmp},
+	{"__adddf3", &Replace_adddf3},
+	{"__subdf3", &Replace_subdf3},
+	{"__muldf3", &Replace_muldf3},
+	{"__divdf3", &Replace_divdf3},
+	{"__floatsidf", &Replace_floatsidf},
+	{"__fixdfsi", &Replace_fixdfsi},
+};
+
+struct ReplacementHashEntry
+{
+	u32 hash;
+	u32 size;
+	const char *name;
+};
+
+// MIPSAnalyst::HashFunction() of the above, used when the game has no symbols.
+// These are the plain byte loop versions, as in a libc built for size.  Run with verbose
+// HLE logging to find new ones.
+static const ReplacementHashEntry hashEntries[] =
+{
+	{0x6105270f, 40, "memcpy"},
+	{0x3ad05ca4, 32, "memset"},
+	{0xca46eb6f, 44, "strlen"},
+	{0xfb15bba8, 32, "strcmp"},
+	{0, 0, NULL},
+};
+
+void Replacement_Init()
+{
+	replacedFunctions.clear();
+}
+
+void Replacement_Clear()
+{
+	replacedFunctions.clear();
+}
+
+void Replacement_Shutdown()
+{
+	replacedFunctions.clear();
+}
+
+int Replacement_FindByName(const char *name)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(entries); ++i)
+	{
+		if (strcmp(name, entries[i].name) == 0)
+			return (int)i;
+	}
+	return -1;
+}
+
+static int FindByHash(u32 hash, u32 size)
+{
+	for (const ReplacementHashEntry *entry = hashEntries; entry->name != NULL; ++entry)
+	{
+		if (entry->hash == hash && entry->size == size)
+			return Replacement_FindByName(entry->name);
+	}
+	return -1;
+}
+
+// The jit and the interpreter check for replacements when they decode a block, so blocks at the address are stale.
+static void InvalidateReplacedBlock(u32 addr)
+{
+	currentMIPS->InvalidateICache(addr, 4);
+}
+
+void Replacement_ScanRange(u32 startAddr, u32 endAddr)
+{
+	for (int i = 0; i < symbolMap.GetNumSymbols(); ++i)
+	{
+		u32 addr = symbolMap.GetSymbolAddr(i);
+		u32 size = symbolMap.GetSymbolSize(i);
+		if (symbolMap.GetSymbolType(i) != ST_FUNCTION || addr < startAddr || addr >= endAddr || size == 0)
+			continue;
+
+		const char *name = symbolMap.GetSymbolName(i);
+		int index = Replacement_FindByName(name);
+		if (index < 0)
+		{
+			u32 hash = MIPSAnalyst::HashFunction(addr, size);
+			index = FindByHash(hash, size);
+			if (index < 0)
+			{
+				VERBOSE_LOG(HLE, "Function %s at %08x: hash=%08x size=%d", name, addr, hash, size);
+				continue;
+			}
+		}
+
+		INFO_LOG(HLE, "Replacing %s at %08x with native %s", name, addr, entries[index].name);
+		replacedFunctions[addr] = index;
+		InvalidateReplacedBlock(addr);
+	}
+}
+
+void Replacement_ClearRange(u32 startAddr, u32 size)
+{
+	std::map<u32, int>::iterator it = replacedFunctions.lower_bound(startAddr);
+	while (it != replacedFunctions.end() && it->first < startAddr + size)
+	{
+		InvalidateReplacedBlock(it->first);
+		replacedFunctions.erase(it++);
+	}
+}
+
+const ReplacementTableEntry *Replacement_GetEntry(int index)
+{
+	if (index < 0 || index >= (int)ARRAY_SIZE(entries))
+		return NULL;
+	return &entries[index];
+}
+
+int Replacement_GetIndex(u32 address)
+{
+	if (replacedFunctions.empty())
+		return -1;
+	std::map<u32, int>::const_iterator it = replacedFunctions.find(address);
+	return it != replacedFunctions.end() ? it->second : -1;
+}
+
+int Replacement_Call(int index)
+{
+	kernelStats.numReplacedCalls++;
+	return entries[index].replaceFunc();
+}
@@ -0,0 +1,47 @@
+// Copyright (c) 2013- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#pragma once
+
+#include "../Globals.h"
+
+// Games statically link libc and libgcc, so memcpy and friends run as emulated code.
+// When one of those functions is recognized (by symbol name or by the hash of its
+// body), the JIT and interpreter call a native version instead.
+
+// Takes its args from currentMIPS, and returns the number of cycles to charge.
+typedef int (*ReplaceFunc)();
+
+struct ReplacementTableEntry
+{
+	const char *name;
+	ReplaceFunc replaceFunc;
+};
+
+void Replacement_Init();
+void Replacement_Shutdown();
+
+// Looks for known functions among the symbols within [startAddr, endAddr).
+void Replacement_ScanRange(u32 startAddr, u32 endAddr);
+void Replacement_ClearRange(u32 startAddr, u32 size);
+void Replacement_Clear();
+
+int Replacement_FindByName(const char *name);
+const ReplacementTableEntry *Replacement_GetEntry(int index);
+// Returns -1 if the function at address isn't replaced.
+int Replacement_GetIndex(u32 address);
+int Replacement_Call(int index);
@@ -15,11 +15,12 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
+#include <algorithm>
+
 #include "__sceAudio.h"
 #include "sceAudio.h"
 #include "sceKernel.h"
 #include "sceKernelThread.h"
-#include "base/mutex.h"
 #include "CommonTypes.h"
 #include "../CoreTiming.h"
 #include "../MemMap.h"
@@ -27,10 +28,14 @@
 #include "../Config.h"
 #include "ChunkFile.h"
 #include "FixedSizeQueue.h"
+#include "Core/HW/StereoResampler.h"
 #include "Common/Thread.h"
 
-// Should be used to lock anything related to the outAudioQueue.
-recursive_mutex section;
+#if defined(_M_SSE) || defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(ARM) && defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
 
 int eventAudioUpdate = -1;
 int eventHostAudioUpdate = -1;
@@ -47,9 +52,17 @@ const int audioHostIntervalUs = (int)(1000000ULL * hostAttemptBlockSize / hwSamp
 const int chanQueueMaxSizeFactor = 2;
 const int chanQueueMinSizeFactor = 1;
 
-// TODO: Need to replace this with something lockless. Mutexes in the audio pipeline
-// is bad mojo.
-FixedSizeQueue<s16, hostAttemptBlockSize * 16> outAudioQueue;
+// Pushed to by __AudioUpdate() on the emulator thread, and popped by __AudioMix() on the
+// host's audio thread.  No locks, since that thread may be realtime.
+LockFreeRingQueue<s16, hostAttemptBlockSize * 16> outAudioQueue;
+
+// Only touched by __AudioMix(), when the host isn't running at hwSampleRate.
+static StereoResampler resampler;
+static s16 resampleInput[StereoResampler::HISTORY_FRAMES * 2];
+// Smoothed fill of outAudioQueue in frames, as seen by the host.
+static double resampleFillAverage = 0.0;
+// At most this far from the nominal rate, which is well under what anyone can hear.
+const double maxResampleAdjust = 0.005;
 
 static inline s16 clamp_s16(int i) {
 	if (i > 32767)
@@ -63,6 +76,58 @@ static inline s16 adjustvolume(s16 sample, int vol) {
 	return clamp_s16((sample * vol) >> 15);
 }
 
+// Adds a channel's samples into mix, or just copies them for the first channel.
+static void MixChannelSamples(s32 *mix, const s16 *samples, size_t count, bool first) {
+	size_t i = 0;
+#if defined(_M_SSE) || defined(__SSE2__)
+	for (; i + 8 <= count; i += 8) {
+		__m128i s = _mm_loadu_si128((const __m128i *)(samples + i));
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16);
+		if (!first) {
+			lo = _mm_add_epi32(lo, _mm_loadu_si128((const __m128i *)(mix + i)));
+			hi = _mm_add_epi32(hi, _mm_loadu_si128((const __m128i *)(mix + i + 4)));
+		}
+		_mm_storeu_si128((__m128i *)(mix + i), lo);
+		_mm_storeu_si128((__m128i *)(mix + i + 4), hi);
+	}
+#elif defined(ARM) && defined(__ARM_NEON__)
+	for (; i + 8 <= count; i += 8) {
+		int16x8_t s = vld1q_s16(samples + i);
+		if (first) {
+			vst1q_s32(mix + i, vmovl_s16(vget_low_s16(s)));
+			vst1q_s32(mix + i + 4, vmovl_s16(vget_high_s16(s)));
+		} else {
+			vst1q_s32(mix + i, vaddw_s16(vld1q_s32(mix + i), vget_low_s16(s)));
+			vst1q_s32(mix + i + 4, vaddw_s16(vld1q_s32(mix + i + 4), vget_high_s16(s)));
+		}
+	}
+#endif
+	if (first) {
+		for (; i < count; i++)
+			mix[i] = samples[i];
+	} else {
+		for (; i < count; i++)
+			mix[i] += samples[i];
+	}
+}
+
+static void ClampSamples(s16 *out, const s32 *mix, size_t count) {
+	size_t i = 0;
+#if defined(_M_SSE) || defined(__SSE2__)
+	for (; i + 8 <= count; i += 8) {
+		__m128i lo = _mm_loadu_si128((const __m128i *)(mix + i));
+		__m128i hi = _mm_loadu_si128((const __m128i *)(mix + i + 4));
+		_mm_storeu_si128((__m128i *)(out + i), _mm_packs_epi32(lo, hi));
+	}
+#elif defined(ARM) && defined(__ARM_NEON__)
+	for (; i + 8 <= count; i += 8)
+		vst1q_s16(out + i, vcombine_s16(vqmovn_s32(vld1q_s32(mix + i)), vqmovn_s32(vld1q_s32(mix + i + 4))));
+#endif
+	for (; i < count; i++)
+		out[i] = clamp_s16(mix[i]);
+}
+
 void hleAudioUpdate(u64 userdata, int cyclesLate)
 {
 	__AudioUpdate();
@@ -100,10 +165,7 @@ void __AudioDoState(PointerWrap &p)
 
 	p.Do(mixFrequency);
 
-	{
-		lock_guard guard(section);
-		outAudioQueue.DoState(p);
-	}
+	outAudioQueue.DoState(p);
 
 	int chanCount = ARRAY_SIZE(chans);
 	p.Do(chanCount);
@@ -289,22 +351,10 @@ void __AudioUpdate() {
 
 		chans[i].sampleQueue.popPointers(hwBlockSize * 2, &buf1, &sz1, &buf2, &sz2);
 
-		if (firstChannel) {
-			for (size_t s = 0; s < sz1; s++)
-				mixBuffer[s] = buf1[s];
-			if (buf2) {
-				for (size_t s = 0; s < sz2; s++)
-					mixBuffer[s + sz1] = buf2[s];
-			}
-			firstChannel = false;
-		} else {
-			for (size_t s = 0; s < sz1; s++)
-				mixBuffer[s] += buf1[s];
-			if (buf2) {
-				for (size_t s = 0; s < sz2; s++)
-					mixBuffer[s + sz1] += buf2[s];
-			}
-		}
+		MixChannelSamples(mixBuffer, buf1, sz1, firstChannel);
+		if (buf2)
+			MixChannelSamples(mixBuffer + sz1, buf2, sz2, firstChannel);
+		firstChannel = false;
 	}
 
 	if (firstChannel) {
@@ -312,51 +362,74 @@ void __AudioUpdate() {
 	}
 
 	if (g_Config.bEnableSound) {
-		lock_guard guard(section);
-		if (outAudioQueue.room() >= hwBlockSize * 2) {
-			s16 *buf1 = 0, *buf2 = 0;
-			size_t sz1, sz2;
-			outAudioQueue.pushPointers(hwBlockSize * 2, &buf1, &sz1, &buf2, &sz2);
-			for (size_t s = 0; s < sz1; s++)
-				buf1[s] = clamp_s16(mixBuffer[s]);
-			if (buf2) {
-				for (size_t s = 0; s < sz2; s++)
-					buf2[s] = clamp_s16(mixBuffer[s + sz1]);
-			}
-		} else {
+		s16 outBuffer[hwBlockSize * 2];
+		ClampSamples(outBuffer, mixBuffer, hwBlockSize * 2);
+		if (!outAudioQueue.push(outBuffer, hwBlockSize * 2)) {
 			// This happens quite a lot. There's still something slightly off
 			// about the amount of audio we produce.
-			DEBUG_LOG(HLE, "Audio outbuffer overrun! room = %i / %i", outAudioQueue.room(), (u32)outAudioQueue.capacity());
+			DEBUG_LOG(HLE, "Audio outbuffer overrun! room = %i / %i", (int)outAudioQueue.room(), (u32)outAudioQueue.capacity());
+		}
+	}
+}
+
+void __AudioGetDebugStats(u32 &underruns, u32 &overruns)
+{
+	underruns = outAudioQueue.underruns();
+	overruns = outAudioQueue.overruns();
+}
+
+static int __AudioMixResampled(short *outstereo, int numFrames, int sampleRate)
+{
+	resampler.SetRates(hwSampleRate, sampleRate);
+
+	// The emulator and the host clocks drift apart, so steer toward keeping the queue half
+	// full: consume a little faster when it's filling up, and a little slower when draining.
+	const double targetFill = outAudioQueue.capacity() / 4.0;
+	resampleFillAverage += (outAudioQueue.size() / 2.0 - resampleFillAverage) * 0.05;
+	// Full correction when a quarter of the queue away from the target.
+	double adjust = (resampleFillAverage - targetFill) / (targetFill / 2.0) * maxResampleAdjust;
+	adjust = std::max(-maxResampleAdjust, std::min(maxResampleAdjust, adjust));
+	double step = resampler.NominalStep() * (1.0 + adjust);
+
+	// The resampler only holds so much input, so big requests go in pieces.
+	int done = 0;
+	while (done < numFrames) {
+		int frames = std::min(numFrames - done, resampler.MaxOutputFrames(step));
+		int needed = resampler.InputFramesNeeded(frames, step);
+		size_t popped = needed > 0 ? outAudioQueue.pop(resampleInput, needed * 2) : 0;
+		if (popped > 0)
+			resampler.AddInput(resampleInput, (int)popped / 2);
+		resampler.Resample(outstereo + done * 2, frames, step);
+
+		if (popped < (size_t)needed * 2) {
+			// The rest is silence, like the pass-through path gives.
+			memset(outstereo + (done + frames) * 2, 0, (numFrames - done - frames) * 2 * sizeof(s16));
+			int underrun = done + (int)((s64)frames * popped / (needed * 2));
+			VERBOSE_LOG(HLE, "Audio out buffer UNDERRUN at %i of %i", underrun, numFrames);
+			return underrun;
 		}
+		done += frames;
 	}
+	return numFrames;
 }
 
 // numFrames is number of stereo frames.
 // This is called from *outside* the emulator thread.
-int __AudioMix(short *outstereo, int numFrames)
+int __AudioMix(short *outstereo, int numFrames, int sampleRate)
 {
-	// TODO: if mixFrequency != the actual output frequency, resample!
+	if (sampleRate != hwSampleRate && sampleRate > 0)
+		return __AudioMixResampled(outstereo, numFrames, sampleRate);
+
 	int underrun = -1;
-	s16 sampleL = 0;
-	s16 sampleR = 0;
 
-	const s16 *buf1 = 0, *buf2 = 0;
-	size_t sz1, sz2;
-	{
-		lock_guard guard(section);
-		outAudioQueue.popPointers(numFrames * 2, &buf1, &sz1, &buf2, &sz2);
-		memcpy(outstereo, buf1, sz1 * sizeof(s16));
-		if (buf2) {
-			memcpy(outstereo + sz1, buf2, sz2 * sizeof(s16));
-		}
-	}
+	size_t popped = outAudioQueue.pop(outstereo, numFrames * 2);
 
-	int remains = (int)(numFrames * 2 - sz1 - sz2);
+	int remains = (int)(numFrames * 2 - popped);
 	if (remains > 0)
-		memset(outstereo + numFrames * 2 - remains, 0, remains);
+		memset(outstereo + popped, 0, remains * sizeof(s16));
 
-	if (sz1 + sz2 < (size_t)numFrames) {
-		underrun = (int)(sz1 + sz2) / 2;
+	if (popped < (size_t)numFrames) {
+		underrun = (int)popped / 2;
 		VERBOSE_LOG(HLE, "Audio out buffer UNDERRUN at %i of %i", underrun, numFrames);
 	}
 	return underrun >= 0 ? underrun : numFrames;
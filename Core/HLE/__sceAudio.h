@@ -32,4 +32,7 @@ u32 __AudioEnqueue(AudioChannel &chan, int chanNum, bool blocking);
 void __AudioWakeThreads(AudioChannel &chan, int result, int step);
 void __AudioWakeThreads(AudioChannel &chan, int result);
 
-int __AudioMix(short *outstereo, int numSamples);
+// Converts from 44100 hz when the host runs at a different sampleRate.
+int __AudioMix(short *outstereo, int numFrames, int sampleRate = 44100);
+// How many times the host ran out of samples, and how many blocks were dropped for lack of room.
+void __AudioGetDebugStats(u32 &underruns, u32 &overruns);
@@ -79,7 +79,9 @@ extern "C" {
 }
 #endif // USE_FFMPEG
 
+#include "base/timeutil.h"
 #include "Core/HW/atrac3plus.h"
+#include "Core/HW/AtracDecodeAhead.h"
 
 struct InputBuffer {
 	u32 addr;
@@ -105,7 +107,7 @@ struct AtracLoopInfo {
 };
 
 struct Atrac {
-	Atrac() : atracID(-1), data_buf(0), decodePos(0), decodeEnd(0), atracChannels(2), atracOutputChannels(2),
+	Atrac() : atracID(-1), data_buf(0), decodePos(0), lastFramePos(-1), decodeEnd(0), atracChannels(2), atracOutputChannels(2),
 		atracBitrate(64), atracBytesPerFrame(0), atracBufSize(0),
 		currentSample(0), endSample(-1), firstSampleoffset(0), loopinfoNum(0), loopNum(0) {
 		memset(&first, 0, sizeof(first));
@@ -127,6 +129,8 @@ struct Atrac {
 	}
 
 	void CleanStuff() {
+		decodeAhead.Stop();
+
 #ifdef USE_FFMPEG
 		ReleaseFFMPEGContext();
 #endif // USE_FFMPEG
@@ -143,6 +147,12 @@ struct Atrac {
 	}
 
 	void DoState(PointerWrap &p) {
+		// The data and decoder may be replaced below.
+		if (p.mode == p.MODE_READ) {
+			decodeAhead.Flush();
+			lastFramePos = -1;
+		}
+
 		p.Do(atracChannels);
 		p.Do(atracOutputChannels);
 
@@ -192,6 +202,14 @@ struct Atrac {
 		return (u32)(firstSampleoffset + sample / atracSamplesPerFrame * atracBytesPerFrame );
 	}
 
+	// Where the plugin decode path goes after the frame at sample, if nothing seeks.
+	int getNextDecodeSample(int sample) {
+		int next = sample + ATRAC3PLUS_MAX_SAMPLES;
+		if (loopNum != 0 && next + (int)ATRAC3PLUS_MAX_SAMPLES > loopEndSample)
+			next = loopStartSample;
+		return next;
+	}
+
 	int getRemainFrames() {
 		// games would like to add atrac data when it wants.
 		// Do not try to guess when it want to add data.
@@ -213,6 +231,8 @@ struct Atrac {
 	u8* data_buf;
 
 	u32 decodePos;
+	// Where the last frame given to the game was, to bring the decoder back to it.  -1 if none.
+	int lastFramePos;
 	u32 decodeEnd;
 
 	u16 atracChannels;
@@ -240,6 +260,7 @@ struct Atrac {
 
 	Atrac3plus_Decoder::BufferQueue sampleQueue;
 	void* decoder_context;
+	AtracDecodeAhead decodeAhead;
 
 	PSPPointer<SceAtracId> atracContext;
 
@@ -283,9 +304,20 @@ static bool atracInited = true;
 static Atrac *atracIDs[PSP_NUM_ATRAC_IDS];
 static int atracIDTypes[PSP_NUM_ATRAC_IDS];
 
+// Just for the debug stats.
+static u32 atracDecodeAheadHits;
+static u32 atracDecodeAheadMisses;
+// Longest a single frame took to decode, and longest the emulator waited on one.
+static double atracWorstDecodeTime;
+static double atracWorstStallTime;
+
 void __AtracInit() {
 	atracInited = true;
 	memset(atracIDs, 0, sizeof(atracIDs));
+	atracDecodeAheadHits = 0;
+	atracDecodeAheadMisses = 0;
+	atracWorstDecodeTime = 0.0;
+	atracWorstStallTime = 0.0;
 
 	// Start with 2 of each in this order.
 	atracIDTypes[0] = PSP_MODE_AT_3_PLUS;
@@ -329,6 +361,13 @@ void __AtracShutdown() {
 	Atrac3plus_Decoder::Shutdown();
 }
 
+void __AtracGetDebugStats(u32 &hits, u32 &misses, double &worstDecodeMs, double &worstStallMs) {
+	hits = atracDecodeAheadHits;
+	misses = atracDecodeAheadMisses;
+	worstDecodeMs = atracWorstDecodeTime * 1000.0;
+	worstStallMs = atracWorstStallTime * 1000.0;
+}
+
 Atrac *getAtrac(int atracID) {
 	if (atracID < 0 || atracID >= PSP_NUM_ATRAC_IDS) {
 		return NULL;
@@ -552,6 +591,55 @@ u32 sceAtracAddStreamData(int atracID, u32 bytesToAdd)
 	return 0;
 }
 
+// The worker decoded frames that were never played, so the decoder's state is from the
+// wrong frames.  Start it over, and run the last frame played back through it.
+static void __AtracResyncDecoder(Atrac *atrac)
+{
+	static u8 discard[AtracDecodeAhead::MAX_FRAME_BYTES];
+	Atrac3plus_Decoder::CloseContext(&atrac->decoder_context);
+	atrac->decoder_context = Atrac3plus_Decoder::OpenContext();
+	if (atrac->decoder_context && atrac->lastFramePos >= 0 && (u32)atrac->lastFramePos + atrac->atracBytesPerFrame <= atrac->first.size) {
+		int outbytes = 0;
+		Atrac3plus_Decoder::Decode(atrac->decoder_context, atrac->data_buf + atrac->lastFramePos, atrac->atracBytesPerFrame, &outbytes, discard);
+	}
+}
+
+// Decodes the frame at currentSample, which is usually already done on the decode-ahead worker.
+static void __AtracDecodeFrame(Atrac *atrac, u8 *outbuf, int *outbytes)
+{
+	double startTime = real_time_now();
+	double decodeTime;
+	if (atrac->decodeAhead.Take(atrac->currentSample, outbuf, outbytes, &decodeTime)) {
+		atracDecodeAheadHits++;
+	} else {
+		if (atrac->decodeAhead.TakeContextDirty())
+			__AtracResyncDecoder(atrac);
+		Atrac3plus_Decoder::Decode(atrac->decoder_context, atrac->data_buf + atrac->decodePos, atrac->atracBytesPerFrame, outbytes, outbuf);
+		decodeTime = real_time_now() - startTime;
+		atracDecodeAheadMisses++;
+	}
+	atrac->lastFramePos = (int)atrac->decodePos;
+	atracWorstDecodeTime = std::max(atracWorstDecodeTime, decodeTime);
+	atracWorstStallTime = std::max(atracWorstStallTime, real_time_now() - startTime);
+}
+
+// Tops up the worker with the frames that will play next, as far as the data is buffered.
+static void __AtracQueueDecodeAhead(Atrac *atrac)
+{
+	AtracDecodeAhead &ahead = atrac->decodeAhead;
+	int queued = ahead.QueuedFrames();
+	int sample = queued == 0 ? atrac->currentSample : atrac->getNextDecodeSample(ahead.LastQueuedSample());
+	for (; queued < AtracDecodeAhead::MAX_FRAMES; ++queued) {
+		if (sample >= atrac->endSample && atrac->loopNum == 0)
+			break;
+		u32 pos = atrac->getDecodePosBySample(sample);
+		if (pos + atrac->atracBytesPerFrame > atrac->first.size)
+			break;
+		ahead.Queue(atrac->decoder_context, sample, atrac->data_buf + pos, atrac->atracBytesPerFrame);
+		sample = atrac->getNextDecodeSample(sample);
+	}
+}
+
 u32 _AtracDecodeData(int atracID, u8* outbuf, u32 *SamplesNum, u32* finish, int *remains)
 {
 	Atrac *atrac = getAtrac(atracID);
@@ -619,7 +707,7 @@ u32 _AtracDecodeData(int atracID, u8* outbuf, u32 *SamplesNum, u32* finish, int
 					int inbytes = std::max((int)atrac->first.size - (int)atrac->decodePos, 0);
 					inbytes = std::min(inbytes, (int)atrac->atracBytesPerFrame);
 					if (inbytes > 0 && inbytes == atrac->atracBytesPerFrame) {
-						Atrac3plus_Decoder::Decode(atrac->decoder_context, atrac->data_buf + atrac->decodePos, inbytes, &decodebytes, buf);
+						__AtracDecodeFrame(atrac, buf, &decodebytes);
 						atrac->sampleQueue.push(buf, decodebytes);
 					}
 				}
@@ -671,6 +759,9 @@ u32 _AtracDecodeData(int atracID, u8* outbuf, u32 *SamplesNum, u32* finish, int
 				(numSamples == 0 && atrac->first.size >= atrac->first.filesize))
 				finishFlag = 1;
 
+			if (atrac->decoder_context)
+				__AtracQueueDecodeAhead(atrac);
+
 			*finish = finishFlag;
 			*remains = atrac->getRemainFrames();
 		}
@@ -939,6 +1030,7 @@ u32 sceAtracResetPlayPosition(int atracID, int sample, int bytesWrittenFirstBuf,
 	} else {
 		if (bytesWrittenFirstBuf > 0)
 			sceAtracAddStreamData(atracID, bytesWrittenFirstBuf);
+		atrac->decodeAhead.Flush();
 		atrac->currentSample = sample;
 #ifdef USE_FFMPEG
 		if (atrac->codeType == PSP_MODE_AT_3 && atrac->pCodecCtx) {
@@ -1238,6 +1330,9 @@ u32 sceAtracSetLoopNum(int atracID, int loopNum)
 	if (atrac) {
 		if (atrac->loopinfoNum == 0)
 			return ATRAC_ERROR_UNSET_PARAM;
+		// Frames were queued following the old loop.
+		if (atrac->loopNum != loopNum)
+			atrac->decodeAhead.Flush();
 		atrac->loopNum = loopNum;
 		if (loopNum != 0 && atrac->loopinfoNum == 0) {
 			// Just loop the whole audio
@@ -1687,6 +1782,7 @@ int sceAtracLowLevelDecode(int atracID, u32 sourceAddr, u32 sourceBytesConsumedA
 			static u8 buf[0x8000];
 			if (sourcebytes > 0) {
 				int decodebytes = 0;
+				atrac->decodeAhead.Flush();
 				Atrac3plus_Decoder::Decode(atrac->decoder_context, Memory::GetPointer(sourceAddr), sourcebytes, &decodebytes, buf);
 				atrac->sampleQueue.push(buf, decodebytes);
 			}
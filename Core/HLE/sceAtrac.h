@@ -25,6 +25,8 @@ void Register_sceAtrac3plus();
 void __AtracInit();
 void __AtracDoState(PointerWrap &p);
 void __AtracShutdown();
+// How often decode-ahead had the frame ready, and the worst decode time vs. the worst wait for one.
+void __AtracGetDebugStats(u32 &hits, u32 &misses, double &worstDecodeMs, double &worstStallMs);
 
 typedef struct
 {
@@ -30,6 +30,8 @@
 #include "../MIPS/MIPS.h"
 #include "../HLE/HLE.h"
 #include "sceAudio.h"
+#include "__sceAudio.h"
+#include "sceAtrac.h"
 #include "../Host.h"
 #include "../Config.h"
 #include "../System.h"
@@ -94,6 +96,15 @@ static int height;
 // Don't include this in the state, time increases regardless of state.
 static double curFrameTime;
 static double nextFrameTime;
+// When the work for the current frame started, after any throttling.
+static double frameWorkStart;
+static double lastDisplayListTime;
+// Running averages for frames that were drawn, in seconds.
+static double renderTimeEstimate;
+static double emulationTimeEstimate;
+// Recent frameskip decisions, for the debug stats.  'S' is skipped, '.' drawn.
+static char frameSkipHistory[61];
+static int frameSkipHistoryPos;
 
 static u64 frameStartTicks;
 const float hCountPerVblank = 285.72f; // insprired by jpcsp
@@ -154,6 +165,13 @@ void __DisplayInit() {
 	vCount = 0;
 	curFrameTime = 0.0;
 	nextFrameTime = 0.0;
+	frameWorkStart = 0.0;
+	lastDisplayListTime = 0.0;
+	renderTimeEstimate = 0.0;
+	emulationTimeEstimate = 0.0;
+	memset(frameSkipHistory, ' ', sizeof(frameSkipHistory) - 1);
+	frameSkipHistory[sizeof(frameSkipHistory) - 1] = '\0';
+	frameSkipHistoryPos = 0;
 
 	fpsHistoryPos = 0;
 	fpsHistoryValid = 0;
@@ -265,12 +283,48 @@ void __DisplayGetDebugStats(char stats[2048])
 
 	float vertexAverageCycles = gpuStats.numVertsSubmitted > 0 ? (float)gpuStats.vertexGPUCycles / (float)gpuStats.numVertsSubmitted : 0.0f;
 
-	sprintf(stats,
+	char syscallStats[1024];
+	syscallStats[0] = '\0';
+	size_t pos = 0;
+	if (!g_Config.bProfileSyscalls)
+		pos += snprintf(syscallStats, sizeof(syscallStats), "  (syscall profiler off, see ProfileSyscalls)\n");
+	const std::vector<HLEProfilerResult> topFuncs = hleProfilerTopFunctions(5);
+	for (size_t i = 0; i < topFuncs.size() && pos < sizeof(syscallStats); ++i)
+		pos += snprintf(syscallStats + pos, sizeof(syscallStats) - pos, "  %s: %0.2f ms, %u calls, slowest %0.3f ms\n", topFuncs[i].name, topFuncs[i].ms, topFuncs[i].calls, topFuncs[i].maxMs);
+	const std::vector<HLEProfilerResult> topModules = hleProfilerTopModules(3);
+	for (size_t i = 0; i < topModules.size() && pos < sizeof(syscallStats); ++i)
+		pos += snprintf(syscallStats + pos, sizeof(syscallStats) - pos, "  [%s]: %0.2f ms, %u calls\n", topModules[i].name, topModules[i].ms, topModules[i].calls);
+
+	char frameSkipStats[256];
+	frameSkipStats[0] = '\0';
+	if (g_Config.iFrameSkip != 0) {
+		// Oldest first.
+		char history[sizeof(frameSkipHistory)];
+		size_t split = sizeof(frameSkipHistory) - 1 - frameSkipHistoryPos;
+		memcpy(history, frameSkipHistory + frameSkipHistoryPos, split);
+		memcpy(history + split, frameSkipHistory, frameSkipHistoryPos);
+		history[sizeof(history) - 1] = '\0';
+		snprintf(frameSkipStats, sizeof(frameSkipStats), "Frameskip (%s, max %d): render %0.2f ms, emulation %0.2f ms\n  [%s]\n",
+			g_Config.bAutoFrameSkip ? "auto" : "fixed", g_Config.iFrameSkip,
+			renderTimeEstimate * 1000.0, emulationTimeEstimate * 1000.0, history);
+	}
+
+	u32 audioUnderruns, audioOverruns;
+	__AudioGetDebugStats(audioUnderruns, audioOverruns);
+	u32 atracHits, atracMisses;
+	double atracWorstDecodeMs, atracWorstStallMs;
+	__AtracGetDebugStats(atracHits, atracMisses, atracWorstDecodeMs, atracWorstStallMs);
+
+	snprintf(stats, 2048,
 		"Frames: %i\n"
+		"%s"
+		"Audio underruns: %u, overruns: %u\n"
+		"Atrac decode-ahead: %u hits, %u misses, worst decode %0.2f ms, worst wait %0.2f ms\n"
 		"DL processing time: %0.2f ms\n"
 		"Kernel processing time: %0.2f ms\n"
-		"Slowest syscall: %s : %0.2f ms\n"
-		"Most active syscall: %s : %0.2f ms\n"
+		"%s"
+		"Replaced function calls: %i\n"
+		"Spin loops skipped: %0.2f ms\n"
 		"Draw calls: %i, flushes %i\n"
 		"Cached Draw calls: %i\n"
 		"Num Tracked Vertex Arrays: %i\n"
@@ -285,12 +339,18 @@ void __DisplayGetDebugStats(char stats[2048])
 		"Fragment shaders loaded: %i\n"
 		"Combined shaders loaded: %i\n",
 		gpuStats.numFrames,
+		frameSkipStats,
+		audioUnderruns,
+		audioOverruns,
+		atracHits,
+		atracMisses,
+		atracWorstDecodeMs,
+		atracWorstStallMs,
 		gpuStats.msProcessingDisplayLists * 1000.0f,
-		kernelStats.msInSyscalls * 1000.0f,
-		kernelStats.slowestSyscallName ? kernelStats.slowestSyscallName : "(none)",
-		kernelStats.slowestSyscallTime * 1000.0f,
-		kernelStats.summedSlowestSyscallName ? kernelStats.summedSlowestSyscallName : "(none)",
-		kernelStats.summedSlowestSyscallTime * 1000.0f,
+		hleProfilerFrameMs(),
+		syscallStats,
+		kernelStats.numReplacedCalls,
+		cyclesToUs(CoreTiming::GetSpinIdleTicks()) / 1000.0,
 		gpuStats.numDrawCalls,
 		gpuStats.numFlushes,
 		gpuStats.numCachedDrawCalls,
@@ -311,6 +371,7 @@ void __DisplayGetDebugStats(char stats[2048])
 
 	gpuStats.resetFrame();
 	kernelStats.ResetFrame();
+	hleProfilerResetFrame();
 }
 
 enum {
@@ -319,6 +380,38 @@ enum {
 	FPS_LIMIT_TURBO = 2,
 };
 
+// Splits the time since the last frame into emulation and display list (render) time.
+static void UpdateFrameTimeEstimates(double now) {
+	double dlTime = gpuStats.msProcessingDisplayLists;
+	// The debug stats reset this.
+	double renderTime = dlTime >= lastDisplayListTime ? dlTime - lastDisplayListTime : dlTime;
+	lastDisplayListTime = dlTime;
+
+	double workTime = now - frameWorkStart;
+	// Paused, or frameskip was just turned on.
+	if (frameWorkStart == 0.0 || workTime > 0.5 || renderTime > workTime)
+		return;
+
+	const double weight = 0.1;
+	emulationTimeEstimate += (workTime - renderTime - emulationTimeEstimate) * weight;
+	// A skipped frame didn't draw, so it says nothing about render time.
+	if (numSkippedFrames == 0)
+		renderTimeEstimate += (renderTime - renderTimeEstimate) * weight;
+}
+
+static bool ShouldAutoSkip(double behind, double frameTime) {
+	// If drawing is cheap, skipping it won't catch up, it'll just stutter.
+	if (renderTimeEstimate < frameTime * 0.1)
+		return false;
+	// Small slips are made up by the next few frames anyway.
+	return behind > renderTimeEstimate * 0.5;
+}
+
+static void RecordFrameSkip(bool skipped) {
+	frameSkipHistory[frameSkipHistoryPos] = skipped ? 'S' : '.';
+	frameSkipHistoryPos = (frameSkipHistoryPos + 1) % (sizeof(frameSkipHistory) - 1);
+}
+
 // Let's collect all the throttling and frameskipping logic here.
 void DoFrameTiming(bool &throttle, bool &skipFrame) {
 	int fpsLimiter = PSP_CoreParameter().fpsLimit;
@@ -350,10 +443,17 @@ void DoFrameTiming(bool &throttle, bool &skipFrame) {
 	curFrameTime = time_now_d();
 	if (nextFrameTime == 0.0)
 		nextFrameTime = time_now_d() + 1.0 / 60.0;
+	if (doFrameSkip)
+		UpdateFrameTimeEstimates(curFrameTime);
 	
 	if (curFrameTime > nextFrameTime && doFrameSkip) {
 		// Argh, we are falling behind! Let's skip a frame and see if we catch up.
-		skipFrame = true;
+		if (g_Config.bAutoFrameSkip) {
+			double frameTime = fpsLimiter == FPS_LIMIT_CUSTOM && g_Config.iFpsLimit > 0 ? 1.0 / g_Config.iFpsLimit : 1.0 / 60.0;
+			skipFrame = ShouldAutoSkip(curFrameTime - nextFrameTime, frameTime);
+		} else {
+			skipFrame = true;
+		}
 		// INFO_LOG(HLE,"FRAMESKIP %i", numSkippedFrames);
 	}
 
@@ -391,6 +491,12 @@ void DoFrameTiming(bool &throttle, bool &skipFrame) {
 	if (numSkippedFrames >= g_Config.iFrameSkip) {
 		skipFrame = false;
 	}
+
+	if (doFrameSkip) {
+		RecordFrameSkip(skipFrame);
+		time_update();
+		frameWorkStart = time_now_d();
+	}
 }
 
 
@@ -720,17 +826,17 @@ const HLEFunction sceDisplay[] = {
 	{0x46F186C3,WrapU_V<sceDisplayWaitVblankStartCB>, "sceDisplayWaitVblankStartCB"},
 	{0x77ed8b3a,WrapU_I<sceDisplayWaitVblankStartMultiCB>,"sceDisplayWaitVblankStartMultiCB"},
 	{0xdba6c4c4,WrapF_V<sceDisplayGetFramePerSec>,"sceDisplayGetFramePerSec"},
-	{0x773dd3a3,WrapU_V<sceDisplayGetCurrentHcount>,"sceDisplayGetCurrentHcount"},
+	{0x773dd3a3,WrapU_V<sceDisplayGetCurrentHcount>,"sceDisplayGetCurrentHcount", HLE_CLEAN},
 	{0x210eab3a,WrapU_V<sceDisplayGetAccumulatedHcount>,"sceDisplayGetAccumulatedHcount"},
 	{0xA83EF139,WrapU_V<sceDisplayAdjustAccumulatedHcount>,"sceDisplayAdjustAccumulatedHcount"},
-	{0x9C6EAAD7,WrapU_V<sceDisplayGetVcount>,"sceDisplayGetVcount"},
+	{0x9C6EAAD7,WrapU_V<sceDisplayGetVcount>,"sceDisplayGetVcount", HLE_CLEAN},
 	{0xDEA197D4,WrapU_UUU<sceDisplayGetMode>,"sceDisplayGetMode"},
 	{0x7ED59BC4,WrapU_U<sceDisplaySetHoldMode>,"sceDisplaySetHoldMode"},
 	{0xA544C486,WrapU_U<sceDisplaySetResumeMode>,"sceDisplaySetResumeMode"},
 	{0xBF79F646,WrapU_U<sceDisplayGetResumeMode>,"sceDisplayGetResumeMode"},
 	{0xB4F378FA,WrapU_V<sceDisplayIsForeground>,"sceDisplayIsForeground"},
 	{0x31C4BAA8,WrapU_U<sceDisplayGetBrightness>,"sceDisplayGetBrightness"},
-	{0x4D4E10EC,WrapU_V<sceDisplayIsVblank>,"sceDisplayIsVblank"},
+	{0x4D4E10EC,WrapU_V<sceDisplayIsVblank>,"sceDisplayIsVblank", HLE_CLEAN},
 	{0x21038913,WrapU_V<sceDisplayIsVsync>,"sceDisplayIsVsync"},
 };
 
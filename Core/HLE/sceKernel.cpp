@@ -21,6 +21,7 @@
 #include "Core/MIPS/MIPS.h"
 #include "Core/MIPS/MIPSCodeUtils.h"
 #include "Core/MIPS/MIPSInt.h"
+#include "Core/MIPS/MIPSTables.h"
 
 #include "Common/LogManager.h"
 #include "../FileSystems/FileSystem.h"
@@ -36,6 +37,7 @@
 
 #include "__sceAudio.h"
 #include "sceAtrac.h"
+#include "sceMp3.h"
 #include "sceAudio.h"
 #include "sceCtrl.h"
 #include "sceDisplay.h"
@@ -158,6 +160,7 @@ void __KernelShutdown()
 	__SasShutdown();
 	__DisplayShutdown();
 	__AtracShutdown();
+	__Mp3Shutdown();
 	__AudioShutdown();
 	__IoShutdown();
 	__KernelMutexShutdown();
@@ -326,7 +329,7 @@ int sceKernelDcacheInvalidateRange(u32 addr, int size)
 
 int sceKernelIcacheInvalidateRange(u32 addr, int size) {
 	DEBUG_LOG(HLE,"sceKernelIcacheInvalidateRange(%08x, %i)", addr, size);
-	// TODO: Make the JIT hash and compare the touched blocks.
+	currentMIPS->InvalidateICache(addr, size);
 	return 0;
 }
 
@@ -382,6 +385,8 @@ u32 sceKernelIcacheInvalidateAll()
 #ifdef LOG_CACHE
 	NOTICE_LOG(CPU, "Icache invalidated - should clear JIT someday");
 #endif
+	// The jit notices rewritten blocks by their emuhack op, and clearing it all would be slow.
+	MIPSInterpret_ClearCache();
 	return 0;
 }
 
@@ -392,45 +397,95 @@ u32 sceKernelIcacheClearAll()
 	NOTICE_LOG(CPU, "Icache cleared - should clear JIT someday");
 #endif
 	DEBUG_LOG(CPU, "Icache cleared - should clear JIT someday");
+	MIPSInterpret_ClearCache();
 	return 0;
 }
 
 KernelObjectPool::KernelObjectPool()
 {
-	memset(occupied, 0, sizeof(bool)*maxCount);
-	nextID = 16;
+	memset(pool, 0, sizeof(pool));
+	memset(handles, 0, sizeof(handles));
+	memset(generations, 0, sizeof(generations));
+	count = 0;
+	ResetFreeList();
 }
 
-SceUID KernelObjectPool::Create(KernelObject *obj, int rangeBottom, int rangeTop)
+void KernelObjectPool::ResetFreeList()
 {
-	if (rangeTop > maxCount)
-		rangeTop = maxCount;
-	if (nextID >= rangeBottom && nextID < rangeTop)
-		rangeBottom = nextID++;
-
-	for (int i = rangeBottom; i < rangeTop; i++)
+	freeFirst = -1;
+	freeLast = -1;
+	for (int i = firstIndex; i < maxCount; i++)
 	{
-		if (!occupied[i])
-		{
-			occupied[i] = true;
-			pool[i] = obj;
-			pool[i]->uid = i + handleOffset;
-			return i + handleOffset;
-		}
+		if (handles[i] == 0)
+			PushFree(i);
 	}
-	_dbg_assert_(HLE, 0);
-	return 0;
 }
 
-bool KernelObjectPool::IsValid(SceUID handle)
+void KernelObjectPool::PushFree(int index)
+{
+	freeNext[index] = -1;
+	if (freeLast == -1)
+		freeFirst = index;
+	else
+		freeNext[freeLast] = index;
+	freeLast = index;
+}
+
+void KernelObjectPool::LinkType(int index)
 {
-	int index = handle - handleOffset;
-	if (index < 0)
-		return false;
-	if (index >= maxCount)
-		return false;
+	TypeList &list = typeLists[pool[index]->GetIDType()];
+	if (list.last == -1)
+		list.first = index;
+	else
+		typeNext[list.last] = index;
+	typePrev[index] = list.last;
+	typeNext[index] = -1;
+	list.last = index;
+}
 
-	return occupied[index];
+void KernelObjectPool::UnlinkType(int index)
+{
+	TypeList &list = typeLists[pool[index]->GetIDType()];
+	if (typePrev[index] == -1)
+		list.first = typeNext[index];
+	else
+		typeNext[typePrev[index]] = typeNext[index];
+	if (typeNext[index] == -1)
+		list.last = typePrev[index];
+	else
+		typePrev[typeNext[index]] = typePrev[index];
+}
+
+SceUID KernelObjectPool::Create(KernelObject *obj)
+{
+	if (freeFirst == -1)
+	{
+		_dbg_assert_(HLE, 0);
+		return 0;
+	}
+
+	int i = freeFirst;
+	freeFirst = freeNext[i];
+	if (freeFirst == -1)
+		freeLast = -1;
+
+	pool[i] = obj;
+	handles[i] = MakeHandle(i);
+	pool[i]->uid = handles[i];
+	LinkType(i);
+	count++;
+	return handles[i];
+}
+
+void KernelObjectPool::Free(int index)
+{
+	UnlinkType(index);
+	handles[index] = 0;
+	generations[index]++;
+	count--;
+	PushFree(index);
+	delete pool[index];
+	pool[index] = NULL;
 }
 
 void KernelObjectPool::Clear()
@@ -438,30 +493,34 @@ void KernelObjectPool::Clear()
 	for (int i=0; i<maxCount; i++)
 	{
 		//brutally clear everything, no validation
-		if (occupied[i])
+		if (handles[i] != 0)
 			delete pool[i];
-		occupied[i]=false;
 	}
-	memset(pool, 0, sizeof(KernelObject*)*maxCount);
+	memset(pool, 0, sizeof(pool));
+	memset(handles, 0, sizeof(handles));
+	memset(generations, 0, sizeof(generations));
+	count = 0;
+	typeLists.clear();
+	ResetFreeList();
 }
 
 KernelObject *&KernelObjectPool::operator [](SceUID handle)
 {
 	_dbg_assert_msg_(HLE, IsValid(handle), "GRABBING UNALLOCED KERNEL OBJ");
-	return pool[handle - handleOffset];
+	return pool[IndexOf(handle)];
 }
 
 void KernelObjectPool::List()
 {
 	for (int i = 0; i < maxCount; i++)
 	{
-		if (occupied[i])
+		if (handles[i] != 0)
 		{
 			char buffer[256];
 			if (pool[i])
 			{
 				pool[i]->GetQuickInfo(buffer,256);
-				INFO_LOG(HLE, "KO %i: %s \"%s\": %s", i + handleOffset, pool[i]->GetTypeName(), pool[i]->GetName(), buffer);
+				INFO_LOG(HLE, "KO %i: %s \"%s\": %s", handles[i], pool[i]->GetTypeName(), pool[i]->GetName(), buffer);
 			}
 			else
 			{
@@ -473,21 +532,17 @@ void KernelObjectPool::List()
 
 int KernelObjectPool::GetCount()
 {
-	int count = 0;
-	for (int i=0; i<maxCount; i++)
-	{
-		if (occupied[i])
-			count++;
-	}
 	return count;
 }
 
 void KernelObjectPool::DoState(PointerWrap &p)
 {
-	int _maxCount = maxCount;
+	// Older states have no generations, which is the same as them all being 0.
+	const int stateHasGenerations = 0x40000000;
+	int _maxCount = maxCount | stateHasGenerations;
 	p.Do(_maxCount);
 
-	if (_maxCount != maxCount)
+	if ((_maxCount & ~stateHasGenerations) != maxCount)
 	{
 		p.SetError(p.ERROR_FAILURE);
 		ERROR_LOG(HLE, "Unable to load state: different kernel object storage.");
@@ -500,7 +555,17 @@ void KernelObjectPool::DoState(PointerWrap &p)
 		kernelObjects.Clear();
 	}
 
-	p.Do(nextID);
+	bool occupied[maxCount];
+	for (int i = 0; i < maxCount; ++i)
+		occupied[i] = handles[i] != 0;
+	if ((_maxCount & stateHasGenerations) != 0)
+		p.DoArray(generations, maxCount);
+	else
+	{
+		// Used to be the next ID to try.
+		int nextID = 0;
+		p.Do(nextID);
+	}
 	p.DoArray(occupied, maxCount);
 	for (int i = 0; i < maxCount; ++i)
 	{
@@ -512,11 +577,15 @@ void KernelObjectPool::DoState(PointerWrap &p)
 		{
 			p.Do(type);
 			pool[i] = CreateByIDType(type);
-			pool[i]->uid = i + handleOffset;
 
 			// Already logged an error.
 			if (pool[i] == NULL)
 				return;
+
+			handles[i] = MakeHandle(i);
+			pool[i]->uid = handles[i];
+			LinkType(i);
+			count++;
 		}
 		else
 		{
@@ -525,6 +594,9 @@ void KernelObjectPool::DoState(PointerWrap &p)
 		}
 		pool[i]->DoState(p);
 	}
+
+	if (p.mode == p.MODE_READ)
+		ResetFreeList();
 	p.DoMarker("KernelObjectPool");
 }
 
@@ -717,9 +789,9 @@ const HLEFunction ThreadManForUser[] =
 	// NOTE: Takes a UID from sceKernelMemory's AllocMemoryBlock and seems thread stack related.
 	//{0x28BFD974,0,"ThreadManForUser_28BFD974"},
 
-	{0x82BC5777,WrapU64_V<sceKernelGetSystemTimeWide>,"sceKernelGetSystemTimeWide"},
-	{0xdb738f35,WrapI_U<sceKernelGetSystemTime>,"sceKernelGetSystemTime"},
-	{0x369ed59d,WrapU_V<sceKernelGetSystemTimeLow>,"sceKernelGetSystemTimeLow"},
+	{0x82BC5777,WrapU64_V<sceKernelGetSystemTimeWide>,"sceKernelGetSystemTimeWide", HLE_CLEAN},
+	{0xdb738f35,WrapI_U<sceKernelGetSystemTime>,"sceKernelGetSystemTime", HLE_CLEAN},
+	{0x369ed59d,WrapU_V<sceKernelGetSystemTimeLow>,"sceKernelGetSystemTimeLow", HLE_CLEAN},
 
 	{0x8218B4DD,WrapI_U<sceKernelReferGlobalProfiler>,"sceKernelReferGlobalProfiler"},
 	{0x627E6F3A,WrapI_U<sceKernelReferSystemStatus>,"sceKernelReferSystemStatus"},
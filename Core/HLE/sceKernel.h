@@ -413,13 +413,15 @@ public:
 };
 
 
+// UIDs are handleOffset + (generation << indexBits | index).  Each slot's generation goes
+// up when its object is destroyed, so a stale UID doesn't find whatever reused the slot.
 class KernelObjectPool {
 public:
 	KernelObjectPool();
 	~KernelObjectPool() {}
 
-	// Allocates a UID within the range and inserts the object into the map.
-	SceUID Create(KernelObject *obj, int rangeBottom = 16, int rangeTop = 0x7fffffff);
+	// Allocates a UID and inserts the object into the pool.
+	SceUID Create(KernelObject *obj);
 
 	void DoState(PointerWrap &p);
 	static KernelObject *CreateByIDType(int type);
@@ -429,19 +431,19 @@ public:
 	{
 		u32 error;
 		if (Get<T>(handle, error))
-		{
-			occupied[handle-handleOffset] = false;
-			delete pool[handle-handleOffset];
-		}
+			Free(IndexOf(handle));
 		return error;
 	};
 
-	bool IsValid(SceUID handle);
+	bool IsValid(SceUID handle)
+	{
+		return handles[IndexOf(handle)] == handle && handle >= handleOffset;
+	}
 
 	template <class T>
 	T* Get(SceUID handle, u32 &outError)
 	{
-		if (handle < handleOffset || handle >= handleOffset+maxCount || !occupied[handle-handleOffset])
+		if (!IsValid(handle))
 		{
 			ERROR_LOG(HLE, "Kernel: Bad object handle %i (%08x)", handle, handle);
 			outError = T::GetMissingErrorCode();
@@ -452,7 +454,7 @@ public:
 			// Previously we had a dynamic_cast here, but since RTTI was disabled traditionally,
 			// it just acted as a static case and everything worked. This means that we will never
 			// see the Wrong type object error below, but we'll just have to live with that danger.
-			T* t = static_cast<T*>(pool[handle - handleOffset]);
+			T* t = static_cast<T*>(pool[IndexOf(handle)]);
 			if (t == 0 || t->GetIDType() != T::GetStaticIDType())
 			{
 				ERROR_LOG(HLE, "Kernel: Wrong object type for %i (%08x)", handle, handle);
@@ -468,39 +470,38 @@ public:
 	template <class T>
 	T *GetFast(SceUID handle)
 	{
-		const SceUID realHandle = handle - handleOffset;
-		if (realHandle < 0 || realHandle >= maxCount || !occupied[realHandle])
+		if (!IsValid(handle))
 		{
 			ERROR_LOG(HLE, "Kernel: Bad fast object handle %i (%08x)", handle, handle);
 			return 0;
 		}
-		return static_cast<T *>(pool[realHandle]);
+		return static_cast<T *>(pool[IndexOf(handle)]);
 	}
 
 	template <class T, typename ArgT>
 	void Iterate(bool func(T *, ArgT), ArgT arg)
 	{
-		int type = T::GetStaticIDType();
-		for (int i = 0; i < maxCount; i++)
+		std::map<int, TypeList>::iterator list = typeLists.find(T::GetStaticIDType());
+		if (list == typeLists.end())
+			return;
+		for (int i = list->second.first; i != -1; )
 		{
-			if (!occupied[i])
-				continue;
-			T *t = static_cast<T *>(pool[i]);
-			if (t->GetIDType() == type) {
-				if (!func(t, arg))
-					break;
-			}
+			// func may destroy the object.
+			int next = typeNext[i];
+			if (!func(static_cast<T *>(pool[i]), arg))
+				break;
+			i = next;
 		}
 	}
 
 	bool GetIDType(SceUID handle, int *type) const
 	{
-		if (handle < handleOffset || handle >= handleOffset+maxCount || !occupied[handle-handleOffset])
+		if (handles[IndexOf(handle)] != handle || handle < handleOffset)
 		{
 			ERROR_LOG(HLE, "Kernel: Bad object handle %i (%08x)", handle, handle);
 			return false;
 		}
-		KernelObject *t = pool[handle - handleOffset];
+		KernelObject *t = pool[IndexOf(handle)];
 		*type = t->GetIDType();
 		return true;
 	}
@@ -513,36 +514,64 @@ public:
 private:
 	enum {
 		maxCount=4096,
-		handleOffset=0x100
+		indexBits=12,
+		indexMask=maxCount-1,
+		// Keeps UIDs positive.
+		generationMask=0x3FFFF,
+		handleOffset=0x100,
+		// The first index handed out.
+		firstIndex=16,
+	};
+
+	struct TypeList
+	{
+		TypeList() : first(-1), last(-1) {}
+		int first;
+		int last;
 	};
+
+	static int IndexOf(SceUID handle)
+	{
+		return ((u32)handle - handleOffset) & indexMask;
+	}
+	SceUID MakeHandle(int index) const
+	{
+		return handleOffset + (int)(((generations[index] & generationMask) << indexBits) | index);
+	}
+	void Free(int index);
+	void ResetFreeList();
+	void PushFree(int index);
+	void LinkType(int index);
+	void UnlinkType(int index);
+
 	KernelObject *pool[maxCount];
-	bool occupied[maxCount];
-	int nextID;
+	// The UID of the object in each slot, or 0 if it's free.
+	SceUID handles[maxCount];
+	u32 generations[maxCount];
+	int count;
+
+	// Freed slots are reused in the order they were freed, so stale UIDs stay stale longer.
+	int freeNext[maxCount];
+	int freeFirst;
+	int freeLast;
+
+	std::map<int, TypeList> typeLists;
+	int typeNext[maxCount];
+	int typePrev[maxCount];
 };
 
 extern KernelObjectPool kernelObjects;
 
-typedef std::pair<int, int> KernelStatsSyscall;
-
+// Syscall times are kept by the profiler in HLE.cpp.
 struct KernelStats {
 	void Reset() {
 		ResetFrame();
 	}
 	void ResetFrame() {
-		msInSyscalls = 0;
-		slowestSyscallTime = 0;
-		slowestSyscallName = 0;
-		summedMsInSyscalls.clear();
-		summedSlowestSyscallTime = 0;
-		summedSlowestSyscallName = 0;
+		numReplacedCalls = 0;
 	}
 
-	double msInSyscalls;
-	double slowestSyscallTime;
-	const char *slowestSyscallName;
-	std::map<KernelStatsSyscall, double> summedMsInSyscalls;
-	double summedSlowestSyscallTime;
-	const char *summedSlowestSyscallName;
+	int numReplacedCalls;
 };
 
 extern KernelStats kernelStats;
@@ -26,6 +26,7 @@
 #include "sceKernel.h"
 #include "sceKernelThread.h"
 #include "sceKernelEventFlag.h"
+#include "KernelWaitQueue.h"
 
 void __KernelEventFlagTimeout(u64 userdata, int cycleslate);
 
@@ -48,6 +49,11 @@ struct EventFlagTh
 	u64 pausedTimeout;
 };
 
+inline SceUID WaitQueueThreadID(const EventFlagTh &th)
+{
+	return th.tid;
+}
+
 class EventFlag : public KernelObject
 {
 public:
@@ -71,13 +77,13 @@ public:
 	{
 		p.Do(nef);
 		EventFlagTh eft = {0};
-		p.Do(waitingThreads, eft);
+		waitingThreads.DoState(p, eft);
 		p.Do(pausedWaits);
 		p.DoMarker("EventFlag");
 	}
 
 	NativeEventFlag nef;
-	std::vector<EventFlagTh> waitingThreads;
+	KernelWaitQueue<EventFlagTh> waitingThreads;
 	// Key is the callback id it was for, or if no callback, the thread id.
 	std::map<SceUID, EventFlagTh> pausedWaits;
 };
@@ -185,7 +191,7 @@ bool __KernelClearEventFlagThreads(EventFlag *e, int reason)
 {
 	u32 error;
 	bool wokeThreads = false;
-	std::vector<EventFlagTh>::iterator iter, end;
+	KernelWaitQueue<EventFlagTh>::iterator iter, end;
 	for (iter = e->waitingThreads.begin(), end = e->waitingThreads.end(); iter != end; ++iter)
 		__KernelUnlockEventFlagForThread(e, *iter, error, reason, wokeThreads);
 	e->waitingThreads.clear();
@@ -210,16 +216,12 @@ void __KernelEventFlagBeginCallback(SceUID threadID, SceUID prevCallbackId)
 			return;
 
 		EventFlagTh waitData = {0};
-		for (size_t i = 0; i < flag->waitingThreads.size(); i++)
+		EventFlagTh *t = flag->waitingThreads.find(threadID);
+		if (t != NULL)
 		{
-			EventFlagTh *t = &flag->waitingThreads[i];
-			if (t->tid == threadID)
-			{
-				waitData = *t;
-				// TODO: Hmm, what about priority/fifo order?  Does it lose its place in line?
-				flag->waitingThreads.erase(flag->waitingThreads.begin() + i);
-				break;
-			}
+			waitData = *t;
+			// TODO: Hmm, what about priority/fifo order?  Does it lose its place in line?
+			flag->waitingThreads.remove(threadID);
 		}
 
 		if (waitData.tid != threadID)
@@ -288,7 +290,7 @@ void __KernelEventFlagEndCallback(SceUID threadID, SceUID prevCallbackId, u32 &r
 			CoreTiming::ScheduleEvent(cyclesLeft, eventFlagWaitTimer, __KernelGetCurThread());
 
 		// TODO: Should this not go at the end?
-		flag->waitingThreads.push_back(waitData);
+		flag->waitingThreads.push(waitData);
 
 		DEBUG_LOG(HLE, "sceKernelWaitEventFlagCB: Resuming lock wait for callback");
 	}
@@ -401,15 +403,12 @@ u32 sceKernelSetEventFlag(SceUID id, u32 bitsToSet)
 
 		e->nef.currentPattern |= bitsToSet;
 
-		for (size_t i = 0; i < e->waitingThreads.size(); ++i)
+		for (auto iter = e->waitingThreads.begin(); iter != e->waitingThreads.end(); )
 		{
-			EventFlagTh *t = &e->waitingThreads[i];
-			if (__KernelUnlockEventFlagForThread(e, *t, error, 0, wokeThreads))
-			{
-				e->waitingThreads.erase(e->waitingThreads.begin() + i);
-				// Try the one that used to be in this place next.
-				--i;
-			}
+			if (__KernelUnlockEventFlagForThread(e, *iter, error, 0, wokeThreads))
+				iter = e->waitingThreads.erase(iter);
+			else
+				++iter;
 		}
 
 		if (wokeThreads)
@@ -436,20 +435,16 @@ void __KernelEventFlagTimeout(u64 userdata, int cycleslate)
 	EventFlag *e = kernelObjects.Get<EventFlag>(flagID, error);
 	if (e)
 	{
-		for (size_t i = 0; i < e->waitingThreads.size(); i++)
+		EventFlagTh *t = e->waitingThreads.find(threadID);
+		if (t != NULL)
 		{
-			EventFlagTh *t = &e->waitingThreads[i];
-			if (t->tid == threadID)
-			{
-				bool wokeThreads;
-
-				// This thread isn't waiting anymore, but we'll remove it from waitingThreads later.
-				// The reason is, if it times out, but what it was waiting on is DELETED prior to it
-				// actually running, it will get a DELETE result instead of a TIMEOUT.
-				// So, we need to remember it or we won't be able to mark it DELETE instead later.
-				__KernelUnlockEventFlagForThread(e, *t, error, SCE_KERNEL_ERROR_WAIT_TIMEOUT, wokeThreads);
-				break;
-			}
+			bool wokeThreads;
+
+			// This thread isn't waiting anymore, but we'll remove it from waitingThreads later.
+			// The reason is, if it times out, but what it was waiting on is DELETED prior to it
+			// actually running, it will get a DELETE result instead of a TIMEOUT.
+			// So, we need to remember it or we won't be able to mark it DELETE instead later.
+			__KernelUnlockEventFlagForThread(e, *t, error, SCE_KERNEL_ERROR_WAIT_TIMEOUT, wokeThreads);
 		}
 	}
 }
@@ -473,15 +468,7 @@ void __KernelSetEventFlagTimeout(EventFlag *e, u32 timeoutPtr)
 
 void __KernelEventFlagRemoveThread(EventFlag *e, SceUID threadID)
 {
-	for (size_t i = 0; i < e->waitingThreads.size(); i++)
-	{
-		EventFlagTh *t = &e->waitingThreads[i];
-		if (t->tid == threadID)
-		{
-			e->waitingThreads.erase(e->waitingThreads.begin() + i);
-			break;
-		}
-	}
+	e->waitingThreads.remove(threadID);
 }
 
 int sceKernelWaitEventFlag(SceUID id, u32 bits, u32 wait, u32 outBitsPtr, u32 timeoutPtr)
@@ -525,7 +512,7 @@ int sceKernelWaitEventFlag(SceUID id, u32 bits, u32 wait, u32 outBitsPtr, u32 ti
 			th.wait = wait;
 			// If < 5ms, sometimes hardware doesn't write this, but it's unpredictable.
 			th.outAddr = timeout == 0 ? 0 : outBitsPtr;
-			e->waitingThreads.push_back(th);
+			e->waitingThreads.push(th);
 
 			__KernelSetEventFlagTimeout(e, timeoutPtr);
 			__KernelWaitCurThread(WAITTYPE_EVENTFLAG, id, 0, timeoutPtr, false, "event flag waited");
@@ -588,7 +575,7 @@ int sceKernelWaitEventFlagCB(SceUID id, u32 bits, u32 wait, u32 outBitsPtr, u32
 			th.wait = wait;
 			// If < 5ms, sometimes hardware doesn't write this, but it's unpredictable.
 			th.outAddr = timeout == 0 ? 0 : outBitsPtr;
-			e->waitingThreads.push_back(th);
+			e->waitingThreads.push(th);
 
 			__KernelSetEventFlagTimeout(e, timeoutPtr);
 			if (doCallbackWait)
@@ -665,12 +652,14 @@ u32 sceKernelReferEventFlagStatus(SceUID id, u32 statusPtr)
 			return -1;
 
 		u32 error;
-		for (auto iter = e->waitingThreads.begin(); iter != e->waitingThreads.end(); ++iter)
+		for (auto iter = e->waitingThreads.begin(); iter != e->waitingThreads.end(); )
 		{
 			SceUID waitID = __KernelGetWaitID(iter->tid, WAITTYPE_EVENTFLAG, error);
 			// The thread is no longer waiting for this, clean it up.
 			if (waitID != id)
-				e->waitingThreads.erase(iter--);
+				iter = e->waitingThreads.erase(iter);
+			else
+				++iter;
 		}
 
 		e->nef.numWaitThreads = (int) e->waitingThreads.size();
@@ -18,6 +18,7 @@
 #include "sceKernel.h"
 #include "sceKernelThread.h"
 #include "sceKernelMbx.h"
+#include "KernelWaitQueue.h"
 #include "HLE.h"
 #include "Core/CoreTiming.h"
 #include "Core/Reporting.h"
@@ -34,6 +35,12 @@ struct MbxWaitingThread
 	SceUID first;
 	u32 second;
 };
+
+inline SceUID WaitQueueThreadID(const MbxWaitingThread &th)
+{
+	return th.first;
+}
+
 void __KernelMbxTimeout(u64 userdata, int cyclesLate);
 
 static int mbxWaitTimer = -1;
@@ -58,25 +65,8 @@ struct Mbx : public KernelObject
 
 	void AddWaitingThread(SceUID id, u32 addr)
 	{
-		bool inserted = false;
-		if (nmb.attr & SCE_KERNEL_MBA_THPRI)
-		{
-			for (std::vector<MbxWaitingThread>::iterator it = waitingThreads.begin(); it != waitingThreads.end(); it++)
-			{
-				if (__KernelGetThreadPrio(id) < __KernelGetThreadPrio((*it).first))
-				{
-					MbxWaitingThread waiting = {id, addr};
-					waitingThreads.insert(it, waiting);
-					inserted = true;
-					break;
-				}
-			}
-		}
-		if (!inserted)
-		{
-			MbxWaitingThread waiting = {id, addr};
-			waitingThreads.push_back(waiting);
-		}
+		MbxWaitingThread waiting = {id, addr};
+		waitingThreads.push(waiting);
 	}
 
 	inline void AddInitialMessage(u32 ptr)
@@ -167,14 +157,15 @@ struct Mbx : public KernelObject
 	virtual void DoState(PointerWrap &p)
 	{
 		p.Do(nmb);
+		waitingThreads.SetUsePriority((nmb.attr & SCE_KERNEL_MBA_THPRI) != 0);
 		MbxWaitingThread mwt = {0};
-		p.Do(waitingThreads, mwt);
+		waitingThreads.DoState(p, mwt);
 		p.DoMarker("Mbx");
 	}
 
 	NativeMbx nmb;
 
-	std::vector<MbxWaitingThread> waitingThreads;
+	KernelWaitQueue<MbxWaitingThread> waitingThreads;
 };
 
 void __KernelMbxInit()
@@ -257,35 +248,7 @@ void __KernelWaitMbx(Mbx *m, u32 timeoutPtr)
 
 void __KernelMbxRemoveThread(Mbx *m, SceUID threadID)
 {
-	for (size_t i = 0; i < m->waitingThreads.size(); i++)
-	{
-		MbxWaitingThread *t = &m->waitingThreads[i];
-		if (t->first == threadID)
-		{
-			m->waitingThreads.erase(m->waitingThreads.begin() + i);
-			break;
-		}
-	}
-}
-
-std::vector<MbxWaitingThread>::iterator __KernelMbxFindPriority(std::vector<MbxWaitingThread> &waiting)
-{
-	_dbg_assert_msg_(HLE, !waiting.empty(), "__KernelMutexFindPriority: Trying to find best of no threads.");
-
-	std::vector<MbxWaitingThread>::iterator iter, end, best = waiting.end();
-	u32 best_prio = 0xFFFFFFFF;
-	for (iter = waiting.begin(), end = waiting.end(); iter != end; ++iter)
-	{
-		u32 iter_prio = __KernelGetThreadPrio(iter->first);
-		if (iter_prio < best_prio)
-		{
-			best = iter;
-			best_prio = iter_prio;
-		}
-	}
-
-	_dbg_assert_msg_(HLE, best != waiting.end(), "__KernelMutexFindPriority: Returning invalid best thread.");
-	return best;
+	m->waitingThreads.remove(threadID);
 }
 
 SceUID sceKernelCreateMbx(const char *name, u32 attr, u32 optAddr)
@@ -309,6 +272,7 @@ SceUID sceKernelCreateMbx(const char *name, u32 attr, u32 optAddr)
 	strncpy(m->nmb.name, name, KERNELOBJECT_MAX_NAME_LENGTH);
 	m->nmb.name[KERNELOBJECT_MAX_NAME_LENGTH] = 0;
 	m->nmb.attr = attr;
+	m->waitingThreads.SetUsePriority((attr & SCE_KERNEL_MBA_THPRI) != 0);
 	m->nmb.numWaitThreads = 0;
 	m->nmb.numMessages = 0;
 	m->nmb.packetListHead = 0;
@@ -332,8 +296,8 @@ int sceKernelDeleteMbx(SceUID id)
 		DEBUG_LOG(HLE, "sceKernelDeleteMbx(%i)", id);
 
 		bool wokeThreads = false;
-		for (size_t i = 0; i < m->waitingThreads.size(); i++)
-			__KernelUnlockMbxForThread(m, m->waitingThreads[i], error, SCE_KERNEL_ERROR_WAIT_DELETE, wokeThreads);
+		for (auto iter = m->waitingThreads.begin(); iter != m->waitingThreads.end(); ++iter)
+			__KernelUnlockMbxForThread(m, *iter, error, SCE_KERNEL_ERROR_WAIT_DELETE, wokeThreads);
 		m->waitingThreads.clear();
 
 		if (wokeThreads)
@@ -368,17 +332,11 @@ int sceKernelSendMbx(SceUID id, u32 packetAddr)
 	if (m->nmb.numMessages == 0)
 	{
 		bool wokeThreads = false;
-		std::vector<MbxWaitingThread>::iterator iter;
 		while (!wokeThreads && !m->waitingThreads.empty())
 		{
-			if ((m->nmb.attr & SCE_KERNEL_MBA_THPRI) != 0)
-				iter = __KernelMbxFindPriority(m->waitingThreads);
-			else
-				iter = m->waitingThreads.begin();
-
-			MbxWaitingThread t = *iter;
+			MbxWaitingThread t = m->waitingThreads.front();
 			__KernelUnlockMbxForThread(m, t, error, 0, wokeThreads);
-			m->waitingThreads.erase(iter);
+			m->waitingThreads.pop_front();
 
 			if (wokeThreads)
 			{
@@ -531,8 +489,8 @@ int sceKernelCancelReceiveMbx(SceUID id, u32 numWaitingThreadsAddr)
 	DEBUG_LOG(HLE, "sceKernelCancelReceiveMbx(%i, %08x): cancelling %d threads", id, numWaitingThreadsAddr, count);
 
 	bool wokeThreads = false;
-	for (size_t i = 0; i < m->waitingThreads.size(); i++)
-		__KernelUnlockMbxForThread(m, m->waitingThreads[i], error, SCE_KERNEL_ERROR_WAIT_CANCEL, wokeThreads);
+	for (auto iter = m->waitingThreads.begin(); iter != m->waitingThreads.end(); ++iter)
+		__KernelUnlockMbxForThread(m, *iter, error, SCE_KERNEL_ERROR_WAIT_CANCEL, wokeThreads);
 	m->waitingThreads.clear();
 
 	if (wokeThreads)
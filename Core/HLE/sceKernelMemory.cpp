@@ -27,6 +27,7 @@
 #include "sceKernel.h"
 #include "sceKernelThread.h"
 #include "sceKernelMemory.h"
+#include "KernelWaitQueue.h"
 
 const int TLS_NUM_INDEXES = 16;
 
@@ -113,12 +114,26 @@ struct FPL : public KernelObject
 	u32 address;
 };
 
+enum SceKernelVplAttr
+{
+	PSP_VPL_ATTR_FIFO = 0x0000,
+	PSP_VPL_ATTR_PRIORITY = 0x0100,
+	PSP_VPL_ATTR_SMALLEST = 0x0200,
+	PSP_VPL_ATTR_HIGHMEM = 0x4000,
+	PSP_VPL_ATTR_KNOWN = PSP_VPL_ATTR_FIFO | PSP_VPL_ATTR_PRIORITY | PSP_VPL_ATTR_SMALLEST | PSP_VPL_ATTR_HIGHMEM,
+};
+
 struct VplWaitingThread
 {
 	SceUID threadID;
 	u32 addrPtr;
 };
 
+inline SceUID WaitQueueThreadID(const VplWaitingThread &th)
+{
+	return th.threadID;
+}
+
 struct SceKernelVplInfo
 {
 	SceSize size;
@@ -143,15 +158,16 @@ struct VPL : public KernelObject
 	{
 		p.Do(nv);
 		p.Do(address);
+		waitingThreads.SetUsePriority((nv.attr & PSP_VPL_ATTR_PRIORITY) != 0);
 		VplWaitingThread dv = {0};
-		p.Do(waitingThreads, dv);
+		waitingThreads.DoState(p, dv);
 		alloc.DoState(p);
 		p.DoMarker("VPL");
 	}
 
 	SceKernelVplInfo nv;
 	u32 address;
-	std::vector<VplWaitingThread> waitingThreads;
+	KernelWaitQueue<VplWaitingThread> waitingThreads;
 	BlockAllocator alloc;
 };
 
@@ -447,7 +463,6 @@ public:
 				address = alloc->AllocAligned(size, 0x100, alignment, type == PSP_SMEM_HighAligned, name);
 			else
 				address = alloc->Alloc(size, type == PSP_SMEM_High, name);
-			alloc->ListBlocks();
 		}
 	}
 	~PartitionMemoryBlock()
@@ -862,15 +877,6 @@ KernelObject *__KernelMemoryPMBObject()
 
 // VPL = variable length memory pool
 
-enum SceKernelVplAttr
-{
-	PSP_VPL_ATTR_FIFO = 0x0000,
-	PSP_VPL_ATTR_PRIORITY = 0x0100,
-	PSP_VPL_ATTR_SMALLEST = 0x0200,
-	PSP_VPL_ATTR_HIGHMEM = 0x4000,
-	PSP_VPL_ATTR_KNOWN = PSP_VPL_ATTR_FIFO | PSP_VPL_ATTR_PRIORITY | PSP_VPL_ATTR_SMALLEST | PSP_VPL_ATTR_HIGHMEM,
-};
-
 bool __KernelUnlockVplForThread(VPL *vpl, VplWaitingThread &threadInfo, u32 &error, int result, bool &wokeThreads)
 {
 	const SceUID threadID = threadInfo.threadID;
@@ -909,27 +915,14 @@ bool __KernelUnlockVplForThread(VPL *vpl, VplWaitingThread &threadInfo, u32 &err
 
 void __KernelVplRemoveThread(VPL *vpl, SceUID threadID)
 {
-	for (size_t i = 0; i < vpl->waitingThreads.size(); i++)
-	{
-		VplWaitingThread *t = &vpl->waitingThreads[i];
-		if (t->threadID == threadID)
-		{
-			vpl->waitingThreads.erase(vpl->waitingThreads.begin() + i);
-			break;
-		}
-	}
-}
-
-bool __VplThreadSortPriority(VplWaitingThread thread1, VplWaitingThread thread2)
-{
-	return __KernelThreadSortPriority(thread1.threadID, thread2.threadID);
+	vpl->waitingThreads.remove(threadID);
 }
 
 bool __KernelClearVplThreads(VPL *vpl, int reason)
 {
 	u32 error;
 	bool wokeThreads = false;
-	for (auto iter = vpl->waitingThreads.begin(), end = vpl->waitingThreads.end(); iter != end; ++iter)
+	for (auto iter = vpl->waitingThreads.begin(); iter != vpl->waitingThreads.end(); ++iter)
 		__KernelUnlockVplForThread(vpl, *iter, error, reason, wokeThreads);
 	vpl->waitingThreads.clear();
 
@@ -991,6 +984,7 @@ SceUID sceKernelCreateVpl(const char *name, int partition, u32 attr, u32 vplSize
 	strncpy(vpl->nv.name, name, KERNELOBJECT_MAX_NAME_LENGTH);
 	vpl->nv.name[KERNELOBJECT_MAX_NAME_LENGTH] = 0;
 	vpl->nv.attr = attr;
+	vpl->waitingThreads.SetUsePriority((attr & PSP_VPL_ATTR_PRIORITY) != 0);
 	vpl->nv.size = sizeof(vpl->nv);
 	vpl->nv.poolSize = vplSize - 0x20;
 	vpl->nv.numWaitThreads = 0;
@@ -1110,7 +1104,7 @@ int sceKernelAllocateVpl(SceUID uid, u32 size, u32 addrPtr, u32 timeoutPtr)
 				SceUID threadID = __KernelGetCurThread();
 				__KernelVplRemoveThread(vpl, threadID);
 				VplWaitingThread waiting = {threadID, addrPtr};
-				vpl->waitingThreads.push_back(waiting);
+				vpl->waitingThreads.push(waiting);
 			}
 
 			__KernelSetVplTimeout(timeoutPtr);
@@ -1137,7 +1131,7 @@ int sceKernelAllocateVplCB(SceUID uid, u32 size, u32 addrPtr, u32 timeoutPtr)
 				SceUID threadID = __KernelGetCurThread();
 				__KernelVplRemoveThread(vpl, threadID);
 				VplWaitingThread waiting = {threadID, addrPtr};
-				vpl->waitingThreads.push_back(waiting);
+				vpl->waitingThreads.push(waiting);
 			}
 
 			__KernelSetVplTimeout(timeoutPtr);
@@ -1170,18 +1164,14 @@ int sceKernelFreeVpl(SceUID uid, u32 addr)
 		if (vpl->alloc.FreeExact(addr))
 		{
 			// TODO: smallest priority
-			if ((vpl->nv.attr & PSP_VPL_ATTR_PRIORITY) != 0)
-				std::stable_sort(vpl->waitingThreads.begin(), vpl->waitingThreads.end(), __VplThreadSortPriority);
-
 			bool wokeThreads = false;
-retry:
-			for (auto iter = vpl->waitingThreads.begin(), end = vpl->waitingThreads.end(); iter != end; ++iter)
+			// Waking a thread only takes memory, so the ones already skipped still won't fit.
+			for (auto iter = vpl->waitingThreads.begin(); iter != vpl->waitingThreads.end(); )
 			{
 				if (__KernelUnlockVplForThread(vpl, *iter, error, 0, wokeThreads))
-				{
-					vpl->waitingThreads.erase(iter);
-					goto retry;
-				}
+					iter = vpl->waitingThreads.erase(iter);
+				else
+					++iter;
 			}
 
 			if (wokeThreads)
@@ -1229,12 +1219,14 @@ int sceKernelReferVplStatus(SceUID uid, u32 infoPtr)
 		DEBUG_LOG(HLE, "sceKernelReferVplStatus(%i, %08x)", uid, infoPtr);
 
 		u32 error;
-		for (auto iter = vpl->waitingThreads.begin(); iter != vpl->waitingThreads.end(); ++iter)
+		for (auto iter = vpl->waitingThreads.begin(); iter != vpl->waitingThreads.end(); )
 		{
 			SceUID waitID = __KernelGetWaitID(iter->threadID, WAITTYPE_VPL, error);
 			// The thread is no longer waiting for this, clean it up.
 			if (waitID != uid)
-				vpl->waitingThreads.erase(iter--);
+				iter = vpl->waitingThreads.erase(iter);
+			else
+				++iter;
 		}
 
 		vpl->nv.numWaitThreads = (int) vpl->waitingThreads.size();
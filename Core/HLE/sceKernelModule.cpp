@@ -21,6 +21,7 @@
 #include "native/base/stringutil.h"
 #include "Core/HLE/HLE.h"
 #include "Core/HLE/HLETables.h"
+#include "Core/HLE/ReplaceTables.h"
 #include "Core/Reporting.h"
 #include "Common/FileUtil.h"
 #include "../Host.h"
@@ -164,6 +165,7 @@ public:
 	Module() : memoryBlockAddr(0), isFake(false), isStarted(false) {}
 	~Module() {
 		if (memoryBlockAddr) {
+			Replacement_ClearRange(memoryBlockAddr, memoryBlockSize);
 			userMemory.Free(memoryBlockAddr);
 		}
 	}
@@ -273,6 +275,27 @@ void __KernelModuleInit()
 	actionAfterModule = __KernelRegisterActionType(AfterModuleEntryCall::Create);
 }
 
+static bool __KernelModuleScanReplacements(Module *module, int unused)
+{
+	if (module->isFake || module->memoryBlockAddr == 0)
+		return true;
+
+	u32 start = module->memoryBlockAddr;
+	u32 end = start + module->memoryBlockSize;
+	// Older states don't have the text range.
+	if (module->nm.text_size != 0)
+	{
+		start = module->nm.text_addr;
+		end = start + module->nm.text_size;
+		// The symbols are still there if this module was loaded before, otherwise find some.
+		SymbolInfo info;
+		if (!symbolMap.GetSymbolInfo(&info, start, ST_FUNCTION))
+			MIPSAnalyst::ScanForFunctions(start, end);
+	}
+	Replacement_ScanRange(start, end);
+	return true;
+}
+
 void __KernelModuleDoState(PointerWrap &p)
 {
 	p.Do(actionAfterModule);
@@ -281,6 +304,13 @@ void __KernelModuleDoState(PointerWrap &p)
 	p.Do(unresolvedVars, vs);
 	p.Do(exportedVars, vs);
 	p.DoMarker("sceKernelModule");
+
+	// Replacements aren't saved, and the modules (and memory) may be different now.
+	if (p.mode == p.MODE_READ)
+	{
+		Replacement_Clear();
+		kernelObjects.Iterate(&__KernelModuleScanReplacements, 0);
+	}
 }
 
 void __KernelModuleShutdown()
@@ -500,6 +530,8 @@ Module *__KernelLoadELFFromPtr(const u8 *ptr, u32 loadAddress, std::string *erro
 	}
 	module->memoryBlockAddr = reader.GetVaddr();
 	module->memoryBlockSize = reader.GetTotalSize();
+	// The module may have been loaded over code that already ran.
+	currentMIPS->InvalidateICache(module->memoryBlockAddr, module->memoryBlockSize);
 
 	struct PspModuleInfo
 	{
@@ -546,9 +578,12 @@ Module *__KernelLoadELFFromPtr(const u8 *ptr, u32 loadAddress, std::string *erro
 	if (textSection != -1) {
 		u32 textStart = reader.GetSectionAddr(textSection);
 		u32 textSize = reader.GetSectionSize(textSection);
+		module->nm.text_addr = textStart;
+		module->nm.text_size = textSize;
 
 		if (!reader.LoadSymbols())
 			MIPSAnalyst::ScanForFunctions(textStart, textStart+textSize);
+		Replacement_ScanRange(textStart, textStart+textSize);
 	}
 
 	INFO_LOG(LOADER,"Module %s: %08x %08x %08x", modinfo->name, modinfo->gp, modinfo->libent,modinfo->libstub);
@@ -19,6 +19,7 @@
 #include "sceKernel.h"
 #include "sceKernelMsgPipe.h"
 #include "sceKernelThread.h"
+#include "KernelWaitQueue.h"
 #include "ChunkFile.h"
 
 #define SCE_KERNEL_MPA_THFIFO_S 0x0000
@@ -50,6 +51,11 @@ struct MsgPipeWaitingThread
 	u32 transferredBytesAddr;
 };
 
+inline SceUID WaitQueueThreadID(const MsgPipeWaitingThread &th)
+{
+	return th.id;
+}
+
 struct MsgPipe : public KernelObject
 {
 	const char *GetName() {return nmp.name;}
@@ -65,38 +71,20 @@ struct MsgPipe : public KernelObject
 			delete [] buffer;
 	}
 
-	void AddWaitingThread(std::vector<MsgPipeWaitingThread> &list, SceUID id, u32 addr, u32 size, int waitMode, u32 transferredBytesAddr, bool usePrio)
+	void AddWaitingThread(KernelWaitQueue<MsgPipeWaitingThread> &list, SceUID id, u32 addr, u32 size, int waitMode, u32 transferredBytesAddr)
 	{
 		MsgPipeWaitingThread thread = { id, addr, size, size, waitMode, transferredBytesAddr };
-		if (usePrio)
-		{
-			for (std::vector<MsgPipeWaitingThread>::iterator it = list.begin(); it != list.end(); it++)
-			{
-				if (__KernelGetThreadPrio(id) >= __KernelGetThreadPrio((*it).id))
-				{
-					list.insert(it, thread);
-					return;
-				}
-			}
-
-			list.push_back(thread);
-		}
-		else
-		{
-			list.push_back(thread);
-		}
+		list.push(thread);
 	}
 
 	void AddSendWaitingThread(SceUID id, u32 addr, u32 size, int waitMode, u32 transferredBytesAddr)
 	{
-		bool usePrio = ((nmp.attr & SCE_KERNEL_MPA_THPRI_S) != 0);
-		AddWaitingThread(sendWaitingThreads, id, addr, size, waitMode, transferredBytesAddr, usePrio);
+		AddWaitingThread(sendWaitingThreads, id, addr, size, waitMode, transferredBytesAddr);
 	}
 
 	void AddReceiveWaitingThread(SceUID id, u32 addr, u32 size, int waitMode, u32 transferredBytesAddr)
 	{
-		bool usePrio = ((nmp.attr & SCE_KERNEL_MPA_THPRI_R) != 0);
-		AddWaitingThread(receiveWaitingThreads, id, addr, size, waitMode, transferredBytesAddr, usePrio);
+		AddWaitingThread(receiveWaitingThreads, id, addr, size, waitMode, transferredBytesAddr);
 	}
 
 	void CheckSendThreads()
@@ -111,7 +99,7 @@ struct MsgPipe : public KernelObject
 			Memory::Write_U32(thread->bufSize, thread->transferredBytesAddr);
 			nmp.freeSize -= thread->bufSize;
 			__KernelResumeThreadFromWait(thread->id);
-			sendWaitingThreads.erase(sendWaitingThreads.begin());
+			sendWaitingThreads.pop_front();
 			CheckReceiveThreads();
 		}
 		else if (thread->waitMode == SCE_KERNEL_MPW_ASAP && nmp.freeSize != 0)
@@ -121,7 +109,7 @@ struct MsgPipe : public KernelObject
 			Memory::Write_U32(nmp.freeSize, thread->transferredBytesAddr);
 			nmp.freeSize = 0;
 			__KernelResumeThreadFromWait(thread->id);
-			receiveWaitingThreads.erase(receiveWaitingThreads.begin());
+			receiveWaitingThreads.pop_front();
 			CheckReceiveThreads();
 		}
 	}
@@ -141,7 +129,7 @@ struct MsgPipe : public KernelObject
 			Memory::Write_U32(thread->bufSize, thread->transferredBytesAddr);
 			nmp.freeSize += thread->bufSize;
 			__KernelResumeThreadFromWait(thread->id);
-			receiveWaitingThreads.erase(receiveWaitingThreads.begin());
+			receiveWaitingThreads.pop_front();
 			CheckSendThreads();
 		}
 		else if (thread->waitMode == SCE_KERNEL_MPW_ASAP && nmp.freeSize != nmp.bufSize)
@@ -151,17 +139,24 @@ struct MsgPipe : public KernelObject
 			Memory::Write_U32(nmp.bufSize - nmp.freeSize, thread->transferredBytesAddr);
 			nmp.freeSize = nmp.bufSize;
 			__KernelResumeThreadFromWait(thread->id);
-			receiveWaitingThreads.erase(receiveWaitingThreads.begin());
+			receiveWaitingThreads.pop_front();
 			CheckSendThreads();
 		}
 	}
 
+	void UpdateWaitPriority()
+	{
+		sendWaitingThreads.SetUsePriority((nmp.attr & SCE_KERNEL_MPA_THPRI_S) != 0);
+		receiveWaitingThreads.SetUsePriority((nmp.attr & SCE_KERNEL_MPA_THPRI_R) != 0);
+	}
+
 	virtual void DoState(PointerWrap &p)
 	{
 		p.Do(nmp);
+		UpdateWaitPriority();
 		MsgPipeWaitingThread mpwt1 = {0}, mpwt2 = {0};
-		p.Do(sendWaitingThreads, mpwt1);
-		p.Do(receiveWaitingThreads, mpwt2);
+		sendWaitingThreads.DoState(p, mpwt1);
+		receiveWaitingThreads.DoState(p, mpwt2);
 		bool hasBuffer = buffer != NULL;
 		p.Do(hasBuffer);
 		if (hasBuffer)
@@ -175,8 +170,8 @@ struct MsgPipe : public KernelObject
 
 	NativeMsgPipe nmp;
 
-	std::vector<MsgPipeWaitingThread> sendWaitingThreads;
-	std::vector<MsgPipeWaitingThread> receiveWaitingThreads;
+	KernelWaitQueue<MsgPipeWaitingThread> sendWaitingThreads;
+	KernelWaitQueue<MsgPipeWaitingThread> receiveWaitingThreads;
 
 	u8 *buffer;
 };
@@ -200,6 +195,7 @@ void sceKernelCreateMsgPipe()
 	m->nmp.size = sizeof(NativeMsgPipe);
 	strncpy(m->nmp.name, name, sizeof(m->nmp.name));
 	m->nmp.attr = attr;
+	m->UpdateWaitPriority();
 	m->nmp.bufSize = size;
 	m->nmp.freeSize = size;
 	m->nmp.numSendWaitThreads = 0;
@@ -227,13 +223,13 @@ void sceKernelDeleteMsgPipe()
 		RETURN(error);
 		return;
 	}
-	for (u32 i = 0; i < m->sendWaitingThreads.size(); i++)
+	for (auto it = m->sendWaitingThreads.begin(); it != m->sendWaitingThreads.end(); ++it)
 	{
-		__KernelResumeThreadFromWait(m->sendWaitingThreads[i].id);
+		__KernelResumeThreadFromWait(it->id);
 	}
-	for (u32 i = 0; i < m->receiveWaitingThreads.size(); i++)
+	for (auto it = m->receiveWaitingThreads.begin(); it != m->receiveWaitingThreads.end(); ++it)
 	{
-		__KernelResumeThreadFromWait(m->receiveWaitingThreads[i].id);
+		__KernelResumeThreadFromWait(it->id);
 	}
 	DEBUG_LOG(HLE, "sceKernelDeleteMsgPipe(%i)", uid);
 	RETURN(kernelObjects.Destroy<MsgPipe>(uid));
@@ -257,7 +253,7 @@ void __KernelSendMsgPipe(MsgPipe *m, u32 sendBufAddr, u32 sendSize, int waitMode
 				{
 					Memory::Write_U32(thread->bufSize - thread->freeSize, thread->transferredBytesAddr);
 					__KernelResumeThreadFromWait(thread->id);
-					m->receiveWaitingThreads.erase(m->receiveWaitingThreads.begin());
+					m->receiveWaitingThreads.pop_front();
 				}
 				break;
 			}
@@ -266,7 +262,7 @@ void __KernelSendMsgPipe(MsgPipe *m, u32 sendBufAddr, u32 sendSize, int waitMode
 				Memory::Memcpy(thread->bufAddr + (thread->bufSize - thread->freeSize), Memory::GetPointer(curSendAddr), sendSize);
 				Memory::Write_U32(thread->bufSize, thread->transferredBytesAddr);
 				__KernelResumeThreadFromWait(thread->id);
-				m->receiveWaitingThreads.erase(m->receiveWaitingThreads.begin());
+				m->receiveWaitingThreads.pop_front();
 				curSendAddr += sendSize;
 				sendSize = 0;
 				break;
@@ -278,7 +274,7 @@ void __KernelSendMsgPipe(MsgPipe *m, u32 sendBufAddr, u32 sendSize, int waitMode
 				curSendAddr += thread->freeSize;
 				Memory::Write_U32(thread->bufSize, thread->transferredBytesAddr);
 				__KernelResumeThreadFromWait(thread->id);
-				m->receiveWaitingThreads.erase(m->receiveWaitingThreads.begin());
+				m->receiveWaitingThreads.pop_front();
 			}
 		}
 		// If there is still data to send and (we want to send all of it or we didn't send anything)
@@ -427,7 +423,7 @@ void __KernelReceiveMsgPipe(MsgPipe *m, u32 receiveBufAddr, u32 receiveSize, int
 				{
 					Memory::Write_U32(thread->bufSize - thread->freeSize, thread->transferredBytesAddr);
 					__KernelResumeThreadFromWait(thread->id);
-					m->sendWaitingThreads.erase(m->sendWaitingThreads.begin());
+					m->sendWaitingThreads.pop_front();
 				}
 				break;
 			}
@@ -437,7 +433,7 @@ void __KernelReceiveMsgPipe(MsgPipe *m, u32 receiveBufAddr, u32 receiveSize, int
 				Memory::Memcpy(curReceiveAddr, Memory::GetPointer(thread->bufAddr), receiveSize);
 				Memory::Write_U32(thread->bufSize, thread->transferredBytesAddr);
 				__KernelResumeThreadFromWait(thread->id);
-				m->sendWaitingThreads.erase(m->sendWaitingThreads.begin());
+				m->sendWaitingThreads.pop_front();
 				curReceiveAddr += receiveSize;
 				receiveSize = 0;
 				break;
@@ -450,7 +446,7 @@ void __KernelReceiveMsgPipe(MsgPipe *m, u32 receiveBufAddr, u32 receiveSize, int
 				curReceiveAddr += thread->bufSize - thread->freeSize;
 				Memory::Write_U32(thread->bufSize, thread->transferredBytesAddr);
 				__KernelResumeThreadFromWait(thread->id);
-				m->sendWaitingThreads.erase(m->sendWaitingThreads.begin());
+				m->sendWaitingThreads.pop_front();
 			}
 		}
 		// All data hasn't been received and (mode isn't ASAP or nothing was received)
@@ -597,14 +593,16 @@ void sceKernelCancelMsgPipe()
 		delete [] m->buffer;
 	}
 	u32 count;
-	for (count = 0; count < m->sendWaitingThreads.size(); count++)
+	count = (u32) m->sendWaitingThreads.size();
+	for (auto it = m->sendWaitingThreads.begin(); it != m->sendWaitingThreads.end(); ++it)
 	{
-		__KernelResumeThreadFromWait(m->sendWaitingThreads[count].id);
+		__KernelResumeThreadFromWait(it->id);
 	}
 	Memory::Write_U32(count, numSendThreadsAddr);
-	for (count = 0; count < m->receiveWaitingThreads.size(); count++)
+	count = (u32) m->receiveWaitingThreads.size();
+	for (auto it = m->receiveWaitingThreads.begin(); it != m->receiveWaitingThreads.end(); ++it)
 	{
-		__KernelResumeThreadFromWait(m->receiveWaitingThreads[count].id);
+		__KernelResumeThreadFromWait(it->id);
 	}
 	Memory::Write_U32(count, numReceiveThreadsAddr);
 	DEBUG_LOG(HLE, "sceKernelCancelMsgPipe(%i, %i, %i)", uid, numSendThreadsAddr, numReceiveThreadsAddr);
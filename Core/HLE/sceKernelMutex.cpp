@@ -25,6 +25,7 @@
 #include "sceKernel.h"
 #include "sceKernelMutex.h"
 #include "sceKernelThread.h"
+#include "KernelWaitQueue.h"
 
 #define PSP_MUTEX_ATTR_FIFO 0
 #define PSP_MUTEX_ATTR_PRIORITY 0x100
@@ -70,14 +71,15 @@ struct Mutex : public KernelObject
 	virtual void DoState(PointerWrap &p)
 	{
 		p.Do(nm);
+		waitingThreads.SetUsePriority((nm.attr & PSP_MUTEX_ATTR_PRIORITY) != 0);
 		SceUID dv = 0;
-		p.Do(waitingThreads, dv);
+		waitingThreads.DoState(p, dv);
 		p.Do(pausedWaitTimeouts);
 		p.DoMarker("Mutex");
 	}
 
 	NativeMutex nm;
-	std::vector<SceUID> waitingThreads;
+	KernelWaitQueue<SceUID> waitingThreads;
 	// Key is the callback id it was for, or if no callback, the thread id.
 	std::map<SceUID, u64> pausedWaitTimeouts;
 };
@@ -132,14 +134,15 @@ struct LwMutex : public KernelObject
 	virtual void DoState(PointerWrap &p)
 	{
 		p.Do(nm);
+		waitingThreads.SetUsePriority((nm.attr & PSP_MUTEX_ATTR_PRIORITY) != 0);
 		SceUID dv = 0;
-		p.Do(waitingThreads, dv);
+		waitingThreads.DoState(p, dv);
 		p.Do(pausedWaitTimeouts);
 		p.DoMarker("LwMutex");
 	}
 
 	NativeLwMutex nm;
-	std::vector<SceUID> waitingThreads;
+	KernelWaitQueue<SceUID> waitingThreads;
 	// Key is the callback id it was for, or if no callback, the thread id.
 	std::map<SceUID, u64> pausedWaitTimeouts;
 };
@@ -227,26 +230,6 @@ void __KernelMutexEraseLock(Mutex *mutex)
 	mutex->nm.lockThread = -1;
 }
 
-std::vector<SceUID>::iterator __KernelMutexFindPriority(std::vector<SceUID> &waiting)
-{
-	_dbg_assert_msg_(HLE, !waiting.empty(), "__KernelMutexFindPriority: Trying to find best of no threads.");
-
-	std::vector<SceUID>::iterator iter, end, best = waiting.end();
-	u32 best_prio = 0xFFFFFFFF;
-	for (iter = waiting.begin(), end = waiting.end(); iter != end; ++iter)
-	{
-		u32 iter_prio = __KernelGetThreadPrio(*iter);
-		if (iter_prio < best_prio)
-		{
-			best = iter;
-			best_prio = iter_prio;
-		}
-	}
-
-	_dbg_assert_msg_(HLE, best != waiting.end(), "__KernelMutexFindPriority: Returning invalid best thread.");
-	return best;
-}
-
 bool __KernelUnlockMutexForThread(Mutex *mutex, SceUID threadID, u32 &error, int result)
 {
 	SceUID waitID = __KernelGetWaitID(threadID, WAITTYPE_MUTEX, error);
@@ -298,7 +281,7 @@ void __KernelMutexBeginCallback(SceUID threadID, SceUID prevCallbackId)
 			mutex->pausedWaitTimeouts[pauseKey] = 0;
 
 		// TODO: Hmm, what about priority/fifo order?  Does it lose its place in line?
-		mutex->waitingThreads.erase(std::remove(mutex->waitingThreads.begin(), mutex->waitingThreads.end(), threadID), mutex->waitingThreads.end());
+		mutex->waitingThreads.remove(threadID);
 
 		DEBUG_LOG(HLE, "sceKernelLockMutexCB: Suspending lock wait for callback");
 	}
@@ -349,7 +332,7 @@ void __KernelMutexEndCallback(SceUID threadID, SceUID prevCallbackId, u32 &retur
 			CoreTiming::ScheduleEvent(cyclesLeft, mutexWaitTimer, __KernelGetCurThread());
 
 		// TODO: Should this not go at the end?
-		mutex->waitingThreads.push_back(threadID);
+		mutex->waitingThreads.push(threadID);
 
 		DEBUG_LOG(HLE, "sceKernelLockMutexCB: Resuming lock wait for callback");
 	}
@@ -380,6 +363,7 @@ int sceKernelCreateMutex(const char *name, u32 attr, int initialCount, u32 optio
 	strncpy(mutex->nm.name, name, KERNELOBJECT_MAX_NAME_LENGTH);
 	mutex->nm.name[KERNELOBJECT_MAX_NAME_LENGTH] = 0;
 	mutex->nm.attr = attr;
+	mutex->waitingThreads.SetUsePriority((attr & PSP_MUTEX_ATTR_PRIORITY) != 0);
 	mutex->nm.initialCount = initialCount;
 	if (initialCount == 0)
 	{
@@ -411,7 +395,7 @@ int sceKernelDeleteMutex(SceUID id)
 	if (mutex)
 	{
 		bool wokeThreads = false;
-		std::vector<SceUID>::iterator iter, end;
+		KernelWaitQueue<SceUID>::iterator iter, end;
 		for (iter = mutex->waitingThreads.begin(), end = mutex->waitingThreads.end(); iter != end; ++iter)
 			wokeThreads |= __KernelUnlockMutexForThread(mutex, *iter, error, SCE_KERNEL_ERROR_WAIT_DELETE);
 
@@ -484,16 +468,10 @@ bool __KernelUnlockMutex(Mutex *mutex, u32 &error)
 	__KernelMutexEraseLock(mutex);
 
 	bool wokeThreads = false;
-	std::vector<SceUID>::iterator iter;
 	while (!wokeThreads && !mutex->waitingThreads.empty())
 	{
-		if ((mutex->nm.attr & PSP_MUTEX_ATTR_PRIORITY) != 0)
-			iter = __KernelMutexFindPriority(mutex->waitingThreads);
-		else
-			iter = mutex->waitingThreads.begin();
-
-		wokeThreads |= __KernelUnlockMutexForThread(mutex, *iter, error, 0);
-		mutex->waitingThreads.erase(iter);
+		wokeThreads |= __KernelUnlockMutexForThread(mutex, mutex->waitingThreads.front(), error, 0);
+		mutex->waitingThreads.pop_front();
 	}
 
 	if (!wokeThreads)
@@ -531,7 +509,7 @@ void __KernelMutexThreadEnd(SceUID threadID)
 	{
 		Mutex *mutex = kernelObjects.Get<Mutex>(waitingMutexID, error);
 		if (mutex)
-			mutex->waitingThreads.erase(std::remove(mutex->waitingThreads.begin(), mutex->waitingThreads.end(), threadID), mutex->waitingThreads.end());
+			mutex->waitingThreads.remove(threadID);
 	}
 
 	// Unlock all mutexes the thread had locked.
@@ -581,9 +559,8 @@ int sceKernelLockMutex(SceUID id, int count, u32 timeoutPtr)
 	else
 	{
 		SceUID threadID = __KernelGetCurThread();
-		// May be in a tight loop timing out (where we don't remove from waitingThreads yet), don't want to add duplicates.
-		if (std::find(mutex->waitingThreads.begin(), mutex->waitingThreads.end(), threadID) == mutex->waitingThreads.end())
-			mutex->waitingThreads.push_back(threadID);
+		// May be in a tight loop timing out (where we don't remove from waitingThreads yet), push() ignores duplicates.
+		mutex->waitingThreads.push(threadID);
 		__KernelWaitMutex(mutex, timeoutPtr);
 		__KernelWaitCurThread(WAITTYPE_MUTEX, id, count, timeoutPtr, false, "mutex waited");
 
@@ -605,9 +582,8 @@ int sceKernelLockMutexCB(SceUID id, int count, u32 timeoutPtr)
 			return error;
 
 		SceUID threadID = __KernelGetCurThread();
-		// May be in a tight loop timing out (where we don't remove from waitingThreads yet), don't want to add duplicates.
-		if (std::find(mutex->waitingThreads.begin(), mutex->waitingThreads.end(), threadID) == mutex->waitingThreads.end())
-			mutex->waitingThreads.push_back(threadID);
+		// May be in a tight loop timing out (where we don't remove from waitingThreads yet), push() ignores duplicates.
+		mutex->waitingThreads.push(threadID);
 		__KernelWaitMutex(mutex, timeoutPtr);
 		__KernelWaitCurThread(WAITTYPE_MUTEX, id, count, timeoutPtr, true, "mutex waited");
 
@@ -695,12 +671,14 @@ int sceKernelReferMutexStatus(SceUID id, u32 infoAddr)
 	if (Memory::Read_U32(infoAddr) != 0)
 	{
 		u32 error;
-		for (auto iter = m->waitingThreads.begin(); iter != m->waitingThreads.end(); ++iter)
+		for (auto iter = m->waitingThreads.begin(); iter != m->waitingThreads.end(); )
 		{
 			SceUID waitID = __KernelGetWaitID(*iter, WAITTYPE_MUTEX, error);
 			// The thread is no longer waiting for this, clean it up.
 			if (waitID != id)
-				m->waitingThreads.erase(iter--);
+				iter = m->waitingThreads.erase(iter);
+			else
+				++iter;
 		}
 
 		m->nm.numWaitThreads = (int) m->waitingThreads.size();
@@ -733,6 +711,7 @@ int sceKernelCreateLwMutex(u32 workareaPtr, const char *name, u32 attr, int init
 	strncpy(mutex->nm.name, name, KERNELOBJECT_MAX_NAME_LENGTH);
 	mutex->nm.name[KERNELOBJECT_MAX_NAME_LENGTH] = 0;
 	mutex->nm.attr = attr;
+	mutex->waitingThreads.SetUsePriority((attr & PSP_MUTEX_ATTR_PRIORITY) != 0);
 	mutex->nm.uid = id;
 	mutex->nm.workarea = workareaPtr;
 	mutex->nm.initialCount = initialCount;
@@ -802,7 +781,7 @@ int sceKernelDeleteLwMutex(u32 workareaPtr)
 	if (mutex)
 	{
 		bool wokeThreads = false;
-		std::vector<SceUID>::iterator iter, end;
+		KernelWaitQueue<SceUID>::iterator iter, end;
 		for (iter = mutex->waitingThreads.begin(), end = mutex->waitingThreads.end(); iter != end; ++iter)
 			wokeThreads |= __KernelUnlockLwMutexForThread(mutex, workarea, *iter, error, SCE_KERNEL_ERROR_WAIT_DELETE);
 		mutex->waitingThreads.clear();
@@ -881,16 +860,10 @@ bool __KernelUnlockLwMutex(T workarea, u32 &error)
 	}
 
 	bool wokeThreads = false;
-	std::vector<SceUID>::iterator iter;
 	while (!wokeThreads && !mutex->waitingThreads.empty())
 	{
-		if ((mutex->nm.attr & PSP_MUTEX_ATTR_PRIORITY) != 0)
-			iter = __KernelMutexFindPriority(mutex->waitingThreads);
-		else
-			iter = mutex->waitingThreads.begin();
-
-		wokeThreads |= __KernelUnlockLwMutexForThread(mutex, workarea, *iter, error, 0);
-		mutex->waitingThreads.erase(iter);
+		wokeThreads |= __KernelUnlockLwMutexForThread(mutex, workarea, mutex->waitingThreads.front(), error, 0);
+		mutex->waitingThreads.pop_front();
 	}
 
 	if (!wokeThreads)
@@ -959,7 +932,7 @@ void __KernelLwMutexBeginCallback(SceUID threadID, SceUID prevCallbackId)
 			mutex->pausedWaitTimeouts[pauseKey] = 0;
 
 		// TODO: Hmm, what about priority/fifo order?  Does it lose its place in line?
-		mutex->waitingThreads.erase(std::remove(mutex->waitingThreads.begin(), mutex->waitingThreads.end(), threadID), mutex->waitingThreads.end());
+		mutex->waitingThreads.remove(threadID);
 
 		DEBUG_LOG(HLE, "sceKernelLockLwMutexCB: Suspending lock wait for callback");
 	}
@@ -1010,7 +983,7 @@ void __KernelLwMutexEndCallback(SceUID threadID, SceUID prevCallbackId, u32 &ret
 			CoreTiming::ScheduleEvent(cyclesLeft, lwMutexWaitTimer, __KernelGetCurThread());
 
 		// TODO: Should this not go at the end?
-		mutex->waitingThreads.push_back(threadID);
+		mutex->waitingThreads.push(threadID);
 
 		DEBUG_LOG(HLE, "sceKernelLockLwMutexCB: Resuming lock wait for callback");
 	}
@@ -1064,9 +1037,8 @@ int sceKernelLockLwMutex(u32 workareaPtr, int count, u32 timeoutPtr)
 		if (mutex)
 		{
 			SceUID threadID = __KernelGetCurThread();
-			// May be in a tight loop timing out (where we don't remove from waitingThreads yet), don't want to add duplicates.
-			if (std::find(mutex->waitingThreads.begin(), mutex->waitingThreads.end(), threadID) == mutex->waitingThreads.end())
-				mutex->waitingThreads.push_back(threadID);
+			// May be in a tight loop timing out (where we don't remove from waitingThreads yet), push() ignores duplicates.
+			mutex->waitingThreads.push(threadID);
 			__KernelWaitLwMutex(mutex, timeoutPtr);
 			__KernelWaitCurThread(WAITTYPE_LWMUTEX, workarea->uid, count, timeoutPtr, false, "lwmutex waited");
 
@@ -1095,9 +1067,8 @@ int sceKernelLockLwMutexCB(u32 workareaPtr, int count, u32 timeoutPtr)
 		if (mutex)
 		{
 			SceUID threadID = __KernelGetCurThread();
-			// May be in a tight loop timing out (where we don't remove from waitingThreads yet), don't want to add duplicates.
-			if (std::find(mutex->waitingThreads.begin(), mutex->waitingThreads.end(), threadID) == mutex->waitingThreads.end())
-				mutex->waitingThreads.push_back(threadID);
+			// May be in a tight loop timing out (where we don't remove from waitingThreads yet), push() ignores duplicates.
+			mutex->waitingThreads.push(threadID);
 			__KernelWaitLwMutex(mutex, timeoutPtr);
 			__KernelWaitCurThread(WAITTYPE_LWMUTEX, workarea->uid, count, timeoutPtr, true, "lwmutex cb waited");
 
@@ -1154,12 +1125,14 @@ int __KernelReferLwMutexStatus(SceUID uid, u32 infoPtr)
 		auto workarea = m->nm.workarea;
 
 		u32 error;
-		for (auto iter = m->waitingThreads.begin(); iter != m->waitingThreads.end(); ++iter)
+		for (auto iter = m->waitingThreads.begin(); iter != m->waitingThreads.end(); )
 		{
 			SceUID waitID = __KernelGetWaitID(*iter, WAITTYPE_LWMUTEX, error);
 			// The thread is no longer waiting for this, clean it up.
 			if (waitID != uid)
-				m->waitingThreads.erase(iter--);
+				iter = m->waitingThreads.erase(iter);
+			else
+				++iter;
 		}
 
 		// Refresh and write
@@ -24,6 +24,7 @@
 #include "sceKernel.h"
 #include "sceKernelThread.h"
 #include "sceKernelSemaphore.h"
+#include "KernelWaitQueue.h"
 
 #define PSP_SEMA_ATTR_FIFO 0
 #define PSP_SEMA_ATTR_PRIORITY 0x100
@@ -63,14 +64,15 @@ struct Semaphore : public KernelObject
 	virtual void DoState(PointerWrap &p)
 	{
 		p.Do(ns);
+		waitingThreads.SetUsePriority((ns.attr & PSP_SEMA_ATTR_PRIORITY) != 0);
 		SceUID dv = 0;
-		p.Do(waitingThreads, dv);
+		waitingThreads.DoState(p, dv);
 		p.Do(pausedWaitTimeouts);
 		p.DoMarker("Semaphore");
 	}
 
 	NativeSemaphore ns;
-	std::vector<SceUID> waitingThreads;
+	KernelWaitQueue<SceUID> waitingThreads;
 	// Key is the callback id it was for, or if no callback, the thread id.
 	std::map<SceUID, u64> pausedWaitTimeouts;
 };
@@ -156,7 +158,7 @@ void __KernelSemaBeginCallback(SceUID threadID, SceUID prevCallbackId)
 			s->pausedWaitTimeouts[pauseKey] = 0;
 
 		// TODO: Hmm, what about priority/fifo order?  Does it lose its place in line?
-		s->waitingThreads.erase(std::remove(s->waitingThreads.begin(), s->waitingThreads.end(), threadID), s->waitingThreads.end());
+		s->waitingThreads.remove(threadID);
 
 		DEBUG_LOG(HLE, "sceKernelWaitSemaCB: Suspending sema wait for callback");
 	}
@@ -210,7 +212,7 @@ void __KernelSemaEndCallback(SceUID threadID, SceUID prevCallbackId, u32 &return
 			CoreTiming::ScheduleEvent(cyclesLeft, semaWaitTimer, __KernelGetCurThread());
 
 		// TODO: Should this not go at the end?
-		s->waitingThreads.push_back(threadID);
+		s->waitingThreads.push(threadID);
 
 		DEBUG_LOG(HLE, "sceKernelWaitSemaCB: Resuming sema wait for callback");
 	}
@@ -222,7 +224,7 @@ bool __KernelClearSemaThreads(Semaphore *s, int reason)
 {
 	u32 error;
 	bool wokeThreads = false;
-	std::vector<SceUID>::iterator iter, end;
+	KernelWaitQueue<SceUID>::iterator iter, end;
 	for (iter = s->waitingThreads.begin(), end = s->waitingThreads.end(); iter != end; ++iter)
 		__KernelUnlockSemaForThread(s, *iter, error, reason, wokeThreads);
 	s->waitingThreads.clear();
@@ -286,6 +288,7 @@ int sceKernelCreateSema(const char* name, u32 attr, int initVal, int maxVal, u32
 	s->ns.currentCount = s->ns.initCount;
 	s->ns.maxCount = maxVal;
 	s->ns.numWaitThreads = 0;
+	s->waitingThreads.SetUsePriority((attr & PSP_SEMA_ATTR_PRIORITY) != 0);
 
 	DEBUG_LOG(HLE, "%i=sceKernelCreateSema(%s, %08x, %i, %i, %08x)", id, s->ns.name, s->ns.attr, s->ns.initCount, s->ns.maxCount, optionPtr);
 
@@ -334,12 +337,14 @@ int sceKernelReferSemaStatus(SceUID id, u32 infoPtr)
 			return -1;
 
 		u32 error;
-		for (auto iter = s->waitingThreads.begin(); iter != s->waitingThreads.end(); ++iter)
+		for (auto iter = s->waitingThreads.begin(); iter != s->waitingThreads.end(); )
 		{
 			SceUID waitID = __KernelGetWaitID(*iter, WAITTYPE_SEMA, error);
 			// The thread is no longer waiting for this, clean it up.
 			if (waitID != id)
-				s->waitingThreads.erase(iter--);
+				iter = s->waitingThreads.erase(iter);
+			else
+				++iter;
 		}
 
 		s->ns.numWaitThreads = (int) s->waitingThreads.size();
@@ -367,18 +372,14 @@ int sceKernelSignalSema(SceUID id, int signal)
 		s->ns.currentCount += signal;
 		DEBUG_LOG(HLE, "sceKernelSignalSema(%i, %i) (old: %i, new: %i)", id, signal, oldval, s->ns.currentCount);
 
-		if ((s->ns.attr & PSP_SEMA_ATTR_PRIORITY) != 0)
-			std::stable_sort(s->waitingThreads.begin(), s->waitingThreads.end(), __KernelThreadSortPriority);
-
+		// Waking only lowers the count, so a thread skipped once can't wake later in this loop.
 		bool wokeThreads = false;
-retry:
-		for (auto iter = s->waitingThreads.begin(), end = s->waitingThreads.end(); iter != end; ++iter)
+		for (auto iter = s->waitingThreads.begin(); iter != s->waitingThreads.end(); )
 		{
 			if (__KernelUnlockSemaForThread(s, *iter, error, 0, wokeThreads))
-			{
-				s->waitingThreads.erase(iter);
-				goto retry;
-			}
+				iter = s->waitingThreads.erase(iter);
+			else
+				++iter;
 		}
 
 		if (wokeThreads)
@@ -456,9 +457,8 @@ int __KernelWaitSema(SceUID id, int wantedCount, u32 timeoutPtr, const char *bad
 		else
 		{
 			SceUID threadID = __KernelGetCurThread();
-			// May be in a tight loop timing out (where we don't remove from waitingThreads yet), don't want to add duplicates.
-			if (std::find(s->waitingThreads.begin(), s->waitingThreads.end(), threadID) == s->waitingThreads.end())
-				s->waitingThreads.push_back(threadID);
+			// May be in a tight loop timing out (where we don't remove from waitingThreads yet), push() ignores duplicates.
+			s->waitingThreads.push(threadID);
 			__KernelSetSemaTimeout(s, timeoutPtr);
 			__KernelWaitCurThread(WAITTYPE_SEMA, id, wantedCount, timeoutPtr, processCallbacks, "sema waited");
 		}
@@ -19,6 +19,9 @@
 #include <map>
 #include <queue>
 #include <algorithm>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 #include "Common/LogManager.h"
 #include "HLE.h"
@@ -434,6 +437,7 @@ public:
 	Thread()
 	{
 		currentStack.start = 0;
+		queueOrder = 0;
 	}
 
 	~Thread()
@@ -455,6 +459,21 @@ public:
 	int getWaitID(WaitType type);
 	ThreadWaitInfo getWaitInfo();
 
+	// Could still be waiting on type, either directly or once a callback returns.
+	inline bool mightWaitFor(WaitType type) const
+	{
+		return nt.waitType == type || currentMipscallId != 0 || !pendingMipsCalls.empty();
+	}
+	inline bool hasReadyCallbacks() const
+	{
+		for (int i = 0; i < THREAD_CALLBACK_NUM_TYPES; i++)
+		{
+			if (!readyCallbacks[i].empty())
+				return true;
+		}
+		return false;
+	}
+
 	// Utils
 	inline bool isRunning() const { return (nt.status & THREADSTATUS_RUNNING) != 0; }
 	inline bool isStopped() const { return (nt.status & THREADSTATUS_DORMANT) != 0; }
@@ -518,6 +537,9 @@ public:
 	// These are stacks that aren't "active" right now, but will pop off once the func returns.
 	std::vector<StackInfo> pushedStacks;
 
+	// Sorts like the thread's position in threadqueue.  Not saved, rebuilt on load.
+	u32 queueOrder;
+
 	StackInfo currentStack;
 };
 
@@ -545,6 +567,7 @@ struct ThreadQueueList
 	ThreadQueueList()
 	{
 		memset(queues, 0, sizeof(queues));
+		memset(nonEmpty, 0, sizeof(nonEmpty));
 		first = invalid();
 	}
 
@@ -559,13 +582,9 @@ struct ThreadQueueList
 
 	inline SceUID pop_first()
 	{
-		Queue *cur = first;
-		while (cur != invalid())
-		{
-			if (cur->end - cur->first > 0)
-				return cur->data[cur->first++];
-			cur = cur->next;
-		}
+		int priority = first_nonempty();
+		if (priority >= 0)
+			return pop(priority);
 
 		_dbg_assert_msg_(HLE, false, "ThreadQueueList should not be empty.");
 		return 0;
@@ -573,14 +592,9 @@ struct ThreadQueueList
 
 	inline SceUID pop_first_better(u32 priority)
 	{
-		Queue *cur = first;
-		Queue *stop = &queues[priority];
-		while (cur < stop)
-		{
-			if (cur->end - cur->first > 0)
-				return cur->data[cur->first++];
-			cur = cur->next;
-		}
+		int best = first_nonempty();
+		if (best >= 0 && best < (int)priority)
+			return pop(best);
 
 		return 0;
 	}
@@ -589,6 +603,7 @@ struct ThreadQueueList
 	{
 		Queue *cur = &queues[priority];
 		cur->data[--cur->first] = threadID;
+		mark_nonempty(priority);
 		if (cur->first == 0)
 			rebalance(priority);
 	}
@@ -597,6 +612,7 @@ struct ThreadQueueList
 	{
 		Queue *cur = &queues[priority];
 		cur->data[cur->end++] = threadID;
+		mark_nonempty(priority);
 		if (cur->end == cur->capacity)
 			rebalance(priority);
 	}
@@ -613,6 +629,8 @@ struct ThreadQueueList
 				int remaining = --cur->end - i;
 				if (remaining > 0)
 					memmove(&cur->data[i], &cur->data[i + 1], remaining * sizeof(SceUID));
+				if (cur->first == cur->end)
+					mark_empty(priority);
 				return;
 			}
 		}
@@ -641,6 +659,7 @@ struct ThreadQueueList
 				free(queues[i].data);
 		}
 		memset(queues, 0, sizeof(queues));
+		memset(nonEmpty, 0, sizeof(nonEmpty));
 		first = invalid();
 	}
 
@@ -690,7 +709,11 @@ struct ThreadQueueList
 			}
 
 			if (size != 0)
+			{
 				p.DoArray(&cur->data[cur->first], size);
+				if (p.mode == p.MODE_READ)
+					mark_nonempty(i);
+			}
 		}
 
 		p.DoMarker("ThreadQueueList");
@@ -702,6 +725,45 @@ private:
 		return (Queue *) -1;
 	}
 
+	inline SceUID pop(int priority)
+	{
+		Queue *cur = &queues[priority];
+		SceUID threadID = cur->data[cur->first++];
+		if (cur->first == cur->end)
+			mark_empty(priority);
+		return threadID;
+	}
+
+	inline void mark_nonempty(u32 priority)
+	{
+		nonEmpty[priority >> 5] |= 1U << (priority & 31);
+	}
+
+	inline void mark_empty(u32 priority)
+	{
+		nonEmpty[priority >> 5] &= ~(1U << (priority & 31));
+	}
+
+	// Lowest (best) priority with any threads, or -1.
+	inline int first_nonempty() const
+	{
+		for (int i = 0; i < NUM_QUEUES / 32; ++i)
+		{
+			u32 bits = nonEmpty[i];
+			if (bits != 0)
+			{
+#ifdef _MSC_VER
+				unsigned long bit;
+				_BitScanForward(&bit, bits);
+				return i * 32 + (int)bit;
+#else
+				return i * 32 + __builtin_ctz(bits);
+#endif
+			}
+		}
+		return -1;
+	}
+
 	void link(u32 priority, int size)
 	{
 		_dbg_assert_msg_(HLE, queues[priority].data == NULL, "ThreadQueueList::Queue should only be initialized once.");
@@ -762,6 +824,50 @@ private:
 	Queue *first;
 	// The priority level queues of thread ids.
 	Queue queues[NUM_QUEUES];
+	// One bit per priority level that currently has threads, so pops don't walk the queues.
+	u32 nonEmpty[NUM_QUEUES / 32];
+};
+
+// Some of the threads in threadqueue, visited in the same order as threadqueue.
+struct ThreadSubList
+{
+	struct Entry
+	{
+		u32 order;
+		SceUID threadID;
+
+		bool operator <(const Entry &other) const
+		{
+			return order < other.order;
+		}
+	};
+
+	void add(const Thread *t)
+	{
+		Entry entry = {t->queueOrder, t->GetUID()};
+		std::vector<Entry>::iterator it = std::lower_bound(entries.begin(), entries.end(), entry);
+		if (it == entries.end() || it->threadID != entry.threadID)
+			entries.insert(it, entry);
+	}
+
+	void remove(SceUID threadID)
+	{
+		for (size_t i = 0; i < entries.size(); ++i)
+		{
+			if (entries[i].threadID == threadID)
+			{
+				entries.erase(entries.begin() + i);
+				return;
+			}
+		}
+	}
+
+	void clear()
+	{
+		entries.clear();
+	}
+
+	std::vector<Entry> entries;
 };
 
 struct WaitTypeFuncs
@@ -777,6 +883,8 @@ void __KernelResetThread(Thread *t, int lowestPriority);
 void __KernelCancelWakeup(SceUID threadID);
 void __KernelCancelThreadEndTimeout(SceUID threadID);
 bool __KernelCheckThreadCallbacks(Thread *thread, bool force);
+void __KernelClearThreadLists();
+void __KernelRebuildThreadLists();
 
 //////////////////////////////////////////////////////////////////////////
 //STATE BEGIN
@@ -800,6 +908,16 @@ std::vector<SceUID> threadqueue;
 // Lists only ready thread ids.
 ThreadQueueList threadReadyQueue;
 
+// Not saved, rebuilt from the threads on load.
+u32 nextThreadQueueOrder = 0;
+// Not saved either, just needs to change when priorities do.
+u32 threadPriorityGeneration = 0;
+// Threads that started waiting on each type.  Threads that stopped are only dropped when
+// the list is next walked, so isWaitingFor() still has to be checked.
+ThreadSubList threadsWaitingByType[NUM_WAITTYPES];
+// Threads that have been notified of callbacks, dropped once none are ready.
+ThreadSubList threadsWithCallbacks;
+
 SceUID threadIdleID[2];
 
 int eventScheduledWakeup;
@@ -963,6 +1081,7 @@ void __KernelThreadingInit()
 	g_inCbCount = 0;
 	currentCallbackThreadID = 0;
 	readyCallbacksCount = 0;
+	__KernelClearThreadLists();
 	idleThreadHackAddr = kernelMemory.Alloc(blockSize, false, "threadrethack");
 
 	Memory::Memcpy(idleThreadHackAddr, idleThreadCode, sizeof(idleThreadCode));
@@ -1026,6 +1145,45 @@ void __KernelThreadingDoStateLate(PointerWrap &p)
 	// We do this late to give modules time to register actions.
 	mipsCalls.DoState(p);
 	p.DoMarker("sceKernelThread Late");
+
+	if (p.mode == p.MODE_READ)
+		__KernelRebuildThreadLists();
+}
+
+void __KernelClearThreadLists()
+{
+	nextThreadQueueOrder = 0;
+	for (int i = 0; i < NUM_WAITTYPES; ++i)
+		threadsWaitingByType[i].clear();
+	threadsWithCallbacks.clear();
+}
+
+void __KernelRebuildThreadLists()
+{
+	__KernelClearThreadLists();
+
+	u32 error;
+	for (std::vector<SceUID>::iterator iter = threadqueue.begin(); iter != threadqueue.end(); iter++)
+	{
+		Thread *t = kernelObjects.Get<Thread>(*iter, error);
+		if (!t)
+			continue;
+
+		t->queueOrder = nextThreadQueueOrder++;
+		if (t->nt.waitType != WAITTYPE_NONE)
+			threadsWaitingByType[t->nt.waitType].add(t);
+		if (t->hasReadyCallbacks())
+			threadsWithCallbacks.add(t);
+	}
+
+	// A thread in a callback keeps its wait in the callback's action.
+	for (std::vector<SceUID>::iterator iter = threadqueue.begin(); iter != threadqueue.end(); iter++)
+	{
+		Thread *t = kernelObjects.Get<Thread>(*iter, error);
+		ActionAfterMipsCall *action = t ? t->getRunningCallbackAction() : NULL;
+		if (action && action->waitType != WAITTYPE_NONE)
+			threadsWaitingByType[action->waitType].add(t);
+	}
 }
 
 KernelObject *__KernelThreadObject()
@@ -1193,6 +1351,7 @@ void __KernelThreadingShutdown()
 	kernelMemory.Free(threadReturnHackAddr);
 	threadqueue.clear();
 	threadReadyQueue.clear();
+	__KernelClearThreadLists();
 	threadEndListeners.clear();
 	mipsCalls.clear();
 	threadReturnHackAddr = 0;
@@ -1504,10 +1663,17 @@ bool __KernelTriggerWait(WaitType type, int id, bool useRetVal, int retVal, cons
 	bool doneAnything = false;
 
 	u32 error;
-	for (std::vector<SceUID>::iterator iter = threadqueue.begin(); iter != threadqueue.end(); iter++)
+	std::vector<ThreadSubList::Entry> &waiting = threadsWaitingByType[type].entries;
+	size_t kept = 0;
+	for (size_t i = 0; i < waiting.size(); ++i)
 	{
-		Thread *t = kernelObjects.Get<Thread>(*iter, error);
-		if (t && t->isWaitingFor(type, id))
+		SceUID threadID = waiting[i].threadID;
+		Thread *t = kernelObjects.Get<Thread>(threadID, error);
+		if (!t || !t->mightWaitFor(type))
+			continue;
+		waiting[kept++] = waiting[i];
+
+		if (t->isWaitingFor(type, id))
 		{
 			// This thread was waiting for the triggered object.
 			t->resumeFromWait();
@@ -1516,9 +1682,10 @@ bool __KernelTriggerWait(WaitType type, int id, bool useRetVal, int retVal, cons
 			doneAnything = true;
 
 			if (type == WAITTYPE_THREADEND)
-				__KernelCancelThreadEndTimeout(*iter);
+				__KernelCancelThreadEndTimeout(threadID);
 		}
 	}
+	waiting.resize(kept);
 
 //	if (doneAnything)     // lumines?
 	{
@@ -1557,6 +1724,7 @@ void __KernelWaitCurThread(WaitType type, SceUID waitID, u32 waitValue, u32 time
 	Thread *thread = __GetCurrentThread();
 	thread->nt.waitID = waitID;
 	thread->nt.waitType = type;
+	threadsWaitingByType[type].add(thread);
 	__KernelChangeThreadState(thread, ThreadStatus(THREADSTATUS_WAIT | (thread->nt.status & THREADSTATUS_SUSPEND)));
 	thread->nt.numReleases++;
 	thread->waitInfo.waitValue = waitValue;
@@ -1584,6 +1752,7 @@ void __KernelWaitCallbacksCurThread(WaitType type, SceUID waitID, u32 waitValue,
 	Thread *thread = __GetCurrentThread();
 	thread->nt.waitID = waitID;
 	thread->nt.waitType = type;
+	threadsWaitingByType[type].add(thread);
 	__KernelChangeThreadState(thread, ThreadStatus(THREADSTATUS_WAIT | (thread->nt.status & THREADSTATUS_SUSPEND)));
 	// TODO: Probably not...?
 	thread->nt.numReleases++;
@@ -1646,6 +1815,9 @@ void __KernelRemoveFromThreadQueue(SceUID threadID)
 		threadReadyQueue.remove(prio, threadID);
 
 	threadqueue.erase(std::remove(threadqueue.begin(), threadqueue.end(), threadID), threadqueue.end());
+	for (int i = 0; i < NUM_WAITTYPES; ++i)
+		threadsWaitingByType[i].remove(threadID);
+	threadsWithCallbacks.remove(threadID);
 }
 
 u32 __KernelDeleteThread(SceUID threadID, int exitStatus, const char *reason, bool dontSwitch)
@@ -1803,7 +1975,10 @@ void __KernelResetThread(Thread *t, int lowestPriority)
 
 	// If the thread would be better than lowestPriority, reset to its initial.  Yes, kinda odd...
 	if (t->nt.currentPriority < lowestPriority)
+	{
 		t->nt.currentPriority = t->nt.initialPriority;
+		threadPriorityGeneration++;
+	}
 
 	t->nt.waitType = WAITTYPE_NONE;
 	t->nt.waitID = 0;
@@ -1827,6 +2002,7 @@ Thread *__KernelCreateThread(SceUID &id, SceUID moduleId, const char *name, u32
 	id = kernelObjects.Create(t);
 
 	threadqueue.push_back(id);
+	t->queueOrder = nextThreadQueueOrder++;
 	threadReadyQueue.prepare(priority);
 
 	memset(&t->nt, 0xCD, sizeof(t->nt));
@@ -2359,6 +2535,7 @@ int sceKernelChangeThreadPriority(SceUID threadID, int priority)
 		threadReadyQueue.remove(old, threadID);
 
 		thread->nt.currentPriority = priority;
+		threadPriorityGeneration++;
 		threadReadyQueue.prepare(thread->nt.currentPriority);
 		if (thread->isRunning())
 			thread->nt.status = (thread->nt.status & ~THREADSTATUS_RUNNING) | THREADSTATUS_READY;
@@ -2454,6 +2631,11 @@ u32 __KernelGetThreadPrio(SceUID id)
 	return 0;
 }
 
+u32 __KernelThreadPriorityGeneration()
+{
+	return threadPriorityGeneration;
+}
+
 bool __KernelThreadSortPriority(SceUID thread1, SceUID thread2)
 {
 	return __KernelGetThreadPrio(thread1) < __KernelGetThreadPrio(thread2);
@@ -2863,6 +3045,8 @@ void ActionAfterMipsCall::run(MipsCall &call) {
 		thread->nt.status = status;
 		thread->nt.waitType = waitType;
 		thread->nt.waitID = waitID;
+		if (waitType != WAITTYPE_NONE)
+			threadsWaitingByType[waitType].add(thread);
 		thread->waitInfo = waitInfo;
 		thread->isProcessingCallbacks = isProcessingCallbacks;
 		thread->currentCallbackId = currentCallbackId;
@@ -3383,11 +3567,16 @@ bool __KernelCheckCallbacks() {
 		bool processed = false;
 
 		u32 error;
-		for (std::vector<SceUID>::iterator iter = threadqueue.begin(); iter != threadqueue.end(); iter++) {
-			Thread *thread = kernelObjects.Get<Thread>(*iter, error);
+		// Copy, since running a callback might notify more.
+		std::vector<ThreadSubList::Entry> notified = threadsWithCallbacks.entries;
+		for (size_t i = 0; i < notified.size(); ++i) {
+			Thread *thread = kernelObjects.Get<Thread>(notified[i].threadID, error);
 			if (thread && __KernelCheckThreadCallbacks(thread, false)) {
 				processed = true;
 			}
+			if (!thread || !thread->hasReadyCallbacks()) {
+				threadsWithCallbacks.remove(notified[i].threadID);
+			}
 		}
 	// } while (processed && currentThread == __KernelGetCurThread());
 
@@ -3478,6 +3667,7 @@ void __KernelNotifyCallback(RegisteredCallbackType type, SceUID cbId, int notify
 	{
 		t->readyCallbacks[type].push_back(cbId);
 		readyCallbacksCount++;
+		threadsWithCallbacks.add(t);
 	}
 }
 
@@ -195,6 +195,8 @@ SceUID __KernelSetupRootThread(SceUID moduleId, int args, const char *argp, int
 void __KernelStartIdleThreads(SceUID moduleId);
 void __KernelReturnFromThread();  // Called as HLE function
 u32 __KernelGetThreadPrio(SceUID id);
+// Changes whenever any thread's priority does, so wait queues know to resort.
+u32 __KernelThreadPriorityGeneration();
 bool __KernelThreadSortPriority(SceUID thread1, SceUID thread2);
 bool __KernelIsDispatchEnabled();
 void __KernelReturnFromExtendStack();
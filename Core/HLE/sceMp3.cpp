@@ -19,30 +19,8 @@
 #include "Core/HLE/HLE.h"
 #include "Core/HLE/sceMp3.h"
 #include "Core/HW/MediaEngine.h"
+#include "Core/HW/Mp3Stream.h"
 #include "Core/Reporting.h"
-#include "../HW/MediaEngine.h"
-
-#ifdef USE_FFMPEG
-#ifndef PRId64
-#define PRId64  "%llu" 
-#endif
-
-// Urgh! Why is this needed?
-#ifdef ANDROID
-#ifndef UINT64_C
-#define UINT64_C(c) (c ## ULL)
-#endif
-#endif
-extern "C" {
-#include <libavutil/opt.h>
-#include <libavformat/avformat.h>
-//#include <libavutil/timestamp.h>     // iOS build is not happy with this one.
-#include <libswresample/swresample.h>
-#include <libavutil/samplefmt.h>
-}
-#endif
-
-static const int MP3_BITRATES[] = {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320};
 
 struct Mp3Context {
 	void DoState(PointerWrap &p) {
@@ -85,27 +63,60 @@ struct Mp3Context {
 	int mp3Bitrate;
 	int mp3SamplingRate;
 	int mp3Version;
-#ifdef USE_FFMPEG
-	AVFormatContext *avformat_context;
-	AVIOContext	  *avio_context;
-	AVCodecContext  *decoder_context;
-	SwrContext      *resampler_context;
-	int audio_stream_index;
-#endif
+
+	// Frames are pulled out of mp3Buf as this wants them, and decoded ahead.
+	Mp3Stream *stream;
 };
 
 static std::map<u32, Mp3Context *> mp3Map;
 static u32 lastMp3Handle = 0;
 
 Mp3Context *getMp3Ctx(u32 mp3) {
-	if (mp3Map.find(mp3) == mp3Map.end()) {
+	std::map<u32, Mp3Context *>::iterator it = mp3Map.find(mp3);
+	if (it == mp3Map.end()) {
 		ERROR_LOG(HLE, "Bad mp3 handle %08x - using last one (%08x) instead", mp3, lastMp3Handle);
-		mp3 = lastMp3Handle;
+		it = mp3Map.find(lastMp3Handle);
 	}
 
-	if (mp3Map.find(mp3) == mp3Map.end())
+	if (it == mp3Map.end())
 		return NULL;
-	return mp3Map[mp3];
+	return it->second;
+}
+
+void __Mp3Shutdown() {
+	for (std::map<u32, Mp3Context *>::iterator it = mp3Map.begin(); it != mp3Map.end(); ++it) {
+		delete it->second->stream;
+		delete it->second;
+	}
+	mp3Map.clear();
+	lastMp3Handle = 0;
+}
+
+// Moves data from the game's buffer into the stream, as much as it wants.
+static void __Mp3FeedStream(Mp3Context *ctx) {
+	if (!ctx->stream)
+		return;
+
+	int wanted = ctx->stream->WantedBytes();
+	while (ctx->bufferAvailable && wanted > 0) {
+		// Maximum bytes we can read
+		int to_read = std::min(ctx->bufferAvailable, wanted);
+
+		// Don't read past the end if the buffer loops
+		to_read = std::min(ctx->mp3BufSize - ctx->bufferRead, to_read);
+		ctx->stream->AddData(Memory::GetPointer(ctx->mp3Buf + ctx->bufferRead), to_read);
+
+		ctx->bufferRead += to_read;
+		if (ctx->bufferRead == ctx->mp3BufSize)
+			ctx->bufferRead = 0;
+		ctx->bufferAvailable -= to_read;
+		wanted -= to_read;
+	}
+
+	if (ctx->bufferAvailable == 0) {
+		ctx->bufferRead = 0;
+		ctx->bufferWrite = 0;
+	}
 }
 
 /* MP3 */
@@ -118,72 +129,19 @@ int sceMp3Decode(u32 mp3, u32 outPcmPtr) {
 		return -1;
 	}
 
-	// Nothing to decode
-	if (ctx->bufferAvailable == 0 || ctx->readPosition >= ctx->mp3StreamEnd) {
+	if (!ctx->stream || !Memory::IsValidAddress(ctx->mp3PcmBuf)) {
 		return 0;
 	}
-	int bytesdecoded = 0;
-
-#ifndef USE_FFMPEG
-	Memory::Memset(ctx->mp3PcmBuf, 0, ctx->mp3PcmBufSize);
-	Memory::Write_U32(ctx->mp3PcmBuf, outPcmPtr);
-#else
-
-	AVFrame frame;
-	memset(&frame, 0, sizeof(frame));
-	AVPacket packet;
-	memset(&packet, 0, sizeof(packet));
-	int got_frame = 0, ret;
-	static int audio_frame_count = 0;
-
-	while (!got_frame) {
-		if ((ret = av_read_frame(ctx->avformat_context, &packet)) < 0)
-			break;
 
-		if (packet.stream_index == ctx->audio_stream_index) {
-			avcodec_get_frame_defaults(&frame);
-			got_frame = 0;
-			ret = avcodec_decode_audio4(ctx->decoder_context, &frame, &got_frame, &packet);
-			if (ret < 0) {
-				ERROR_LOG(HLE, "avcodec_decode_audio4: Error decoding audio %d", ret);
-				continue;
-			}
-			if (got_frame) {
-				//char buf[1024] = "";
-				//av_ts_make_time_string(buf, frame.pts, &ctx->decoder_context->time_base);
-				//DEBUG_LOG(HLE, "audio_frame n:%d nb_samples:%d pts:%s", audio_frame_count++, frame.nb_samples, buf);
-
-				/*
-				u8 *audio_dst_data;
-				int audio_dst_linesize;
-
-				ret = av_samples_alloc(&audio_dst_data, &audio_dst_linesize, frame.channels, frame.nb_samples, (AVSampleFormat)frame.format, 1);
-				if (ret < 0) {
-					ERROR_LOG(HLE, "av_samples_alloc: Could not allocate audio buffer %d", ret);
-					return -1;
-				}
-				*/
-
-				int decoded = av_samples_get_buffer_size(NULL, frame.channels, frame.nb_samples, (AVSampleFormat)frame.format, 1);
-
-				u8* out = Memory::GetPointer(ctx->mp3PcmBuf + bytesdecoded);
-				ret = swr_convert(ctx->resampler_context, &out, frame.nb_samples, (const u8**)frame.extended_data, frame.nb_samples);
-				if (ret < 0) {
-					ERROR_LOG(HLE, "swr_convert: Error while converting %d", ret);
-					return -1;
-				}
-
-				//av_samples_copy(&audio_dst_data, frame.data, 0, 0, frame.nb_samples, frame.channels, (AVSampleFormat)frame.format);
-
-				//memcpy(Memory::GetPointer(ctx->mp3PcmBuf + bytesdecoded), audio_dst_data, decoded);
-				bytesdecoded += decoded;
-				// av_freep(&audio_dst_data[0]);
-			}
-		}
-		av_free_packet(&packet);
+	__Mp3FeedStream(ctx);
+	int bytesdecoded = ctx->stream->Decode(Memory::GetPointer(ctx->mp3PcmBuf), ctx->mp3PcmBufSize);
+	// Nothing to decode
+	if (bytesdecoded == 0) {
+		return 0;
 	}
+	// So the worker has the next frames to get on with.
+	__Mp3FeedStream(ctx);
 	Memory::Write_U32(ctx->mp3PcmBuf, outPcmPtr);
-#endif
 
 	#if 0 && defined(_DEBUG)
 	char fileName[256];
@@ -215,6 +173,12 @@ int sceMp3ResetPlayPosition(u32 mp3) {
 	}
 
 	ctx->readPosition = ctx->mp3StreamStart;
+	// Whatever was buffered belongs to the old position.
+	ctx->bufferAvailable = 0;
+	ctx->bufferRead = 0;
+	ctx->bufferWrite = 0;
+	if (ctx->stream)
+		ctx->stream->Flush();
 	return 0;
 }
 
@@ -230,50 +194,6 @@ int sceMp3CheckStreamDataNeeded(u32 mp3) {
 	return ctx->bufferAvailable != ctx->mp3BufSize && ctx->readPosition < ctx->mp3StreamEnd;
 }
 
-int readFunc(void *opaque, uint8_t *buf, int buf_size) {
-	Mp3Context *ctx = static_cast<Mp3Context*>(opaque);
-
-	int res = 0;
-	while (ctx->bufferAvailable && buf_size) {
-		// Maximum bytes we can read
-		int to_read = std::min(ctx->bufferAvailable, buf_size);
-
-		// Don't read past the end if the buffer loops
-		to_read = std::min(ctx->mp3BufSize - ctx->bufferRead, to_read);
-		memcpy(buf + res, Memory::GetCharPointer(ctx->mp3Buf + ctx->bufferRead), to_read);
-
-		ctx->bufferRead += to_read;
-		if (ctx->bufferRead == ctx->mp3BufSize)
-			ctx->bufferRead = 0;
-		ctx->bufferAvailable -= to_read;
-		buf_size -= to_read;
-		res += to_read;
-	}
-
-	if (ctx->bufferAvailable == 0) {
-		ctx->bufferRead = 0;
-		ctx->bufferWrite = 0;
-	}
-
-#if 0 && defined(_DEBUG)
-	char fileName[256];
-	sprintf(fileName, "out.mp3");
-
-	FILE * file = fopen(fileName, "a+b");
-	if (file) {
-		if (!Memory::IsValidAddress(ctx->mp3Buf)) {
-			ERROR_LOG(HLE, "sceMp3Decode mp3Buf %08X is not a valid address!", ctx->mp3Buf);
-		}
-
-		fwrite(buf, 1, res, file);
-
-		fclose(file);
-	}
-#endif
-
-	return res;
-}
-
 u32 sceMp3ReserveMp3Handle(u32 mp3Addr) {
 	DEBUG_LOG(HLE, "sceMp3ReserveMp3Handle(%08x)", mp3Addr);
 	Mp3Context *ctx = new Mp3Context;
@@ -293,11 +213,7 @@ u32 sceMp3ReserveMp3Handle(u32 mp3Addr) {
 	ctx->mp3Channels = 2;
 	ctx->mp3Bitrate = 128;
 	ctx->mp3SamplingRate = 44100;
-
-#ifdef USE_FFMPEG
-	ctx->avformat_context = NULL;
-	ctx->avio_context = NULL;
-#endif
+	ctx->stream = NULL;
 
 	mp3Map[mp3Addr] = ctx;
 	return mp3Addr;
@@ -324,77 +240,22 @@ int sceMp3Init(u32 mp3) {
 		return -1;
 	}
 
-	// Read in the header and swap the endian
-	int header = Memory::Read_U32(ctx->mp3Buf);
-	header = (header >> 24) |
-		((header<<8) & 0x00FF0000) |
-		((header>>8) & 0x0000FF00) |
-		(header << 24);
-
-	ctx->mp3Version = ((header >> 19) & 0x3);
-
-#ifdef USE_FFMPEG
-	u8* avio_buffer = static_cast<u8*>(av_malloc(ctx->mp3BufSize));
-	ctx->avio_context = avio_alloc_context(avio_buffer, ctx->mp3BufSize, 0, ctx, readFunc, NULL, NULL);
-	ctx->avformat_context = avformat_alloc_context();
-	ctx->avformat_context->pb = ctx->avio_context;
-
-	int ret;
-	if ((ret = avformat_open_input(&ctx->avformat_context, NULL, av_find_input_format("mp3"), NULL)) < 0) {
-		ERROR_LOG(HLE, "avformat_open_input: Cannot open input %d", ret);
+	delete ctx->stream;
+	ctx->stream = new Mp3Stream();
+	if (!ctx->stream->Init())
 		return -1;
-	}
 
-	if ((ret = avformat_find_stream_info(ctx->avformat_context, NULL)) < 0) {
-		ERROR_LOG(HLE, "avformat_find_stream_info: Cannot find stream information %d", ret);
-		return -1;
-	}
-
-	AVCodec *dec;
-
-	/* select the audio stream */
-	ret = av_find_best_stream(ctx->avformat_context, AVMEDIA_TYPE_AUDIO, -1, -1, &dec, 0);
-	if (ret < 0) {
-		ERROR_LOG(HLE, "av_find_best_stream: Cannot find a audio stream in the input file %d", ret);
-		return -1;
-	}
-	ctx->audio_stream_index = ret;
-	ctx->decoder_context = ctx->avformat_context->streams[ctx->audio_stream_index]->codec;
-
-	/* init the audio decoder */
-	if ((ret = avcodec_open2(ctx->decoder_context, dec, NULL)) < 0) {
-		ERROR_LOG(HLE, "avcodec_open2: Cannot open audio decoder %d", ret);
-		return -1;
-	}
-
-	ctx->resampler_context = swr_alloc_set_opts(NULL,
-		ctx->decoder_context->channel_layout,
-		AV_SAMPLE_FMT_S16,
-		ctx->decoder_context->sample_rate,
-		ctx->decoder_context->channel_layout,
-		ctx->decoder_context->sample_fmt,
-		ctx->decoder_context->sample_rate,
-		0, NULL);
-
-	// Let's just grab this info from FFMPEG, it seems more reliable than the code above.
-
-	ctx->mp3SamplingRate = ctx->decoder_context->sample_rate;
-	ctx->mp3Channels = ctx->decoder_context->channels;
-	ctx->mp3Bitrate = ctx->decoder_context->bit_rate;
-
-	if (!ctx->resampler_context) {
-		ERROR_LOG(HLE, "Could not allocate resampler context %d", ret);
-		return -1;
-	}
-
-	if ((ret = swr_init(ctx->resampler_context)) < 0) {
-		ERROR_LOG(HLE, "Failed to initialize the resampling context %d", ret);
-		return -1;
+	__Mp3FeedStream(ctx);
+	Mp3FrameHeader info;
+	if (ctx->stream->GetFirstHeader(&info)) {
+		ctx->mp3Version = info.version;
+		ctx->mp3SamplingRate = info.sampleRate;
+		ctx->mp3Channels = info.channels;
+		ctx->mp3Bitrate = info.bitrate;
+	} else {
+		WARN_LOG(HLE, "sceMp3Init(%08x): no mp3 frames found in the initial data", mp3);
 	}
 
-	av_dump_format(ctx->avformat_context, 0, "mp3", 0);
-#endif
-
 	return 0;
 }
 
@@ -534,12 +395,14 @@ int sceMp3ReleaseMp3Handle(u32 mp3) {
 		return -1;
 	}
 
-#ifdef USE_FFMPEG
-	av_free(ctx->avio_context->buffer);
-	av_free(ctx->avio_context);
-#endif
-	mp3Map.erase(mp3Map.find(mp3));
+	for (std::map<u32, Mp3Context *>::iterator it = mp3Map.begin(); it != mp3Map.end(); ++it) {
+		if (it->second == ctx) {
+			mp3Map.erase(it);
+			break;
+		}
+	}
 
+	delete ctx->stream;
 	delete ctx;
 
 	return 0;
@@ -19,4 +19,5 @@
 
 #include "HLE.h"
 
-void Register_sceMp3();
\ No newline at end of file
+void Register_sceMp3();
+void __Mp3Shutdown();
\ No newline at end of file
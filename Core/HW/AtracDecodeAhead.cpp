@@ -0,0 +1,168 @@
+// Copyright (c) 2013- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <cstring>
+
+#include "base/timeutil.h"
+#include "Common/Thread.h"
+#include "Core/HW/AtracDecodeAhead.h"
+
+AtracDecodeAhead::AtracDecodeAhead() : thread_(NULL), stop_(false), busy_(false), context_(NULL), contextDirty_(false) {
+}
+
+AtracDecodeAhead::~AtracDecodeAhead() {
+	Stop();
+}
+
+void AtracDecodeAhead::FlushLocked(std::unique_lock<std::mutex> &guard) {
+	while (busy_)
+		cond_.wait(guard);
+	for (size_t i = 0; i < frames_.size(); ++i) {
+		if (frames_[i].decoded)
+			contextDirty_ = true;
+	}
+	frames_.clear();
+}
+
+void AtracDecodeAhead::Flush() {
+	std::unique_lock<std::mutex> guard(mutex_);
+	FlushLocked(guard);
+}
+
+void AtracDecodeAhead::Stop() {
+	{
+		std::unique_lock<std::mutex> guard(mutex_);
+		FlushLocked(guard);
+		stop_ = true;
+		cond_.notify_all();
+	}
+	if (thread_) {
+		thread_->join();
+		delete thread_;
+		thread_ = NULL;
+	}
+	stop_ = false;
+	context_ = NULL;
+	contextDirty_ = false;
+}
+
+void AtracDecodeAhead::Queue(Atrac3plus_Decoder::Context context, int sample, const u8 *data, int bytes) {
+	std::unique_lock<std::mutex> guard(mutex_);
+	if (context_ != context) {
+		FlushLocked(guard);
+		context_ = context;
+	}
+
+	frames_.push_back(Frame());
+	Frame &frame = frames_.back();
+	frame.sample = sample;
+	frame.data = data;
+	frame.inbytes = bytes;
+	frame.decoded = false;
+	frame.outbytes = 0;
+	frame.decodeTime = 0.0;
+
+	if (!thread_)
+		thread_ = new std::thread(&AtracDecodeAhead::RunThread, this);
+	cond_.notify_all();
+}
+
+int AtracDecodeAhead::QueuedFrames() {
+	std::lock_guard<std::mutex> guard(mutex_);
+	return (int)frames_.size();
+}
+
+int AtracDecodeAhead::DecodedFrames() {
+	std::lock_guard<std::mutex> guard(mutex_);
+	int decoded = 0;
+	for (size_t i = 0; i < frames_.size(); ++i) {
+		if (frames_[i].decoded)
+			decoded++;
+	}
+	return decoded;
+}
+
+int AtracDecodeAhead::LastQueuedSample() {
+	std::lock_guard<std::mutex> guard(mutex_);
+	return frames_.back().sample;
+}
+
+bool AtracDecodeAhead::Take(int sample, u8 *out, int *outbytes, double *decodeTime) {
+	std::unique_lock<std::mutex> guard(mutex_);
+	if (frames_.empty() || frames_.front().sample != sample) {
+		FlushLocked(guard);
+		return false;
+	}
+
+	// It's next in line, so either done or being worked on.
+	while (!frames_.front().decoded)
+		cond_.wait(guard);
+
+	const Frame &frame = frames_.front();
+	memcpy(out, frame.pcm, frame.outbytes);
+	*outbytes = frame.outbytes;
+	*decodeTime = frame.decodeTime;
+	frames_.pop_front();
+	return true;
+}
+
+bool AtracDecodeAhead::TakeContextDirty() {
+	std::lock_guard<std::mutex> guard(mutex_);
+	bool dirty = contextDirty_;
+	contextDirty_ = false;
+	return dirty;
+}
+
+void AtracDecodeAhead::RunThread(AtracDecodeAhead *self) {
+	self->Run();
+}
+
+void AtracDecodeAhead::Run() {
+	Common::SetCurrentThreadName("AtracDecodeAhead");
+
+	std::unique_lock<std::mutex> guard(mutex_);
+	while (!stop_) {
+		Frame *frame = NULL;
+		for (size_t i = 0; i < frames_.size(); ++i) {
+			if (!frames_[i].decoded) {
+				frame = &frames_[i];
+				break;
+			}
+		}
+		if (!frame) {
+			cond_.wait(guard);
+			continue;
+		}
+
+		// Nothing else moves or frees this frame while busy_ is set.
+		busy_ = true;
+		guard.unlock();
+
+		double startTime = real_time_now();
+		int outbytes = 0;
+		if (!Atrac3plus_Decoder::Decode(context_, (void *)frame->data, frame->inbytes, &outbytes, frame->pcm))
+			outbytes = 0;
+		double decodeTime = real_time_now() - startTime;
+
+		guard.lock();
+		busy_ = false;
+		frame->outbytes = outbytes;
+		frame->decodeTime = decodeTime;
+		frame->decoded = true;
+		cond_.notify_all();
+	}
+}
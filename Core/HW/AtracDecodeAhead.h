@@ -0,0 +1,93 @@
+// Copyright (c) 2013- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#pragma once
+
+#include <deque>
+
+#include "../../Globals.h"
+#include "Common/StdConditionVariable.h"
+#include "Common/StdMutex.h"
+#include "Common/StdThread.h"
+#include "Core/HW/atrac3plus.h"
+
+// Decodes Atrac3+ frames on a worker thread, before the game asks for them.
+//
+// The emulator thread queues the frames it expects to play next, keyed by their first
+// sample.  When the game then decodes, Take() hands over the frame if it's the one that
+// was expected, and otherwise throws everything away so the caller decodes it itself.
+// While anything is queued, only the worker may touch the decoder context.
+//
+// Frames carry decoder state over, so if decoded frames get thrown away, the context has
+// gone past the last frame taken.  TakeContextDirty() tells the caller to fix that up.
+class AtracDecodeAhead
+{
+public:
+	enum {
+		MAX_FRAMES = 4,
+		// 0x800 samples of up to 8 channels, like the decode buffer in sceAtrac.
+		MAX_FRAME_BYTES = 0x8000,
+	};
+
+	AtracDecodeAhead();
+	~AtracDecodeAhead();
+
+	// Forgets anything queued or decoded, waiting for the worker to let go of the context.
+	void Flush();
+	// Also ends the worker, before the context or its data go away.
+	void Stop();
+
+	// data must stay valid and unchanged until the frame is taken or flushed.
+	void Queue(Atrac3plus_Decoder::Context context, int sample, const u8 *data, int bytes);
+	int QueuedFrames();
+	// Of those, how many the worker has finished.
+	int DecodedFrames();
+	// Only valid when something is queued.
+	int LastQueuedSample();
+
+	// Returns false (after flushing) if sample isn't the next queued frame.
+	// decodeTime is how long the worker spent on it, in seconds.
+	bool Take(int sample, u8 *out, int *outbytes, double *decodeTime);
+	// True (once) if a flush threw away frames the worker had already decoded.
+	bool TakeContextDirty();
+
+private:
+	struct Frame {
+		int sample;
+		const u8 *data;
+		int inbytes;
+		bool decoded;
+		int outbytes;
+		double decodeTime;
+		u8 pcm[MAX_FRAME_BYTES];
+	};
+
+	static void RunThread(AtracDecodeAhead *self);
+	void Run();
+	void FlushLocked(std::unique_lock<std::mutex> &guard);
+
+	std::thread *thread_;
+	std::mutex mutex_;
+	// Signals both new work for the worker and finished frames for the emulator.
+	std::condition_variable cond_;
+	bool stop_;
+	// The worker is decoding, outside the lock.
+	bool busy_;
+	Atrac3plus_Decoder::Context context_;
+	bool contextDirty_;
+	std::deque<Frame> frames_;
+};
@@ -18,7 +18,9 @@
 #include "MediaEngine.h"
 #include "../MemMap.h"
 #include "GPU/GPUInterface.h"
+#include "Common/Thread.h"
 #include "Core/HW/atrac3plus.h"
+#include "Core/HW/YuvConvert.h"
 
 #ifdef USE_FFMPEG
 
@@ -97,6 +99,14 @@ MediaEngine::MediaEngine(): m_pdata(0) {
 	m_noAudioData = false;
 	m_bufSize = 0x2000;
 	m_mpegheaderReadPos = 0;
+	memset(&m_picture, 0, sizeof(m_picture));
+	m_decodingsize = 0;
+	m_decodeThread = 0;
+	m_readPos = 0;
+	m_consumedPos = 0;
+	m_lastReadSize = 0;
+	m_decodeStop = false;
+	m_decodeStarved = false;
 	g_iNumVideos++;
 }
 
@@ -106,6 +116,9 @@ MediaEngine::~MediaEngine() {
 }
 
 void MediaEngine::closeMedia() {
+	// The decode thread uses everything below.
+	stopDecodeThread();
+	freePicture(&m_picture);
 #ifdef USE_FFMPEG
 	if (m_buffer)
 		av_free(m_buffer);
@@ -153,12 +166,18 @@ void MediaEngine::DoState(PointerWrap &p){
 		loadStream(m_mpegheader, 2048, m_ringbuffersize);
 	u32 hasopencontext = m_pFormatCtx != NULL;
 	p.Do(hasopencontext);
-	if (hasopencontext && p.mode == p.MODE_READ)
-		openContext();
-	if (m_pdata)
+	if (m_pdata) {
+		std::lock_guard<std::mutex> guard(m_decodeMutex);
 		m_pdata->DoState(p);
+	}
 	if (m_demux)
 		m_demux->DoState(p);
+	// Only now that the data is back, since opening reads some.  Everything the game hasn't
+	// taken a picture for is still in m_pdata, so the pictures decoded ahead just get redone.
+	if (hasopencontext && p.mode == p.MODE_READ) {
+		openContext();
+		startDecodeThread();
+	}
 
 	p.Do(m_videopts);
 	p.Do(m_audiopts);
@@ -181,9 +200,19 @@ int _MpegReadbuffer(void *opaque, uint8_t *buf, int buf_size)
 	} else if (mpeg->m_mpegheaderReadPos == mpegheaderSize) {
 		return 0;
 	} else {
-		size = mpeg->m_pdata->pop_front(buf, buf_size);
-		if (size > 0)
-			mpeg->m_decodingsize = size;
+		std::unique_lock<std::mutex> guard(mpeg->m_decodeMutex);
+		// Ahead of the game, wait for it to add a whole read, so the sizes don't depend on
+		// timing.  But if it's waiting on a picture, run dry just like decoding on demand would.
+		int unread = mpeg->m_pdata->getQueueSize() - (int)(mpeg->m_readPos - mpeg->m_consumedPos);
+		while (mpeg->m_decodeThread && unread < buf_size && !mpeg->m_decodeStarved && !mpeg->m_decodeStop) {
+			mpeg->m_decodeCond.wait(guard);
+			unread = mpeg->m_pdata->getQueueSize() - (int)(mpeg->m_readPos - mpeg->m_consumedPos);
+		}
+		size = mpeg->m_pdata->get_front(buf, buf_size, (int)(mpeg->m_readPos - mpeg->m_consumedPos));
+		if (size > 0) {
+			mpeg->m_readPos += size;
+			mpeg->m_lastReadSize = size;
+		}
 	}
 	return size;
 }
@@ -207,6 +236,9 @@ bool MediaEngine::openContext() {
 		return false;
 	m_mpegheaderReadPos = 0;
 	m_decodingsize = 0;
+	m_readPos = 0;
+	m_consumedPos = 0;
+	m_lastReadSize = 0;
 
 	u8* tempbuf = (u8*)av_malloc(m_bufSize);
 
@@ -280,8 +312,12 @@ bool MediaEngine::loadStream(u8* buffer, int readSize, int RingbufferSize)
 int MediaEngine::addStreamData(u8* buffer, int addSize) {
 	int size = addSize;
 	if (size > 0 && m_pdata) {
-		if (!m_pdata->push(buffer, size)) 
-			size  = 0;
+		{
+			std::lock_guard<std::mutex> guard(m_decodeMutex);
+			if (!m_pdata->push(buffer, size)) 
+				size  = 0;
+			m_decodeCond.notify_all();
+		}
 		if (m_demux) {
 			m_demux->addStreamData(buffer, addSize);
 			m_demux->demux(m_audioStream);
@@ -291,7 +327,8 @@ int MediaEngine::addStreamData(u8* buffer, int addSize) {
 			m_pdata->get_front(m_mpegheader, sizeof(m_mpegheader));
 			int mpegoffset = bswap32(*(int*)(m_mpegheader + 8));
 			m_pdata->pop_front(0, mpegoffset);
-			openContext();
+			if (openContext())
+				startDecodeThread();
 		}
 #endif // USE_FFMPEG
 	}
@@ -367,11 +404,127 @@ bool MediaEngine::stepVideo(int videoPixelMode) {
 	if ((!m_pFrame)||(!m_pFrameRGB))
 		return false;
 
-	updateSwsFormat(videoPixelMode);
-	// TODO: Technically we could set this to frameWidth instead of m_desWidth for better perf.
-	// Update the linesize for the new format too.  We started with the largest size, so it should fit.
-	m_pFrameRGB->linesize[0] = getPixelFormatBytes(videoPixelMode) * m_desWidth;
+	DecodedPicture picture;
+	{
+		std::unique_lock<std::mutex> guard(m_decodeMutex);
+		if (!m_decodeThread)
+			return false;
+		if (m_decoded.empty()) {
+			m_decodeStarved = true;
+			m_decodeCond.notify_all();
+			while (m_decoded.empty())
+				m_decodeCond.wait(guard);
+		}
+		picture = m_decoded.front();
+		m_decoded.pop_front();
+		// Room for the next one.
+		m_decodeCond.notify_all();
+
+		// The game is done with the data for this one.
+		m_pdata->pop_front(0, (int)(picture.readEnd - m_consumedPos));
+		m_consumedPos = picture.readEnd;
+		m_decodingsize = picture.readSize;
+	}
+
+	if (picture.reachedEnd)
+		m_isVideoEnd = picture.videoEnd;
+	if (!picture.buffer)
+		return false;
+
+	freePicture(&m_picture);
+	m_picture = picture;
+	m_videopts = picture.pts;
+
+	if (!canConvertDirectly()) {
+		updateSwsFormat(videoPixelMode);
+		// TODO: Technically we could set this to frameWidth instead of m_desWidth for better perf.
+		// Update the linesize for the new format too.  We started with the largest size, so it should fit.
+		m_pFrameRGB->linesize[0] = getPixelFormatBytes(videoPixelMode) * m_desWidth;
+		sws_scale(m_sws_ctx, m_picture.data, m_picture.linesize, 0,
+			m_pCodecCtx->height, m_pFrameRGB->data, m_pFrameRGB->linesize);
+	}
+	return true;
+#else
+	return true;
+#endif // USE_FFMPEG
+}
 
+bool MediaEngine::canConvertDirectly() {
+#ifdef USE_FFMPEG
+	// Scaling and other formats are left to swscale.
+	return m_picture.buffer && m_picture.pixelFormat == AV_PIX_FMT_YUV420P &&
+		m_desWidth == m_pCodecCtx->width && m_desHeight == m_pCodecCtx->height;
+#else
+	return false;
+#endif // USE_FFMPEG
+}
+
+void MediaEngine::startDecodeThread() {
+	std::lock_guard<std::mutex> guard(m_decodeMutex);
+	if (m_decodeThread || !m_pCodecCtx || !m_pFrame)
+		return;
+	m_decodeStop = false;
+	m_decodeStarved = false;
+	m_decodeThread = new std::thread(&MediaEngine::runDecodeThread, this);
+}
+
+void MediaEngine::stopDecodeThread() {
+	std::thread *thread;
+	{
+		std::lock_guard<std::mutex> guard(m_decodeMutex);
+		m_decodeStop = true;
+		m_decodeCond.notify_all();
+		thread = m_decodeThread;
+	}
+	if (thread) {
+		thread->join();
+		delete thread;
+	}
+
+	std::lock_guard<std::mutex> guard(m_decodeMutex);
+	m_decodeThread = 0;
+	m_decodeStop = false;
+	for (size_t i = 0; i < m_decoded.size(); ++i)
+		freePicture(&m_decoded[i]);
+	m_decoded.clear();
+}
+
+void MediaEngine::runDecodeThread(MediaEngine *engine) {
+	engine->decodeThreadFunc();
+}
+
+void MediaEngine::decodeThreadFunc() {
+	Common::SetCurrentThreadName("MediaEngine");
+
+	std::unique_lock<std::mutex> guard(m_decodeMutex);
+	while (!m_decodeStop) {
+		if (m_decoded.size() >= VIDEO_DECODE_AHEAD_FRAMES) {
+			m_decodeCond.wait(guard);
+			continue;
+		}
+
+		// Only this thread touches the decoder while it runs.
+		guard.unlock();
+		DecodedPicture picture;
+		decodePicture(&picture);
+		guard.lock();
+
+		if (m_decodeStop) {
+			freePicture(&picture);
+			break;
+		}
+		picture.readEnd = m_readPos;
+		picture.readSize = picture.videoEnd ? 0 : m_lastReadSize;
+		m_decoded.push_back(picture);
+		// That answers the game, if it was waiting.
+		m_decodeStarved = false;
+		m_decodeCond.notify_all();
+	}
+}
+
+void MediaEngine::decodePicture(DecodedPicture *picture) {
+	memset(picture, 0, sizeof(*picture));
+#ifdef USE_FFMPEG
 	AVPacket packet;
 	int frameFinished;
 	bool bGetFrame = false;
@@ -386,29 +539,44 @@ bool MediaEngine::stepVideo(int videoPixelMode) {
 
 			int result = avcodec_decode_video2(m_pCodecCtx, m_pFrame, &frameFinished, &packet);
 			if (frameFinished) {
-				sws_scale(m_sws_ctx, m_pFrame->data, m_pFrame->linesize, 0,
-					m_pCodecCtx->height, m_pFrameRGB->data, m_pFrameRGB->linesize);
-
-				m_videopts = m_pFrame->pkt_dts + av_frame_get_pkt_duration(m_pFrame) - m_firstTimeStamp;
+				// The decoder reuses its frames, so keep a copy.
+				AVPixelFormat format = m_pCodecCtx->pix_fmt;
+				int width = m_pCodecCtx->width;
+				int height = m_pCodecCtx->height;
+				AVPicture copy;
+				picture->buffer = (u8 *)av_malloc(avpicture_get_size(format, width, height));
+				avpicture_fill(&copy, picture->buffer, format, width, height);
+				av_picture_copy(&copy, (const AVPicture *)m_pFrame, format, width, height);
+				for (int i = 0; i < 4; ++i) {
+					picture->data[i] = copy.data[i];
+					picture->linesize[i] = copy.linesize[i];
+				}
+				picture->pixelFormat = format;
+				picture->pts = m_pFrame->pkt_dts + av_frame_get_pkt_duration(m_pFrame) - m_firstTimeStamp;
 				bGetFrame = true;
 			}
 			if (result <= 0 && dataEnd) {
 				// Sometimes, m_readSize is less than m_streamSize at the end, but not by much.
 				// This is kinda a hack, but the ringbuffer would have to be prematurely empty too.
-				m_isVideoEnd = !bGetFrame && (m_pdata->getQueueSize() == 0);
-				if (m_isVideoEnd)
-					m_decodingsize = 0;
+				std::lock_guard<std::mutex> guard(m_decodeMutex);
+				picture->reachedEnd = true;
+				picture->videoEnd = !bGetFrame && m_pdata->getQueueSize() == (int)(m_readPos - m_consumedPos);
 				break;
 			}
 		}
 		av_free_packet(&packet);
 	}
-	return bGetFrame;
-#else
-	return true;
 #endif // USE_FFMPEG
 }
 
+void MediaEngine::freePicture(DecodedPicture *picture) {
+#ifdef USE_FFMPEG
+	if (picture->buffer)
+		av_free(picture->buffer);
+#endif // USE_FFMPEG
+	picture->buffer = 0;
+}
+
 // Helpers that null out alpha (which seems to be the case on the PSP.)
 // Some games depend on this, for example Sword Art Online (doesn't clear A's from buffer.)
 
@@ -460,6 +628,15 @@ int MediaEngine::writeVideoImage(u8* buffer, int frameWidth, int videoPixelMode)
 	u8 *imgbuf = buffer;
 	const u8 *data = m_pFrameRGB->data[0];
 
+	if (canConvertDirectly()) {
+		const u8 *const planes[3] = {m_picture.data[0], m_picture.data[1], m_picture.data[2]};
+		if (!ConvertYUV420ToPSP(imgbuf, frameWidth, videoPixelMode, planes, m_picture.linesize, 0, 0, width, height)) {
+			ERROR_LOG(ME, "Unsupported video pixel format %d", videoPixelMode);
+			return 0;
+		}
+		return frameWidth * getPixelFormatBytes(videoPixelMode) * height;
+	}
+
 	switch (videoPixelMode) {
 	case TPSM_PIXEL_STORAGE_MODE_32BIT_ABGR8888:
 		for (int y = 0; y < height; y++) {
@@ -521,6 +698,15 @@ int MediaEngine::writeVideoImageWithRange(u8* buffer, int frameWidth, int videoP
 	if (height > m_desHeight - ypos)
 		height = m_desHeight - ypos;
 
+	if (canConvertDirectly()) {
+		const u8 *const planes[3] = {m_picture.data[0], m_picture.data[1], m_picture.data[2]};
+		if (!ConvertYUV420ToPSP(imgbuf, frameWidth, videoPixelMode, planes, m_picture.linesize, xpos, ypos, width, height)) {
+			ERROR_LOG(ME, "Unsupported video pixel format %d", videoPixelMode);
+			return 0;
+		}
+		return frameWidth * getPixelFormatBytes(videoPixelMode) * m_desHeight;
+	}
+
 	switch (videoPixelMode) {
 	case TPSM_PIXEL_STORAGE_MODE_32BIT_ABGR8888:
 		data += (ypos * m_desWidth + xpos) * sizeof(u32);
@@ -574,6 +760,7 @@ int MediaEngine::writeVideoImageWithRange(u8* buffer, int frameWidth, int videoP
 int MediaEngine::getRemainSize() {
 	if (!m_pdata)
 		return 0;
+	std::lock_guard<std::mutex> guard(m_decodeMutex);
 	return std::max(m_pdata->getRemainSize() - m_decodingsize - 2048, 0);
 }
 
@@ -25,9 +25,15 @@
 
 // An approximation of what the interface will look like. Similar to JPCSP's.
 
+#include <deque>
+
 #include "../../Globals.h"
 #include "../HLE/sceMpeg.h"
 #include "ChunkFile.h"
+#include "Common/StdConditionVariable.h"
+#include "Common/StdMutex.h"
+#include "Common/StdThread.h"
+#include "Core/HW/atrac3plus.h"
 #include "Core/HW/MpegDemux.h"
 
 struct SwsContext;
@@ -44,6 +50,11 @@ inline s64 getMpegTimeStamp(u8* buf) {
 class MediaEngine
 {
 public:
+	enum {
+		// Pictures the decode thread keeps ready, ahead of the game.
+		VIDEO_DECODE_AHEAD_FRAMES = 3,
+	};
+
 	MediaEngine();
 	~MediaEngine();
 
@@ -76,7 +87,30 @@ public:
 	void DoState(PointerWrap &p);
 
 private:
+	// A decoded picture, copied out of the decoder.
+	struct DecodedPicture {
+		u8 *buffer;
+		u8 *data[4];
+		int linesize[4];
+		int pixelFormat;
+		s64 pts;
+		// Decoding ran out of data, so m_isVideoEnd should become videoEnd.
+		bool reachedEnd;
+		bool videoEnd;
+		// How far into m_pdata decoding this read, and how much it read last.
+		s64 readEnd;
+		int readSize;
+	};
+
 	void updateSwsFormat(int videoPixelMode);
+	bool canConvertDirectly();
+
+	void startDecodeThread();
+	void stopDecodeThread();
+	static void runDecodeThread(MediaEngine *engine);
+	void decodeThreadFunc();
+	void decodePicture(DecodedPicture *picture);
+	static void freePicture(DecodedPicture *picture);
 
 public:
 
@@ -93,6 +127,7 @@ public:
 
 	int  m_desWidth;
 	int  m_desHeight;
+	// The last read for the picture the game took.  Emulator thread only.
 	int m_decodingsize;
 	int m_bufSize;
 	s64 m_videopts;
@@ -111,4 +146,22 @@ public:
 	int m_ringbuffersize;
 	u8 m_mpegheader[0x10000];
 	int m_mpegheaderReadPos;
+
+	// The picture writeVideoImage() uses.  Emulator thread only.
+	DecodedPicture m_picture;
+
+	std::thread *m_decodeThread;
+	// Guards m_pdata and the positions in it too, which the decode thread reads from.
+	std::mutex m_decodeMutex;
+	// Decoding reads m_pdata without popping, the data only goes once the game takes the
+	// picture it was for.  So states keep it, and the free space is the same however far
+	// ahead the decode thread is.  Both count from openContext().
+	s64 m_readPos;
+	s64 m_consumedPos;
+	int m_lastReadSize;
+	std::condition_variable m_decodeCond;
+	bool m_decodeStop;
+	// The game is waiting on a picture, so reading shouldn't wait for more data.
+	bool m_decodeStarved;
+	std::deque<DecodedPicture> m_decoded;
 };
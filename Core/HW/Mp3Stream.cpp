@@ -0,0 +1,336 @@
+// Copyright (c) 2013- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <algorithm>
+#include <cstring>
+
+#include "Common/Log.h"
+#include "Common/Thread.h"
+#include "Core/HW/Mp3Stream.h"
+
+#ifdef USE_FFMPEG
+
+// Urgh! Why is this needed?
+#ifdef ANDROID
+#ifndef UINT64_C
+#define UINT64_C(c) (c ## ULL)
+#endif
+#endif
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libswresample/swresample.h>
+#include <libavutil/samplefmt.h>
+}
+#endif // USE_FFMPEG
+
+static const int MP3_BITRATES[] = {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320};
+// MPEG 2 and 2.5.
+static const int MP3_BITRATES_LSF[] = {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160};
+static const int MP3_SAMPLE_RATES[] = {44100, 48000, 32000};
+
+bool Mp3ParseFrameHeader(u32 header, Mp3FrameHeader *info) {
+	if ((header & 0xFFE00000) != 0xFFE00000)
+		return false;
+	int version = (header >> 19) & 3;
+	int layer = (header >> 17) & 3;
+	int bitrateIndex = (header >> 12) & 0xF;
+	int sampleRateIndex = (header >> 10) & 3;
+	// Version 1 is reserved, and layer 1 means layer III.  Free format isn't supported.
+	if (version == 1 || layer != 1 || bitrateIndex == 0 || bitrateIndex == 0xF || sampleRateIndex == 3)
+		return false;
+
+	bool mpeg1 = version == 3;
+	info->version = version;
+	info->bitrate = mpeg1 ? MP3_BITRATES[bitrateIndex] : MP3_BITRATES_LSF[bitrateIndex];
+	info->sampleRate = MP3_SAMPLE_RATES[sampleRateIndex] >> (mpeg1 ? 0 : (version == 2 ? 1 : 2));
+	info->channels = ((header >> 6) & 3) == 3 ? 1 : 2;
+	info->samplesPerFrame = mpeg1 ? 1152 : 576;
+	int padding = (header >> 9) & 1;
+	info->frameSize = (mpeg1 ? 144000 : 72000) * info->bitrate / info->sampleRate + padding;
+	return true;
+}
+
+Mp3Stream::Mp3Stream()
+	: skipBytes_(0), haveFirstHeader_(false), thread_(NULL), stop_(false), busy_(false), framesBytes_(0),
+	  hits_(0), misses_(0), decoder_(NULL), frame_(NULL), resampler_(NULL) {
+	memset(&firstHeader_, 0, sizeof(firstHeader_));
+}
+
+Mp3Stream::~Mp3Stream() {
+	Stop();
+#ifdef USE_FFMPEG
+	if (resampler_)
+		swr_free(&resampler_);
+	if (frame_)
+		av_free(frame_);
+	if (decoder_) {
+		avcodec_close(decoder_);
+		av_free(decoder_);
+	}
+#endif // USE_FFMPEG
+}
+
+bool Mp3Stream::Init() {
+#ifdef USE_FFMPEG
+	AVCodec *codec = avcodec_find_decoder_by_name("mp3");
+	if (!codec) {
+		ERROR_LOG(HLE, "Mp3Stream: no mp3 decoder");
+		return false;
+	}
+	decoder_ = avcodec_alloc_context3(codec);
+	int ret;
+	if ((ret = avcodec_open2(decoder_, codec, NULL)) < 0) {
+		ERROR_LOG(HLE, "avcodec_open2: Cannot open audio decoder %d", ret);
+		av_free(decoder_);
+		decoder_ = NULL;
+		return false;
+	}
+	frame_ = avcodec_alloc_frame();
+#endif // USE_FFMPEG
+
+	if (!thread_)
+		thread_ = new std::thread(&Mp3Stream::RunThread, this);
+	return true;
+}
+
+void Mp3Stream::Stop() {
+	{
+		std::unique_lock<std::mutex> guard(mutex_);
+		stop_ = true;
+		cond_.notify_all();
+	}
+	if (thread_) {
+		thread_->join();
+		delete thread_;
+		thread_ = NULL;
+	}
+	stop_ = false;
+}
+
+int Mp3Stream::WantedBytes() {
+	std::lock_guard<std::mutex> guard(mutex_);
+	return std::max(0, (int)TARGET_INPUT_BYTES - (int)pending_.size() - framesBytes_);
+}
+
+void Mp3Stream::AddData(const u8 *data, int size) {
+	pending_.insert(pending_.end(), data, data + size);
+	ParseFrames();
+}
+
+bool Mp3Stream::GetFirstHeader(Mp3FrameHeader *info) const {
+	if (haveFirstHeader_)
+		*info = firstHeader_;
+	return haveFirstHeader_;
+}
+
+void Mp3Stream::ParseFrames() {
+	const u8 *data = pending_.empty() ? NULL : &pending_[0];
+	size_t size = pending_.size();
+	size_t pos = std::min((size_t)skipBytes_, size);
+	skipBytes_ -= (int)pos;
+
+	std::vector<std::vector<u8> > found;
+	while (pos + 4 <= size) {
+		size_t remaining = size - pos;
+		// ID3v2 tags come first in many files.
+		if (memcmp(data + pos, "ID3", 3) == 0) {
+			if (remaining < 10)
+				break;
+			int tagSize = (data[pos + 6] << 21) | (data[pos + 7] << 14) | (data[pos + 8] << 7) | data[pos + 9];
+			// There may be a footer, too.
+			tagSize += (data[pos + 5] & 0x10) ? 20 : 10;
+			size_t skip = std::min((size_t)tagSize, remaining);
+			skipBytes_ = tagSize - (int)skip;
+			pos += skip;
+			continue;
+		}
+
+		u32 header = (data[pos] << 24) | (data[pos + 1] << 16) | (data[pos + 2] << 8) | data[pos + 3];
+		Mp3FrameHeader info;
+		if (!Mp3ParseFrameHeader(header, &info)) {
+			// Lost sync, or junk like an ID3v1 tag.
+			++pos;
+			continue;
+		}
+		if (remaining < (size_t)info.frameSize)
+			break;
+
+		if (!haveFirstHeader_) {
+			firstHeader_ = info;
+			haveFirstHeader_ = true;
+		}
+		found.push_back(std::vector<u8>(data + pos, data + pos + info.frameSize));
+		pos += info.frameSize;
+	}
+	pending_.erase(pending_.begin(), pending_.begin() + pos);
+
+	if (!found.empty()) {
+		std::lock_guard<std::mutex> guard(mutex_);
+		for (size_t i = 0; i < found.size(); ++i) {
+			framesBytes_ += (int)found[i].size();
+			frames_.push_back(std::vector<u8>());
+			frames_.back().swap(found[i]);
+		}
+		cond_.notify_all();
+	}
+}
+
+int Mp3Stream::Decode(u8 *out, int maxBytes) {
+	std::unique_lock<std::mutex> guard(mutex_);
+	// If the worker is on the next frame, it's quicker to wait for it.
+	while (busy_)
+		cond_.wait(guard);
+
+	if (!pcm_.empty()) {
+		const std::vector<u8> &pcm = pcm_.front();
+		int bytes = std::min((int)pcm.size(), maxBytes);
+		memcpy(out, &pcm[0], bytes);
+		pcm_.pop_front();
+		hits_++;
+		cond_.notify_all();
+		return bytes;
+	}
+
+	while (!frames_.empty()) {
+		std::vector<u8> frame;
+		frame.swap(frames_.front());
+		frames_.pop_front();
+		framesBytes_ -= (int)frame.size();
+		busy_ = true;
+		guard.unlock();
+
+		// Nothing prefetched, so straight into the output.
+		int bytes = DecodeFrame(frame, out, maxBytes);
+
+		guard.lock();
+		busy_ = false;
+		misses_++;
+		cond_.notify_all();
+		// Skip any frame that failed, like a real decoder would.
+		if (bytes > 0)
+			return bytes;
+	}
+	return 0;
+}
+
+void Mp3Stream::Flush() {
+	pending_.clear();
+	skipBytes_ = 0;
+
+	std::unique_lock<std::mutex> guard(mutex_);
+	while (busy_)
+		cond_.wait(guard);
+	frames_.clear();
+	framesBytes_ = 0;
+	pcm_.clear();
+#ifdef USE_FFMPEG
+	if (decoder_)
+		avcodec_flush_buffers(decoder_);
+#endif // USE_FFMPEG
+}
+
+void Mp3Stream::RunThread(Mp3Stream *self) {
+	self->Run();
+}
+
+void Mp3Stream::Run() {
+	Common::SetCurrentThreadName("Mp3Stream");
+
+	std::unique_lock<std::mutex> guard(mutex_);
+	while (!stop_) {
+		if (busy_ || frames_.empty() || pcm_.size() >= PREFETCH_FRAMES) {
+			cond_.wait(guard);
+			continue;
+		}
+
+		std::vector<u8> frame;
+		frame.swap(frames_.front());
+		frames_.pop_front();
+		framesBytes_ -= (int)frame.size();
+		busy_ = true;
+		guard.unlock();
+
+		std::vector<u8> pcm(MAX_PCM_BYTES);
+		int bytes = DecodeFrame(frame, &pcm[0], MAX_PCM_BYTES);
+		pcm.resize(bytes);
+
+		guard.lock();
+		busy_ = false;
+		if (bytes > 0) {
+			pcm_.push_back(std::vector<u8>());
+			pcm_.back().swap(pcm);
+		}
+		cond_.notify_all();
+	}
+}
+
+int Mp3Stream::DecodeFrame(const std::vector<u8> &frame, u8 *out, int maxBytes) {
+#ifdef USE_FFMPEG
+	if (!decoder_)
+		return 0;
+
+	// The decoder may read a little past the end.
+	std::vector<u8> padded(frame.size() + FF_INPUT_BUFFER_PADDING_SIZE, 0);
+	memcpy(&padded[0], &frame[0], frame.size());
+
+	AVPacket packet;
+	av_init_packet(&packet);
+	packet.data = &padded[0];
+	packet.size = (int)frame.size();
+
+	avcodec_get_frame_defaults(frame_);
+	int got_frame = 0;
+	int ret = avcodec_decode_audio4(decoder_, frame_, &got_frame, &packet);
+	if (ret < 0) {
+		ERROR_LOG(HLE, "avcodec_decode_audio4: Error decoding audio %d", ret);
+		return 0;
+	}
+	if (!got_frame)
+		return 0;
+
+	int channels = decoder_->channels;
+	if (!resampler_) {
+		int64_t layout = frame_->channel_layout ? frame_->channel_layout : av_get_default_channel_layout(channels);
+		resampler_ = swr_alloc_set_opts(NULL, layout, AV_SAMPLE_FMT_S16, frame_->sample_rate,
+			layout, (AVSampleFormat)frame_->format, frame_->sample_rate, 0, NULL);
+		if (!resampler_ || swr_init(resampler_) < 0) {
+			ERROR_LOG(HLE, "Mp3Stream: Failed to initialize the resampling context");
+			if (resampler_)
+				swr_free(&resampler_);
+			return 0;
+		}
+	}
+
+	int samples = std::min(frame_->nb_samples, maxBytes / (channels * (int)sizeof(s16)));
+	ret = swr_convert(resampler_, &out, samples, (const u8 **)frame_->extended_data, frame_->nb_samples);
+	if (ret < 0) {
+		ERROR_LOG(HLE, "swr_convert: Error while converting %d", ret);
+		return 0;
+	}
+	return ret * channels * sizeof(s16);
+#else
+	// Silence of the right length, so at least the timing works out.
+	Mp3FrameHeader info;
+	u32 header = (frame[0] << 24) | (frame[1] << 16) | (frame[2] << 8) | frame[3];
+	if (!Mp3ParseFrameHeader(header, &info))
+		return 0;
+	int bytes = std::min(info.samplesPerFrame * info.channels * (int)sizeof(s16), maxBytes);
+	memset(out, 0, bytes);
+	return bytes;
+#endif // USE_FFMPEG
+}
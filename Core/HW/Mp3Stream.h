@@ -0,0 +1,117 @@
+// Copyright (c) 2013- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#pragma once
+
+#include <deque>
+#include <vector>
+
+#include "../../Globals.h"
+#include "Common/StdConditionVariable.h"
+#include "Common/StdMutex.h"
+#include "Common/StdThread.h"
+
+struct AVCodecContext;
+struct AVFrame;
+struct SwrContext;
+
+// Layer III only, which is all sceMp3 plays.
+struct Mp3FrameHeader {
+	// The raw version bits: 0 is MPEG 2.5, 2 is MPEG 2, 3 is MPEG 1.
+	int version;
+	// In kbps.
+	int bitrate;
+	int sampleRate;
+	int channels;
+	// Including the header.
+	int frameSize;
+	int samplesPerFrame;
+};
+
+// header is the first four bytes, big endian.  Returns false if it isn't a usable header.
+bool Mp3ParseFrameHeader(u32 header, Mp3FrameHeader *info);
+
+// Splits a byte stream into MP3 frames, and decodes them on a worker thread so that a few
+// frames of PCM are ready before the game asks.
+//
+// Data goes in and PCM comes out on the emulator thread.  If nothing is ready, the next
+// frame is decoded right into the caller's buffer instead.
+class Mp3Stream
+{
+public:
+	enum {
+		// 320 kbps at 32 khz, padded.
+		MAX_FRAME_BYTES = 1441,
+		MAX_PCM_BYTES = 1152 * 2 * sizeof(s16),
+		PREFETCH_FRAMES = 4,
+		// Undecoded data to hold on to, beyond what's prefetched.
+		TARGET_INPUT_BYTES = MAX_FRAME_BYTES * 8,
+	};
+
+	Mp3Stream();
+	~Mp3Stream();
+
+	// Opens the decoder.  Returns false if it couldn't.
+	bool Init();
+
+	// How much more data is worth adding right now.
+	int WantedBytes();
+	void AddData(const u8 *data, int size);
+	// The first frame's header, once one has been found.
+	bool GetFirstHeader(Mp3FrameHeader *info) const;
+
+	// Writes the next frame's PCM, interleaved s16.  Returns the bytes written, or 0 once
+	// everything added so far has been decoded.
+	int Decode(u8 *out, int maxBytes);
+
+	// Forgets everything added and decoded so far, as after a seek.
+	void Flush();
+
+	u32 Hits() const { return hits_; }
+	u32 Misses() const { return misses_; }
+
+private:
+	static void RunThread(Mp3Stream *self);
+	void Run();
+	void Stop();
+	void ParseFrames();
+	// Whichever thread has busy_ set.
+	int DecodeFrame(const std::vector<u8> &frame, u8 *out, int maxBytes);
+
+	// Emulator thread only.
+	std::vector<u8> pending_;
+	int skipBytes_;
+	bool haveFirstHeader_;
+	Mp3FrameHeader firstHeader_;
+
+	std::thread *thread_;
+	std::mutex mutex_;
+	std::condition_variable cond_;
+	bool stop_;
+	// Someone is decoding outside the lock, so the decoder is taken.
+	bool busy_;
+	std::deque<std::vector<u8> > frames_;
+	int framesBytes_;
+	std::deque<std::vector<u8> > pcm_;
+
+	u32 hits_;
+	u32 misses_;
+
+	AVCodecContext *decoder_;
+	AVFrame *frame_;
+	SwrContext *resampler_;
+};
@@ -1,4 +1,7 @@
+#include <algorithm>
+
 #include "MpegDemux.h"
+#include "Core/HW/atrac3plus.h"
 
 const int PACKET_START_CODE_MASK   = 0xffffff00;
 const int PACKET_START_CODE_PREFIX = 0x00000100;
@@ -18,25 +21,109 @@ const int PRIVATE_STREAM_1         = 0x000001bd;
 const int PADDING_STREAM           = 0x000001be;
 const int PRIVATE_STREAM_2         = 0x000001bf;
 
-MpegDemux::MpegDemux(int size, int offset) : m_audioStream(size)
+MpegDemux::MpegDemux(int size, int offset)
 {
-	m_buf = new u8[size];
+	// Room for the data not demuxed yet, and as much again for audio that hasn't been
+	// decoded, like the separate audio queue there used to be.
+	m_len = size * 2;
+	m_buf = new u8[m_len];
 
-	m_len = size;
 	m_index = offset;
 	m_audioChannel = -1;
 	m_readSize = 0;
+	m_audioOffset = 0;
+	m_audioSize = 0;
 }
 
 
 MpegDemux::~MpegDemux(void)
 {
+	delete [] m_buf;
+}
+
+// Older states start with m_index, an int that never got this big.
+static const u32 MPEGDEMUX_STATE_RING = 0x80000001;
+
+void MpegDemux::DoState(PointerWrap &p) {
+	u32 version = MPEGDEMUX_STATE_RING;
+	p.Do(version);
+	if ((version & 0x80000000) == 0) {
+		DoOldState(p, (int)version);
+		return;
+	}
+	if (version != MPEGDEMUX_STATE_RING) {
+		p.SetError(p.ERROR_FAILURE);
+		ERROR_LOG(ME, "Unable to load state: unknown mpeg demux version %08x.", version);
+		return;
+	}
+
+	// The ring was allocated by loadStream(), so the size has to match.
+	int len = m_len;
+	p.Do(len);
+	if (len != m_len) {
+		p.SetError(p.ERROR_FAILURE);
+		ERROR_LOG(ME, "Unable to load state: mpeg demux ring is %d bytes, expected %d.", len, m_len);
+		return;
+	}
+	p.Do(m_index);
+	p.Do(m_audioChannel);
+	p.Do(m_readSize);
+	p.DoArray(m_buf, m_len);
+	p.Do(m_audioSegments);
+	p.Do(m_audioOffset);
+	p.Do(m_audioSize);
+	p.DoMarker("MpegDemux");
+}
+
+void MpegDemux::DoOldState(PointerWrap &p, int index) {
+	// The stream was a flat buffer of half the ring's size, so positions carry over as is.
+	int len = m_len / 2;
+	int readSize = 0;
+	p.Do(len);
+	p.Do(m_audioChannel);
+	p.Do(readSize);
+	if (len != m_len / 2 || index > readSize || readSize > len) {
+		p.SetError(p.ERROR_FAILURE);
+		ERROR_LOG(ME, "Unable to load state: old mpeg demux buffer is %d bytes, expected %d.", len, m_len / 2);
+		return;
+	}
+	p.DoArray(m_buf, len);
+
+	// Demuxed audio used to be copied out to a queue, which isn't in the ring.  It's only a few
+	// frames, so drop it rather than fail the whole state.
+	Atrac3plus_Decoder::BufferQueue oldAudio(len);
+	p.DoClass(oldAudio);
+	if (oldAudio.getQueueSize() != 0)
+		WARN_LOG(ME, "Dropping %d bytes of demuxed audio from an old state.", oldAudio.getQueueSize());
+
+	m_index = index;
+	m_readSize = readSize;
+	m_audioSegments.clear();
+	m_audioOffset = 0;
+	m_audioSize = 0;
+}
+
+bool MpegDemux::makeRoom(int size) {
+	s64 keepFrom = std::min(m_index, m_readSize);
+	if (m_readSize - keepFrom + size > m_len)
+		return false;
+	// Audio nobody's decoding goes first, so the video keeps going.
+	while (!m_audioSegments.empty()) {
+		s64 audioStart = m_audioSegments.front().pos + m_audioOffset;
+		if (m_readSize - std::min(audioStart, keepFrom) + size <= m_len)
+			break;
+		popAudio(m_audioSegments.front().len - m_audioOffset);
+	}
+	return true;
 }
 
 bool MpegDemux::addStreamData(u8* buf, int addSize) {
-	if (m_readSize + addSize > m_len)
+	if (addSize <= 0 || !makeRoom(addSize))
 		return false;
-	memcpy(m_buf + m_readSize, buf, addSize);
+	int start = (int)(m_readSize % m_len);
+	int first = std::min(addSize, m_len - start);
+	memcpy(m_buf + start, buf, first);
+	memcpy(m_buf, buf + first, addSize - first);
 	m_readSize += addSize;
 	return true;
 }
@@ -133,7 +220,12 @@ int MpegDemux::demuxStream(bool bdemux, int startCode, int channel)
 		length = readPesHeader(pesHeader, length, startCode);
 		if (pesHeader.channel == channel || channel < 0) {
 			channel = pesHeader.channel;
-			m_audioStream.push(m_buf + m_index, length);
+			// Just remember where it is, it stays in the ring until it's decoded.
+			if (length > 0) {
+				AudioSegment segment = {m_index, length};
+				m_audioSegments.push_back(segment);
+				m_audioSize += length;
+			}
 		}
 		skip(length);
 	} else {
@@ -146,7 +238,7 @@ void MpegDemux::demux(int audioChannel)
 {
 	if (audioChannel >= 0)
 		m_audioChannel = audioChannel;
-	while (m_index < m_len)
+	while (true)
 	{
 		if (m_index + 2048 > m_readSize)
 			break;
@@ -188,25 +280,16 @@ void MpegDemux::demux(int audioChannel)
 			break;
 		}
 	}
-	if (m_index < m_readSize) {
-		int size = m_readSize - m_index;
-		memcpy(m_buf, m_buf + m_index, size);
-		m_index = 0;
-		m_readSize = size;
-	} else {
-		m_index = 0;
-		m_readSize = 0;
-	}
 }
 
-static bool isHeader(u8* audioStream, int offset)
+static bool isHeader(const u8* audioStream, int offset)
 {
 	const u8 header1 = (u8)0x0F;
 	const u8 header2 = (u8)0xD0;
 	return (audioStream[offset] == header1) && (audioStream[offset+1] == header2);
 }
 
-static int getNextHeaderPosition(u8* audioStream, int curpos, int limit, int frameSize)
+static int getNextHeaderPosition(const u8* audioStream, int curpos, int limit, int frameSize)
 {
 	int endScan = limit - 1;
 
@@ -222,24 +305,102 @@ static int getNextHeaderPosition(u8* audioStream, int curpos, int limit, int fra
 	return -1;
 }
 
+void MpegDemux::peekAudio(int offset, u8 *dest, int size)
+{
+	offset += m_audioOffset;
+	for (size_t i = 0; i < m_audioSegments.size() && size > 0; ++i) {
+		const AudioSegment &segment = m_audioSegments[i];
+		if (offset >= segment.len) {
+			offset -= segment.len;
+			continue;
+		}
+		int n = std::min(size, segment.len - offset);
+		// Might wrap around the ring, too.
+		for (int done = 0; done < n; ) {
+			s64 pos = segment.pos + offset + done;
+			int chunk = std::min(n - done, m_len - (int)(pos % m_len));
+			memcpy(dest + done, at(pos), chunk);
+			done += chunk;
+		}
+		dest += n;
+		size -= n;
+		offset = 0;
+	}
+}
+
+const u8 *MpegDemux::audioPointer(int offset, int size)
+{
+	offset += m_audioOffset;
+	for (size_t i = 0; i < m_audioSegments.size(); ++i) {
+		const AudioSegment &segment = m_audioSegments[i];
+		if (offset >= segment.len) {
+			offset -= segment.len;
+			continue;
+		}
+		s64 pos = segment.pos + offset;
+		if (offset + size > segment.len || (int)(pos % m_len) + size > m_len)
+			return NULL;
+		return at(pos);
+	}
+	return NULL;
+}
+
+void MpegDemux::popAudio(int size)
+{
+	m_audioSize -= size;
+	size += m_audioOffset;
+	while (!m_audioSegments.empty() && size >= m_audioSegments.front().len) {
+		size -= m_audioSegments.front().len;
+		m_audioSegments.pop_front();
+	}
+	m_audioOffset = size;
+}
+
 int MpegDemux::getNextaudioFrame(u8** buf, int *headerCode1, int *headerCode2)
 {
-	int gotsize = m_audioStream.get_front(m_audioFrame, 0x2000);
-	if (gotsize == 0 || !isHeader(m_audioFrame, 0))
-		return 0;
-	u8 Code1 = m_audioFrame[2];
-	u8 Code2 = m_audioFrame[3];
-	int frameSize = ((Code1 & 0x03) << 8) | (Code2 & 0xFF) * 8 + 0x10;
+	u8 header[8];
+	while (true) {
+		if (m_audioSize < 8)
+			return 0;
+		peekAudio(0, header, 8);
+		if (isHeader(header, 0))
+			break;
+		// Lost track, like after audio had to be dropped.  Skip to the next header.
+		int gotsize = std::min(m_audioSize, (int)sizeof(m_audioFrame));
+		peekAudio(0, m_audioFrame, gotsize);
+		int nextHeader = getNextHeaderPosition(m_audioFrame, 1, gotsize, 8);
+		popAudio(nextHeader >= 0 ? nextHeader : gotsize - 1);
+	}
+	u8 Code1 = header[2];
+	u8 Code2 = header[3];
+	int frameSize = ((((Code1 & 0x03) << 8) | Code2) * 8) + 0x10;
+	int gotsize = std::min(m_audioSize, (int)sizeof(m_audioFrame));
 	if (frameSize > gotsize)
 		return 0;
-	int audioPos = 8;
-	int nextHeader = getNextHeaderPosition(m_audioFrame, audioPos, gotsize, frameSize);
-	if (nextHeader >= 0) {
-		audioPos = nextHeader;
-	} else
-		audioPos = gotsize;
-	m_audioStream.pop_front(0, audioPos);
-	*buf = m_audioFrame + 8;
+
+	// Almost always, the next frame starts right after this one.
+	int audioPos = frameSize;
+	const u8 *frame = NULL;
+	u8 next[2];
+	if (m_audioSize >= frameSize + 2) {
+		peekAudio(frameSize, next, 2);
+		if (!isHeader(next, 0)) {
+			peekAudio(0, m_audioFrame, gotsize);
+			int nextHeader = getNextHeaderPosition(m_audioFrame, 8, gotsize, frameSize);
+			if (nextHeader >= 0)
+				audioPos = nextHeader;
+			frame = m_audioFrame + 8;
+		}
+	}
+	if (!frame)
+		frame = audioPointer(8, frameSize - 8);
+	if (!frame) {
+		// Split between packets, or around the end of the ring.
+		peekAudio(8, m_audioFrame + 8, frameSize - 8);
+		frame = m_audioFrame + 8;
+	}
+	popAudio(audioPos);
+	*buf = (u8 *)frame;
 	if (headerCode1) *headerCode1 = Code1;
 	if (headerCode2) *headerCode2 = Code2;
 	return frameSize - 8;
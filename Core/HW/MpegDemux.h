@@ -3,10 +3,13 @@
 
 #pragma once
 
+#include <deque>
+
 #include "../../Globals.h"
-#include "Core/HW/atrac3plus.h"
 #include "Common/ChunkFile.h"
 
+// The stream data goes into a ring, and demuxing only indexes where the audio payloads are,
+// so audio frames can usually be handed out right from the ring.
 class MpegDemux
 {
 public:
@@ -17,6 +20,7 @@ public:
 	void demux(int audioChannel);
 
 	// return its framesize
+	// buf is only valid until the next call, or until more data is added.
 	int getNextaudioFrame(u8** buf, int *headerCode1, int *headerCode2);
 private:
 	struct PesHeader {
@@ -30,8 +34,18 @@ private:
 			channel = chan;
 		}
 	};
+	// Where one PES packet's audio payload is in the stream.
+	struct AudioSegment {
+		s64 pos;
+		int len;
+	};
+
+	// Positions count from the start of the stream, and wrap around the ring.
+	u8 *at(s64 pos) {
+		return m_buf + (int)(pos % m_len);
+	}
 	int read8() {
-		return m_buf[m_index++] & 0xFF;
+		return *at(m_index++);
 	}
 	int read16() {
 		return (read8() << 8) | read8();
@@ -43,7 +57,7 @@ private:
 		return (((long) (c & 0x0E)) << 29) | ((read16() >> 1) << 15) | (read16() >> 1);
 	}
 	bool isEOF() {
-		return m_index >= m_len;
+		return m_index >= m_readSize;
 	}
 	void skip(int n) {
 		if (n > 0) {
@@ -52,23 +66,28 @@ private:
 	}
 	int readPesHeader(PesHeader &pesHeader, int length, int startCode);
 	int demuxStream(bool bdemux, int startCode, int channel);
+
+	// Audio bytes are counted from the first one not yet handed out.
+	void peekAudio(int offset, u8 *dest, int size);
+	const u8 *audioPointer(int offset, int size);
+	void popAudio(int size);
+	// Makes room for size more bytes of stream, dropping the oldest audio if it must.
+	bool makeRoom(int size);
+	// States from before the ring, which start right at m_index.
+	void DoOldState(PointerWrap &p, int index);
 public:
-	void DoState(PointerWrap &p) {
-		p.Do(m_index);
-		p.Do(m_len);
-		p.Do(m_audioChannel);
-		p.Do(m_readSize);
-		if (m_buf)
-			p.DoArray(m_buf, m_len);
-		p.DoClass(m_audioStream);
-	}
+	void DoState(PointerWrap &p);
 private:
-	int m_index;
+	s64 m_index;
 	int m_len;
 	u8* m_buf;
-	Atrac3plus_Decoder::BufferQueue m_audioStream;
+	std::deque<AudioSegment> m_audioSegments;
+	// Already handed out, of the first segment.
+	int m_audioOffset;
+	int m_audioSize;
+	// For frames that are split up in the ring.
 	u8  m_audioFrame[0x2000];
 	int m_audioChannel;
-	int m_readSize;
+	s64 m_readSize;
 };
 
@@ -16,12 +16,20 @@
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
 #include "base/basictypes.h"
+#include "base/functional.h"
+#include "Common/ThreadPools.h"
 #include "../Globals.h"
 #include "../MemMap.h"
 #include "Core/HLE/sceAtrac.h"
 #include "Core/Config.h" 
 #include "SasAudio.h"
 
+#if defined(_M_SSE) || defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(ARM) && defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
 // #define AUDIO_TO_FILE
 
 static const s8 f[16][2] = {
@@ -276,6 +284,11 @@ SasInstance::SasInstance()
 		mixBuffer(0),
 		sendBuffer(0),
 		resampleBuffer(0),
+		voiceBuffer(0),
+		envelopeBuffer(0),
+		parallelResampleBuffer(0),
+		parallelVoiceBuffer(0),
+		parallelEnvelopeBuffer(0),
 		grainSize(0) {
 #ifdef AUDIO_TO_FILE
 	audioDump = fopen("D:\\audio.raw", "wb");
@@ -296,9 +309,23 @@ void SasInstance::ClearGrainSize() {
 		delete [] sendBuffer;
 	if (resampleBuffer)
 		delete [] resampleBuffer;
+	delete [] voiceBuffer;
+	delete [] envelopeBuffer;
 	mixBuffer = NULL;
 	sendBuffer = NULL;
 	resampleBuffer = NULL;
+	voiceBuffer = NULL;
+	envelopeBuffer = NULL;
+	ClearParallelBuffers();
+}
+
+void SasInstance::ClearParallelBuffers() {
+	delete [] parallelResampleBuffer;
+	delete [] parallelVoiceBuffer;
+	delete [] parallelEnvelopeBuffer;
+	parallelResampleBuffer = NULL;
+	parallelVoiceBuffer = NULL;
+	parallelEnvelopeBuffer = NULL;
 }
 
 void SasInstance::SetGrainSize(int newGrainSize) {
@@ -319,8 +346,18 @@ void SasInstance::SetGrainSize(int newGrainSize) {
 	// 2 samples padding at the start, that's where we copy the two last samples from the channel
 	// so that we can do bicubic resampling if necessary.  Plus 1 for smoothness hackery.
 	resampleBuffer = new s16[grainSize * 4 + 3];
+
+	delete [] voiceBuffer;
+	delete [] envelopeBuffer;
+	voiceBuffer = new int[grainSize];
+	envelopeBuffer = new int[grainSize];
+	// These are only allocated once Mix() needs them, and depend on the grain size.
+	ClearParallelBuffers();
 }
 
+// Below this many playing voices, handing them out to worker threads costs more than it saves.
+static const int PARALLEL_MIN_VOICES = 8;
+
 static inline s16 clamp_s16(int i) {
 	if (i > 32767)
 		return 32767;
@@ -329,126 +366,275 @@ static inline s16 clamp_s16(int i) {
 	return i;
 }
 
+// Mix() runs each voice through these stages a grain at a time.  The SIMD versions
+// must give exactly the same results as the plain loops, which handle the leftovers.
+
+#if defined(_M_SSE) || defined(__SSE2__)
+// The low 32 bits of each product, like a plain int multiply.  SSE2 lacks pmulld.
+static inline __m128i MulLo32(__m128i a, __m128i b) {
+	__m128i even = _mm_mul_epu32(a, b);
+	__m128i odd = _mm_mul_epu32(_mm_srli_si128(a, 4), _mm_srli_si128(b, 4));
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+#endif
+
+// Nearest neighbour resampling to exactly count samples.  in has the 2 history samples first.
+static void ResampleVoice(int *out, const s16 *in, u32 sampleFrac, int pitch, int count) {
+	int i = 0;
+	if (pitch == PSP_SAS_PITCH_BASE) {
+		// Every sample, in order, so it's just a widening copy.
+		in += sampleFrac / PSP_SAS_PITCH_BASE + 2;
+#if defined(_M_SSE) || defined(__SSE2__)
+		for (; i + 8 <= count; i += 8) {
+			__m128i s = _mm_loadu_si128((const __m128i *)(in + i));
+			_mm_storeu_si128((__m128i *)(out + i), _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16));
+			_mm_storeu_si128((__m128i *)(out + i + 4), _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16));
+		}
+#elif defined(ARM) && defined(__ARM_NEON__)
+		for (; i + 8 <= count; i += 8) {
+			int16x8_t s = vld1q_s16(in + i);
+			vst1q_s32(out + i, vmovl_s16(vget_low_s16(s)));
+			vst1q_s32(out + i + 4, vmovl_s16(vget_high_s16(s)));
+		}
+#endif
+		for (; i < count; i++)
+			out[i] = in[i];
+		return;
+	}
+
+	for (; i < count; i++) {
+		out[i] = in[sampleFrac / PSP_SAS_PITCH_BASE + 2];
+		sampleFrac += pitch;
+	}
+}
+
+// The envelope steps once per sample, so it can't be vectorized, but applying it can.
+static void StepEnvelope(int *out, ADSREnvelope &envelope, int count) {
+	for (int i = 0; i < count; i++) {
+		// The maximum envelope height (PSP_SAS_ENVELOPE_HEIGHT_MAX) is (1 << 30) - 1.
+		// Reduce it to 14 bits, by shifting off 15.  Round up by adding (1 << 14) first.
+		out[i] = (envelope.GetHeight() + (1 << 14)) >> 15;
+		envelope.Step();
+	}
+}
+
+static void ApplyEnvelope(int *samples, const int *envelope, int count) {
+	int i = 0;
+	// We just scale by the envelope before we scale by volumes.
+	// Again, we round up by adding (1 << 14) first (*after* multiplying.)
+#if defined(_M_SSE) || defined(__SSE2__)
+	const __m128i round = _mm_set1_epi32(1 << 14);
+	for (; i + 4 <= count; i += 4) {
+		__m128i s = _mm_loadu_si128((const __m128i *)(samples + i));
+		__m128i e = _mm_loadu_si128((const __m128i *)(envelope + i));
+		_mm_storeu_si128((__m128i *)(samples + i), _mm_srai_epi32(_mm_add_epi32(MulLo32(s, e), round), 15));
+	}
+#elif defined(ARM) && defined(__ARM_NEON__)
+	const int32x4_t round = vdupq_n_s32(1 << 14);
+	for (; i + 4 <= count; i += 4) {
+		int32x4_t s = vmulq_s32(vld1q_s32(samples + i), vld1q_s32(envelope + i));
+		vst1q_s32(samples + i, vshrq_n_s32(vaddq_s32(s, round), 15));
+	}
+#endif
+	for (; i < count; i++)
+		samples[i] = ((samples[i] * envelope[i]) + (1 << 14)) >> 15;
+}
+
+// Adds a voice to the interleaved stereo mix and send buffers.
+static void AccumulateVoice(int *mix, int *send, const int *samples, int count, int volumeLeft, int volumeRight, int volumeShift, int sendLeft, int sendRight) {
+	int i = 0;
+#if defined(_M_SSE) || defined(__SSE2__)
+	const __m128i volume = _mm_setr_epi32(volumeLeft, volumeRight, volumeLeft, volumeRight);
+	const __m128i sendVolume = _mm_setr_epi32(sendLeft, sendRight, sendLeft, sendRight);
+	const __m128i shift = _mm_cvtsi32_si128(volumeShift);
+	for (; i + 4 <= count; i += 4) {
+		__m128i s = _mm_loadu_si128((const __m128i *)(samples + i));
+		// Each sample twice, once for each side.
+		__m128i s01 = _mm_unpacklo_epi32(s, s);
+		__m128i s23 = _mm_unpackhi_epi32(s, s);
+		__m128i *m = (__m128i *)(mix + i * 2);
+		__m128i *d = (__m128i *)(send + i * 2);
+		_mm_storeu_si128(m, _mm_add_epi32(_mm_loadu_si128(m), _mm_sra_epi32(MulLo32(s01, volume), shift)));
+		_mm_storeu_si128(m + 1, _mm_add_epi32(_mm_loadu_si128(m + 1), _mm_sra_epi32(MulLo32(s23, volume), shift)));
+		_mm_storeu_si128(d, _mm_add_epi32(_mm_loadu_si128(d), _mm_srai_epi32(MulLo32(s01, sendVolume), 12)));
+		_mm_storeu_si128(d + 1, _mm_add_epi32(_mm_loadu_si128(d + 1), _mm_srai_epi32(MulLo32(s23, sendVolume), 12)));
+	}
+#elif defined(ARM) && defined(__ARM_NEON__)
+	const int32x4_t volume = {volumeLeft, volumeRight, volumeLeft, volumeRight};
+	const int32x4_t sendVolume = {sendLeft, sendRight, sendLeft, sendRight};
+	const int32x4_t shift = vdupq_n_s32(-volumeShift);
+	for (; i + 4 <= count; i += 4) {
+		int32x4_t s = vld1q_s32(samples + i);
+		// Each sample twice, once for each side.
+		int32x4x2_t both = vzipq_s32(s, s);
+		int *m = mix + i * 2;
+		int *d = send + i * 2;
+		vst1q_s32(m, vaddq_s32(vld1q_s32(m), vshlq_s32(vmulq_s32(both.val[0], volume), shift)));
+		vst1q_s32(m + 4, vaddq_s32(vld1q_s32(m + 4), vshlq_s32(vmulq_s32(both.val[1], volume), shift)));
+		vst1q_s32(d, vaddq_s32(vld1q_s32(d), vshrq_n_s32(vmulq_s32(both.val[0], sendVolume), 12)));
+		vst1q_s32(d + 4, vaddq_s32(vld1q_s32(d + 4), vshrq_n_s32(vmulq_s32(both.val[1], sendVolume), 12)));
+	}
+#endif
+	for (; i < count; i++) {
+		int sample = samples[i];
+		// We mix into this 32-bit temp buffer and clip in a second loop
+		// Ideally, the shift right should be there too but for now I'm concerned about
+		// not overflowing.
+		mix[i * 2] += (sample * volumeLeft ) >> volumeShift; // Max = 16 and Min = 12(default)
+		mix[i * 2 + 1] += (sample * volumeRight) >> volumeShift; // Max = 16 and Min = 12(default)
+		send[i * 2] += sample * sendLeft >> 12;
+		send[i * 2 + 1] += sample * sendRight >> 12;
+	}
+}
+
+// Decodes a grain of the voice, resamples it and applies the envelope, leaving it in out.
+// Returns false if there's nothing to mix.  Doesn't touch any of the instance's buffers,
+// so different voices can be rendered at the same time.
+bool SasInstance::RenderVoice(SasVoice &voice, s16 *resample, int *out, int *envelope) {
+	// TODO: Special case no-resample case for speed
+
+	if (voice.type == VOICETYPE_VAG && !voice.vagAddr)
+		return false;
+	if (voice.type == VOICETYPE_PCM && !voice.pcmAddr)
+		return false;
+
+	// Load resample history (so we can use a wide filter)
+	resample[0] = voice.resampleHist[0];
+	resample[1] = voice.resampleHist[1];
+
+	// Figure out number of samples to read.
+	// Actually this is not entirely correct - we need to get one extra sample, and store it
+	// for the next time around. A little complicated...
+	// But for now, see Smoothness HACKERY below :P
+	u32 numSamples = (voice.sampleFrac + grainSize * voice.pitch) / PSP_SAS_PITCH_BASE;
+	if ((int)numSamples > grainSize * 4) {
+		ERROR_LOG(SAS, "numSamples too large, clamping: %i vs %i", numSamples, grainSize * 4);
+		numSamples = grainSize * 4;
+	}
+
+	// Read N samples into the resample buffer. Could do either PCM or VAG here.
+	switch (voice.type) {
+	case VOICETYPE_VAG:
+		{
+			voice.vag.GetSamples(resample + 2, numSamples);
+			if (voice.vag.End()) {
+				// NOTICE_LOG(SAS, "Hit end of VAG audio");
+				voice.playing = false;
+				voice.on = false;  // ??
+			}
+		}
+		break;
+	case VOICETYPE_PCM:
+		{
+			u32 size = std::min(voice.pcmSize * 2 - voice.pcmIndex, (int)(numSamples * sizeof(s16)));
+			memset(resample + 2, 0, numSamples * sizeof(s16));
+			if (!voice.on) {
+				voice.pcmIndex = 0;
+				break;
+			}
+			Memory::Memcpy(resample + 2, voice.pcmAddr + voice.pcmIndex, size);
+			voice.pcmIndex += size;
+			if (voice.pcmIndex >= voice.pcmSize * 2) {
+				voice.pcmIndex = 0;
+			}
+		}
+		break;
+	case VOICETYPE_ATRAC3:
+		{
+			int ret = voice.atrac3.getNextSamples(resample + 2, numSamples);
+			if (ret) {
+				// Hit atrac3 voice end
+				voice.playing = false;
+				voice.on = false;  // ??
+			}
+		}
+		break;
+	default:
+		{
+			memset(resample + 2, 0, numSamples * sizeof(s16));
+		}
+		break;
+	}
+	// Smoothness HACKERY
+	resample[2 + numSamples] = resample[2 + numSamples - 1];
+
+	// Save resample history
+	voice.resampleHist[0] = resample[2 + numSamples - 2];
+	voice.resampleHist[1] = resample[2 + numSamples - 1];
+
+	// Resample to the correct pitch, writing exactly "grainSize" samples.
+	// For now: nearest neighbour, not even using the resample history at all.
+	u32 sampleFrac = voice.sampleFrac;
+	ResampleVoice(out, resample, sampleFrac, voice.pitch, grainSize);
+	sampleFrac += voice.pitch * grainSize;
+
+	StepEnvelope(envelope, voice.envelope, grainSize);
+	ApplyEnvelope(out, envelope, grainSize);
+
+	voice.sampleFrac = sampleFrac;
+	// Let's hope grainSize is a power of 2.
+	//voice.sampleFrac &= grainSize * PSP_SAS_PITCH_BASE - 1;
+	voice.sampleFrac -= numSamples * PSP_SAS_PITCH_BASE;
+
+	if (voice.envelope.HasEnded())
+	{
+		// NOTICE_LOG(SAS, "Hit end of envelope");
+		voice.playing = false;
+	}
+	return true;
+}
+
+void SasInstance::RenderVoices(const int *playing, bool *rendered, int lower, int upper) {
+	const int resampleSize = grainSize * 4 + 3;
+	for (int i = lower; i < upper; i++) {
+		SasVoice &voice = voices[playing[i]];
+		if (voice.type != VOICETYPE_ATRAC3)
+			rendered[i] = RenderVoice(voice, parallelResampleBuffer + i * resampleSize, parallelVoiceBuffer + i * grainSize, parallelEnvelopeBuffer + i * grainSize);
+	}
+}
+
 void SasInstance::Mix(u32 outAddr, u32 inAddr, int leftVol, int rightVol) {
+	const int MAX_CONFIG_VOLUME = 17;  // 12 + 5
+	int volumeShift = (MAX_CONFIG_VOLUME - g_Config.iSEVolume);
+	if (volumeShift < 0) volumeShift = 0;
+
+	int playing[PSP_SAS_VOICES_MAX];
 	int voicesPlayingCount = 0;
 	for (int v = 0; v < PSP_SAS_VOICES_MAX; v++) {
 		SasVoice &voice = voices[v];
 		if (!voice.playing || voice.paused)
 			continue;
-		voicesPlayingCount++;
+		playing[voicesPlayingCount++] = v;
+	}
 
-		// TODO: Special case no-resample case for speed
+	if (g_Config.bParallelSasVoices && g_Config.iNumWorkerThreads > 1 && voicesPlayingCount >= PARALLEL_MIN_VOICES) {
+		// Each voice gets its own buffers, and they're added up in order afterward.
+		const int resampleSize = grainSize * 4 + 3;
+		if (!parallelVoiceBuffer) {
+			parallelResampleBuffer = new s16[PSP_SAS_VOICES_MAX * resampleSize];
+			parallelVoiceBuffer = new int[PSP_SAS_VOICES_MAX * grainSize];
+			parallelEnvelopeBuffer = new int[PSP_SAS_VOICES_MAX * grainSize];
+		}
 
-		switch (voice.type) {
-		case VOICETYPE_VAG:
-			if (voice.type == VOICETYPE_VAG && !voice.vagAddr)
-				break;
-		case VOICETYPE_PCM:
-			if (voice.type == VOICETYPE_PCM && !voice.pcmAddr)
-				break;
-		default: 
-			// Load resample history (so we can use a wide filter)
-			resampleBuffer[0] = voice.resampleHist[0];
-			resampleBuffer[1] = voice.resampleHist[1];
-
-			// Figure out number of samples to read.
-			// Actually this is not entirely correct - we need to get one extra sample, and store it
-			// for the next time around. A little complicated...
-			// But for now, see Smoothness HACKERY below :P
-			u32 numSamples = (voice.sampleFrac + grainSize * voice.pitch) / PSP_SAS_PITCH_BASE;
-			if ((int)numSamples > grainSize * 4) {
-				ERROR_LOG(SAS, "numSamples too large, clamping: %i vs %i", numSamples, grainSize * 4);
-				numSamples = grainSize * 4;
-			}
+		// ATRAC3 voices go through sceAtrac, which isn't safe to call from other threads.
+		bool rendered[PSP_SAS_VOICES_MAX];
+		for (int i = 0; i < voicesPlayingCount; i++) {
+			SasVoice &voice = voices[playing[i]];
+			if (voice.type == VOICETYPE_ATRAC3)
+				rendered[i] = RenderVoice(voice, parallelResampleBuffer + i * resampleSize, parallelVoiceBuffer + i * grainSize, parallelEnvelopeBuffer + i * grainSize);
+		}
+		GlobalThreadPool::Loop(std::bind(&SasInstance::RenderVoices, this, playing, rendered, placeholder::_1, placeholder::_2), 0, voicesPlayingCount);
 
-			// Read N samples into the resample buffer. Could do either PCM or VAG here.
-			switch (voice.type) {
-			case VOICETYPE_VAG:
-				{
-					voice.vag.GetSamples(resampleBuffer + 2, numSamples);
-					if (voice.vag.End()) {
-						// NOTICE_LOG(SAS, "Hit end of VAG audio");
-						voice.playing = false;
-						voice.on = false;  // ??
-					}
-				}
-				break;
-			case VOICETYPE_PCM:
-				{
-					u32 size = std::min(voice.pcmSize * 2 - voice.pcmIndex, (int)(numSamples * sizeof(s16)));
-					memset(resampleBuffer + 2, 0, numSamples * sizeof(s16));
-					if (!voice.on) {
-						voice.pcmIndex = 0;
-						break;
-					}
-					Memory::Memcpy(resampleBuffer + 2, voice.pcmAddr + voice.pcmIndex, size);
-					voice.pcmIndex += size;
-					if (voice.pcmIndex >= voice.pcmSize * 2) {
-						voice.pcmIndex = 0;
-					}
-				}
-				break;
-			case VOICETYPE_ATRAC3:
-				{
-					int ret = voice.atrac3.getNextSamples(resampleBuffer + 2, numSamples);
-					if (ret) {
-						// Hit atrac3 voice end
-						voice.playing = false;
-						voice.on = false;  // ??
-					}
-				}
-				break;
-			default:
-				{
-					memset(resampleBuffer + 2, 0, numSamples * sizeof(s16));
-				}
-				break;
-			}
-			// Smoothness HACKERY
-			resampleBuffer[2 + numSamples] = resampleBuffer[2 + numSamples - 1];
-
-			// Save resample history
-			voice.resampleHist[0] = resampleBuffer[2 + numSamples - 2];
-			voice.resampleHist[1] = resampleBuffer[2 + numSamples - 1];
-
-			// Resample to the correct pitch, writing exactly "grainSize" samples.
-			u32 sampleFrac = voice.sampleFrac;
-			const int MAX_CONFIG_VOLUME = 17;  // 12 + 5
-			int volumeShift = (MAX_CONFIG_VOLUME - g_Config.iSEVolume);
-			if (volumeShift < 0) volumeShift = 0;
-			for (int i = 0; i < grainSize; i++) {
-				// For now: nearest neighbour, not even using the resample history at all.
-				int sample = resampleBuffer[sampleFrac / PSP_SAS_PITCH_BASE + 2];
-				sampleFrac += voice.pitch;
-
-				// The maximum envelope height (PSP_SAS_ENVELOPE_HEIGHT_MAX) is (1 << 30) - 1.
-				// Reduce it to 14 bits, by shifting off 15.  Round up by adding (1 << 14) first.
-				int envelopeValue = voice.envelope.GetHeight();
-				envelopeValue = (envelopeValue + (1 << 14)) >> 15;
-
-				// We just scale by the envelope before we scale by volumes.
-				// Again, we round up by adding (1 << 14) first (*after* multiplying.)
-				sample = ((sample * envelopeValue) + (1 << 14)) >> 15;
-
-				// We mix into this 32-bit temp buffer and clip in a second loop
-				// Ideally, the shift right should be there too but for now I'm concerned about
-				// not overflowing.
-				mixBuffer[i * 2] += (sample * voice.volumeLeft ) >> volumeShift; // Max = 16 and Min = 12(default)
-				mixBuffer[i * 2 + 1] += (sample * voice.volumeRight) >> volumeShift; // Max = 16 and Min = 12(default)
-				sendBuffer[i * 2] += sample * voice.volumeLeftSend >> 12;
-				sendBuffer[i * 2 + 1] += sample * voice.volumeRightSend >> 12;
-				voice.envelope.Step();
-			}
-			voice.sampleFrac = sampleFrac;
-			// Let's hope grainSize is a power of 2.
-			//voice.sampleFrac &= grainSize * PSP_SAS_PITCH_BASE - 1;
-			voice.sampleFrac -= numSamples * PSP_SAS_PITCH_BASE;
-
-			if (voice.envelope.HasEnded())
-			{
-				// NOTICE_LOG(SAS, "Hit end of envelope");
-				voice.playing = false;
-			}
+		for (int i = 0; i < voicesPlayingCount; i++) {
+			SasVoice &voice = voices[playing[i]];
+			if (rendered[i])
+				AccumulateVoice(mixBuffer, sendBuffer, parallelVoiceBuffer + i * grainSize, grainSize, voice.volumeLeft, voice.volumeRight, volumeShift, voice.volumeLeftSend, voice.volumeRightSend);
+		}
+	} else {
+		for (int i = 0; i < voicesPlayingCount; i++) {
+			SasVoice &voice = voices[playing[i]];
+			if (RenderVoice(voice, resampleBuffer, voiceBuffer, envelopeBuffer))
+				AccumulateVoice(mixBuffer, sendBuffer, voiceBuffer, grainSize, voice.volumeLeft, voice.volumeRight, volumeShift, voice.volumeLeftSend, voice.volumeRightSend);
 		}
 	}
 
@@ -462,15 +648,46 @@ void SasInstance::Mix(u32 outAddr, u32 inAddr, int leftVol, int rightVol) {
 	s16 *outp = (s16 *)Memory::GetPointer(outAddr);
 	const s16 *inp = inAddr ? (s16*)Memory::GetPointer(inAddr) : 0;
 	if (outputMode == 0) {
+		int i = 0;
+#if defined(_M_SSE) || defined(__SSE2__)
+		// packs saturates exactly like clamp_s16.
+		const __m128i inVolume = _mm_setr_epi32(leftVol, rightVol, leftVol, rightVol);
+		for (; i + 8 <= grainSize * 2; i += 8) {
+			__m128i l = _mm_add_epi32(_mm_loadu_si128((const __m128i *)(mixBuffer + i)), _mm_loadu_si128((const __m128i *)(sendBuffer + i)));
+			__m128i h = _mm_add_epi32(_mm_loadu_si128((const __m128i *)(mixBuffer + i + 4)), _mm_loadu_si128((const __m128i *)(sendBuffer + i + 4)));
+			if (inp) {
+				__m128i in = _mm_loadu_si128((const __m128i *)inp);
+				l = _mm_add_epi32(l, _mm_srai_epi32(MulLo32(_mm_srai_epi32(_mm_unpacklo_epi16(in, in), 16), inVolume), 12));
+				h = _mm_add_epi32(h, _mm_srai_epi32(MulLo32(_mm_srai_epi32(_mm_unpackhi_epi16(in, in), 16), inVolume), 12));
+				inp += 8;
+			}
+			_mm_storeu_si128((__m128i *)outp, _mm_packs_epi32(l, h));
+			outp += 8;
+		}
+#elif defined(ARM) && defined(__ARM_NEON__)
+		const int32x4_t inVolume = {leftVol, rightVol, leftVol, rightVol};
+		for (; i + 8 <= grainSize * 2; i += 8) {
+			int32x4_t l = vaddq_s32(vld1q_s32(mixBuffer + i), vld1q_s32(sendBuffer + i));
+			int32x4_t h = vaddq_s32(vld1q_s32(mixBuffer + i + 4), vld1q_s32(sendBuffer + i + 4));
+			if (inp) {
+				int16x8_t in = vld1q_s16(inp);
+				l = vaddq_s32(l, vshrq_n_s32(vmulq_s32(vmovl_s16(vget_low_s16(in)), inVolume), 12));
+				h = vaddq_s32(h, vshrq_n_s32(vmulq_s32(vmovl_s16(vget_high_s16(in)), inVolume), 12));
+				inp += 8;
+			}
+			vst1q_s16(outp, vcombine_s16(vqmovn_s32(l), vqmovn_s32(h)));
+			outp += 8;
+		}
+#endif
 		if (inp) {
-			for (int i = 0; i < grainSize * 2; i += 2) {
+			for (; i < grainSize * 2; i += 2) {
 				int sampleL = mixBuffer[i] + sendBuffer[i] + ((*inp++) * leftVol >> 12);
 				int sampleR = mixBuffer[i + 1] + sendBuffer[i + 1] + ((*inp++) * rightVol >> 12);
 				*outp++ = clamp_s16(sampleL);
 				*outp++ = clamp_s16(sampleR);
 			}
 		} else {
-			for (int i = 0; i < grainSize * 2; i += 2) {
+			for (; i < grainSize * 2; i += 2) {
 				*outp++ = clamp_s16(mixBuffer[i] + sendBuffer[i]);
 				*outp++ = clamp_s16(mixBuffer[i + 1] + sendBuffer[i + 1]);
 			}
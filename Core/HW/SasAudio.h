@@ -253,6 +253,13 @@ public:
 	int *mixBuffer;
 	int *sendBuffer;
 	s16 *resampleBuffer;
+	// Scratch for one voice at a time, not part of the state.
+	int *voiceBuffer;
+	int *envelopeBuffer;
+	// Scratch for every voice at once, when rendering them in parallel.
+	s16 *parallelResampleBuffer;
+	int *parallelVoiceBuffer;
+	int *parallelEnvelopeBuffer;
 
 	FILE *audioDump;
 
@@ -264,5 +271,9 @@ public:
 	WaveformEffect waveformEffect;
 
 private:
+	void ClearParallelBuffers();
+	bool RenderVoice(SasVoice &voice, s16 *resample, int *out, int *envelope);
+	void RenderVoices(const int *playing, bool *rendered, int lower, int upper);
+
 	int grainSize;
 };
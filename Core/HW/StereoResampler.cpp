@@ -0,0 +1,205 @@
+// Copyright (c) 2013- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "Core/HW/StereoResampler.h"
+
+#if defined(_M_SSE) || defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(ARM) && defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+static const int HALF_TAPS = StereoResampler::TAPS / 2;
+// Stopband around -90 dB.
+static const double KAISER_BETA = 9.0;
+
+// Modified Bessel function of the first kind, order 0, for the Kaiser window.
+static double BesselI0(double x) {
+	double sum = 1.0, term = 1.0;
+	for (int k = 1; k < 50; ++k) {
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+		if (term < sum * 1e-12)
+			break;
+	}
+	return sum;
+}
+
+StereoResampler::StereoResampler() : inRate_(0), outRate_(0) {
+	coefs_.resize((PHASES + 1) * TAPS * 2);
+	history_.resize(HISTORY_FRAMES * 2);
+	SetRates(44100, 44100);
+}
+
+void StereoResampler::SetRates(int inRate, int outRate) {
+	if (inRate == inRate_ && outRate == outRate_)
+		return;
+	inRate_ = inRate;
+	outRate_ = outRate;
+
+	// Cut off a bit under the lower of the two Nyquist frequencies, relative to the input's.
+	const double cutoff = 0.91 * std::min(1.0, (double)outRate / inRate);
+	const double windowScale = 1.0 / BesselI0(KAISER_BETA);
+
+	for (int p = 0; p <= PHASES; ++p) {
+		float *c = &coefs_[p * TAPS * 2];
+		double frac = (double)p / PHASES;
+		double sum = 0.0;
+		double taps[TAPS];
+		for (int k = 0; k < TAPS; ++k) {
+			// Distance from the output's position to this input frame.
+			double d = (k - (HALF_TAPS - 1)) - frac;
+			double x = M_PI * cutoff * d;
+			double sinc = x == 0.0 ? 1.0 : sin(x) / x;
+			double r = d / HALF_TAPS;
+			double window = r >= 1.0 || r <= -1.0 ? 0.0 : BesselI0(KAISER_BETA * sqrt(1.0 - r * r)) * windowScale;
+			taps[k] = sinc * window;
+			sum += taps[k];
+		}
+		// Unity gain at DC for every phase, so there's no ripple from phase to phase.
+		for (int k = 0; k < TAPS; ++k) {
+			c[k * 2] = (float)(taps[k] / sum);
+			c[k * 2 + 1] = (float)(taps[k] / sum);
+		}
+	}
+
+	Reset();
+}
+
+void StereoResampler::Reset() {
+	// Silence before the first frame, so the filter has something to look back at.
+	memset(&history_[0], 0, (HALF_TAPS - 1) * 2 * sizeof(float));
+	historyStart_ = 0;
+	historyFrames_ = HALF_TAPS - 1;
+	pos_ = HALF_TAPS - 1;
+}
+
+float *StereoResampler::AppendHistory(int frames) {
+	if (historyStart_ + historyFrames_ + frames > HISTORY_FRAMES) {
+		memmove(&history_[0], &history_[historyStart_ * 2], historyFrames_ * 2 * sizeof(float));
+		historyStart_ = 0;
+	}
+	float *dest = &history_[(historyStart_ + historyFrames_) * 2];
+	historyFrames_ += frames;
+	return dest;
+}
+
+int StereoResampler::InputFramesNeeded(int outFrames, double step) const {
+	if (outFrames <= 0)
+		return 0;
+	double last = pos_ + (outFrames - 1) * step;
+	int needed = (int)last + HALF_TAPS + 1 - historyFrames_;
+	return std::max(needed, 0);
+}
+
+int StereoResampler::MaxOutputFrames(double step) const {
+	// The position is always within a frame of the start of the taps.
+	return std::max(1, (int)((HISTORY_FRAMES - TAPS - 2) / step));
+}
+
+void StereoResampler::AddInput(const s16 *in, int frames) {
+	// Only if the caller went over MaxOutputFrames().
+	frames = std::min(frames, HISTORY_FRAMES - historyFrames_);
+	float *dest = AppendHistory(frames);
+	for (int i = 0; i < frames * 2; ++i)
+		dest[i] = (float)in[i];
+}
+
+static inline s16 ClampToS16(float f) {
+	if (f >= 32767.0f)
+		return 32767;
+	if (f <= -32768.0f)
+		return -32768;
+	return (s16)floorf(f + 0.5f);
+}
+
+void StereoResampler::Resample(s16 *out, int outFrames, double step) {
+	outFrames = std::min(outFrames, MaxOutputFrames(step));
+	int missing = InputFramesNeeded(outFrames, step);
+	if (missing > 0)
+		memset(AppendHistory(missing), 0, missing * 2 * sizeof(float));
+
+	const float *history = &history_[historyStart_ * 2];
+	const float *coefs = &coefs_[0];
+	for (int o = 0; o < outFrames; ++o) {
+		int i = (int)pos_;
+		float phase = (float)(pos_ - i) * PHASES;
+		int p = (int)phase;
+		float phaseFrac = phase - p;
+		if (p >= PHASES) {
+			p = PHASES - 1;
+			phaseFrac = 1.0f;
+		}
+
+		const float *x = history + (i - HALF_TAPS + 1) * 2;
+		const float *c0 = coefs + p * TAPS * 2;
+		const float *c1 = c0 + TAPS * 2;
+
+#if defined(_M_SSE) || defined(__SSE2__)
+		// Two frames at a time, as L R L R.
+		__m128 acc0 = _mm_setzero_ps();
+		__m128 acc1 = _mm_setzero_ps();
+		for (int k = 0; k < TAPS * 2; k += 4) {
+			__m128 v = _mm_loadu_ps(x + k);
+			acc0 = _mm_add_ps(acc0, _mm_mul_ps(v, _mm_loadu_ps(c0 + k)));
+			acc1 = _mm_add_ps(acc1, _mm_mul_ps(v, _mm_loadu_ps(c1 + k)));
+		}
+		__m128 acc = _mm_add_ps(acc0, _mm_mul_ps(_mm_set1_ps(phaseFrac), _mm_sub_ps(acc1, acc0)));
+		acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+		__m128i result = _mm_cvtps_epi32(acc);
+		result = _mm_packs_epi32(result, result);
+		u32 lr = (u32)_mm_cvtsi128_si32(result);
+		memcpy(out + o * 2, &lr, sizeof(lr));
+#elif defined(ARM) && defined(__ARM_NEON__)
+		float32x4_t acc0 = vdupq_n_f32(0.0f);
+		float32x4_t acc1 = vdupq_n_f32(0.0f);
+		for (int k = 0; k < TAPS * 2; k += 4) {
+			float32x4_t v = vld1q_f32(x + k);
+			acc0 = vmlaq_f32(acc0, v, vld1q_f32(c0 + k));
+			acc1 = vmlaq_f32(acc1, v, vld1q_f32(c1 + k));
+		}
+		float32x4_t acc = vmlaq_n_f32(acc0, vsubq_f32(acc1, acc0), phaseFrac);
+		float32x2_t lr = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+		out[o * 2] = ClampToS16(vget_lane_f32(lr, 0));
+		out[o * 2 + 1] = ClampToS16(vget_lane_f32(lr, 1));
+#else
+		float l0 = 0.0f, r0 = 0.0f, l1 = 0.0f, r1 = 0.0f;
+		for (int k = 0; k < TAPS * 2; k += 2) {
+			l0 += x[k] * c0[k];
+			r0 += x[k + 1] * c0[k + 1];
+			l1 += x[k] * c1[k];
+			r1 += x[k + 1] * c1[k + 1];
+		}
+		out[o * 2] = ClampToS16(l0 + phaseFrac * (l1 - l0));
+		out[o * 2 + 1] = ClampToS16(r0 + phaseFrac * (r1 - r0));
+#endif
+
+		pos_ += step;
+	}
+
+	// Drop what no future output can reach.
+	int consumed = std::min((int)pos_ - (HALF_TAPS - 1), historyFrames_);
+	if (consumed > 0) {
+		historyStart_ += consumed;
+		historyFrames_ -= consumed;
+		pos_ -= consumed;
+	}
+}
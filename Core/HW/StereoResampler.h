@@ -0,0 +1,77 @@
+// Copyright (c) 2013- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#pragma once
+
+#include <vector>
+
+#include "../../Globals.h"
+
+// Converts interleaved 16-bit stereo from one rate to another, with a windowed sinc
+// filter.  The filter is tabulated at a fixed number of phases, and the output is
+// interpolated between the two nearest ones.
+//
+// The step (input frames per output frame) can be nudged on every call, which is how
+// the audio output keeps its buffer from slowly filling up or running dry.
+//
+// Everything is allocated up front, since this runs on the host's audio thread.
+class StereoResampler
+{
+public:
+	StereoResampler();
+
+	// Rebuilds the filter, and forgets any buffered input.
+	void SetRates(int inRate, int outRate);
+	int InRate() const { return inRate_; }
+	int OutRate() const { return outRate_; }
+	// Input frames per output frame, before any adjustment.
+	double NominalStep() const { return (double)inRate_ / outRate_; }
+
+	// How many more input frames Resample() will need to make outFrames at this step.
+	int InputFramesNeeded(int outFrames, double step) const;
+	// The most output frames one Resample() call can make, since the input must fit.
+	int MaxOutputFrames(double step) const;
+	void AddInput(const s16 *in, int frames);
+	// Makes outFrames, which needs InputFramesNeeded() frames to have been added.
+	// Anything missing is treated as silence.  At most MaxOutputFrames() are made.
+	void Resample(s16 *out, int outFrames, double step);
+
+	enum {
+		TAPS = 48,
+		PHASES = 256,
+		// Input frames that fit at once, including what the filter looks back at.
+		HISTORY_FRAMES = 8192,
+	};
+
+private:
+	void Reset();
+	// Room for frames more at the end of the history, moving it to the front if needed.
+	float *AppendHistory(int frames);
+
+	int inRate_;
+	int outRate_;
+
+	// (PHASES + 1) filters of TAPS coefficients, each stored twice (for left and right.)
+	std::vector<float> coefs_;
+	// Interleaved stereo.  The frames in use start at historyStart_, TAPS / 2 - 1 frames
+	// before the next output's position.
+	std::vector<float> history_;
+	int historyStart_;
+	int historyFrames_;
+	// Position of the next output from historyStart_, in input frames.
+	double pos_;
+};
@@ -0,0 +1,257 @@
+// Copyright (c) 2013- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <cstring>
+
+#include "GPU/ge_constants.h"
+#include "Core/HW/YuvConvert.h"
+
+#if defined(_M_SSE) || defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(ARM) && defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+// The inputs are scaled up by 128 (Y << 7, (U - 128) << 7), multiplied keeping the high
+// 16 bits, and give 12.4 fixed point.  Every path rounds exactly the same way.
+// NEON's vqdmulh doubles, so it uses half of each, which is why they're all even.
+enum {
+	COEF_Y = 9536,   // 1.164
+	COEF_RV = 13074, // 1.596
+	COEF_GU = 3204,  // 0.391
+	COEF_GV = 6660,  // 0.813
+	COEF_BU = 16532, // 2.018
+	OFFSET_Y = 298,  // 16 * 1.164
+};
+
+static inline int MulHigh(int a, int b) {
+	return (a * b) >> 16;
+}
+
+static inline int ClampToU8(int x) {
+	if (x < 0)
+		return 0;
+	if (x > 255)
+		return 255;
+	return x;
+}
+
+template <int format>
+static inline void StorePixel(u8 *dest, int i, int r, int g, int b) {
+	switch (format) {
+	case GE_FORMAT_565:
+		((u16 *)dest)[i] = (u16)(((b >> 3) << 11) | ((g >> 2) << 5) | (r >> 3));
+		break;
+	case GE_FORMAT_5551:
+		((u16 *)dest)[i] = (u16)(((b >> 3) << 10) | ((g >> 3) << 5) | (r >> 3));
+		break;
+	case GE_FORMAT_4444:
+		((u16 *)dest)[i] = (u16)(((b >> 4) << 8) | ((g >> 4) << 4) | (r >> 4));
+		break;
+	case GE_FORMAT_8888:
+		((u32 *)dest)[i] = (b << 16) | (g << 8) | r;
+		break;
+	}
+}
+
+// x is the source column, which picks the chroma sample.
+template <int format>
+static void ConvertPixels(u8 *dest, const u8 *y, const u8 *u, const u8 *v, int x, int count) {
+	for (int i = 0; i < count; ++i, ++x) {
+		int yy = MulHigh(y[x] << 7, COEF_Y) - OFFSET_Y;
+		int uu = (u[x >> 1] - 128) << 7;
+		int vv = (v[x >> 1] - 128) << 7;
+		int r = ClampToU8((yy + MulHigh(vv, COEF_RV) + 8) >> 4);
+		int g = ClampToU8((yy - MulHigh(uu, COEF_GU) - MulHigh(vv, COEF_GV) + 8) >> 4);
+		int b = ClampToU8((yy + MulHigh(uu, COEF_BU) + 8) >> 4);
+		StorePixel<format>(dest, i, r, g, b);
+	}
+}
+
+#if defined(_M_SSE) || defined(__SSE2__)
+#define HAVE_SIMD_YUV
+
+// Eight pixels, starting on an even column.
+template <int format>
+static inline void ConvertPixels8(u8 *dest, const u8 *y, const u8 *u, const u8 *v) {
+	const __m128i zero = _mm_setzero_si128();
+	u32 u4, v4;
+	memcpy(&u4, u, sizeof(u4));
+	memcpy(&v4, v, sizeof(v4));
+
+	__m128i yy = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)y), zero);
+	// Each chroma sample covers two pixels.
+	__m128i uu = _mm_cvtsi32_si128(u4);
+	__m128i vv = _mm_cvtsi32_si128(v4);
+	uu = _mm_unpacklo_epi8(_mm_unpacklo_epi8(uu, uu), zero);
+	vv = _mm_unpacklo_epi8(_mm_unpacklo_epi8(vv, vv), zero);
+
+	yy = _mm_sub_epi16(_mm_mulhi_epi16(_mm_slli_epi16(yy, 7), _mm_set1_epi16(COEF_Y)), _mm_set1_epi16(OFFSET_Y));
+	uu = _mm_slli_epi16(_mm_sub_epi16(uu, _mm_set1_epi16(128)), 7);
+	vv = _mm_slli_epi16(_mm_sub_epi16(vv, _mm_set1_epi16(128)), 7);
+
+	const __m128i round = _mm_set1_epi16(8);
+	__m128i r = _mm_add_epi16(yy, _mm_mulhi_epi16(vv, _mm_set1_epi16(COEF_RV)));
+	__m128i g = _mm_sub_epi16(yy, _mm_mulhi_epi16(uu, _mm_set1_epi16(COEF_GU)));
+	g = _mm_sub_epi16(g, _mm_mulhi_epi16(vv, _mm_set1_epi16(COEF_GV)));
+	__m128i b = _mm_add_epi16(yy, _mm_mulhi_epi16(uu, _mm_set1_epi16(COEF_BU)));
+	// Packing clamps to 0-255.
+	__m128i r8 = _mm_packus_epi16(_mm_srai_epi16(_mm_add_epi16(r, round), 4), zero);
+	__m128i g8 = _mm_packus_epi16(_mm_srai_epi16(_mm_add_epi16(g, round), 4), zero);
+	__m128i b8 = _mm_packus_epi16(_mm_srai_epi16(_mm_add_epi16(b, round), 4), zero);
+
+	if (format == GE_FORMAT_8888) {
+		__m128i rg = _mm_unpacklo_epi8(r8, g8);
+		__m128i ba = _mm_unpacklo_epi8(b8, zero);
+		_mm_storeu_si128((__m128i *)dest, _mm_unpacklo_epi16(rg, ba));
+		_mm_storeu_si128((__m128i *)(dest + 16), _mm_unpackhi_epi16(rg, ba));
+		return;
+	}
+
+	__m128i r16 = _mm_unpacklo_epi8(r8, zero);
+	__m128i g16 = _mm_unpacklo_epi8(g8, zero);
+	__m128i b16 = _mm_unpacklo_epi8(b8, zero);
+	__m128i px;
+	switch (format) {
+	case GE_FORMAT_565:
+		px = _mm_and_si128(_mm_slli_epi16(b16, 8), _mm_set1_epi16((s16)0xF800));
+		px = _mm_or_si128(px, _mm_and_si128(_mm_slli_epi16(g16, 3), _mm_set1_epi16(0x07E0)));
+		px = _mm_or_si128(px, _mm_srli_epi16(r16, 3));
+		break;
+	case GE_FORMAT_5551:
+		px = _mm_and_si128(_mm_slli_epi16(b16, 7), _mm_set1_epi16(0x7C00));
+		px = _mm_or_si128(px, _mm_and_si128(_mm_slli_epi16(g16, 2), _mm_set1_epi16(0x03E0)));
+		px = _mm_or_si128(px, _mm_srli_epi16(r16, 3));
+		break;
+	default:
+		px = _mm_and_si128(_mm_slli_epi16(b16, 4), _mm_set1_epi16(0x0F00));
+		px = _mm_or_si128(px, _mm_and_si128(g16, _mm_set1_epi16(0x00F0)));
+		px = _mm_or_si128(px, _mm_srli_epi16(r16, 4));
+		break;
+	}
+	_mm_storeu_si128((__m128i *)dest, px);
+}
+
+#elif defined(ARM) && defined(__ARM_NEON__)
+#define HAVE_SIMD_YUV
+
+template <int format>
+static inline void ConvertPixels8(u8 *dest, const u8 *y, const u8 *u, const u8 *v) {
+	u32 u4, v4;
+	memcpy(&u4, u, sizeof(u4));
+	memcpy(&v4, v, sizeof(v4));
+
+	int16x8_t yy = vreinterpretq_s16_u16(vshll_n_u8(vld1_u8(y), 7));
+	// Each chroma sample covers two pixels.
+	uint8x8_t u8x = vreinterpret_u8_u32(vdup_n_u32(u4));
+	uint8x8_t v8x = vreinterpret_u8_u32(vdup_n_u32(v4));
+	int16x8_t uu = vreinterpretq_s16_u16(vmovl_u8(vzip_u8(u8x, u8x).val[0]));
+	int16x8_t vv = vreinterpretq_s16_u16(vmovl_u8(vzip_u8(v8x, v8x).val[0]));
+
+	yy = vsubq_s16(vqdmulhq_n_s16(yy, COEF_Y / 2), vdupq_n_s16(OFFSET_Y));
+	uu = vshlq_n_s16(vsubq_s16(uu, vdupq_n_s16(128)), 7);
+	vv = vshlq_n_s16(vsubq_s16(vv, vdupq_n_s16(128)), 7);
+
+	int16x8_t r = vaddq_s16(yy, vqdmulhq_n_s16(vv, COEF_RV / 2));
+	int16x8_t g = vsubq_s16(vsubq_s16(yy, vqdmulhq_n_s16(uu, COEF_GU / 2)), vqdmulhq_n_s16(vv, COEF_GV / 2));
+	int16x8_t b = vaddq_s16(yy, vqdmulhq_n_s16(uu, COEF_BU / 2));
+	uint8x8_t r8 = vqmovun_s16(vrshrq_n_s16(r, 4));
+	uint8x8_t g8 = vqmovun_s16(vrshrq_n_s16(g, 4));
+	uint8x8_t b8 = vqmovun_s16(vrshrq_n_s16(b, 4));
+
+	if (format == GE_FORMAT_8888) {
+		uint8x8x4_t px;
+		px.val[0] = r8;
+		px.val[1] = g8;
+		px.val[2] = b8;
+		px.val[3] = vdup_n_u8(0);
+		vst4_u8(dest, px);
+		return;
+	}
+
+	uint16x8_t r16 = vmovl_u8(r8);
+	uint16x8_t g16 = vmovl_u8(g8);
+	uint16x8_t b16 = vmovl_u8(b8);
+	uint16x8_t px;
+	switch (format) {
+	case GE_FORMAT_565:
+		px = vandq_u16(vshlq_n_u16(b16, 8), vdupq_n_u16(0xF800));
+		px = vorrq_u16(px, vandq_u16(vshlq_n_u16(g16, 3), vdupq_n_u16(0x07E0)));
+		px = vorrq_u16(px, vshrq_n_u16(r16, 3));
+		break;
+	case GE_FORMAT_5551:
+		px = vandq_u16(vshlq_n_u16(b16, 7), vdupq_n_u16(0x7C00));
+		px = vorrq_u16(px, vandq_u16(vshlq_n_u16(g16, 2), vdupq_n_u16(0x03E0)));
+		px = vorrq_u16(px, vshrq_n_u16(r16, 3));
+		break;
+	default:
+		px = vandq_u16(vshlq_n_u16(b16, 4), vdupq_n_u16(0x0F00));
+		px = vorrq_u16(px, vandq_u16(g16, vdupq_n_u16(0x00F0)));
+		px = vorrq_u16(px, vshrq_n_u16(r16, 4));
+		break;
+	}
+	vst1q_u16((u16 *)dest, px);
+}
+#endif
+
+template <int format>
+static void ConvertRow(u8 *dest, const u8 *y, const u8 *u, const u8 *v, int x, int width) {
+	const int bpp = format == GE_FORMAT_8888 ? 4 : 2;
+	int i = 0;
+#ifdef HAVE_SIMD_YUV
+	// Get onto a chroma pair first.
+	if ((x & 1) && width > 0) {
+		ConvertPixels<format>(dest, y, u, v, x, 1);
+		i = 1;
+	}
+	for (; i + 8 <= width; i += 8)
+		ConvertPixels8<format>(dest + i * bpp, y + x + i, u + ((x + i) >> 1), v + ((x + i) >> 1));
+#endif
+	ConvertPixels<format>(dest + i * bpp, y, u, v, x + i, width - i);
+}
+
+template <int format>
+static void ConvertRect(u8 *dest, int destStride, const u8 *const planes[3], const int linesizes[3], int xpos, int ypos, int width, int height) {
+	const int bpp = format == GE_FORMAT_8888 ? 4 : 2;
+	for (int row = 0; row < height; ++row) {
+		int sy = ypos + row;
+		const u8 *y = planes[0] + sy * linesizes[0];
+		const u8 *u = planes[1] + (sy >> 1) * linesizes[1];
+		const u8 *v = planes[2] + (sy >> 1) * linesizes[2];
+		ConvertRow<format>(dest + row * destStride * bpp, y, u, v, xpos, width);
+	}
+}
+
+bool ConvertYUV420ToPSP(u8 *dest, int destStride, int pixelFormat,
+	const u8 *const planes[3], const int linesizes[3], int xpos, int ypos, int width, int height) {
+	switch (pixelFormat) {
+	case GE_FORMAT_565:
+		ConvertRect<GE_FORMAT_565>(dest, destStride, planes, linesizes, xpos, ypos, width, height);
+		return true;
+	case GE_FORMAT_5551:
+		ConvertRect<GE_FORMAT_5551>(dest, destStride, planes, linesizes, xpos, ypos, width, height);
+		return true;
+	case GE_FORMAT_4444:
+		ConvertRect<GE_FORMAT_4444>(dest, destStride, planes, linesizes, xpos, ypos, width, height);
+		return true;
+	case GE_FORMAT_8888:
+		ConvertRect<GE_FORMAT_8888>(dest, destStride, planes, linesizes, xpos, ypos, width, height);
+		return true;
+	default:
+		return false;
+	}
+}
@@ -0,0 +1,29 @@
+// Copyright (c) 2013- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#pragma once
+
+#include "../../Globals.h"
+
+// Converts part of a planar YUV 4:2:0 picture (BT.601, studio range, as MPEG video is)
+// straight to a PSP pixel format, which is a GEBufferFormat.  Alpha is always zero, like
+// the PSP's own decoder gives.
+//
+// The rectangle at (xpos, ypos) of the source goes to dest, with rows destStride pixels
+// apart.  Returns false if the pixel format is unknown.
+bool ConvertYUV420ToPSP(u8 *dest, int destStride, int pixelFormat,
+	const u8 *const planes[3], const int linesizes[3], int xpos, int ypos, int width, int height);
@@ -14,6 +14,7 @@
 #include "base/logging.h"
 #include "Core/Config.h"
 #include "Common/FileUtil.h"
+#include "Common/StdMutex.h"
 #include "Core/HW/atrac3plus.h"
 
 #ifdef __APPLE__
@@ -48,6 +49,10 @@ namespace Atrac3plus_Decoder {
 	ATRAC3PLUS_OPENCONTEXT open_context = 0;
 	ATRAC3PLUS_CLOSECONTEXT close_context = 0;
 
+	// Each Atrac decodes ahead on its own thread, and nothing says the plugin is thread safe
+	// (decodeFrame hands back its own buffer, too.)  So only one call at a time.
+	static std::mutex pluginLock;
+
 	std::string GetInstalledFilename() {
 #if defined(ANDROID) && defined(ARM)
 		return g_Config.internalDataDirectory + "libat3plusdecoder.so";
@@ -164,6 +169,7 @@ namespace Atrac3plus_Decoder {
 	}
 
 	int Shutdown() {
+		std::lock_guard<std::mutex> guard(pluginLock);
 #ifdef _WIN32
 		if (hlib) {
 			FreeLibrary(hlib);
@@ -182,12 +188,14 @@ namespace Atrac3plus_Decoder {
 	}
 
 	void* OpenContext() {
+		std::lock_guard<std::mutex> guard(pluginLock);
 		if (!open_context)
 			return 0;
 		return open_context();
 	}
 
 	int CloseContext(Context *context) {
+		std::lock_guard<std::mutex> guard(pluginLock);
 		if (!close_context || !context)
 			return 0;
 		close_context(*context);
@@ -196,6 +204,7 @@ namespace Atrac3plus_Decoder {
 	}
 
 	bool Decode(Context context, void* inbuf, int inbytes, int *outbytes, void* outbuf) {
+		std::lock_guard<std::mutex> guard(pluginLock);
 		if (!frame_decoder) {
 			*outbytes = 0;
 			return false;
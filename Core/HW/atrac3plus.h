@@ -90,17 +90,21 @@ namespace Atrac3plus_Decoder {
 			return bytesgot;
 		}
 
-		int get_front(unsigned char *buf, int wantedsize) {
-			if (wantedsize <= 0)
+		// Like pop_front(), but leaves the data queued.  offset skips that much of the front.
+		int get_front(unsigned char *buf, int wantedsize, int offset = 0) {
+			if (wantedsize <= 0 || offset < 0)
 				return 0;
-			int bytesgot = getQueueSize();
+			int bytesgot = getQueueSize() - offset;
 			if (wantedsize < bytesgot)
 				bytesgot = wantedsize;
-			if (start + bytesgot <= bufQueueSize) {
-				memcpy(buf, bufQueue + start, bytesgot);
+			if (bytesgot <= 0)
+				return 0;
+			int from = (start + offset) % bufQueueSize;
+			if (from + bytesgot <= bufQueueSize) {
+				memcpy(buf, bufQueue + from, bytesgot);
 			} else {
-				int size = bufQueueSize - start;
-				memcpy(buf, bufQueue + start, size);
+				int size = bufQueueSize - from;
+				memcpy(buf, bufQueue + from, size);
 				memcpy(buf + size, bufQueue, bytesgot - size);
 			}
 			return bytesgot;
@@ -16,6 +16,8 @@
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
 #include "Core/Reporting.h"
+#include "Core/CoreTiming.h"
+#include "Core/Config.h"
 
 #include "Core/HLE/HLE.h"
 
@@ -89,7 +91,7 @@ void Jit::BranchRSRTComp(u32 op, ArmGen::CCFlags cc, bool likely)
 		if (!delaySlotIsNice)
 			CompileDelaySlot(DELAYSLOT_SAFE_FLUSH);
 		else
-			FlushAll();
+			FlushAllForExits(targetAddr, js.compilerPC + 8);
 		ptr = B_CC(cc);
 	}
 	else
@@ -100,6 +102,8 @@ void Jit::BranchRSRTComp(u32 op, ArmGen::CCFlags cc, bool likely)
 	}
 
 	// Take the branch
+	if (MIPSAnalyst::IsSpinLoop(js.compilerPC))
+		QuickCallFunction(R1, (void *)&CoreTiming::IdleSpinLoop);
 	WriteExit(targetAddr, 0);
 
 	SetJumpTarget(ptr);
@@ -134,6 +138,8 @@ void Jit::BranchRSZeroComp(u32 op, ArmGen::CCFlags cc, bool andLink, bool likely
 	{
 		if (!delaySlotIsNice)
 			CompileDelaySlot(DELAYSLOT_SAFE_FLUSH);
+		else if (!andLink)
+			FlushAllForExits(targetAddr, js.compilerPC + 8);
 		else
 			FlushAll();
 		ptr = B_CC(cc);
@@ -151,6 +157,8 @@ void Jit::BranchRSZeroComp(u32 op, ArmGen::CCFlags cc, bool andLink, bool likely
 		MOVI2R(R0, js.compilerPC + 8);
 		STR(R0, CTXREG, MIPS_REG_RA * 4);
 	}
+	else if (MIPSAnalyst::IsSpinLoop(js.compilerPC))
+		QuickCallFunction(R1, (void *)&CoreTiming::IdleSpinLoop);
 
 	WriteExit(targetAddr, 0);
 
@@ -218,9 +226,12 @@ void Jit::BranchFPFlag(u32 op, ArmGen::CCFlags cc, bool likely)
 	bool delaySlotIsNice = IsDelaySlotNiceFPU(op, delaySlotOp);
 	CONDITIONAL_NICE_DELAYSLOT;
 	if (!likely && delaySlotIsNice)
+	{
 		CompileDelaySlot(DELAYSLOT_NICE);
-
-	FlushAll();
+		FlushAllForExits(targetAddr, js.compilerPC + 8);
+	}
+	else
+		FlushAll();
 
 	LDR(R0, CTXREG, offsetof(MIPSState, fpcond));
 	TST(R0, Operand2(1, TYPE_IMM));
@@ -277,9 +288,12 @@ void Jit::BranchVFPUFlag(u32 op, ArmGen::CCFlags cc, bool likely)
 	bool delaySlotIsNice = IsDelaySlotNiceVFPU(op, delaySlotOp);
 	CONDITIONAL_NICE_DELAYSLOT;
 	if (!likely && delaySlotIsNice)
+	{
 		CompileDelaySlot(DELAYSLOT_NICE);
-
-	FlushAll();
+		FlushAllForExits(targetAddr, js.compilerPC + 8);
+	}
+	else
+		FlushAll();
 
 	int imm3 = (op >> 18) & 7;
 
@@ -336,7 +350,7 @@ void Jit::Comp_Jump(u32 op)
 	{
 	case 2: //j
 		CompileDelaySlot(DELAYSLOT_NICE);
-		FlushAll();
+		FlushAllForExits(targetAddr, targetAddr);
 		WriteExit(targetAddr, 0);
 		break;
 
@@ -413,8 +427,31 @@ void Jit::Comp_Syscall(u32 op)
 	WriteDownCount(offset);
 	js.downcountAmount = -offset;
 
-	MOVI2R(R0, op);
-	QuickCallFunction(R1, (void *)&CallSyscall);
+	const int index = GetSyscallIndex(op);
+	void *quickFunc = GetQuickSyscallFunc(index);
+	if (quickFunc)
+	{
+		MOVI2R(R0, (u32)&g_Config.bProfileSyscalls);
+		LDRB(R0, R0, 0);
+		CMP(R0, 0);
+		FixupBranch withStats = B_CC(CC_NEQ);
+		QuickCallFunction(R1, quickFunc);
+		FixupBranch done = B();
+		SetJumpTarget(withStats);
+		MOVI2R(R0, index);
+		QuickCallFunction(R1, (void *)&CallSyscallWithoutFlags);
+		SetJumpTarget(done);
+	}
+	else if (index >= 0)
+	{
+		MOVI2R(R0, index);
+		QuickCallFunction(R1, (void *)&CallSyscallWithFlags);
+	}
+	else
+	{
+		MOVI2R(R0, op);
+		QuickCallFunction(R1, (void *)&CallSyscall);
+	}
 
 	WriteSyscallExit();
 	js.compiling = false;
@@ -823,4 +823,91 @@ namespace MIPSComp
 		DISABLE;
 	}
 
+	// Sign and operand order of each product, summed left to right like the interpreter.
+	struct CrossQuatTerm {
+		u8 s, t;
+		bool negate;
+	};
+
+	static const CrossQuatTerm crossTerms[3][2] = {
+		{{1, 2, false}, {2, 1, true}},
+		{{2, 0, false}, {0, 2, true}},
+		{{0, 1, false}, {1, 0, true}},
+	};
+
+	static const CrossQuatTerm quatTerms[4][4] = {
+		{{0, 3, false}, {1, 2, false}, {2, 1, true}, {3, 0, false}},
+		{{0, 2, true}, {1, 3, false}, {2, 0, false}, {3, 1, false}},
+		{{0, 1, false}, {1, 0, true}, {2, 3, false}, {3, 2, false}},
+		{{0, 0, true}, {1, 1, true}, {2, 2, true}, {3, 3, false}},
+	};
+
+	void Jit::Comp_VCrossQuat(u32 op) {
+		CONDITIONAL_DISABLE;
+
+		if (!(js.prefixDFlag & ArmJitState::PREFIX_KNOWN))
+			DISABLE;
+
+		VectorSize sz = GetVecSize(op);
+		int n = GetNumVectorElements(sz);
+
+		const CrossQuatTerm *terms;
+		int numTerms;
+		switch (sz) {
+		case V_Triple:  // vcrsp.t
+			terms = &crossTerms[0][0];
+			numTerms = 2;
+			break;
+		case V_Quad:  // vqmul.q
+			terms = &quatTerms[0][0];
+			numTerms = 4;
+			break;
+		default:
+			DISABLE;
+		}
+
+		// The interpreter ignores the S and T prefixes, and doesn't saturate, but the D write
+		// mask still applies (masked lanes go to temps here.)
+		u8 sregs[4], tregs[4], dregs[4];
+		GetVectorRegs(sregs, sz, _VS);
+		GetVectorRegs(tregs, sz, _VT);
+		GetVectorRegsPrefixD(dregs, sz, _VD);
+
+		fpr.MapRegsV(sregs, sz, 0);
+		fpr.MapRegsV(tregs, sz, 0);
+
+		// D may overlap S or T, so sum into temps first.
+		MIPSReg tempregs[4];
+		for (int i = 0; i < n; i++) {
+			tempregs[i] = fpr.GetTempV();
+			fpr.MapRegV(tempregs[i], MAP_NOINIT | MAP_DIRTY);
+			fpr.SpillLockV(tempregs[i]);
+			ARMReg sum = fpr.V(tempregs[i]);
+
+			// VMLA/VMLS round the product before adding, same as separate ops.
+			for (int j = 0; j < numTerms; j++) {
+				const CrossQuatTerm &term = terms[i * numTerms + j];
+				ARMReg s = fpr.V(sregs[term.s]);
+				ARMReg t = fpr.V(tregs[term.t]);
+				if (j == 0) {
+					VMUL(sum, s, t);
+					if (term.negate)
+						VNEG(sum, sum);
+				} else if (term.negate) {
+					VMLS(sum, s, t);
+				} else {
+					VMLA(sum, s, t);
+				}
+			}
+		}
+
+		fpr.MapRegsV(dregs, sz, MAP_NOINIT | MAP_DIRTY);
+		for (int i = 0; i < n; i++)
+			VMOV(fpr.V(dregs[i]), fpr.V(tempregs[i]));
+
+		fpr.ReleaseSpillLocks();
+
+		js.EatPrefix();
+	}
+
 }
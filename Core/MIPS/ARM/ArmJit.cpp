@@ -19,9 +19,11 @@
 #include "../../Core.h"
 #include "../../CoreTiming.h"
 #include "../MIPS.h"
+#include "../MIPSAnalyst.h"
 #include "../MIPSCodeUtils.h"
 #include "../MIPSInt.h"
 #include "../MIPSTables.h"
+#include "../../HLE/ReplaceTables.h"
 
 #include "ArmRegCache.h"
 #include "ArmJit.h"
@@ -88,6 +90,31 @@ void Jit::FlushAll()
 	FlushPrefixV();
 }
 
+// Pass the same address twice for a single exit.
+void Jit::FlushAllForExits(u32 exit1, u32 exit2)
+{
+	if (jo.discardDeadRegs)
+	{
+		MIPSAnalyst::LiveRegs live = MIPSAnalyst::GetLiveRegs(exit1);
+		if (exit2 != exit1)
+		{
+			MIPSAnalyst::LiveRegs live2 = MIPSAnalyst::GetLiveRegs(exit2);
+			live.gpr |= live2.gpr;
+			live.fpr |= live2.fpr;
+		}
+
+		for (int i = 0; i < 32; ++i)
+		{
+			if ((live.gpr & (1 << i)) == 0)
+				gpr.DiscardR(i);
+			if ((live.fpr & (1 << i)) == 0)
+				fpr.DiscardR(i);
+		}
+	}
+
+	FlushAll();
+}
+
 void Jit::FlushPrefixV()
 {
 	if ((js.prefixSFlag & ArmJitState::PREFIX_DIRTY) != 0)
@@ -223,6 +250,21 @@ const u8 *Jit::DoJit(u32 em_address, JitBlock *b)
 	if (logBlocks > 0) logBlocks--;
 	if (dontLogBlocks > 0) dontLogBlocks--;
 
+	int replacement = Replacement_GetIndex(em_address);
+	if (replacement >= 0)
+	{
+		// Just call the native version and return to the caller.
+		MOVI2R(R0, replacement);
+		QuickCallFunction(R1, (void *)&Replacement_Call);
+		LDR(R1, CTXREG, offsetof(MIPSState, downcount));
+		SUB(R1, R1, R0);
+		STR(R1, CTXREG, offsetof(MIPSState, downcount));
+		LDR(R0, CTXREG, gpr.GetMipsRegOffset(MIPS_REG_RA));
+		WriteExitDestInR(R0);
+		numInstructions = 1;
+		js.compiling = false;
+	}
+
 // #define LOGASM
 #ifdef LOGASM
 	char temp[256];
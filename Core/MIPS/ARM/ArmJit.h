@@ -36,9 +36,12 @@ struct ArmJitOptions
 	ArmJitOptions()
 	{
 		enableBlocklink = true;
+		discardDeadRegs = true;
 	}
 
 	bool enableBlocklink;
+	// Skip writing back registers the exit targets overwrite before reading.
+	bool discardDeadRegs;
 };
 
 struct ArmJitState
@@ -212,6 +215,7 @@ public:
 	void Comp_Vi2f(u32 op);
 	void Comp_Vcst(u32 op);
 	void Comp_Vhoriz(u32 op);
+	void Comp_VCrossQuat(u32 op);
 
 	JitBlockCache *GetBlockCache() { return &blocks; }
 
@@ -224,6 +228,7 @@ public:
 private:
 	void GenerateFixedCode();
 	void FlushAll();
+	void FlushAllForExits(u32 exit1, u32 exit2);
 	void FlushPrefixV();
 
 	void WriteDownCount(int offset = 0);
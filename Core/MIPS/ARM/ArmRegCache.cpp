@@ -216,6 +216,17 @@ void ArmRegCache::FlushR(MIPSReg r) {
 	mr[r].imm = 0;
 }
 
+void ArmRegCache::DiscardR(MIPSReg r) {
+	if (mr[r].loc == ML_ARMREG) {
+		// Note that we DO NOT write it back here. That's the whole point of Discard.
+		ar[mr[r].reg].isDirty = false;
+		ar[mr[r].reg].mipsReg = -1;
+	}
+	mr[r].loc = ML_MEM;
+	mr[r].reg = INVALID_REG;
+	mr[r].imm = 0;
+}
+
 void ArmRegCache::FlushAll() {
 	for (int i = 0; i < NUM_MIPSREG; i++) {
 		FlushR(i);
@@ -94,6 +94,8 @@ public:
 	void MapDirtyDirtyInIn(MIPSReg rd1, MIPSReg rd2, MIPSReg rs, MIPSReg rt, bool avoidLoad = true);
 	void FlushArmReg(ARMReg r);
 	void FlushR(MIPSReg r);
+	// Drops the cached value (even an immediate) without writing it back.
+	void DiscardR(MIPSReg r);
 
 	void FlushAll();
 
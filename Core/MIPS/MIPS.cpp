@@ -61,6 +61,7 @@ void MIPSState::Reset()
 		
 	if (PSP_CoreParameter().cpuCore == CPU_JIT)
 		MIPSComp::jit = new MIPSComp::Jit(this);
+	MIPSInterpret_ClearCache();
 
 	memset(r, 0, sizeof(r));
 	memset(f, 0, sizeof(f));
@@ -148,6 +149,13 @@ int MIPSState::RunLoopUntil(u64 globalTicks)
 	return 1;
 }
 
+void MIPSState::InvalidateICache(u32 address, int length)
+{
+	if (MIPSComp::jit)
+		MIPSComp::jit->GetBlockCache()->InvalidateICache(address, length);
+	MIPSInterpret_InvalidateCache(address, length);
+}
+
 void MIPSState::WriteFCR(int reg, int value)
 {
 	if (reg == 31)
@@ -136,6 +136,8 @@ public:
 
 	void SingleStep();
 	int RunLoopUntil(u64 globalTicks);
+	// Drops whatever the jit or the interpreter decoded from this range, after the code changed.
+	void InvalidateICache(u32 address, int length);
 };
 
 
@@ -16,6 +16,7 @@
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
 #include <map>
+#include <cstring>
 #include "../../Globals.h"
 
 #include "MIPS.h"
@@ -23,6 +24,7 @@
 #include "MIPSAnalyst.h"
 #include "MIPSCodeUtils.h"
 #include "../Debugger/SymbolMap.h"
+#include "../HLE/HLE.h"
 
 using namespace MIPSCodeUtils;
 using namespace std;
@@ -317,25 +319,424 @@ namespace MIPSAnalyst
 		return true;
 	}
 
+	// How many ops to scan along each path, and how many branches to follow.
+	static const int LIVENESS_MAX_OPS = 48;
+	static const int LIVENESS_MAX_DEPTH = 3;
+
+	struct OpRegUsage
+	{
+		u32 gprIn;
+		u32 gprOut;
+		u32 fprIn;
+		u32 fprOut;
+	};
+
+	// The info flags aren't complete for every op (swc1, FPU ops, Allegrex), so
+	// this decodes the ops it knows.  Returns false for anything else.
+	static bool GetOpRegUsage(u32 op, OpRegUsage &u)
+	{
+		const u32 rs = 1 << MIPS_GET_RS(op);
+		const u32 rt = 1 << MIPS_GET_RT(op);
+		const u32 rd = 1 << MIPS_GET_RD(op);
+		const u32 fs = 1 << MIPS_GET_FS(op);
+		const u32 ft = 1 << MIPS_GET_FT(op);
+		const u32 fd = 1 << MIPS_GET_FD(op);
+		u.gprIn = 0;
+		u.gprOut = 0;
+		u.fprIn = 0;
+		u.fprOut = 0;
+
+		switch (op >> 26)
+		{
+		case 0: // special
+			switch (op & 0x3F)
+			{
+			case 0: case 2: case 3: // sll, srl/rotr, sra
+				u.gprIn = rt; u.gprOut = rd; return true;
+			case 4: case 6: case 7: // sllv, srlv/rotrv, srav
+				u.gprIn = rs | rt; u.gprOut = rd; return true;
+			case 8: case 9: // jr, jalr
+				u.gprIn = rs; u.gprOut = (op & 0x3F) == 9 ? rd : 0; return true;
+			case 10: case 11: // movz, movn - rd is only conditionally written.
+				u.gprIn = rs | rt | rd; return true;
+			case 15: // sync
+				return true;
+			case 16: case 18: // mfhi, mflo
+				u.gprOut = rd; return true;
+			case 17: case 19: // mthi, mtlo
+				u.gprIn = rs; return true;
+			case 22: case 23: // clz, clo
+				u.gprIn = rs; u.gprOut = rd; return true;
+			case 24: case 25: case 26: case 27: case 28: case 29: case 46: case 47: // mult, div, madd, msub
+				u.gprIn = rs | rt; return true;
+			case 32: case 33: case 34: case 35: case 36: case 37: case 38: case 39:
+			case 42: case 43: case 44: case 45: // add ... nor, slt, sltu, max, min
+				u.gprIn = rs | rt; u.gprOut = rd; return true;
+			}
+			return false;
+
+		case 1: // regimm
+			switch (MIPS_GET_RT(op))
+			{
+			case 0: case 1: case 2: case 3: // bltz, bgez, bltzl, bgezl
+				u.gprIn = rs; return true;
+			case 16: case 17: case 18: case 19: // bltzal, bgezal, bltzall, bgezall
+				u.gprIn = rs; u.gprOut = 1 << MIPS_REG_RA; return true;
+			}
+			return false;
+
+		case 2: // j
+			return true;
+		case 3: // jal
+			u.gprOut = 1 << MIPS_REG_RA; return true;
+
+		case 4: case 5: case 20: case 21: // beq, bne, beql, bnel
+			u.gprIn = rs | rt; return true;
+		case 6: case 7: case 22: case 23: // blez, bgtz, blezl, bgtzl
+			u.gprIn = rs; return true;
+
+		case 8: case 9: case 10: case 11: case 12: case 13: case 14: // addi ... xori
+			u.gprIn = rs; u.gprOut = rt; return true;
+		case 15: // lui
+			u.gprOut = rt; return true;
+
+		case 17: // cop1
+			switch (MIPS_GET_RS(op))
+			{
+			case 0: // mfc1
+				u.fprIn = fs; u.gprOut = rt; return true;
+			case 2: // cfc1
+				u.gprOut = rt; return true;
+			case 4: // mtc1
+				u.gprIn = rt; u.fprOut = fs; return true;
+			case 6: // ctc1
+				u.gprIn = rt; return true;
+			case 8: // bc1f, bc1t, bc1fl, bc1tl
+				return MIPS_GET_RT(op) < 4;
+			case 16: // fmt s
+				switch (op & 0x3F)
+				{
+				case 0: case 1: case 2: case 3: // add.s, sub.s, mul.s, div.s
+					u.fprIn = fs | ft; u.fprOut = fd; return true;
+				case 4: case 5: case 6: case 7: case 12: case 13: case 14: case 15: case 36: // sqrt.s ... cvt.w.s
+					u.fprIn = fs; u.fprOut = fd; return true;
+				}
+				if ((op & 0x30) == 0x30) // c.cond.s
+				{
+					u.fprIn = fs | ft;
+					return true;
+				}
+				return false;
+			case 20: // fmt w
+				if ((op & 0x3F) == 32) // cvt.s.w
+				{
+					u.fprIn = fs; u.fprOut = fd;
+					return true;
+				}
+				return false;
+			}
+			return false;
+
+		case 31: // special3
+			switch (op & 0x3F)
+			{
+			case 0: // ext
+				u.gprIn = rs; u.gprOut = rt; return true;
+			case 4: // ins
+				u.gprIn = rs | rt; u.gprOut = rt; return true;
+			case 32: // allegrex
+				switch ((op >> 6) & 0x1F)
+				{
+				case 2: case 3: case 16: case 20: case 24: // wsbh, wsbw, seb, bitrev, seh
+					u.gprIn = rt; u.gprOut = rd; return true;
+				}
+				return false;
+			}
+			return false;
+
+		case 32: case 33: case 35: case 36: case 37: // lb, lh, lw, lbu, lhu
+			u.gprIn = rs; u.gprOut = rt; return true;
+		case 34: case 38: // lwl, lwr merge into rt.
+			u.gprIn = rs | rt; u.gprOut = rt; return true;
+		case 40: case 41: case 42: case 43: case 46: // sb, sh, swl, sw, swr
+			u.gprIn = rs | rt; return true;
+		case 49: // lwc1
+			u.gprIn = rs; u.fprOut = ft; return true;
+		case 57: // swc1
+			u.gprIn = rs; u.fprIn = ft; return true;
+		}
+
+		// VFPU ops only touch GPRs through rs/rt (lv/sv addresses, mtv), and never the FPU.
+		// mfv may write rt, but leaving it out just means we keep it alive.
+		if (MIPSGetInfo(op) & IS_VFPU)
+		{
+			u.gprIn = rs | rt;
+			return true;
+		}
+		return false;
+	}
+
+	static void AddLiveRegs(LiveRegs &live, const LiveRegs &killed, u32 gprs, u32 fprs)
+	{
+		live.gpr |= gprs & ~killed.gpr;
+		live.fpr |= fprs & ~killed.fpr;
+	}
+
+	// Like a single op step: reads first, then writes.  Returns false if everything should be considered live.
+	static bool StepLiveRegs(u32 op, LiveRegs &live, LiveRegs &killed)
+	{
+		OpRegUsage u;
+		if (!GetOpRegUsage(op, u))
+			return false;
+		AddLiveRegs(live, killed, u.gprIn, u.fprIn);
+		killed.gpr |= u.gprOut;
+		killed.fpr |= u.fprOut;
+		return true;
+	}
+
+	// Scanning into other functions would depend on code we don't track for changes.
+	// Without symbols, j is too often a tail call to trust, but branches stay local.
+	static bool IsLiveRegsTargetInFunction(u32 target, bool isJump, const SymbolInfo &func)
+	{
+		if (func.size == 0)
+			return !isJump;
+		return target >= func.address && target < func.address + func.size;
+	}
+
+	static void ScanLiveRegs(u32 addr, LiveRegs killed, LiveRegs &live, int depth, const SymbolInfo &func)
+	{
+		for (int i = 0; i < LIVENESS_MAX_OPS; ++i, addr += 4)
+		{
+			if (!Memory::IsValidAddress(addr))
+				break;
+			if (func.size != 0 && addr - func.address >= func.size)
+				break;
+
+			u32 op = Memory::Read_Instruction(addr);
+			u32 info = MIPSGetInfo(op);
+			if (!StepLiveRegs(op, live, killed))
+				break;
+			if ((info & DELAYSLOT) == 0)
+				continue;
+
+			// Calls, jr, and anything too deep are treated as reading everything.
+			if (depth <= 0 || (info & (IS_JUMP | IS_CONDBRANCH)) == 0 || (info & OUT_RA) != 0 || (op >> 26) == 3)
+				break;
+
+			u32 delaySlotOp = Memory::Read_Instruction(addr + 4);
+			if (MIPSGetInfo(delaySlotOp) & DELAYSLOT)
+				break;
+
+			if (info & IS_JUMP)
+			{
+				// Only j gets here.
+				u32 jumpTarget = ((addr + 4) & 0xF0000000) | ((op & 0x03FFFFFF) << 2);
+				if (!IsLiveRegsTargetInFunction(jumpTarget, true, func))
+					break;
+				if (!StepLiveRegs(delaySlotOp, live, killed))
+					break;
+				ScanLiveRegs(jumpTarget, killed, live, depth - 1, func);
+				return;
+			}
+
+			u32 target = addr + 4 + ((s16)(op & 0xFFFF) << 2);
+			if (!IsLiveRegsTargetInFunction(target, false, func))
+				break;
+			if (info & LIKELY)
+			{
+				// Not taken skips the delay slot.
+				ScanLiveRegs(addr + 8, killed, live, depth - 1, func);
+				if (!StepLiveRegs(delaySlotOp, live, killed))
+					break;
+				ScanLiveRegs(target, killed, live, depth - 1, func);
+				return;
+			}
+
+			if (!StepLiveRegs(delaySlotOp, live, killed))
+				break;
+			ScanLiveRegs(target, killed, live, depth - 1, func);
+			// b (beq zero, zero) is always taken.
+			if ((op & 0xFFFF0000) != 0x10000000)
+				ScanLiveRegs(addr + 8, killed, live, depth - 1, func);
+			return;
+		}
+
+		// Ran out of ops or understanding, so whatever isn't written yet may be read.
+		AddLiveRegs(live, killed, 0xFFFFFFFF, 0xFFFFFFFF);
+	}
+
+	LiveRegs GetLiveRegs(u32 addr)
+	{
+		LiveRegs live = {0, 0};
+		LiveRegs killed = {0, 0};
+		SymbolInfo func = {0, 0};
+		if (!symbolMap.GetSymbolInfo(&func, addr, ST_FUNCTION))
+			func.size = 0;
+		ScanLiveRegs(addr, killed, live, LIVENESS_MAX_DEPTH, func);
+		// ZERO is never stored anyway.
+		live.gpr &= ~1;
+		return live;
+	}
+
+	static const int SPINLOOP_MAX_OPS = 16;
+
+	// HLE queries whose result only changes when an event fires.
+	static const char *const spinLoopQueries[] = {
+		"sceDisplayGetVcount",
+		"sceDisplayIsVblank",
+		"sceDisplayIsVsync",
+	};
+
+	// Is target a stub for one of the above?  They look like "jr ra; syscall".
+	static bool IsSpinLoopQuery(u32 target)
+	{
+		if (!Memory::IsValidAddress(target) || Memory::Read_Instruction(target) != MIPS_MAKE_JR_RA())
+			return false;
+		u32 op = Memory::Read_Instruction(target + 4);
+		if (!IsSyscall(op))
+			return false;
+
+		u32 callno = (op >> 6) & 0xFFFFF;
+		const char *name = GetFuncName((callno & 0xFF000) >> 12, callno & 0xFFF);
+		for (size_t i = 0; i < ARRAY_SIZE(spinLoopQueries); ++i)
+		{
+			if (!strcmp(name, spinLoopQueries[i]))
+				return true;
+		}
+		return false;
+	}
+
+	// Only simple ALU ops and loads.  HI/LO and the FPU aren't tracked.
+	static bool GetSpinLoopOpRegUsage(u32 op, OpRegUsage &u)
+	{
+		if (!GetOpRegUsage(op, u) || u.fprIn != 0 || u.fprOut != 0)
+			return false;
+		if (MIPSGetInfo(op) & (DELAYSLOT | OUT_MEM | IS_VFPU))
+			return false;
+		if ((op >> 26) == 0)
+		{
+			switch (op & 0x3F)
+			{
+			case 16: case 17: case 18: case 19: // mfhi, mthi, mflo, mtlo
+			case 24: case 25: case 26: case 27: case 28: case 29: case 46: case 47: // mult, div, madd, msub
+				return false;
+			}
+		}
+		// lwc1 and cop1 were caught by the FPU check, but swc1 doesn't have OUT_MEM.
+		return (op >> 26) != 57;
+	}
+
+	static bool AnalyzeSpinLoop(u32 branchAddr)
+	{
+		u32 op = Memory::Read_Instruction(branchAddr);
+		u32 info = MIPSGetInfo(op);
+		if ((info & IS_CONDBRANCH) == 0 || (info & (OUT_RA | IS_VFPU | IN_FPUFLAG)) != 0)
+			return false;
+		u32 target = branchAddr + 4 + ((s16)(op & 0xFFFF) << 2);
+		if (target > branchAddr || branchAddr - target > SPINLOOP_MAX_OPS * 4)
+			return false;
+
+		// Collect what each op reads and writes, in order.  The branch reads before its delay slot.
+		// A jal and its delay slot take three entries.
+		OpRegUsage usage[SPINLOOP_MAX_OPS * 2 + 3];
+		int count = 0;
+		for (u32 addr = target; addr < branchAddr; addr += 4)
+		{
+			u32 bodyOp = Memory::Read_Instruction(addr);
+			if ((bodyOp >> 26) == 3)
+			{
+				// jal to an event-driven query: ra, then the delay slot, then v0/v1.
+				u32 callTarget = (addr & 0xF0000000) | ((bodyOp & 0x03FFFFFF) << 2);
+				if (addr + 4 >= branchAddr || !IsSpinLoopQuery(callTarget))
+					return false;
+				usage[count].gprIn = 0;
+				usage[count].gprOut = 1 << MIPS_REG_RA;
+				usage[count].fprIn = usage[count].fprOut = 0;
+				count++;
+				addr += 4;
+				if (!GetSpinLoopOpRegUsage(Memory::Read_Instruction(addr), usage[count++]))
+					return false;
+				usage[count].gprIn = 0;
+				usage[count].gprOut = (1 << MIPS_REG_V0) | (1 << MIPS_REG_V1);
+				usage[count].fprIn = usage[count].fprOut = 0;
+				count++;
+			}
+			else if (!GetSpinLoopOpRegUsage(bodyOp, usage[count++]))
+				return false;
+		}
+		if (!GetOpRegUsage(op, usage[count++]))
+			return false;
+		if (!GetSpinLoopOpRegUsage(Memory::Read_Instruction(branchAddr + 4), usage[count++]))
+			return false;
+
+		// If no value is carried from one iteration to the next, every iteration does
+		// exactly the same thing until memory changes, which needs an event.
+		u32 loopWrites = 0;
+		for (int i = 0; i < count; ++i)
+			loopWrites |= usage[i].gprOut;
+		loopWrites &= ~1;
+
+		u32 written = 0;
+		for (int i = 0; i < count; ++i)
+		{
+			if (usage[i].gprIn & loopWrites & ~written)
+				return false;
+			written |= usage[i].gprOut;
+		}
+		return true;
+	}
+
+	struct SpinLoopCacheEntry
+	{
+		u32 branchAddr;
+		u32 branchOp;
+		u32 targetOp;
+		bool spin;
+	};
+
+	static SpinLoopCacheEntry spinLoopCache[256];
+
+	bool IsSpinLoop(u32 branchAddr)
+	{
+		// The interpreter asks on every taken backward branch, so remember the answer.
+		// The ops are compared in case the code was replaced.
+		u32 op = Memory::Read_Instruction(branchAddr);
+		u32 targetOp = Memory::Read_Instruction(branchAddr + 4 + ((s16)(op & 0xFFFF) << 2));
+		SpinLoopCacheEntry &entry = spinLoopCache[(branchAddr >> 2) & (ARRAY_SIZE(spinLoopCache) - 1)];
+		if (entry.branchAddr != branchAddr || entry.branchOp != op || entry.targetOp != targetOp)
+		{
+			entry.branchAddr = branchAddr;
+			entry.branchOp = op;
+			entry.targetOp = targetOp;
+			entry.spin = AnalyzeSpinLoop(branchAddr);
+		}
+		return entry.spin;
+	}
+
+	u32 HashFunction(u32 start, u32 size)
+	{
+		u32 hash = 0x1337babe;
+		for (u32 addr = start; addr < start + size; addr += 4)
+		{
+			u32 validbits = 0xFFFFFFFF;
+			u32 instr = Memory::Read_Instruction(addr);
+			u32 flags = MIPSGetInfo(instr);
+			if (flags & IN_IMM16)
+				validbits&=~0xFFFF;
+			if (flags & IN_IMM26)
+				validbits&=~0x3FFFFFF;
+			hash = __rotl(hash,13);
+			hash ^= (instr&validbits);
+		}
+		return hash;
+	}
+
 	void HashFunctions()
 	{
 		for (vector<Function>::iterator iter = functions.begin(); iter!=functions.end(); iter++)
 		{
 			Function &f=*iter;
-			u32 hash = 0x1337babe;
-			for (u32 addr = f.start; addr <= f.end; addr += 4)
-			{
-				u32 validbits = 0xFFFFFFFF;
-				u32 instr = Memory::Read_Instruction(addr);
-				u32 flags = MIPSGetInfo(instr);
-				if (flags & IN_IMM16)
-					validbits&=~0xFFFF;
-				if (flags & IN_IMM26)
-					validbits&=~0x3FFFFFF;
-				hash = __rotl(hash,13);
-				hash ^= (instr&validbits);
-			}
-			f.hash=hash;
+			f.hash = HashFunction(f.start, f.end - f.start + 4);
 			f.hasHash=true;
 		}
 	}
@@ -47,8 +47,23 @@ namespace MIPSAnalyst
 		int x;
 	};
 
+	// Bit N set means register N may be read before it's next written.
+	struct LiveRegs
+	{
+		u32 gpr;
+		u32 fpr;
+	};
+
 	bool IsRegisterUsed(u32 reg, u32 addr);
+	// Conservative liveness of the GPRs and FPU regs on entry to addr.  Follows branches
+	// within the function a short distance, and assumes everything is live when unsure.
+	LiveRegs GetLiveRegs(u32 addr);
+	// A short backward branch polling memory (or vcount) without storing or counting anything.
+	// Until an event fires, such a loop can't exit, so the time until then can be skipped.
+	bool IsSpinLoop(u32 branchAddr);
 	void ScanForFunctions(u32 startAddr, u32 endAddr);
+	// Immediates are masked out, so the hash doesn't depend on where the function was linked.
+	u32 HashFunction(u32 start, u32 size);
 	void CompileLeafs();
 
 	std::vector<int> GetInputRegs(u32 op);
@@ -26,6 +26,8 @@
 #include "MIPS.h"
 #include "MIPSInt.h"
 #include "MIPSTables.h"
+#include "MIPSAnalyst.h"
+#include "Core/CoreTiming.h"
 #include "Core/Reporting.h"
 #include "Core/Config.h"
 
@@ -77,6 +79,13 @@ static inline void DelayBranchTo(u32 where)
 	mipsr4k.inDelaySlot = true;
 }
 
+// Call after a branch.  If it went back into a loop that only polls, skip to the next event.
+static inline void CheckSpinLoop(int imm)
+{
+	if (imm < 0 && mipsr4k.inDelaySlot && MIPSAnalyst::IsSpinLoop(PC - 4))
+		CoreTiming::IdleSpinLoop();
+}
+
 static inline void SkipLikely()
 {
 	PC += 8;
@@ -220,6 +229,7 @@ namespace MIPSInt
 			_dbg_assert_msg_(CPU,0,"Trying to interpret instruction that can't be interpreted");
 			break;
 		}
+		CheckSpinLoop(imm);
 	}
 
 	void Int_RelBranchRI(u32 op)
@@ -242,6 +252,7 @@ namespace MIPSInt
 			_dbg_assert_msg_(CPU,0,"Trying to interpret instruction that can't be interpreted");
 			break;
 		}
+		CheckSpinLoop(imm);
 	}
 
 
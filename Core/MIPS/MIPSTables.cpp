@@ -23,7 +23,10 @@
 #include "Core/MIPS/MIPSIntVFPU.h"
 #include "Core/MIPS/MIPSCodeUtils.h"
 #include "Core/MIPS/MIPSTables.h"
+#include "Core/MIPS/MIPSAnalyst.h"
+#include "Core/MemMap.h"
 #include "Core/CoreTiming.h"
+#include "Core/HLE/ReplaceTables.h"
 #include "Core/Debugger/Breakpoints.h"
 
 #include "JitCommon/JitCommon.h"
@@ -493,8 +496,8 @@ const MIPSInstruction tableVFPU1[8] =
 	INSTR("vscl",&Jit::Comp_VScl, Dis_VScl, Int_VScl, IS_VFPU|OUT_EAT_PREFIX),
 	{-2},
 	INSTR("vhdp",&Jit::Comp_VHdp, Dis_Generic, Int_VHdp, IS_VFPU|OUT_EAT_PREFIX), 
-	INSTR("vcrs",&Jit::Comp_VCrs, Dis_Vcrs, Int_Vcrs, IS_VFPU), 
-	INSTR("vdet",&Jit::Comp_VDet, Dis_Generic, Int_Vdet, IS_VFPU), 
+	INSTR("vcrs",&Jit::Comp_VCrs, Dis_Vcrs, Int_Vcrs, IS_VFPU|OUT_EAT_PREFIX), 
+	INSTR("vdet",&Jit::Comp_VDet, Dis_Generic, Int_Vdet, IS_VFPU|OUT_EAT_PREFIX), 
 	{-2},
 };
 
@@ -651,10 +654,10 @@ const MIPSInstruction tableVFPU6[32] =  //111100 xxx
 	INSTR("vmscl",&Jit::Comp_Vmscl, Dis_Generic, Int_Vmscl, IS_VFPU|OUT_EAT_PREFIX),
 	INSTR("vmscl",&Jit::Comp_Vmscl, Dis_Generic, Int_Vmscl, IS_VFPU|OUT_EAT_PREFIX),
 
-	INSTR("vcrsp.t/vqmul.q",&Jit::Comp_Generic, Dis_CrossQuat, Int_CrossQuat, IS_VFPU|OUT_EAT_PREFIX),
-	INSTR("vcrsp.t/vqmul.q",&Jit::Comp_Generic, Dis_CrossQuat, Int_CrossQuat, IS_VFPU|OUT_EAT_PREFIX),
-	INSTR("vcrsp.t/vqmul.q",&Jit::Comp_Generic, Dis_CrossQuat, Int_CrossQuat, IS_VFPU|OUT_EAT_PREFIX),
-	INSTR("vcrsp.t/vqmul.q",&Jit::Comp_Generic, Dis_CrossQuat, Int_CrossQuat, IS_VFPU|OUT_EAT_PREFIX),
+	INSTR("vcrsp.t/vqmul.q",&Jit::Comp_VCrossQuat, Dis_CrossQuat, Int_CrossQuat, IS_VFPU|OUT_EAT_PREFIX),
+	INSTR("vcrsp.t/vqmul.q",&Jit::Comp_VCrossQuat, Dis_CrossQuat, Int_CrossQuat, IS_VFPU|OUT_EAT_PREFIX),
+	INSTR("vcrsp.t/vqmul.q",&Jit::Comp_VCrossQuat, Dis_CrossQuat, Int_CrossQuat, IS_VFPU|OUT_EAT_PREFIX),
+	INSTR("vcrsp.t/vqmul.q",&Jit::Comp_VCrossQuat, Dis_CrossQuat, Int_CrossQuat, IS_VFPU|OUT_EAT_PREFIX),
 //24
 	{-2},
 	{-2},
@@ -693,7 +696,7 @@ const MIPSInstruction tableVFPU9[32] = //110100 00010 xxxxx
 	INSTR("vocp", &Jit::Comp_Generic, Dis_Vbfy, Int_Vocp, IS_VFPU|OUT_EAT_PREFIX),  // one's complement
 	INSTR("vsocp", &Jit::Comp_Generic, Dis_Vbfy, Int_Vsocp, IS_VFPU|OUT_EAT_PREFIX),
 	INSTR("vfad", &Jit::Comp_Vhoriz, Dis_Vfad, Int_Vfad, IS_VFPU|OUT_EAT_PREFIX),
-	INSTR("vavg", &Jit::Comp_Vhoriz, Dis_Vfad, Int_Vavg, IS_VFPU),
+	INSTR("vavg", &Jit::Comp_Vhoriz, Dis_Vfad, Int_Vavg, IS_VFPU|OUT_EAT_PREFIX),
 	//8
 	INSTR("vsrt3", &Jit::Comp_Generic, Dis_Vbfy, Int_Vsrt3, IS_VFPU),
 	INSTR("vsrt4", &Jit::Comp_Generic, Dis_Vbfy, Int_Vsrt4, IS_VFPU),
@@ -945,62 +948,285 @@ void MIPSInterpret(u32 op) //only for those rare ones
 #define R(i)   (curMips->r[i])
 
 
-int MIPSInterpret_RunUntil(u64 globalTicks)
+// The interpreter runs pre-decoded blocks: straight line code up to a branch and its delay
+// slot, decoded once into a handler per op with the operands already pulled out.  The common
+// ops have handlers here, the rest call their Int_ function with the op.  Like the jit's
+// blocks, these only see changed code through MIPSState::InvalidateICache().  A block whose
+// first op was replaced is decoded again anyway, the jit notices that through its emuhacks.
+struct InterpretOp;
+typedef void (*InterpretOpFunc)(MIPSState *curMips, const InterpretOp &d);
+
+struct InterpretOp
 {
-	MIPSState *curMips = currentMIPS;
-	while (coreState == CORE_RUNNING)
-	{
-		CoreTiming::Advance();
+	InterpretOpFunc func;
+	MIPSInterpretFunc interpret;
+	u32 op;
+	// Extended the way the op wants, or the target for branches and jumps.
+	u32 imm;
+	u8 rs;
+	u8 rt;
+	u8 rd;
+	u8 sa;
+};
 
-		// NEVER stop in a delay slot!
-		while (curMips->downcount >= 0 && coreState == CORE_RUNNING)
+struct InterpretBlock
+{
+	u32 start;
+	u32 firstOp;
+	// 0 when empty or invalidated.
+	int numOps;
+};
+
+static const int INTERPRET_BLOCK_MAX_OPS = 32;
+static const u32 INTERPRET_BLOCK_CACHE_SIZE = 0x800;
+// Indexed by start address, a block that collides is just decoded again.
+static InterpretBlock interpretBlocks[INTERPRET_BLOCK_CACHE_SIZE];
+static InterpretOp interpretBlockOps[INTERPRET_BLOCK_CACHE_SIZE][INTERPRET_BLOCK_MAX_OPS];
+
+static inline void DelayBranchTo(MIPSState *curMips, u32 where)
+{
+	curMips->pc += 4;
+	curMips->nextPC = where;
+	curMips->inDelaySlot = true;
+}
+
+static void Interpret_Generic(MIPSState *curMips, const InterpretOp &d) { d.interpret(d.op); }
+static void Interpret_Unknown(MIPSState *curMips, const InterpretOp &d) { MIPSInterpret(d.op); }
+static void Interpret_Nop(MIPSState *curMips, const InterpretOp &d) { curMips->pc += 4; }
+
+static void Interpret_Addiu(MIPSState *curMips, const InterpretOp &d) { R(d.rt) = R(d.rs) + d.imm; curMips->pc += 4; }
+static void Interpret_Slti(MIPSState *curMips, const InterpretOp &d) { R(d.rt) = (s32)R(d.rs) < (s32)d.imm; curMips->pc += 4; }
+static void Interpret_Sltiu(MIPSState *curMips, const InterpretOp &d) { R(d.rt) = R(d.rs) < d.imm; curMips->pc += 4; }
+static void Interpret_Andi(MIPSState *curMips, const InterpretOp &d) { R(d.rt) = R(d.rs) & d.imm; curMips->pc += 4; }
+static void Interpret_Ori(MIPSState *curMips, const InterpretOp &d) { R(d.rt) = R(d.rs) | d.imm; curMips->pc += 4; }
+static void Interpret_Xori(MIPSState *curMips, const InterpretOp &d) { R(d.rt) = R(d.rs) ^ d.imm; curMips->pc += 4; }
+static void Interpret_Lui(MIPSState *curMips, const InterpretOp &d) { R(d.rt) = d.imm; curMips->pc += 4; }
+
+static void Interpret_Addu(MIPSState *curMips, const InterpretOp &d) { R(d.rd) = R(d.rs) + R(d.rt); curMips->pc += 4; }
+static void Interpret_Subu(MIPSState *curMips, const InterpretOp &d) { R(d.rd) = R(d.rs) - R(d.rt); curMips->pc += 4; }
+static void Interpret_And(MIPSState *curMips, const InterpretOp &d) { R(d.rd) = R(d.rs) & R(d.rt); curMips->pc += 4; }
+static void Interpret_Or(MIPSState *curMips, const InterpretOp &d) { R(d.rd) = R(d.rs) | R(d.rt); curMips->pc += 4; }
+static void Interpret_Xor(MIPSState *curMips, const InterpretOp &d) { R(d.rd) = R(d.rs) ^ R(d.rt); curMips->pc += 4; }
+static void Interpret_Nor(MIPSState *curMips, const InterpretOp &d) { R(d.rd) = ~(R(d.rs) | R(d.rt)); curMips->pc += 4; }
+static void Interpret_Slt(MIPSState *curMips, const InterpretOp &d) { R(d.rd) = (s32)R(d.rs) < (s32)R(d.rt); curMips->pc += 4; }
+static void Interpret_Sltu(MIPSState *curMips, const InterpretOp &d) { R(d.rd) = R(d.rs) < R(d.rt); curMips->pc += 4; }
+static void Interpret_Sll(MIPSState *curMips, const InterpretOp &d) { R(d.rd) = R(d.rt) << d.sa; curMips->pc += 4; }
+static void Interpret_Srl(MIPSState *curMips, const InterpretOp &d) { R(d.rd) = R(d.rt) >> d.sa; curMips->pc += 4; }
+static void Interpret_Sra(MIPSState *curMips, const InterpretOp &d) { R(d.rd) = (u32)((s32)R(d.rt) >> d.sa); curMips->pc += 4; }
+
+static void Interpret_Lb(MIPSState *curMips, const InterpretOp &d) { R(d.rt) = (u32)(s32)(s8)Memory::Read_U8(R(d.rs) + d.imm); curMips->pc += 4; }
+static void Interpret_Lh(MIPSState *curMips, const InterpretOp &d) { R(d.rt) = (u32)(s32)(s16)Memory::Read_U16(R(d.rs) + d.imm); curMips->pc += 4; }
+static void Interpret_Lw(MIPSState *curMips, const InterpretOp &d) { R(d.rt) = Memory::Read_U32(R(d.rs) + d.imm); curMips->pc += 4; }
+static void Interpret_Lbu(MIPSState *curMips, const InterpretOp &d) { R(d.rt) = Memory::Read_U8(R(d.rs) + d.imm); curMips->pc += 4; }
+static void Interpret_Lhu(MIPSState *curMips, const InterpretOp &d) { R(d.rt) = Memory::Read_U16(R(d.rs) + d.imm); curMips->pc += 4; }
+static void Interpret_Sb(MIPSState *curMips, const InterpretOp &d) { Memory::Write_U8(R(d.rt), R(d.rs) + d.imm); curMips->pc += 4; }
+static void Interpret_Sh(MIPSState *curMips, const InterpretOp &d) { Memory::Write_U16(R(d.rt), R(d.rs) + d.imm); curMips->pc += 4; }
+static void Interpret_Sw(MIPSState *curMips, const InterpretOp &d) { Memory::Write_U32(R(d.rt), R(d.rs) + d.imm); curMips->pc += 4; }
+
+// The Spin versions are for branches back into a loop that only polls, like the jit
+// decides when it compiles them.
+#define INTERPRET_BRANCH(name, cond) \
+	static void Interpret_##name(MIPSState *curMips, const InterpretOp &d) { \
+		if (cond) DelayBranchTo(curMips, d.imm); else curMips->pc += 4; \
+	} \
+	static void Interpret_##name##Spin(MIPSState *curMips, const InterpretOp &d) { \
+		if (cond) { DelayBranchTo(curMips, d.imm); CoreTiming::IdleSpinLoop(); } else curMips->pc += 4; \
+	}
+
+INTERPRET_BRANCH(Beq, R(d.rt) == R(d.rs))
+INTERPRET_BRANCH(Bne, R(d.rt) != R(d.rs))
+INTERPRET_BRANCH(Blez, (s32)R(d.rs) <= 0)
+INTERPRET_BRANCH(Bgtz, (s32)R(d.rs) > 0)
+
+static void Interpret_J(MIPSState *curMips, const InterpretOp &d) { DelayBranchTo(curMips, d.imm); }
+static void Interpret_Jal(MIPSState *curMips, const InterpretOp &d) { R(MIPS_REG_RA) = curMips->pc + 8; DelayBranchTo(curMips, d.imm); }
+static void Interpret_Jr(MIPSState *curMips, const InterpretOp &d) { DelayBranchTo(curMips, R(d.rs)); }
+
+// Same results as the Int_ functions, including leaving $zr alone.  Branches and jumps in a
+// delay slot stay with those, they have special cases for it.
+static void DecodeInterpretOp(InterpretOp &d, u32 pc, u32 op, bool inDelaySlot)
+{
+	const MIPSInstruction *instr = MIPSGetInstruction(op);
+	d.op = op;
+	d.interpret = instr ? instr->interpret : NULL;
+	d.func = d.interpret ? &Interpret_Generic : &Interpret_Unknown;
+	d.rs = _RS;
+	d.rt = _RT;
+	d.rd = _RD;
+	d.sa = (op >> 6) & 0x1F;
+	d.imm = (u32)(s32)(s16)(op & 0xFFFF);
+	if (!d.interpret || (inDelaySlot && (instr->flags & DELAYSLOT)))
+		return;
+
+	const u32 branchTarget = pc + 4 + (d.imm << 2);
+	const bool spin = (s32)d.imm < 0 && MIPSAnalyst::IsSpinLoop(pc);
+	switch (op >> 26)
+	{
+	case 0:
+		switch (op & 0x3F)
 		{
-			// int cycles = 0;
-			{
-				again:
-				u32 op = Memory::Read_U32(curMips->pc);
-				//u32 op = Memory::Read_Opcode_JIT(mipsr4k.pc);
-				/*
-				// Choke on VFPU
-				u32 info = MIPSGetInfo(op);
-				if (info & IS_VFPU)
-				{
-					if (!Core_IsStepping() && !GetAsyncKeyState(VK_LSHIFT))
-					{
-						Core_EnableStepping(true);
-						return;
-					}
-				}*/
+		case 0: d.func = d.rd == 0 ? &Interpret_Nop : &Interpret_Sll; break;
+		case 2: if (d.rs == 0) d.func = d.rd == 0 ? &Interpret_Nop : &Interpret_Srl; break;
+		case 3: d.func = d.rd == 0 ? &Interpret_Nop : &Interpret_Sra; break;
+		case 8: d.func = &Interpret_Jr; break;
+		case 33: d.func = d.rd == 0 ? &Interpret_Nop : &Interpret_Addu; break;
+		case 35: d.func = d.rd == 0 ? &Interpret_Nop : &Interpret_Subu; break;
+		case 36: d.func = d.rd == 0 ? &Interpret_Nop : &Interpret_And; break;
+		case 37: d.func = d.rd == 0 ? &Interpret_Nop : &Interpret_Or; break;
+		case 38: d.func = d.rd == 0 ? &Interpret_Nop : &Interpret_Xor; break;
+		case 39: d.func = d.rd == 0 ? &Interpret_Nop : &Interpret_Nor; break;
+		case 42: d.func = d.rd == 0 ? &Interpret_Nop : &Interpret_Slt; break;
+		case 43: d.func = d.rd == 0 ? &Interpret_Nop : &Interpret_Sltu; break;
+		}
+		break;
+
+	case 2: d.imm = (pc & 0xF0000000) | ((op & 0x03FFFFFF) << 2); d.func = &Interpret_J; break;
+	case 3: d.imm = (pc & 0xF0000000) | ((op & 0x03FFFFFF) << 2); d.func = &Interpret_Jal; break;
+	case 4: d.imm = branchTarget; d.func = spin ? &Interpret_BeqSpin : &Interpret_Beq; break;
+	case 5: d.imm = branchTarget; d.func = spin ? &Interpret_BneSpin : &Interpret_Bne; break;
+	case 6: d.imm = branchTarget; d.func = spin ? &Interpret_BlezSpin : &Interpret_Blez; break;
+	case 7: d.imm = branchTarget; d.func = spin ? &Interpret_BgtzSpin : &Interpret_Bgtz; break;
+
+	case 8: // addi
+	case 9: d.func = d.rt == 0 ? &Interpret_Nop : &Interpret_Addiu; break;
+	case 10: d.func = d.rt == 0 ? &Interpret_Nop : &Interpret_Slti; break;
+	case 11: d.func = d.rt == 0 ? &Interpret_Nop : &Interpret_Sltiu; break;
+	case 12: d.imm &= 0xFFFF; d.func = d.rt == 0 ? &Interpret_Nop : &Interpret_Andi; break;
+	case 13: d.imm &= 0xFFFF; d.func = d.rt == 0 ? &Interpret_Nop : &Interpret_Ori; break;
+	case 14: d.imm &= 0xFFFF; d.func = d.rt == 0 ? &Interpret_Nop : &Interpret_Xori; break;
+	case 15: d.imm <<= 16; d.func = d.rt == 0 ? &Interpret_Nop : &Interpret_Lui; break;
+
+	// Loads into $zr don't even read.
+	case 32: d.func = d.rt == 0 ? &Interpret_Nop : &Interpret_Lb; break;
+	case 33: d.func = d.rt == 0 ? &Interpret_Nop : &Interpret_Lh; break;
+	case 35: d.func = d.rt == 0 ? &Interpret_Nop : &Interpret_Lw; break;
+	case 36: d.func = d.rt == 0 ? &Interpret_Nop : &Interpret_Lbu; break;
+	case 37: d.func = d.rt == 0 ? &Interpret_Nop : &Interpret_Lhu; break;
+	case 40: d.func = &Interpret_Sb; break;
+	case 41: d.func = &Interpret_Sh; break;
+	case 43: d.func = &Interpret_Sw; break;
+	}
+}
+
+static void DecodeInterpretBlock(u32 index, u32 start)
+{
+	InterpretBlock &block = interpretBlocks[index];
+	InterpretOp *ops = interpretBlockOps[index];
+	block.start = start;
+	block.numOps = 0;
+
+	u32 pc = start;
+	bool delaySlot = false;
+	while (block.numOps < INTERPRET_BLOCK_MAX_OPS && Memory::IsValidAddress(pc))
+	{
+		u32 op = Memory::Read_U32(pc);
+		bool branch = (MIPSGetInfo(op) & DELAYSLOT) != 0;
+		// Keep the delay slot in the same block, so a block never stops in one.
+		if (branch && !delaySlot && block.numOps == INTERPRET_BLOCK_MAX_OPS - 1)
+			break;
+		DecodeInterpretOp(ops[block.numOps++], pc, op, delaySlot);
+		// Syscalls can load or patch code, so don't keep going with what was decoded before.
+		if (delaySlot || (op & 0xFC00003F) == 0x0000000C)
+			break;
+		delaySlot = branch;
+		pc += 4;
+	}
+	block.firstOp = block.numOps != 0 ? ops[0].op : 0;
+}
+
+static inline const InterpretOp *GetInterpretBlock(u32 pc, int &numOps)
+{
+	u32 index = (pc >> 2) & (INTERPRET_BLOCK_CACHE_SIZE - 1);
+	InterpretBlock &block = interpretBlocks[index];
+	if (block.numOps == 0 || block.start != pc || Memory::ReadUnchecked_U32(pc) != block.firstOp)
+		DecodeInterpretBlock(index, pc);
+	numOps = block.numOps;
+	return interpretBlockOps[index];
+}
+
+void MIPSInterpret_InvalidateCache(u32 address, int length)
+{
+	for (u32 i = 0; i < INTERPRET_BLOCK_CACHE_SIZE; ++i)
+	{
+		InterpretBlock &block = interpretBlocks[i];
+		if (block.numOps != 0 && block.start < address + length && block.start + block.numOps * 4 > address)
+			block.numOps = 0;
+	}
+}
 
+void MIPSInterpret_ClearCache()
+{
+	for (u32 i = 0; i < INTERPRET_BLOCK_CACHE_SIZE; ++i)
+		interpretBlocks[i].numOps = 0;
+}
+
+// Runs until the ops run out or something other than the next one comes up.
+static void RunInterpretOps(MIPSState *curMips, u32 pc, const InterpretOp *ops, int numOps)
+{
+	for (int i = 0; i < numOps; ++i)
+	{
 		//2: check for breakpoint (VERY SLOW)
 #if defined(_DEBUG)
-				if (CBreakPoints::IsAddressBreakPoint(curMips->pc))
-				{
-					Core_EnableStepping(true);
-					if (CBreakPoints::IsTempBreakPoint(curMips->pc))
-						CBreakPoints::RemoveBreakPoint(curMips->pc);
-					break;
-				}
+		if (CBreakPoints::IsAddressBreakPoint(pc))
+		{
+			Core_EnableStepping(true);
+			if (CBreakPoints::IsTempBreakPoint(pc))
+				CBreakPoints::RemoveBreakPoint(pc);
+			return;
+		}
 #endif
 
-				bool wasInDelaySlot = curMips->inDelaySlot;
+		bool wasInDelaySlot = curMips->inDelaySlot;
+		ops[i].func(curMips, ops[i]);
+		curMips->downcount -= 1;
+
+		// The reason we have to check this is the delay slot hack in Int_Syscall.
+		if (curMips->inDelaySlot && wasInDelaySlot)
+		{
+			curMips->pc = curMips->nextPC;
+			curMips->inDelaySlot = false;
 
-				MIPSInterpret(op);
+			// Functions are only entered by branching, so this is the place to check.
+			int replacement = Replacement_GetIndex(curMips->pc);
+			if (replacement >= 0)
+			{
+				curMips->downcount -= Replacement_Call(replacement);
+				curMips->pc = curMips->r[MIPS_REG_RA];
+			}
+			return;
+		}
 
-				if (curMips->inDelaySlot)
-				{
-					// The reason we have to check this is the delay slot hack in Int_Syscall.
-					if (wasInDelaySlot)
-					{
-						curMips->pc = curMips->nextPC;
-						curMips->inDelaySlot = false;
-					}
-					curMips->downcount -= 1;
-					goto again;
-				}
+		// Not taken likely branches, syscalls, and so on.  Never stop in a delay slot, though.
+		pc += 4;
+		if (curMips->pc != pc || (coreState != CORE_RUNNING && !curMips->inDelaySlot))
+			return;
+	}
+}
+
+int MIPSInterpret_RunUntil(u64 globalTicks)
+{
+	MIPSState *curMips = currentMIPS;
+	while (coreState == CORE_RUNNING)
+	{
+		CoreTiming::Advance();
+
+		// NEVER stop in a delay slot!  Blocks always run through theirs.
+		while (curMips->downcount >= 0 && coreState == CORE_RUNNING)
+		{
+			u32 pc = curMips->pc;
+			int numOps = 0;
+			const InterpretOp *ops = curMips->inDelaySlot ? NULL : GetInterpretBlock(pc, numOps);
+			if (numOps != 0)
+				RunInterpretOps(curMips, pc, ops, numOps);
+			else
+			{
+				// Finishing a delay slot from stepping, or somewhere blocks can't be decoded.
+				InterpretOp single;
+				DecodeInterpretOp(single, pc, Memory::Read_U32(pc), curMips->inDelaySlot);
+				RunInterpretOps(curMips, pc, &single, 1);
 			}
 
-			curMips->downcount -= 1;
+			// Like the jit, only between blocks.
 			if (CoreTiming::GetTicks() > globalTicks)
 			{
 				// DEBUG_LOG(CPU, "Hit the max ticks, bailing 1 : %llu, %llu", globalTicks, CoreTiming::GetTicks());
@@ -1012,13 +1238,6 @@ int MIPSInterpret_RunUntil(u64 globalTicks)
 	return 1;
 }
 
-static inline void DelayBranchTo(MIPSState *curMips, u32 where)
-{
-	curMips->pc += 4;
-	curMips->nextPC = where;
-	curMips->inDelaySlot = true;
-}
-
 const char *MIPSGetName(u32 op)
 {
 	static const char *noname = "unk";
@@ -61,6 +61,9 @@ void MIPSDisAsm(u32 op, u32 pc, char *out, bool tabsToSpaces = false);
 u32  MIPSGetInfo(u32 op);
 void MIPSInterpret(u32 op); //only for those rare ones
 int MIPSInterpret_RunUntil(u64 globalTicks);
+// Use MIPSState::InvalidateICache() instead, it tells the jit too.
+void MIPSInterpret_InvalidateCache(u32 address, int length);
+void MIPSInterpret_ClearCache();
 MIPSInterpretFunc MIPSGetInterpretFunc(u32 op);
 
 int MIPSGetInstructionCycleEstimate(u32 op);
@@ -16,6 +16,8 @@
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
 #include "Core/Reporting.h"
+#include "Core/CoreTiming.h"
+#include "Core/Config.h"
 
 #include "../../HLE/HLE.h"
 #include "../../Host.h"
@@ -160,7 +162,7 @@ void Jit::BranchRSRTComp(u32 op, Gen::CCFlags cc, bool likely)
 		if (!delaySlotIsNice)
 			CompileDelaySlot(DELAYSLOT_SAFE_FLUSH);
 		else
-			FlushAll();
+			FlushAllForExits(targetAddr, js.compilerPC + 8);
 		ptr = J_CC(cc, true);
 	}
 	else
@@ -170,6 +172,8 @@ void Jit::BranchRSRTComp(u32 op, Gen::CCFlags cc, bool likely)
 		CompileDelaySlot(DELAYSLOT_FLUSH);
 	}
 	// Take the branch
+	if (MIPSAnalyst::IsSpinLoop(js.compilerPC))
+		ABI_CallFunction((void *)&CoreTiming::IdleSpinLoop);
 	CONDITIONAL_LOG_EXIT(targetAddr);
 	WriteExit(targetAddr, 0);
 
@@ -206,6 +210,8 @@ void Jit::BranchRSZeroComp(u32 op, Gen::CCFlags cc, bool andLink, bool likely)
 	{
 		if (!delaySlotIsNice)
 			CompileDelaySlot(DELAYSLOT_SAFE_FLUSH);
+		else if (!andLink)
+			FlushAllForExits(targetAddr, js.compilerPC + 8);
 		else
 			FlushAll();
 		ptr = J_CC(cc, true);
@@ -220,6 +226,8 @@ void Jit::BranchRSZeroComp(u32 op, Gen::CCFlags cc, bool andLink, bool likely)
 	// Take the branch
 	if (andLink)
 		MOV(32, M(&mips_->r[MIPS_REG_RA]), Imm32(js.compilerPC + 8));
+	else if (MIPSAnalyst::IsSpinLoop(js.compilerPC))
+		ABI_CallFunction((void *)&CoreTiming::IdleSpinLoop);
 	CONDITIONAL_LOG_EXIT(targetAddr);
 	WriteExit(targetAddr, 0);
 
@@ -290,9 +298,12 @@ void Jit::BranchFPFlag(u32 op, Gen::CCFlags cc, bool likely)
 	bool delaySlotIsNice = IsDelaySlotNiceFPU(op, delaySlotOp);
 	CONDITIONAL_NICE_DELAYSLOT;
 	if (!likely && delaySlotIsNice)
+	{
 		CompileDelaySlot(DELAYSLOT_NICE);
-
-	FlushAll();
+		FlushAllForExits(targetAddr, js.compilerPC + 8);
+	}
+	else
+		FlushAll();
 
 	TEST(32, M((void *)&(mips_->fpcond)), Imm32(1));
 	Gen::FixupBranch ptr;
@@ -351,9 +362,12 @@ void Jit::BranchVFPUFlag(u32 op, Gen::CCFlags cc, bool likely)
 	bool delaySlotIsNice = IsDelaySlotNiceVFPU(op, delaySlotOp);
 	CONDITIONAL_NICE_DELAYSLOT;
 	if (!likely && delaySlotIsNice)
+	{
 		CompileDelaySlot(DELAYSLOT_NICE);
-
-	FlushAll();
+		FlushAllForExits(targetAddr, js.compilerPC + 8);
+	}
+	else
+		FlushAll();
 
 	// THE CONDITION
 	int imm3 = (op >> 18) & 7;
@@ -415,7 +429,7 @@ void Jit::Comp_Jump(u32 op)
 	{
 	case 2: //j
 		CompileDelaySlot(DELAYSLOT_NICE);
-		FlushAll();
+		FlushAllForExits(targetAddr, targetAddr);
 		CONDITIONAL_LOG_EXIT(targetAddr);
 		WriteExit(targetAddr, 0);
 		break;
@@ -504,7 +518,22 @@ void Jit::Comp_Syscall(u32 op)
 	WriteDowncount(offset);
 	js.downcountAmount = -offset;
 
-	ABI_CallFunctionC((void *)&CallSyscall, op);
+	const int index = GetSyscallIndex(op);
+	void *quickFunc = GetQuickSyscallFunc(index);
+	if (quickFunc)
+	{
+		CMP(8, M((void *)&g_Config.bProfileSyscalls), Imm8(0));
+		FixupBranch withStats = J_CC(CC_NZ);
+		ABI_CallFunction(quickFunc);
+		FixupBranch done = J();
+		SetJumpTarget(withStats);
+		ABI_CallFunctionC((void *)&CallSyscallWithoutFlags, index);
+		SetJumpTarget(done);
+	}
+	else if (index >= 0)
+		ABI_CallFunctionC((void *)&CallSyscallWithFlags, index);
+	else
+		ABI_CallFunctionC((void *)&CallSyscall, op);
 
 	WriteSyscallExit();
 	js.compiling = false;
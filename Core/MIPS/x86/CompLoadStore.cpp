@@ -52,6 +52,7 @@ namespace MIPSComp
 		gpr.BindToRegister(rt, rt == rs, true);
 
 		JitSafeMem safe(this, rs, offset);
+		safe.AllowBackpatch();
 		OpArg src;
 		if (safe.PrepareRead(src, bits / 8))
 			(this->*mov)(32, bits, gpr.RX(rt), src);
@@ -82,6 +83,7 @@ namespace MIPSComp
 #endif
 
 		JitSafeMem safe(this, rs, offset);
+		safe.AllowBackpatch();
 		OpArg dest;
 		if (safe.PrepareWrite(dest, bits / 8))
 		{
@@ -1113,15 +1113,123 @@ void Jit::Comp_Vtfm(u32 op) {
 
 
 void Jit::Comp_VHdp(u32 op) {
-	DISABLE;
+	CONDITIONAL_DISABLE;
+
+	if (js.HasUnknownPrefix())
+		DISABLE;
+
+	VectorSize sz = GetVecSize(op);
+	int n = GetNumVectorElements(sz);
+
+	u8 sregs[4], tregs[4], dregs[1];
+	GetVectorRegsPrefixS(sregs, sz, _VS);
+	GetVectorRegsPrefixT(tregs, sz, _VT);
+	GetVectorRegsPrefixD(dregs, V_Single, _VD);
+
+	X64Reg tempxreg = XMM0;
+	if (IsOverlapSafe(dregs[0], 0, n, sregs, n, tregs))
+	{
+		fpr.MapRegsV(dregs, V_Single, MAP_NOINIT | MAP_DIRTY);
+		tempxreg = fpr.VX(dregs[0]);
+	}
+
+	// Need to start with +0.0f so it doesn't result in -0.0f.
+	XORPS(tempxreg, R(tempxreg));
+	for (int i = 0; i < n; i++)
+	{
+		// sum += (i == n - 1) ? t[i] : s[i]*t[i];
+		if (i == n - 1)
+			ADDSS(tempxreg, fpr.V(tregs[i]));
+		else
+		{
+			MOVSS(XMM1, fpr.V(sregs[i]));
+			MULSS(XMM1, fpr.V(tregs[i]));
+			ADDSS(tempxreg, R(XMM1));
+		}
+	}
+
+	// A NaN result loses its sign (fabsf), anything else is left alone.
+	MOVSS(XMM1, R(tempxreg));
+	CMPSS(XMM1, R(XMM1), 3);  // CMPUNORDSS
+	ANDPS(XMM1, M((void *)&signBitLower));
+	ANDNPS(XMM1, R(tempxreg));
+
+	fpr.MapRegsV(dregs, V_Single, MAP_NOINIT | MAP_DIRTY);
+	MOVSS(fpr.VX(dregs[0]), R(XMM1));
+
+	ApplyPrefixD(dregs, V_Single);
+
+	fpr.ReleaseSpillLocks();
 }
 
 void Jit::Comp_VCrs(u32 op) {
-	DISABLE;
+	CONDITIONAL_DISABLE;
+
+	if (js.HasUnknownPrefix())
+		DISABLE;
+
+	VectorSize sz = GetVecSize(op);
+	if (sz != V_Triple)
+		DISABLE;
+
+	// Half a cross product.  S and T prefixes are ignored, D is not.
+	u8 sregs[4], tregs[4], dregs[4];
+	GetVectorRegs(sregs, sz, _VS);
+	GetVectorRegs(tregs, sz, _VT);
+	GetVectorRegsPrefixD(dregs, sz, _VD);
+
+	static const u8 sIndex[3] = {1, 2, 0};
+	static const u8 tIndex[3] = {2, 0, 1};
+
+	u8 tempregs[3];
+	for (int i = 0; i < 3; i++)
+	{
+		tempregs[i] = (u8) fpr.GetTempV();
+		fpr.MapRegV(tempregs[i], MAP_NOINIT | MAP_DIRTY);
+		fpr.SpillLockV(tempregs[i]);
+
+		MOVSS(fpr.VX(tempregs[i]), fpr.V(sregs[sIndex[i]]));
+		MULSS(fpr.VX(tempregs[i]), fpr.V(tregs[tIndex[i]]));
+	}
+
+	fpr.MapRegsV(dregs, sz, MAP_NOINIT | MAP_DIRTY);
+	for (int i = 0; i < 3; i++)
+		MOVSS(fpr.VX(dregs[i]), fpr.V(tempregs[i]));
+
+	ApplyPrefixD(dregs, sz);
+
+	fpr.ReleaseSpillLocks();
 }
 
 void Jit::Comp_VDet(u32 op) {
-	DISABLE;
+	CONDITIONAL_DISABLE;
+
+	if (js.HasUnknownPrefix())
+		DISABLE;
+
+	VectorSize sz = GetVecSize(op);
+	if (sz != V_Pair)
+		DISABLE;
+
+	// The interpreter only swizzles S here.
+	u8 sregs[4], tregs[4], dregs[1];
+	GetVectorRegsPrefixS(sregs, sz, _VS);
+	GetVectorRegs(tregs, sz, _VT);
+	GetVectorRegsPrefixD(dregs, V_Single, _VD);
+
+	// d = s[0] * t[1] - s[1] * t[0];
+	MOVSS(XMM0, fpr.V(sregs[0]));
+	MULSS(XMM0, fpr.V(tregs[1]));
+	MOVSS(XMM1, fpr.V(sregs[1]));
+	MULSS(XMM1, fpr.V(tregs[0]));
+	SUBSS(XMM0, R(XMM1));
+
+	fpr.MapRegsV(dregs, V_Single, MAP_NOINIT | MAP_DIRTY);
+	MOVSS(fpr.VX(dregs[0]), R(XMM0));
+
+	ApplyPrefixD(dregs, V_Single);
+
+	fpr.ReleaseSpillLocks();
 }
 
 void Jit::Comp_Vi2x(u32 op) {
@@ -1136,8 +1244,133 @@ void Jit::Comp_Vf2i(u32 op) {
 	DISABLE;
 }
 
+static const float GC_ALIGNED16(vavgDivisor[5]) = {0.0f, 1.0f, 2.0f, 3.0f, 4.0f};
+
 void Jit::Comp_Vhoriz(u32 op) {
-	DISABLE;
+	CONDITIONAL_DISABLE;
+
+	if (js.HasUnknownPrefix())
+		DISABLE;
+
+	bool average;
+	switch ((op >> 16) & 31)
+	{
+	case 6:  // vfad
+		average = false;
+		break;
+	case 7:  // vavg
+		average = true;
+		break;
+	default:
+		DISABLE;
+	}
+
+	VectorSize sz = GetVecSize(op);
+	int n = GetNumVectorElements(sz);
+
+	u8 sregs[4], dregs[1];
+	GetVectorRegsPrefixS(sregs, sz, _VS);
+	GetVectorRegsPrefixD(dregs, V_Single, _VD);
+
+	// Need to start with +0.0f so it doesn't result in -0.0f.
+	XORPS(XMM0, R(XMM0));
+	for (int i = 0; i < n; i++)
+		ADDSS(XMM0, fpr.V(sregs[i]));
+
+	// Divide rather than multiply by 1/n to match the interpreter bit for bit.
+	if (average)
+		DIVSS(XMM0, M((void *)&vavgDivisor[n]));
+
+	fpr.MapRegsV(dregs, V_Single, MAP_NOINIT | MAP_DIRTY);
+	MOVSS(fpr.VX(dregs[0]), R(XMM0));
+
+	ApplyPrefixD(dregs, V_Single);
+
+	fpr.ReleaseSpillLocks();
+}
+
+// Sign and operand order of each product, summed left to right like the interpreter.
+struct CrossQuatTerm {
+	u8 s, t;
+	bool negate;
+};
+
+static const CrossQuatTerm crossTerms[3][2] = {
+	{{1, 2, false}, {2, 1, true}},
+	{{2, 0, false}, {0, 2, true}},
+	{{0, 1, false}, {1, 0, true}},
+};
+
+static const CrossQuatTerm quatTerms[4][4] = {
+	{{0, 3, false}, {1, 2, false}, {2, 1, true}, {3, 0, false}},
+	{{0, 2, true}, {1, 3, false}, {2, 0, false}, {3, 1, false}},
+	{{0, 1, false}, {1, 0, true}, {2, 3, false}, {3, 2, false}},
+	{{0, 0, true}, {1, 1, true}, {2, 2, true}, {3, 3, false}},
+};
+
+void Jit::Comp_VCrossQuat(u32 op) {
+	CONDITIONAL_DISABLE;
+
+	if (!(js.prefixDFlag & JitState::PREFIX_KNOWN))
+		DISABLE;
+
+	VectorSize sz = GetVecSize(op);
+	int n = GetNumVectorElements(sz);
+
+	const CrossQuatTerm *terms;
+	int numTerms;
+	switch (sz)
+	{
+	case V_Triple:  // vcrsp.t
+		terms = &crossTerms[0][0];
+		numTerms = 2;
+		break;
+	case V_Quad:  // vqmul.q
+		terms = &quatTerms[0][0];
+		numTerms = 4;
+		break;
+	default:
+		DISABLE;
+	}
+
+	// The interpreter ignores the S and T prefixes, and doesn't saturate, but the D write
+	// mask still applies (masked lanes go to temps here.)
+	u8 sregs[4], tregs[4], dregs[4];
+	GetVectorRegs(sregs, sz, _VS);
+	GetVectorRegs(tregs, sz, _VT);
+	GetVectorRegsPrefixD(dregs, sz, _VD);
+
+	u8 tempregs[4];
+	for (int i = 0; i < n; i++)
+	{
+		tempregs[i] = (u8) fpr.GetTempV();
+		fpr.MapRegV(tempregs[i], MAP_NOINIT | MAP_DIRTY);
+		fpr.SpillLockV(tempregs[i]);
+		X64Reg sum = fpr.VX(tempregs[i]);
+
+		for (int j = 0; j < numTerms; j++)
+		{
+			const CrossQuatTerm &term = terms[i * numTerms + j];
+			X64Reg prod = j == 0 ? sum : XMM0;
+			MOVSS(prod, fpr.V(sregs[term.s]));
+			MULSS(prod, fpr.V(tregs[term.t]));
+			if (j == 0)
+			{
+				if (term.negate)
+					XORPS(sum, M((void *)&signBitLower));
+			}
+			else if (term.negate)
+				SUBSS(sum, R(prod));
+			else
+				ADDSS(sum, R(prod));
+		}
+	}
+
+	fpr.MapRegsV(dregs, sz, MAP_NOINIT | MAP_DIRTY);
+	for (int i = 0; i < n; i++)
+		MOVSS(fpr.VX(dregs[i]), fpr.V(tempregs[i]));
+
+	fpr.ReleaseSpillLocks();
 }
 
 }
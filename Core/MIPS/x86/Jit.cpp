@@ -23,9 +23,12 @@
 #include "Core/CoreTiming.h"
 #include "Core/Config.h"
 #include "Core/MIPS/MIPS.h"
+#include "Core/MIPS/MIPSAnalyst.h"
 #include "Core/MIPS/MIPSCodeUtils.h"
 #include "Core/MIPS/MIPSInt.h"
 #include "Core/MIPS/MIPSTables.h"
+#include "Core/HLE/ReplaceTables.h"
+#include "Common/MemArena.h"
 
 #include "RegCache.h"
 #include "Jit.h"
@@ -114,6 +117,7 @@ Jit::Jit(MIPSState *mips) : blocks(mips, this), mips_(mips)
 	fpr.SetEmitter(this);
 	AllocCodeSpace(1024 * 1024 * 16);
 	asm_.Init(mips, this);
+	InitBackpatch();
 
 	// TODO: If it becomes possible to switch from the interpreter, this should be set right.
 	js.startDefaultPrefix = true;
@@ -140,6 +144,32 @@ void Jit::FlushAll()
 	FlushPrefixV();
 }
 
+// Pass the same address twice for a single exit.
+void Jit::FlushAllForExits(u32 exit1, u32 exit2)
+{
+	// If we might rewind to the branch, it'll need everything.
+	if (jo.discardDeadRegs && (js.afterOp & (JitState::AFTER_CORE_STATE | JitState::AFTER_REWIND_PC_BAD_STATE)) == 0)
+	{
+		MIPSAnalyst::LiveRegs live = MIPSAnalyst::GetLiveRegs(exit1);
+		if (exit2 != exit1)
+		{
+			MIPSAnalyst::LiveRegs live2 = MIPSAnalyst::GetLiveRegs(exit2);
+			live.gpr |= live2.gpr;
+			live.fpr |= live2.fpr;
+		}
+
+		for (int i = 0; i < 32; ++i)
+		{
+			if ((live.gpr & (1 << i)) == 0)
+				gpr.DiscardR(i);
+			if ((live.fpr & (1 << i)) == 0)
+				fpr.DiscardR(i);
+		}
+	}
+
+	FlushAll();
+}
+
 void Jit::FlushPrefixV()
 {
 	if ((js.prefixSFlag & JitState::PREFIX_DIRTY) != 0)
@@ -171,6 +201,7 @@ void Jit::ClearCache()
 {
 	blocks.Clear();
 	ClearCodeSpace();
+	ClearBackpatch();
 }
 
 void Jit::ClearCacheAt(u32 em_address)
@@ -278,6 +309,19 @@ const u8 *Jit::DoJit(u32 em_address, JitBlock *b)
 	fpr.Start(mips_, analysis);
 
 	js.numInstructions = 0;
+
+	int replacement = Replacement_GetIndex(em_address);
+	if (replacement >= 0)
+	{
+		// Just call the native version and return to the caller.
+		ABI_CallFunctionC((void *)&Replacement_Call, replacement);
+		SUB(32, M(&currentMIPS->downcount), R(EAX));
+		MOV(32, R(EAX), M(&mips_->r[MIPS_REG_RA]));
+		WriteExitDestInEAX();
+		js.numInstructions = 1;
+		js.compiling = false;
+	}
+
 	while (js.compiling)
 	{
 		// Jit breakpoints are quite fast, so let's do them in release too.
@@ -487,7 +531,7 @@ bool Jit::CheckJitBreakpoint(u32 addr, int downcountOffset)
 }
 
 Jit::JitSafeMem::JitSafeMem(Jit *jit, int raddr, s32 offset, u32 alignMask)
-	: jit_(jit), raddr_(raddr), offset_(offset), needsCheck_(false), needsSkip_(false), alignMask_(alignMask)
+	: jit_(jit), raddr_(raddr), offset_(offset), needsCheck_(false), needsSkip_(false), backpatch_(false), alignMask_(alignMask)
 {
 	// This makes it more instructions, so let's play it safe and say we need a far jump.
 	far_ = !g_Config.bIgnoreBadMemAccess || !CBreakPoints::GetMemChecks().empty();
@@ -497,6 +541,14 @@ Jit::JitSafeMem::JitSafeMem(Jit *jit, int raddr, s32 offset, u32 alignMask)
 		iaddr_ = (u32) -1;
 }
 
+void Jit::JitSafeMem::AllowBackpatch()
+{
+	// Without bIgnoreBadMemAccess, we'd need to check coreState after a bad access.
+	backpatch_ = !g_Config.bFastMemory && jit_->jo.backpatchMemory && MemArena::HasGuardRegion();
+	backpatch_ = backpatch_ && g_Config.bIgnoreBadMemAccess && CBreakPoints::GetMemChecks().empty();
+	backpatch_ = backpatch_ && iaddr_ == (u32) -1 && alignMask_ == 0xFFFFFFFF;
+}
+
 void Jit::JitSafeMem::SetFar()
 {
 	_dbg_assert_msg_(JIT, !needsSkip_, "Sorry, you need to call SetFar() earlier.");
@@ -526,6 +578,7 @@ bool Jit::JitSafeMem::PrepareWrite(OpArg &dest, int size)
 	// Otherwise, we always can do the write (conditionally.)
 	else
 		dest = PrepareMemoryOpArg(MEM_WRITE);
+	fastStart_ = jit_->GetCodePtr();
 	return true;
 }
 
@@ -550,6 +603,7 @@ bool Jit::JitSafeMem::PrepareRead(OpArg &src, int size)
 	}
 	else
 		src = PrepareMemoryOpArg(MEM_READ);
+	fastStart_ = jit_->GetCodePtr();
 	return true;
 }
 
@@ -597,7 +651,7 @@ OpArg Jit::JitSafeMem::PrepareMemoryOpArg(ReadType type)
 
 	MemCheckAsm(type);
 
-	if (!g_Config.bFastMemory)
+	if (!g_Config.bFastMemory && !backpatch_)
 	{
 		// Is it in physical ram?
 		jit_->CMP(32, R(xaddr_), Imm32(PSP_GetKernelMemoryBase() - offset_));
@@ -647,12 +701,25 @@ void Jit::JitSafeMem::PrepareSlowAccess()
 	jit_->SetJumpTarget(tooLow);
 }
 
+void Jit::JitSafeMem::PadForBackpatch()
+{
+	// The fault handler overwrites the access with a 5 byte CALL, so it needs the room.
+	while (jit_->GetCodePtr() - fastStart_ < 5)
+		jit_->NOP(1);
+}
+
 bool Jit::JitSafeMem::PrepareSlowWrite()
 {
 	// If it's immediate, we only need a slow write on invalid.
 	if (iaddr_ != (u32) -1)
 		return !g_Config.bFastMemory && !ImmValid();
 
+	if (backpatch_)
+	{
+		PadForBackpatch();
+		return false;
+	}
+
 	if (!g_Config.bFastMemory)
 	{
 		PrepareSlowAccess();
@@ -679,6 +746,12 @@ void Jit::JitSafeMem::DoSlowWrite(void *safeFunc, const OpArg src, int suboffset
 
 bool Jit::JitSafeMem::PrepareSlowRead(void *safeFunc)
 {
+	if (backpatch_)
+	{
+		PadForBackpatch();
+		return false;
+	}
+
 	if (!g_Config.bFastMemory)
 	{
 		if (iaddr_ != (u32) -1)
@@ -30,6 +30,8 @@
 #include "RegCache.h"
 #include "RegCacheFPU.h"
 
+struct InstructionInfo;
+
 namespace MIPSComp
 {
 
@@ -41,9 +43,19 @@ struct JitOptions
 	JitOptions()
 	{
 		enableBlocklink = true;
+		discardDeadRegs = true;
+#if defined(__linux__) && defined(_M_X64)
+		backpatchMemory = true;
+#else
+		backpatchMemory = false;
+#endif
 	}
 
 	bool enableBlocklink;
+	// Skip writing back registers the exit targets overwrite before reading.
+	bool discardDeadRegs;
+	// Emit unchecked loads/stores and patch them to a slow call when they fault.
+	bool backpatchMemory;
 };
 
 struct JitState
@@ -221,6 +233,7 @@ public:
 	void Comp_Vi2f(u32 op);
 	void Comp_Vcst(u32 op);
 	void Comp_Vhoriz(u32 op);
+	void Comp_VCrossQuat(u32 op);
 
 	void Comp_DoNothing(u32 op);
 
@@ -244,8 +257,17 @@ public:
 
 	void ClearCache();
 	void ClearCacheAt(u32 em_address);
+
+	// Rewrites a faulting fast memory access at codePtr into a call to the slow path.
+	bool BackpatchMemoryAccess(u8 *codePtr, bool isWrite);
+	int BackpatchTrampolineCount() const { return backpatchTrampolineCount; }
 private:
+	void InitBackpatch();
+	void ClearBackpatch();
+	const u8 *GetBackpatchTrampoline(const InstructionInfo &info, bool isWrite);
+
 	void FlushAll();
+	void FlushAllForExits(u32 exit1, u32 exit2);
 	void FlushPrefixV();
 	void WriteDowncount(int offset = 0);
 
@@ -294,6 +316,16 @@ private:
 
 	AsmRoutineManager asm_;
 	ThunkManager thunks;
+	Gen::XCodeBlock backpatchCode;
+	// Looked up from the fault handler, so it's a fixed size open addressing table (nothing
+	// may allocate in there.)  Kept at most half full.
+	enum { BACKPATCH_TABLE_SIZE = 4096 };
+	struct BackpatchTrampoline {
+		u64 key;
+		const u8 *code;
+	};
+	BackpatchTrampoline backpatchTrampolines[BACKPATCH_TABLE_SIZE];
+	int backpatchTrampolineCount;
 
 	MIPSState *mips_;
 
@@ -317,6 +349,10 @@ private:
 		// Cleans up final code for the memory access.
 		void Finish();
 
+		// Call before PrepareRead/PrepareWrite if the fast access is a single GPR MOV.
+		// Register addresses then skip the range check, and faults are backpatched instead.
+		void AllowBackpatch();
+
 		// Use this before anything else if you're gonna use the below.
 		void SetFar();
 		// WARNING: Only works for non-GPR.  Do not use for reads into GPR.
@@ -336,6 +372,7 @@ private:
 		void MemCheckImm(ReadType type);
 		void MemCheckAsm(ReadType type);
 		bool ImmValid();
+		void PadForBackpatch();
 
 		Jit *jit_;
 		int raddr_;
@@ -344,12 +381,14 @@ private:
 		bool needsCheck_;
 		bool needsSkip_;
 		bool far_;
+		bool backpatch_;
 		u32 alignMask_;
 		u32 iaddr_;
 		X64Reg xaddr_;
 		FixupBranch tooLow_, tooHigh_, skip_;
 		std::vector<FixupBranch> skipChecks_;
 		const u8 *safe_;
+		const u8 *fastStart_;
 	};
 	friend class JitSafeMem;
 };
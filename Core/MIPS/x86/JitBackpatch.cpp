@@ -0,0 +1,249 @@
+// Copyright (c) 2013- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+// Loads and stores through a register address are emitted without a range check
+// (see JitSafeMem::AllowBackpatch.)  Everything around Memory::base that isn't RAM
+// is reserved PROT_NONE, so a bad address faults.  The handler below then rewrites
+// the access into a CALL to a trampoline which goes through Memory::Read_U32 etc.
+
+#include "Common/ABI.h"
+#include "Common/x64Analyzer.h"
+#include "Common/MemArena.h"
+#include "Core/MemMap.h"
+#include "Core/MIPS/JitCommon/JitCommon.h"
+#include "Core/MIPS/x86/Jit.h"
+
+#if defined(__linux__) && defined(_M_X64)
+#include <signal.h>
+#include <ucontext.h>
+#endif
+
+using namespace Gen;
+
+namespace MIPSComp
+{
+
+#if defined(__linux__) && defined(_M_X64)
+
+static struct sigaction oldSegvAction;
+static bool segvHandlerInstalled = false;
+
+static void SegvHandler(int sig, siginfo_t *info, void *raw_context)
+{
+	ucontext_t *context = (ucontext_t *)raw_context;
+	u8 *codePtr = (u8 *)context->uc_mcontext.gregs[REG_RIP];
+	// Bit 1 of the page fault error code is set for writes.
+	bool isWrite = (context->uc_mcontext.gregs[REG_ERR] & 2) != 0;
+
+	// When we return, the CPU will retry at codePtr, which is now the CALL.
+	if (jit && MemArena::IsInGuardRegion(info->si_addr) && jit->BackpatchMemoryAccess(codePtr, isWrite))
+		return;
+
+	// Not ours, let whoever was there before handle it.
+	if (oldSegvAction.sa_flags & SA_SIGINFO)
+		oldSegvAction.sa_sigaction(sig, info, raw_context);
+	else if (oldSegvAction.sa_handler != SIG_DFL && oldSegvAction.sa_handler != SIG_IGN)
+		oldSegvAction.sa_handler(sig);
+	else
+	{
+		// Restoring the default and retrying the instruction crashes as usual.
+		sigaction(SIGSEGV, &oldSegvAction, NULL);
+	}
+}
+
+#endif
+
+void Jit::InitBackpatch()
+{
+	memset(backpatchTrampolines, 0, sizeof(backpatchTrampolines));
+	backpatchTrampolineCount = 0;
+	if (!jo.backpatchMemory)
+		return;
+
+#if defined(__linux__) && defined(_M_X64)
+	backpatchCode.AllocCodeSpace(1024 * 256);
+
+	if (!segvHandlerInstalled)
+	{
+		struct sigaction sa;
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_sigaction = &SegvHandler;
+		sa.sa_flags = SA_SIGINFO;
+		sigemptyset(&sa.sa_mask);
+		if (sigaction(SIGSEGV, &sa, &oldSegvAction) == 0)
+			segvHandlerInstalled = true;
+	}
+	if (!segvHandlerInstalled)
+	{
+		ERROR_LOG(JIT, "Unable to install fault handler, memory accesses will be range checked");
+		jo.backpatchMemory = false;
+	}
+#else
+	jo.backpatchMemory = false;
+#endif
+}
+
+void Jit::ClearBackpatch()
+{
+	if (!jo.backpatchMemory)
+		return;
+
+	memset(backpatchTrampolines, 0, sizeof(backpatchTrampolines));
+	backpatchTrampolineCount = 0;
+	backpatchCode.ClearCodeSpace();
+}
+
+const u8 *Jit::GetBackpatchTrampoline(const InstructionInfo &info, bool isWrite)
+{
+	const X64Reg addrReg = (X64Reg)info.scaledReg;
+	const X64Reg dataReg = (X64Reg)info.regOperandReg;
+
+	u64 key = (u32)info.displacement;
+	key |= (u64)addrReg << 32;
+	key |= (u64)dataReg << 36;
+	key |= (u64)info.operandSize << 40;
+	key |= (u64)(info.signExtend ? 1 : 0) << 44;
+	key |= (u64)(isWrite ? 1 : 0) << 45;
+
+	// Keys are never 0 (operandSize is at least 1), but a NULL code pointer marks a free slot.
+	u32 slot = (u32)((key * 0x9E3779B97F4A7C15ULL) >> 52) & (BACKPATCH_TABLE_SIZE - 1);
+	while (backpatchTrampolines[slot].code != NULL)
+	{
+		if (backpatchTrampolines[slot].key == key)
+			return backpatchTrampolines[slot].code;
+		slot = (slot + 1) & (BACKPATCH_TABLE_SIZE - 1);
+	}
+
+	if (backpatchCode.GetSpaceLeft() < 256 || backpatchTrampolineCount >= BACKPATCH_TABLE_SIZE / 2)
+		return NULL;
+
+	void *func;
+	if (isWrite)
+	{
+		switch (info.operandSize)
+		{
+		case 1: func = (void *) &Memory::Write_U8; break;
+		case 2: func = (void *) &Memory::Write_U16; break;
+		default: func = (void *) &Memory::Write_U32; break;
+		}
+	}
+	else
+	{
+		switch (info.operandSize)
+		{
+		case 1: func = (void *) &Memory::Read_U8; break;
+		case 2: func = (void *) &Memory::Read_U16; break;
+		default: func = (void *) &Memory::Read_U32; break;
+		}
+	}
+
+	// Like the regular slow path, this may clobber EAX and flags, but nothing else.
+	XEmitter &emit = backpatchCode;
+	emit.AlignCode16();
+	const u8 *trampoline = emit.GetCodePtr();
+
+	emit.ABI_CallFunction((void *)thunks.GetSaveRegsFunction());
+	// We came from a CALL, so the stack may be misaligned.  RBX is restored below.
+	emit.MOV(64, R(RBX), R(RSP));
+	emit.AND(64, R(RSP), Imm8((u8)-16));
+
+	if (isWrite)
+	{
+		emit.LEA(32, ABI_PARAM2, MDisp(addrReg, info.displacement));
+		emit.MOV(32, R(ABI_PARAM1), R(dataReg));
+		emit.ABI_CallFunction(func);
+	}
+	else
+	{
+		emit.LEA(32, ABI_PARAM1, MDisp(addrReg, info.displacement));
+		emit.ABI_CallFunction(func);
+	}
+
+	emit.MOV(64, R(RSP), R(RBX));
+	emit.ABI_CallFunction((void *)thunks.GetLoadRegsFunction());
+
+	// The destination might be one of the regs load_regs just restored, so only now.
+	if (!isWrite)
+	{
+		if (info.signExtend)
+			emit.MOVSX(32, info.operandSize * 8, dataReg, R(EAX));
+		else if (info.operandSize < 4)
+			emit.MOVZX(32, info.operandSize * 8, dataReg, R(EAX));
+		else
+			emit.MOV(32, R(dataReg), R(EAX));
+	}
+	emit.RET();
+
+	backpatchTrampolines[slot].key = key;
+	backpatchTrampolines[slot].code = trampoline;
+	backpatchTrampolineCount++;
+	return trampoline;
+}
+
+bool Jit::BackpatchMemoryAccess(u8 *codePtr, bool isWrite)
+{
+	if (!jo.backpatchMemory || !IsInSpace(codePtr))
+		return false;
+
+	// DisassembleMov() complains loudly about unknown writes, so check first.
+	if (isWrite)
+	{
+		const u8 *op = codePtr;
+		if (*op == 0x66)
+			op++;
+		if ((*op & 0xF0) == 0x40)
+			op++;
+		if (*op != MOVE_8BIT_REG_TO_MEM && *op != MOVE_REG_TO_MEM)
+			return false;
+	}
+
+	InstructionInfo info;
+	if (!DisassembleMov(codePtr, info, isWrite ? OP_ACCESS_WRITE : OP_ACCESS_READ))
+		return false;
+
+	// Only [RBX + reg + disp], as emitted by JitSafeMem.  RSI/RDI are the call params.
+	if (info.otherReg != RBX || info.scaledReg < 0 || info.operandSize > 4 || info.hasImmediate)
+		return false;
+	static const int badRegs[] = {RSP, RBX, RSI, RDI};
+	for (int i = 0; i < 4; ++i)
+	{
+		if (info.scaledReg == badRegs[i] || info.regOperandReg == badRegs[i])
+			return false;
+	}
+
+	// Short instructions are padded with NOPs, make sure that's really what follows.
+	int patchSize = info.instructionSize;
+	for (; patchSize < 5; ++patchSize)
+	{
+		if (codePtr[patchSize] != 0x90)
+			return false;
+	}
+
+	const u8 *trampoline = GetBackpatchTrampoline(info, isWrite);
+	if (!trampoline)
+		return false;
+	s64 distance = (s64)trampoline - ((s64)codePtr + 5);
+	if (distance < -0x80000000LL || distance >= 0x80000000LL)
+		return false;
+
+	XEmitter emitter(codePtr);
+	emitter.CALL((const void *)trampoline);
+	emitter.NOP(patchSize - 5);
+	return true;
+}
+
+}	// namespace MIPSComp
@@ -277,6 +277,20 @@ void GPRRegCache::StoreFromRegister(int i) {
 	}
 }
 
+void GPRRegCache::DiscardR(int i) {
+	if (regs[i].away) {
+		if (regs[i].location.IsSimpleReg()) {
+			X64Reg xr = RX(i);
+			// Note that we DO NOT write it back here. That's the whole point of Discard.
+			xregs[xr].free = true;
+			xregs[xr].mipsReg = -1;
+			xregs[xr].dirty = false;
+		}
+		regs[i].location = GetDefaultLocation(i);
+		regs[i].away = false;
+	}
+}
+
 void GPRRegCache::Flush()
 {
 	for (int i = 0; i < NUM_X_REGS; i++) {
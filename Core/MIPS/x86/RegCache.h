@@ -69,6 +69,8 @@ public:
 
 	void BindToRegister(int preg, bool doLoad = true, bool makeDirty = true);
 	void StoreFromRegister(int preg);
+	// Drops the cached value (even an immediate) without writing it back.
+	void DiscardR(int preg);
 
 	const OpArg &R(int preg) const {return regs[preg].location;}
 	X64Reg RX(int preg) const
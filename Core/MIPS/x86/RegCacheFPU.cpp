@@ -168,6 +168,10 @@ int FPURegCache::GetTempR() {
 }
 
 void FPURegCache::Flush() {
+	// Temps are only valid within a single op, never write them back.
+	for (int i = TEMP0; i < TEMP0 + NUM_TEMPS; ++i) {
+		DiscardR(i);
+	}
 	for (int i = 0; i < NUM_MIPS_FPRS; i++) {
 		if (regs[i].locked) {
 			PanicAlert("Somebody forgot to unlock MIPS reg %i.", i);
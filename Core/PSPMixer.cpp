@@ -24,9 +24,9 @@
 #include "HLE/__sceAudio.h"
 #include "base/NativeApp.h"
 
-int PSPMixer::Mix(short *stereoout, int numSamples)
+int PSPMixer::Mix(short *stereoout, int numSamples, int sampleRate)
 {
-	int numFrames = __AudioMix(stereoout, numSamples);
+	int numFrames = __AudioMix(stereoout, numSamples, sampleRate);
 #ifdef _WIN32
 	if (numFrames < numSamples) {
 		// Our dsound backend will not stop playing, let's just feed it zeroes if we miss data.
@@ -23,6 +23,6 @@
 class PSPMixer : public PMixer
 {
 public:
-	int Mix(short *stereoout, int numSamples);
+	int Mix(short *stereoout, int numSamples, int sampleRate = 44100);
 };
 
@@ -19,9 +19,7 @@
 #include "BlockAllocator.h"
 #include "ChunkFile.h"
 
-// Slow freaking thing but works (eventually) :)
-
-BlockAllocator::BlockAllocator(int grain) : bottom_(NULL), top_(NULL), grain_(grain)
+BlockAllocator::BlockAllocator(int grain) : bottom_(NULL), top_(NULL), grain_(grain), freeRoot_(NULL), totalFree_(0), treeSeed_(0x12345678)
 {
 }
 
@@ -38,6 +36,7 @@ void BlockAllocator::Init(u32 rangeStart, u32 rangeSize)
 	//Initial block, covering everything
 	top_ = new Block(rangeStart_, rangeSize_, false, NULL, NULL);
 	bottom_ = top_;
+	IndexBlock(top_);
 }
 
 void BlockAllocator::Shutdown()
@@ -49,6 +48,9 @@ void BlockAllocator::Shutdown()
 		bottom_ = next;
 	}
 	top_ = NULL;
+	blocks_.clear();
+	freeRoot_ = NULL;
+	totalFree_ = 0;
 }
 
 u32 BlockAllocator::AllocAligned(u32 &size, u32 sizeGrain, u32 grain, bool fromTop, const char *tag)
@@ -71,58 +73,46 @@ u32 BlockAllocator::AllocAligned(u32 &size, u32 sizeGrain, u32 grain, bool fromT
 	if (!fromTop)
 	{
 		//Allocate from bottom of mem
-		for (Block *bp = bottom_; bp != NULL; bp = bp->next)
+		Block *bp = FindFirstFit(freeRoot_, size, grain);
+		if (bp != NULL)
 		{
 			Block &b = *bp;
 			u32 offset = b.start % grain;
 			if (offset != 0)
 				offset = grain - offset;
 			u32 needed = offset + size;
-			if (b.taken == false && b.size >= needed)
+			UnindexBlock(&b);
+			if (b.size != needed)
 			{
-				if (b.size == needed)
-				{
-					b.taken = true;
-					b.SetTag(tag);
-					return b.start + offset;
-				}
-				else
-				{
-					InsertFreeAfter(&b, b.start + needed, b.size - needed);
-					b.taken = true;
-					b.size = needed;
-					b.SetTag(tag);
-					return b.start + offset;
-				}
+				InsertFreeAfter(&b, b.start + needed, b.size - needed);
+				b.size = needed;
 			}
+			b.taken = true;
+			b.SetTag(tag);
+			IndexBlock(&b);
+			return b.start + offset;
 		}
 	}
 	else
 	{
 		// Allocate from top of mem.
-		for (Block *bp = top_; bp != NULL; bp = bp->prev)
+		Block *bp = FindLastFit(freeRoot_, size, grain);
+		if (bp != NULL)
 		{
 			Block &b = *bp;
 			u32 offset = (b.start + b.size - size) % grain;
 			u32 needed = offset + size;
-			if (b.taken == false && b.size >= needed)
+			UnindexBlock(&b);
+			if (b.size != needed)
 			{
-				if (b.size == needed)
-				{
-					b.taken = true;
-					b.SetTag(tag);
-					return b.start;
-				}
-				else
-				{
-					InsertFreeBefore(&b, b.start, b.size - needed);
-					b.taken = true;
-					b.start += b.size - needed;
-					b.size = needed;
-					b.SetTag(tag);
-					return b.start;
-				}
+				InsertFreeBefore(&b, b.start, b.size - needed);
+				b.start += b.size - needed;
+				b.size = needed;
 			}
+			b.taken = true;
+			b.SetTag(tag);
+			IndexBlock(&b);
+			return b.start;
 		}
 	}
 
@@ -141,7 +131,7 @@ u32 BlockAllocator::Alloc(u32 &size, bool fromTop, const char *tag)
 u32 BlockAllocator::AllocAt(u32 position, u32 size, const char *tag)
 {
 	CheckBlocks();
-	if (size > rangeSize_) {
+	if (size == 0 || size > rangeSize_) {
 		ERROR_LOG(HLE, "Clearly bogus size: %08x - failing allocation", size);
 		return -1;
 	}
@@ -163,30 +153,30 @@ u32 BlockAllocator::AllocAt(u32 position, u32 size, const char *tag)
 			ERROR_LOG(HLE, "Block allocator AllocAt failed, block taken! %08x, %i", position, size);
 			return -1;
 		}
+		else if (b.start + b.size < position + size)
+		{
+			ERROR_LOG(HLE, "Block allocator AllocAt failed, block too small! %08x, %i", position, size);
+		}
 		else
 		{
 			//good to go
-			if (b.start == position)
+			UnindexBlock(&b);
+			if (b.start != position)
 			{
-				InsertFreeAfter(&b, b.start + size, b.size - size);
-				b.taken = true;
-				b.size = size;
-				b.SetTag(tag);
-				CheckBlocks();
-				return position;
+				InsertFreeBefore(&b, b.start, position - b.start);
+				b.size -= position - b.start;
+				b.start = position;
 			}
-			else
+			if (b.size != size)
 			{
-				int size1 = position - b.start;
-				InsertFreeBefore(&b, b.start, size1);
-				if (b.start + b.size > position + size)
-					InsertFreeAfter(&b, position + size, b.size - (size + size1));
-				b.taken = true;
-				b.start = position;
+				InsertFreeAfter(&b, position + size, b.size - size);
 				b.size = size;
-				b.SetTag(tag);
-				return position;
 			}
+			b.taken = true;
+			b.SetTag(tag);
+			IndexBlock(&b);
+			CheckBlocks();
+			return position;
 		}
 	}
 	else
@@ -205,10 +195,12 @@ void BlockAllocator::MergeFreeBlocks(Block *fromBlock)
 {
 	DEBUG_LOG(HLE, "Merging Blocks");
 
+	UnindexBlock(fromBlock);
 	Block *prev = fromBlock->prev;
 	while (prev != NULL && prev->taken == false)
 	{
 		DEBUG_LOG(HLE, "Block Alloc found adjacent free blocks - merging");
+		UnindexBlock(prev);
 		prev->size += fromBlock->size;
 		if (fromBlock->next == NULL)
 			top_ = prev;
@@ -229,6 +221,7 @@ void BlockAllocator::MergeFreeBlocks(Block *fromBlock)
 	while (next != NULL && next->taken == false)
 	{
 		DEBUG_LOG(HLE, "Block Alloc found adjacent free blocks - merging");
+		UnindexBlock(next);
 		fromBlock->size += next->size;
 		fromBlock->next = next->next;
 		delete next;
@@ -239,6 +232,7 @@ void BlockAllocator::MergeFreeBlocks(Block *fromBlock)
 		top_ = fromBlock;
 	else
 		next->prev = fromBlock;
+	IndexBlock(fromBlock);
 }
 
 bool BlockAllocator::Free(u32 position)
@@ -246,7 +240,9 @@ bool BlockAllocator::Free(u32 position)
 	Block *b = GetBlockFromAddress(position);
 	if (b && b->taken)
 	{
+		UnindexBlock(b);
 		b->taken = false;
+		IndexBlock(b);
 		MergeFreeBlocks(b);
 		return true;
 	}
@@ -262,7 +258,9 @@ bool BlockAllocator::FreeExact(u32 position)
 	Block *b = GetBlockFromAddress(position);
 	if (b && b->taken && b->start == position)
 	{
+		UnindexBlock(b);
 		b->taken = false;
+		IndexBlock(b);
 		MergeFreeBlocks(b);
 		return true;
 	}
@@ -282,6 +280,7 @@ BlockAllocator::Block *BlockAllocator::InsertFreeBefore(Block *b, u32 start, u32
 	else
 		inserted->prev->next = inserted;
 
+	IndexBlock(inserted);
 	return inserted;
 }
 
@@ -294,9 +293,155 @@ BlockAllocator::Block *BlockAllocator::InsertFreeAfter(Block *b, u32 start, u32
 	else
 		inserted->next->prev = inserted;
 
+	IndexBlock(inserted);
 	return inserted;
 }
 
+// Blocks must be taken out of the index while their start, size, or taken flag change.
+void BlockAllocator::IndexBlock(Block *b)
+{
+	// Older save states may have empty blocks, which never contain an address.
+	if (b->size == 0)
+		return;
+	blocks_[b->start] = b;
+	if (!b->taken)
+	{
+		FreeTreeInsert(b);
+		totalFree_ += b->size;
+	}
+}
+
+void BlockAllocator::UnindexBlock(Block *b)
+{
+	if (b->size == 0)
+		return;
+	blocks_.erase(b->start);
+	if (!b->taken)
+	{
+		FreeTreeErase(b);
+		totalFree_ -= b->size;
+	}
+}
+
+void BlockAllocator::ResetIndex()
+{
+	blocks_.clear();
+	freeRoot_ = NULL;
+	totalFree_ = 0;
+	for (Block *bp = bottom_; bp != NULL; bp = bp->next)
+		IndexBlock(bp);
+}
+
+void BlockAllocator::FreeTreeUpdate(Block *t)
+{
+	t->maxFreeSize = t->size;
+	if (t->left != NULL && t->left->maxFreeSize > t->maxFreeSize)
+		t->maxFreeSize = t->left->maxFreeSize;
+	if (t->right != NULL && t->right->maxFreeSize > t->maxFreeSize)
+		t->maxFreeSize = t->right->maxFreeSize;
+}
+
+// Splits into blocks before start, and blocks at or after start.
+void BlockAllocator::FreeTreeSplit(Block *t, u32 start, Block *&left, Block *&right)
+{
+	if (t == NULL)
+	{
+		left = NULL;
+		right = NULL;
+	}
+	else if (t->start < start)
+	{
+		FreeTreeSplit(t->right, start, t->right, right);
+		left = t;
+		FreeTreeUpdate(t);
+	}
+	else
+	{
+		FreeTreeSplit(t->left, start, left, t->left);
+		right = t;
+		FreeTreeUpdate(t);
+	}
+}
+
+BlockAllocator::Block *BlockAllocator::FreeTreeMerge(Block *left, Block *right)
+{
+	if (left == NULL)
+		return right;
+	if (right == NULL)
+		return left;
+	if (left->treePriority > right->treePriority)
+	{
+		left->right = FreeTreeMerge(left->right, right);
+		FreeTreeUpdate(left);
+		return left;
+	}
+	else
+	{
+		right->left = FreeTreeMerge(left, right->left);
+		FreeTreeUpdate(right);
+		return right;
+	}
+}
+
+void BlockAllocator::FreeTreeInsert(Block *b)
+{
+	// Any deterministic sequence keeps it balanced, and save states stay reproducible.
+	treeSeed_ ^= treeSeed_ << 13;
+	treeSeed_ ^= treeSeed_ >> 17;
+	treeSeed_ ^= treeSeed_ << 5;
+	b->treePriority = treeSeed_;
+	b->left = NULL;
+	b->right = NULL;
+	FreeTreeUpdate(b);
+
+	Block *left, *right;
+	FreeTreeSplit(freeRoot_, b->start, left, right);
+	freeRoot_ = FreeTreeMerge(FreeTreeMerge(left, b), right);
+}
+
+void BlockAllocator::FreeTreeErase(Block *b)
+{
+	Block *left, *middle, *right;
+	FreeTreeSplit(freeRoot_, b->start, left, middle);
+	FreeTreeSplit(middle, b->start + 1, middle, right);
+	_dbg_assert_msg_(HLE, middle == b, "Free block missing from index");
+	freeRoot_ = FreeTreeMerge(left, right);
+	b->left = NULL;
+	b->right = NULL;
+}
+
+// The lowest free block that the size fits in, after aligning its start to grain.
+BlockAllocator::Block *BlockAllocator::FindFirstFit(Block *t, u32 size, u32 grain)
+{
+	if (t == NULL || t->maxFreeSize < size)
+		return NULL;
+	Block *found = FindFirstFit(t->left, size, grain);
+	if (found != NULL)
+		return found;
+
+	u32 offset = t->start % grain;
+	if (offset != 0)
+		offset = grain - offset;
+	if (t->size >= offset + size)
+		return t;
+	return FindFirstFit(t->right, size, grain);
+}
+
+// The highest free block that the size fits in, after aligning its end down to grain.
+BlockAllocator::Block *BlockAllocator::FindLastFit(Block *t, u32 size, u32 grain)
+{
+	if (t == NULL || t->maxFreeSize < size)
+		return NULL;
+	Block *found = FindLastFit(t->right, size, grain);
+	if (found != NULL)
+		return found;
+
+	u32 offset = (t->start + t->size - size) % grain;
+	if (t->size >= offset + size)
+		return t;
+	return FindLastFit(t->left, size, grain);
+}
+
 void BlockAllocator::CheckBlocks() const
 {
 	for (const Block *bp = bottom_; bp != NULL; bp = bp->next)
@@ -310,28 +455,21 @@ void BlockAllocator::CheckBlocks() const
 
 inline BlockAllocator::Block *BlockAllocator::GetBlockFromAddress(u32 addr)
 {
-	for (Block *bp = bottom_; bp != NULL; bp = bp->next)
-	{
-		Block &b = *bp;
-		if (b.start <= addr && b.start + b.size > addr)
-		{
-			// Got one!
-			return bp;
-		}
-	}
-	return NULL;
+	const BlockAllocator *constThis = this;
+	return const_cast<Block *>(constThis->GetBlockFromAddress(addr));
 }
 
 const BlockAllocator::Block *BlockAllocator::GetBlockFromAddress(u32 addr) const
 {
-	for (const Block *bp = bottom_; bp != NULL; bp = bp->next)
+	std::map<u32, Block *>::const_iterator it = blocks_.upper_bound(addr);
+	if (it == blocks_.begin())
+		return NULL;
+	--it;
+	const Block &b = *it->second;
+	if (b.start <= addr && b.start + b.size > addr)
 	{
-		const Block &b = *bp;
-		if (b.start <= addr && b.start + b.size > addr)
-		{
-			// Got one!
-			return bp;
-		}
+		// Got one!
+		return it->second;
 	}
 	return NULL;
 }
@@ -366,31 +504,12 @@ void BlockAllocator::ListBlocks() const
 
 u32 BlockAllocator::GetLargestFreeBlockSize() const
 {
-	u32 maxFreeBlock = 0;
-	for (const Block *bp = bottom_; bp != NULL; bp = bp->next)
-	{
-		const Block &b = *bp;
-		if (!b.taken)
-		{
-			if (b.size > maxFreeBlock)
-				maxFreeBlock = b.size;
-		}
-	}
-	return maxFreeBlock;
+	return freeRoot_ != NULL ? freeRoot_->maxFreeSize : 0;
 }
 
 u32 BlockAllocator::GetTotalFreeBytes() const
 {
-	u32 sum = 0;
-	for (const Block *bp = bottom_; bp != NULL; bp = bp->next)
-	{
-		const Block &b = *bp;
-		if (!b.taken)
-		{
-			sum += b.size;
-		}
-	}
-	return sum;
+	return totalFree_;
 }
 
 void BlockAllocator::DoState(PointerWrap &p)
@@ -435,6 +554,9 @@ void BlockAllocator::DoState(PointerWrap &p)
 	p.Do(rangeSize_);
 	p.Do(grain_);
 	p.DoMarker("BlockAllocator");
+
+	if (p.mode == p.MODE_READ)
+		ResetIndex();
 }
 
 void BlockAllocator::Block::DoState(PointerWrap &p)
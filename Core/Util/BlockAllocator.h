@@ -19,11 +19,13 @@
 
 #include "../../Globals.h"
 
-#include <list>
+#include <map>
 
 class PointerWrap;
 
 // Generic allocator thingy. Allocates blocks from a range.
+// Blocks are kept in address order, with an index of the free ones so that finding
+// the lowest (or highest) free block that fits doesn't walk every block.
 
 class BlockAllocator
 {
@@ -64,7 +66,7 @@ private:
 	struct Block
 	{
 		Block(u32 _start, u32 _size, bool _taken, Block *_prev, Block *_next)
-			: start(_start), size(_size), taken(_taken), prev(_prev), next(_next)
+			: start(_start), size(_size), taken(_taken), prev(_prev), next(_next), left(NULL), right(NULL), treePriority(0), maxFreeSize(0)
 		{
 			strcpy(tag, "(untitled)");
 		}
@@ -82,6 +84,12 @@ private:
 		char tag[32];
 		Block *prev;
 		Block *next;
+
+		// Free blocks only: a treap by start address, which knows its largest block.
+		Block *left;
+		Block *right;
+		u32 treePriority;
+		u32 maxFreeSize;
 	};
 
 	Block *bottom_;
@@ -91,6 +99,23 @@ private:
 
 	u32 grain_;
 
+	// Every block, by start address.
+	std::map<u32, Block *> blocks_;
+	Block *freeRoot_;
+	u32 totalFree_;
+	u32 treeSeed_;
+
+	void IndexBlock(Block *b);
+	void UnindexBlock(Block *b);
+	void ResetIndex();
+	void FreeTreeInsert(Block *b);
+	void FreeTreeErase(Block *b);
+	static void FreeTreeUpdate(Block *t);
+	static void FreeTreeSplit(Block *t, u32 start, Block *&left, Block *&right);
+	static Block *FreeTreeMerge(Block *left, Block *right);
+	static Block *FindFirstFit(Block *t, u32 size, u32 grain);
+	static Block *FindLastFit(Block *t, u32 size, u32 grain);
+
 	void MergeFreeBlocks(Block *fromBlock);
 	Block *GetBlockFromAddress(u32 addr);
 	const Block *GetBlockFromAddress(u32 addr) const;
@@ -73,6 +73,7 @@ void GameSettingsScreen::CreateViews() {
 	tabHolder->AddTab("Audio", audioSettingsScroll);
 	audioSettings->Add(new CheckBox(&g_Config.bEnableSound, a->T("Enable Sound")));
 	audioSettings->Add(new CheckBox(&g_Config.bEnableAtrac3plus, a->T("Enable Atrac3+")));
+	audioSettings->Add(new CheckBox(&g_Config.bParallelSasVoices, a->T("Mix voices on multiple threads")));
 	audioSettings->Add(new Choice(a->T("Download Atrac3+ plugin")))->OnClick.Handle(this, &GameSettingsScreen::OnDownloadPlugin);
 	
 	ViewGroup *controlsSettingsScroll = new ScrollView(ORIENT_VERTICAL, new LinearLayoutParams(FILL_PARENT, FILL_PARENT));
@@ -523,6 +523,7 @@ void PauseScreen::render() {
 		if (UIButton(GEN_ID, hlinear2, 40, 0, gs->T("+1"), ALIGN_LEFT))
 			if (g_Config.iFrameSkip < 9)
 				g_Config.iFrameSkip += 1;
+		UICheckBox(GEN_ID, x + 60, y += stride, gs->T("Auto FrameSkip"), ALIGN_TOPLEFT, &g_Config.bAutoFrameSkip);
 		y+=20;
 	} else 
 		g_Config.iFrameSkip = 0;
@@ -822,6 +823,7 @@ void AudioScreen::render() {
 				g_Config.iSEVolume += 1;
 
 		y+=10;
+		UICheckBox(GEN_ID, x, y += stride, a->T("Mix voices on multiple threads"), ALIGN_TOPLEFT, &g_Config.bParallelSasVoices);
 
 	} else
 		g_Config.bEnableAtrac3plus = false;
@@ -1135,6 +1137,7 @@ void GraphicsScreenP3::render() {
 		if (UIButton(GEN_ID, hlinear2, 40, 0, gs->T("+1"), ALIGN_LEFT))
 			if (g_Config.iFrameSkip < 9)
 				g_Config.iFrameSkip += 1;
+		UICheckBox(GEN_ID, x + 60, y += stride, gs->T("Auto FrameSkip"), ALIGN_TOPLEFT, &g_Config.bAutoFrameSkip);
 
 		y += 20;
 	} else 
@@ -167,6 +167,7 @@ public:
 
 // globals
 static PMixer *g_mixer = 0;
+static int g_mixerSampleRate = 44100;
 #ifndef _WIN32
 static AndroidLogger *logger = 0;
 #endif
@@ -189,10 +190,14 @@ void NativeHost::ShutdownSound() {
 	g_mixer = 0;
 }
 
+void NativeSetMixerSampleRate(int sample_rate) {
+	g_mixerSampleRate = sample_rate;
+}
+
 int NativeMix(short *audio, int num_samples) {
 	// ILOG("Entering mixer");
 	if (g_mixer) {
-		num_samples = g_mixer->Mix(audio, num_samples);
+		num_samples = g_mixer->Mix(audio, num_samples, g_mixerSampleRate);
 	}	else {
 		memset(audio, 0, num_samples * 2 * sizeof(short));
 	}
@@ -0,0 +1,6 @@
+// This is a generated file.
+
+const char *PPSSPP_GIT_VERSION = "add2237";
+
+// If you don't want this file to update/recompile, change to 1.
+#define PPSSPP_GIT_VERSION_NO_UPDATE 0
@@ -8,6 +8,7 @@
 #include "Core/Core.h"
 #include "Core/CoreTiming.h"
 #include "Core/System.h"
+#include "Core/HLE/HLE.h"
 #include "Core/HLE/sceUtility.h"
 #include "Core/MIPS/MIPS.h"
 #include "Core/Host.h"
@@ -84,6 +85,7 @@ void printUsage(const char *progname, const char *reason)
 	fprintf(stderr, "  -i                    use the interpreter\n");
 	fprintf(stderr, "  -j                    use jit (default)\n");
 	fprintf(stderr, "  -c, --compare         compare with output in file.expected\n");
+	fprintf(stderr, "  --profile=FILE        write syscall times to a csv file\n");
 	fprintf(stderr, "\nSee headless.txt for details.\n");
 }
 
@@ -97,6 +99,7 @@ int main(int argc, const char* argv[])
 	const char *bootFilename = 0;
 	const char *mountIso = 0;
 	const char *screenshotFilename = 0;
+	const char *profileFilename = 0;
 	bool readMount = false;
 
 	for (int i = 1; i < argc; i++)
@@ -121,6 +124,8 @@ int main(int argc, const char* argv[])
 			useGraphics = true;
 		else if (!strncmp(argv[i], "--screenshot=", strlen("--screenshot=")) && strlen(argv[i]) > strlen("--screenshot="))
 			screenshotFilename = argv[i] + strlen("--screenshot=");
+		else if (!strncmp(argv[i], "--profile=", strlen("--profile=")) && strlen(argv[i]) > strlen("--profile="))
+			profileFilename = argv[i] + strlen("--profile=");
 		else if (bootFilename == 0)
 			bootFilename = argv[i];
 		else
@@ -207,6 +212,7 @@ int main(int argc, const char* argv[])
 	g_Config.iDateFormat = PSP_SYSTEMPARAM_DATE_FORMAT_DDMMYYYY;
 	g_Config.iButtonPreference = PSP_SYSTEMPARAM_BUTTON_CROSS;
 	g_Config.iLockParentalLevel = 9;
+	g_Config.bProfileSyscalls = profileFilename != 0;
 
 #if defined(ANDROID)
 #elif defined(BLACKBERRY) || defined(__SYMBIAN32__)
@@ -241,6 +247,9 @@ int main(int argc, const char* argv[])
 		}
 	}
 
+	if (profileFilename != 0)
+		hleProfilerWriteCSV(profileFilename);
+
 	host->ShutdownGL();
 	PSP_Shutdown();
 
@@ -183,9 +183,11 @@ extern "C" void Java_com_henrikrydgard_libnative_NativeApp_init
 
 	use_opensl_audio = juseNativeAudio;
 	if (use_opensl_audio) {
-		// TODO: PPSSPP doesn't support 48khz yet so let's not use that yet.
-		ILOG("Using OpenSL audio! frames/buffer: %i   optimal sr: %i   actual sr: 44100", optimalFramesPerBuffer, optimalSampleRate);
-		optimalSampleRate = 44100;
+		// Only 44100 and 48000 are supported by the OpenSL wrapper.  48khz is resampled.
+		if (optimalSampleRate != 48000)
+			optimalSampleRate = 44100;
+		ILOG("Using OpenSL audio! frames/buffer: %i   optimal sr: %i", optimalFramesPerBuffer, optimalSampleRate);
+		NativeSetMixerSampleRate(optimalSampleRate);
 		AndroidAudio_Init(&NativeMix, library_path, optimalFramesPerBuffer, optimalSampleRate);
 	}
 	ILOG("NativeApp.init() -- end");
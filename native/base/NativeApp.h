@@ -56,7 +56,7 @@ void NativeAxis(const AxisInput &axis);
 // will also be called sixty times per second. Main thread.
 void NativeRender();
 
-// This should render num_samples 44khz stereo samples.
+// This should render num_samples stereo samples, at 44khz unless told otherwise below.
 // Try not to make too many assumptions on the granularity
 // of num_samples.
 // This function may be called from a totally separate thread from
@@ -64,7 +64,9 @@ void NativeRender();
 // Returns the number of samples actually output. The app should do everything it can
 // to fill the buffer completely.
 int NativeMix(short *audio, int num_samples);
-void NativeSetMixer(void* mixer);
+void NativeSetMixer(void* mixer);
+// The rate the audio device actually runs at, if it's not 44100.
+void NativeSetMixerSampleRate(int sample_rate);
 
 // Called when it's time to shutdown. After this has been called,
 // no more calls to any other function will be made from the framework
@@ -502,10 +502,23 @@ int main(int argc, char *argv[]) {
 	fmt.callback = &mixaudio;
 	fmt.userdata = (void *)0;
 
-	if (SDL_OpenAudio(&fmt, NULL) < 0) {
+	// Take whatever rate the device prefers, and resample to it.
+	SDL_AudioSpec obtained;
+	if (SDL_OpenAudio(&fmt, &obtained) < 0) {
 		ELOG("Failed to open audio: %s", SDL_GetError());
 		return 1;
 	}
+	if (obtained.format != AUDIO_S16 || obtained.channels != 2) {
+		// Let SDL convert everything else.
+		SDL_CloseAudio();
+		if (SDL_OpenAudio(&fmt, NULL) < 0) {
+			ELOG("Failed to open audio: %s", SDL_GetError());
+			return 1;
+		}
+	} else if (obtained.freq != fmt.freq) {
+		ILOG("Audio device runs at %i hz, resampling", obtained.freq);
+		NativeSetMixerSampleRate(obtained.freq);
+	}
 
 	// Audio must be unpaused _after_ NativeInit()
 	SDL_PauseAudio(0);